@@ -0,0 +1,347 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Assembler.h"
+#include "AssemblerStats.h"
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "LineTable.h"
+#include "Source.h"
+#include "StatusCodes.h"
+#include "TimingAnalysis.h"
+
+#define USAGE "Expected arguments: [--timing model.txt]... [--budget N] [--time] (program.o | program.asm)\n"
+
+#define MAX_TIMING_MODELS 8
+#define LOCATION_LENGTH 96
+
+/**
+ * A timing model and the path it was read from, for reporting
+ */
+typedef struct _NamedTimingModel {
+    const char* path;  // NULL for the built-in instruction count
+    TimingModel model;
+} NamedTimingModel;
+
+/**
+ * @brief Load the line table the assembler wrote next to a program with --line-table
+ *
+ * @param path Path of the assembled program
+ * @param table Empty table to fill in, left empty if there is none or it is malformed
+ */
+static void loadLineTable(const char* const path, LineTable* table)
+{
+    size_t pathLength = strlen(path);
+    char* tablePath = (char*)malloc(pathLength + sizeof(LINE_TABLE_EXTENSION));
+    SourceReader file;
+    if (tablePath == NULL) {
+        return;
+    }
+    memcpy(tablePath, path, pathLength);
+    memcpy(tablePath + pathLength, LINE_TABLE_EXTENSION, sizeof(LINE_TABLE_EXTENSION));
+    if (openSourceFile(&file, tablePath) == 0) {
+        if (file.data == NULL || readLineTable((const uint8_t*)file.data, file.length, table) != 0) {
+            fprintf(stderr, "Note: Ignoring malformed line table %s.\n", tablePath);
+            freeLineTable(table);
+        }
+        closeSource(&file);
+    }
+    free(tablePath);
+}
+
+/**
+ * @brief Load a program, assembling it first if it is a .asm source
+ *
+ * @param path Path of an assembled program or of a source ending in .asm
+ * @param code Buffer to append the program to
+ * @param table Receives the program's line table, left empty if there is none
+ * @return 0 if successful, otherwise the error that occurred (already printed)
+ */
+static uint8_t loadProgram(const char* const path, CodeBuffer* code, LineTable* table)
+{
+    SourceReader source;
+    if (openSourceFile(&source, path) != 0) {
+        fprintf(stderr, "Error: Input file does not exist.\n");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    uint8_t status = 0;
+    size_t pathLength = strlen(path);
+    if (pathLength >= 4 && strcmp(path + pathLength - 4, ".asm") == 0) {
+        AssemblerDiagnostic diagnostic;
+        RelaxationReport relaxation;
+        AssemblerOptions options = {ASSEMBLER_MODE_TWO_PASS, 1, NULL, &relaxation};
+        status = assembleSource(&source, code, &options, &diagnostic);
+        if (status != 0) {
+            printDiagnostic(stderr, &diagnostic);
+        } else if (!rewindSource(&source) || buildLineTable(&source, path, table) != 0 || relaxLineTable(table, &relaxation) != 0) {
+            freeLineTable(table);  // the analysis still works, without loop bounds
+        }
+        freeRelaxationReport(&relaxation);
+    } else if (source.data != NULL && source.length > 0) {
+        if (reserveCode(code, source.length)) {
+            memcpy(code->data, source.data, source.length);
+            code->length = source.length;
+        } else {
+            status = ERROR_OUT_OF_MEMORY;
+            fprintf(stderr, "Error: Out of memory.\n");
+        }
+        loadLineTable(path, table);
+    }
+    closeSource(&source);
+    return status;
+}
+
+/**
+ * @brief Describe where an instruction is, by source line and the label it follows if the line table is known
+ *
+ * @param dest Where to write the description, such as "line 12 (Loop)" or "offset 7"
+ * @param size Size of dest
+ * @param table The program's line table, empty if unknown
+ * @param offset Offset of the instruction
+ */
+static void describeOffset(char* dest, size_t size, const LineTable* const table, uint32_t offset)
+{
+    if (offset >= table->length) {
+        snprintf(dest, size, "offset %" PRIu32, offset);
+        return;
+    }
+    int64_t label = findEnclosingLabel(table, offset);
+    if (label < 0) {
+        snprintf(dest, size, "line %" PRIu32, *(table->lines + offset));
+    } else {
+        snprintf(dest, size, "line %" PRIu32 " (%.48s)", *(table->lines + offset), (table->labels + label)->name);
+    }
+}
+
+/**
+ * @brief Apply the `@loop` bounds in the program's source to its loops
+ *
+ * A bound applies to the loop whose header is on its line, either as an instruction or as a label marking it, or
+ * whose JUMP back to the header is on its line.
+ *
+ * @param analysis The program's control flow
+ * @param table The program's line table, empty if unknown
+ * @return 0 if successful, otherwise the error that occurred (already printed)
+ */
+static uint8_t applyLoopBounds(TimingAnalysis* analysis, const LineTable* const table)
+{
+    if (table->length != analysis->length || table->sourcePath == NULL) {
+        fprintf(stderr, "Note: No line table, assemble with --line-table or analyze the .asm source to read loop bounds.\n");
+        return 0;
+    }
+    SourceReader source;
+    if (openSourceFile(&source, table->sourcePath) != 0) {
+        fprintf(stderr, "Note: Source %s not found, so no loop bounds were read.\n", table->sourcePath);
+        return 0;
+    }
+    LoopBoundsList bounds;
+    memset(&bounds, 0, sizeof(bounds));
+    AssemblerDiagnostic diagnostic;
+    uint8_t status = readLoopBounds(&source, &bounds, &diagnostic);
+    closeSource(&source);
+    if (status != 0) {
+        fprintf(stderr, "%s: ", table->sourcePath);
+        printDiagnostic(stderr, &diagnostic);
+        freeLoopBoundsList(&bounds);
+        return status;
+    }
+    for (uint32_t b = 0; b < bounds.length; b++) {
+        const LoopBound* bound = bounds.bounds + b;
+        bool applied = false;
+        for (uint32_t i = 0; i < table->numLabels; i++) {
+            const LineTableLabel* label = table->labels + i;
+            if (label->line == bound->line) {
+                applied |= boundLoopAt(analysis, label->offset, bound->minIterations, bound->maxIterations);
+            }
+        }
+        for (uint32_t i = 0; i < table->length && !applied; i++) {
+            if (*(table->lines + i) == bound->line) {
+                applied |= boundLoopAt(analysis, i, bound->minIterations, bound->maxIterations);
+            }
+        }
+        if (!applied) {
+            printf("Note: The loop bound on line %" PRIu32 " is not on the first instruction of a loop or a JUMP back to it.\n", bound->line);
+        }
+    }
+    freeLoopBoundsList(&bounds);
+    return 0;
+}
+
+/**
+ * @brief Order loops by the offset of their header, each key being the header above the loop's index
+ */
+static int compareLoopKeys(const void* a, const void* b)
+{
+    uint64_t keyA = *(const uint64_t*)a;
+    uint64_t keyB = *(const uint64_t*)b;
+    return (keyA > keyB) - (keyA < keyB);
+}
+
+/**
+ * @brief Bound how long a RISC-MC8 program can run, without running it
+ *
+ * @param argc Argument count
+ * @param argv Arguments, should be `[--timing model.txt]... [--budget N] [--time] program` where program is an
+ *             assembled program or a source ending in .asm. Loops need a `# @loop N` or `# @loop M..N` comment on
+ *             their first line or on the JUMP back to it, read through the line table of a program.o. The best and
+ *             worst cases are printed in instructions, which are the Logisim CPU's clock cycles, and in the unit of
+ *             each --timing model. `--budget N` fails if the worst case exceeds N, in the unit of the first --timing
+ *             model or in instructions without one. --time reports how long the analysis took.
+ * @return 0 if successful, otherwise a non-zero error code accompanied with a message on stderr
+ */
+int main(int argc, char** argv)
+{
+    const char* path = NULL;
+    NamedTimingModel models[MAX_TIMING_MODELS + 1];
+    uint32_t numModels = 1;
+    uint64_t budget = 0;
+    bool budgeted = false;
+    bool timed = false;
+    models[0].path = NULL;
+    initInstructionCountModel(&models[0].model);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            if (numModels > MAX_TIMING_MODELS) {
+                fprintf(stderr, "Error: At most %d timing models.\n", MAX_TIMING_MODELS);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+            models[numModels++].path = argv[++i];
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            char* end;
+            budget = strtoull(argv[++i], &end, 10);
+            budgeted = true;
+            if (*end != '\0' || *argv[i] == '\0' || *argv[i] == '-') {
+                fprintf(stderr, "Error: Invalid budget.\n");
+                fprintf(stderr, USAGE);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--time") == 0) {
+            timed = true;
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "Error: Wrong number of arguments.\n");
+        fprintf(stderr, USAGE);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    for (uint32_t m = 1; m < numModels; m++) {
+        SourceReader file;
+        if (openSourceFile(&file, models[m].path) != 0) {
+            fprintf(stderr, "Error: Timing model %s does not exist.\n", models[m].path);
+            return ERROR_INVALID_ARGUMENTS;
+        }
+        AssemblerDiagnostic diagnostic;
+        uint8_t status = readTimingModel(&file, &models[m].model, &diagnostic);
+        closeSource(&file);
+        if (status != 0) {
+            fprintf(stderr, "%s: ", models[m].path);
+            printDiagnostic(stderr, &diagnostic);
+            return status;
+        }
+    }
+
+    CodeBuffer code;
+    initGrowableCodeBuffer(&code);
+    LineTable table;
+    initLineTable(&table);
+    uint8_t status = loadProgram(path, &code, &table);
+    if (status != 0) {
+        freeLineTable(&table);
+        freeCodeBuffer(&code);
+        return status;
+    }
+
+    PhaseTimer timer;
+    PhaseStats phase;
+    startPhase(&timer);
+    TimingAnalysis analysis;
+    char location[LOCATION_LENGTH];
+    status = analyzeControlFlow(code.data, (uint32_t)code.length, &analysis);
+    if (status != 0) {
+        fprintf(stderr, "Error: %s.\n", getStatusMessage(status));
+    } else if (analysis.irreducibleAt != UINT32_MAX) {
+        status = ERROR_IRREDUCIBLE_LOOP;
+        describeOffset(location, sizeof(location), &table, analysis.irreducibleAt);
+        fprintf(stderr, "Error: %s at %s, every way into a loop has to pass through one instruction.\n", getStatusMessage(status), location);
+    } else if (analysis.numLoops > 0) {
+        status = applyLoopBounds(&analysis, &table);
+    }
+
+    // loops in source order, for reporting
+    uint64_t* loopWorst = (uint64_t*)malloc(((size_t)analysis.numLoops + 1) * sizeof(uint64_t));
+    uint64_t* loopOrder = (uint64_t*)malloc(((size_t)analysis.numLoops + 1) * sizeof(uint64_t));
+    if (status == 0 && (loopWorst == NULL || loopOrder == NULL)) {
+        status = ERROR_OUT_OF_MEMORY;
+        fprintf(stderr, "Error: %s.\n", getStatusMessage(status));
+    }
+    for (uint32_t k = 0; k < analysis.numLoops && status == 0; k++) {
+        *(loopOrder + k) = ((uint64_t)(analysis.loops + k)->header << 32) | k;
+    }
+    if (status == 0) {
+        qsort(loopOrder, analysis.numLoops, sizeof(uint64_t), compareLoopKeys);
+    }
+    for (uint32_t k = 0; k < analysis.numLoops && (status == 0 || status == ERROR_UNBOUNDED_LOOP); k++) {
+        const TimedLoop* loop = analysis.loops + (uint32_t)*(loopOrder + k);
+        describeOffset(location, sizeof(location), &table, loop->header);
+        if (!loop->exits) {
+            status = ERROR_UNBOUNDED_LOOP;
+            fprintf(stderr, "Error: The loop at %s never exits, so the program has no worst case.\n", location);
+        } else if (loop->maxIterations == 0) {
+            status = ERROR_UNBOUNDED_LOOP;
+            fprintf(stderr, "Error: The loop at %s has no bound, add `# @loop N` to its first line or the JUMP back to it.\n", location);
+        }
+    }
+
+    uint64_t best[MAX_TIMING_MODELS + 1];
+    uint64_t worst[MAX_TIMING_MODELS + 1];
+    for (uint32_t m = 0; m < numModels && status == 0; m++) {
+        uint32_t unboundedLoop;
+        status = boundExecutionTime(&analysis, &models[m].model, best + m, worst + m, m == 0 ? loopWorst : NULL, &unboundedLoop);
+        if (status != 0) {
+            fprintf(stderr, "Error: %s.\n", getStatusMessage(status));
+        }
+    }
+    stopPhase(&timer, &phase);
+
+    if (status == 0) {
+        printf("Analyzed %" PRIu32 " reachable instructions of %zu, with %" PRIu32 " loops.\n", analysis.numReachable, code.length, analysis.numLoops);
+        for (uint32_t k = 0; k < analysis.numLoops; k++) {
+            uint32_t index = (uint32_t)*(loopOrder + k);
+            const TimedLoop* loop = analysis.loops + index;
+            describeOffset(location, sizeof(location), &table, loop->header);
+            printf("  Loop at %s: ", location);
+            if (loop->minIterations == loop->maxIterations) {
+                printf("%" PRIu32, loop->maxIterations);
+            } else {
+                printf("%" PRIu32 "..%" PRIu32, loop->minIterations, loop->maxIterations);
+            }
+            printf(" iterations of up to %" PRIu64 " instructions.\n", *(loopWorst + index));
+        }
+        printf("Best case %" PRIu64 " instructions, worst case %" PRIu64 " instructions (clock cycles on the Logisim CPU).\n", best[0], worst[0]);
+        for (uint32_t m = 1; m < numModels; m++) {
+            printf("%s: best case %" PRIu64 " %s, worst case %" PRIu64 " %s.\n", models[m].path, best[m], models[m].model.unit, worst[m], models[m].model.unit);
+        }
+        uint32_t checked = numModels > 1 ? 1 : 0;
+        if (budgeted && worst[checked] > budget) {
+            status = ERROR_OVER_BUDGET;
+            fprintf(stderr, "Error: %s, %" PRIu64 " %s is over %" PRIu64 ".\n", getStatusMessage(status), worst[checked], models[checked].model.unit, budget);
+        }
+    }
+    if (timed) {
+        printf("Analysis took %.6f seconds.\n", phase.wallSeconds);
+    }
+    free(loopWorst);
+    free(loopOrder);
+    freeTimingAnalysis(&analysis);
+    freeLineTable(&table);
+    freeCodeBuffer(&code);
+    return status;
+}
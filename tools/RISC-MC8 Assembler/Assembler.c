@@ -0,0 +1,178 @@
+#include "Assembler.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "InstructionParser.h"
+#include "ParallelAssembler.h"
+#include "StatusCodes.h"
+#include "Symbols.h"
+
+/**
+ * @brief Assemble a source with the usual two passes, extracting symbols then parsing instructions
+ *
+ * @param source Source to assemble, must be rewindable
+ * @param code Buffer to append the assembled code to
+ * @param farJumps List to record JUMPs to labels out of range in
+ * @param stats Receives the time spent in each pass, may be NULL
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t assembleTwoPass(SourceReader* source, CodeBuffer* code, FarJumpsList* farJumps, AssemblerStats* stats, AssemblerDiagnostic* diagnostic)
+{
+    AssemblerDiagnostic symbolsDiagnostic = {ERROR_SYMBOLS_LIST_NULL, 0, 0};
+    JumpLandings landings = {NULL, 0, 0, 0, 0, false, false};
+    PhaseTimer timer;
+    startPhase(&timer);
+    SymbolsList* symbols = extractSymbols(source, &landings, &symbolsDiagnostic);
+    if (symbols != NULL && landings.unsettled) {
+        // a JUMP by a number lands behind an li that relied on what the registers held, so size it again without
+        freeSymbolsList(&symbols);
+        settleJumpLandings(source, &landings);
+        symbols = extractSymbols(source, &landings, &symbolsDiagnostic);
+    }
+    stopPhase(&timer, stats == NULL ? NULL : &stats->extraction);
+    if (symbols == NULL) {
+        freeJumpLandings(&landings);
+        setDiagnostic(diagnostic, symbolsDiagnostic.code, symbolsDiagnostic.line, symbolsDiagnostic.column);
+        return symbolsDiagnostic.code;
+    }
+    rewindSource(source);
+    rewindJumpLandings(&landings);
+    startPhase(&timer);
+    uint8_t status = parseInstructions(source, code, symbols, &landings, farJumps, diagnostic);
+    stopPhase(&timer, stats == NULL ? NULL : &stats->parsing);
+    freeSymbolsList(&symbols);
+    freeJumpLandings(&landings);
+    return status;
+}
+
+/**
+ * @brief Give the JUMPs to labels out of range routes through trampolines
+ *
+ * @param source The source that was assembled, rewound to assemble it again if the code did not fit
+ * @param code Buffer holding the code, from start
+ * @param start Offset of the code within the buffer
+ * @param farJumps JUMPs to labels out of range
+ * @param report Receives the trampolines added, may be NULL
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t relaxCode(SourceReader* source, CodeBuffer* code, size_t start, const FarJumpsList* const farJumps, RelaxationReport* report, AssemblerDiagnostic* diagnostic)
+{
+    if (codeFits(code)) {
+        return relaxJumps(code, start, farJumps, report, diagnostic);
+    }
+
+    // a full fixed buffer only counted the code past its end, but relaxing reads all of it, so assemble again into a
+    // buffer that keeps it to find out how much room is needed
+    if (!rewindSource(source)) {
+        setDiagnostic(diagnostic, ERROR_OUTPUT_TOO_SMALL, 0, 0);
+        return ERROR_OUTPUT_TOO_SMALL;  // code->length is only a lower bound
+    }
+    CodeBuffer whole;
+    initGrowableCodeBuffer(&whole);
+    FarJumpsList wholeFarJumps = {NULL, 0, 0};
+    uint8_t status = assembleTwoPass(source, &whole, &wholeFarJumps, NULL, diagnostic);
+    if (status == 0) {
+        status = relaxJumps(&whole, 0, &wholeFarJumps, report, diagnostic);
+    }
+    if (status == 0) {
+        code->length = start;
+        for (size_t i = 0; i < whole.length; i++) {
+            appendCode(code, *(whole.data + i));  // cannot fail, a full fixed buffer only counts
+        }
+    }
+    freeFarJumpsList(&wholeFarJumps);
+    freeCodeBuffer(&whole);
+    return status;
+}
+
+/**
+ * @brief Assemble a source into a code buffer
+ *
+ * @param source Source to assemble, read from the beginning
+ * @param code Buffer to append the assembled code to
+ * @param options How to assemble, or NULL for the two-pass defaults
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, ERROR_OUTPUT_TOO_SMALL if a fixed buffer ran out of room (code->length is the size needed),
+ *         otherwise the error that occurred
+ */
+uint8_t assembleSource(SourceReader* source, CodeBuffer* code, const AssemblerOptions* const options, AssemblerDiagnostic* diagnostic)
+{
+    setDiagnostic(diagnostic, 0, 0, 0);
+    uint8_t mode = options == NULL ? ASSEMBLER_MODE_TWO_PASS : options->mode;
+    if (source->data == NULL) {
+        mode = ASSEMBLER_MODE_SINGLE_PASS;  // a pipe or other stream cannot be rewound or split
+    }
+
+    AssemblerStats* stats = options == NULL ? NULL : options->stats;
+    RelaxationReport* report = options == NULL ? NULL : options->relaxation;
+    if (report != NULL) {
+        memset(report, 0, sizeof(RelaxationReport));
+    }
+    size_t startLength = code->length;
+
+    FarJumpsList farJumps = {NULL, 0, 0};
+    uint8_t status;
+    if (mode == ASSEMBLER_MODE_PARALLEL) {
+        status = parseInstructionsParallel(source->data, source->length, code, options->numThreads, &farJumps, stats, diagnostic);
+        if (status == STATUS_NEEDS_TWO_PASS) {
+            mode = ASSEMBLER_MODE_TWO_PASS;
+            status = assembleTwoPass(source, code, &farJumps, stats, diagnostic);
+        }
+    } else if (mode == ASSEMBLER_MODE_SINGLE_PASS) {
+        PhaseTimer timer;
+        startPhase(&timer);
+        status = parseInstructionsSinglePass(source, code, &farJumps, diagnostic);
+        stopPhase(&timer, stats == NULL ? NULL : &stats->parsing);
+    } else {
+        status = assembleTwoPass(source, code, &farJumps, stats, diagnostic);
+    }
+    if (source->status != 0) {
+        // the rest of a stream was never read, so whatever else went wrong follows from this
+        status = source->status;
+        setDiagnostic(diagnostic, status, source->lineNumber + 1, 0);
+    }
+    if (status == 0 && farJumps.length > 0) {
+        status = relaxCode(source, code, startLength, &farJumps, report, diagnostic);
+    }
+    freeFarJumpsList(&farJumps);
+    if (stats != NULL) {
+        stats->lines += mode == ASSEMBLER_MODE_PARALLEL ? 0 : source->lineNumber;
+        stats->instructions += code->length - startLength;
+    }
+
+    if (status == 0 && !codeFits(code)) {
+        status = ERROR_OUTPUT_TOO_SMALL;
+        setDiagnostic(diagnostic, status, 0, 0);
+    }
+    return status;
+}
+
+/**
+ * @brief Assemble source text held in memory into a caller-provided buffer, without touching the filesystem
+ *
+ * @param source The source text, does not need to be NUL terminated
+ * @param length Number of bytes in source
+ * @param output Where to write the assembled code, may be NULL to only measure it
+ * @param capacity Number of bytes available at output
+ * @param outputLength Set to the number of bytes of code, even if they did not fit, may be NULL
+ * @param options How to assemble, or NULL for the two-pass defaults
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, ERROR_OUTPUT_TOO_SMALL if capacity was not enough, otherwise the error that occurred
+ */
+uint8_t assembleBuffer(const char* const source, size_t length, uint8_t* output, size_t capacity, size_t* outputLength, const AssemblerOptions* const options, AssemblerDiagnostic* diagnostic)
+{
+    SourceReader reader;
+    openSourceBuffer(&reader, source, length);
+    CodeBuffer code;
+    initFixedCodeBuffer(&code, output, capacity);
+    uint8_t status = assembleSource(&reader, &code, options, diagnostic);
+    if (outputLength != NULL) {
+        *outputLength = status == 0 || status == ERROR_OUTPUT_TOO_SMALL ? code.length : 0;
+    }
+    closeSource(&reader);
+    return status;
+}
@@ -0,0 +1,59 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "AssemblerStats.h"
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Relaxation.h"
+#include "Source.h"
+
+#define ASSEMBLER_ISA_VERSION "4.5"
+
+#define ASSEMBLER_MODE_TWO_PASS 0
+#define ASSEMBLER_MODE_SINGLE_PASS 1
+#define ASSEMBLER_MODE_PARALLEL 2
+
+/**
+ * How to assemble a source. Every mode produces the same code, they differ only in speed and memory use.
+ */
+typedef struct _AssemblerOptions {
+    uint8_t mode;
+    uint32_t numThreads;   // threads used by ASSEMBLER_MODE_PARALLEL, 0 for one per processor
+    AssemblerStats* stats;  // receives phase times and counts if not NULL, see AssemblerStats
+    RelaxationReport* relaxation;  // receives the trampolines added for JUMPs out of range if not NULL, free it with
+                                   // freeRelaxationReport
+} AssemblerOptions;
+
+/**
+ * @brief Assemble a source into a code buffer
+ *
+ * Streams cannot be rewound or split, so they are always assembled in a single pass whatever the mode. JUMPs to
+ * labels more than -64..63 instructions away are relaxed with relaxJumps afterwards.
+ *
+ * @param source Source to assemble, read from the beginning
+ * @param code Buffer to append the assembled code to
+ * @param options How to assemble, or NULL for the two-pass defaults
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, ERROR_OUTPUT_TOO_SMALL if a fixed buffer ran out of room (code->length is the size needed),
+ *         otherwise the error that occurred
+ */
+uint8_t assembleSource(SourceReader* source, CodeBuffer* code, const AssemblerOptions* const options, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Assemble source text held in memory into a caller-provided buffer, without touching the filesystem
+ *
+ * @param source The source text, does not need to be NUL terminated
+ * @param length Number of bytes in source
+ * @param output Where to write the assembled code, may be NULL to only measure it
+ * @param capacity Number of bytes available at output
+ * @param outputLength Set to the number of bytes of code, even if they did not fit, may be NULL
+ * @param options How to assemble, or NULL for the two-pass defaults
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, ERROR_OUTPUT_TOO_SMALL if capacity was not enough, otherwise the error that occurred
+ */
+uint8_t assembleBuffer(const char* const source, size_t length, uint8_t* output, size_t capacity, size_t* outputLength, const AssemblerOptions* const options, AssemblerDiagnostic* diagnostic);
+
+#endif
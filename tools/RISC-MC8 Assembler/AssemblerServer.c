@@ -0,0 +1,424 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "AssemblerServer.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "Assembler.h"
+#include "Source.h"
+#include "StatusCodes.h"
+#include "WorkerPool.h"
+
+#define RESPONSE_HEADER_LENGTH 17
+#define POLL_INTERVAL_MS 250
+
+#if !defined(_WIN32)
+
+typedef struct _AssemblerServer {
+    int listenFd;
+} AssemblerServer;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+/**
+ * @brief Ask every server thread to finish up
+ *
+ * @param signal The signal that was received
+ */
+static void requestStop(int signal)
+{
+    (void)signal;
+    stopRequested = 1;
+}
+
+/**
+ * @brief Write a 32-bit value in little-endian order
+ *
+ * @param dest Where to write the 4 bytes
+ * @param value The value to write
+ */
+static void putUint32(uint8_t* dest, uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; i++) {
+        *(dest + i) = (uint8_t)(value >> (i * 8));
+    }
+}
+
+/**
+ * @brief Read a 32-bit value in little-endian order
+ *
+ * @param src The 4 bytes to read
+ * @return The value
+ */
+static uint32_t getUint32(const uint8_t* const src)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        value |= (uint32_t)*(src + i) << (i * 8);
+    }
+    return value;
+}
+
+/**
+ * @brief Read exactly length bytes, giving up if the peer hangs up or the server is stopping
+ *
+ * @param fd Socket to read from
+ * @param dest Where to write the bytes
+ * @param length Number of bytes to read
+ * @param stoppable Whether to give up once a stop has been requested, so idle clients do not hold up shutdown
+ * @return true if every byte was read, false otherwise
+ */
+static bool readFully(int fd, void* dest, size_t length, bool stoppable)
+{
+    uint8_t* bytes = (uint8_t*)dest;
+    while (length > 0) {
+        if (stoppable) {
+            struct pollfd waiting = {fd, POLLIN, 0};
+            int ready = poll(&waiting, 1, POLL_INTERVAL_MS);
+            if (stopRequested) {
+                return false;
+            } else if (ready <= 0) {
+                if (ready < 0 && errno != EINTR) {
+                    return false;
+                }
+                continue;
+            }
+        }
+        ssize_t got = recv(fd, bytes, length, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        } else if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        length -= (size_t)got;
+    }
+    return true;
+}
+
+/**
+ * @brief Write exactly length bytes
+ *
+ * @param fd Socket to write to
+ * @param src The bytes to write
+ * @param length Number of bytes to write
+ * @return true if every byte was written, false if the peer hung up
+ */
+static bool writeFully(int fd, const void* src, size_t length)
+{
+    const uint8_t* bytes = (const uint8_t*)src;
+    while (length > 0) {
+        ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+/**
+ * @brief Send the result of one request
+ *
+ * @param fd Socket to write to
+ * @param diagnostic Status of the request and where any error occurred
+ * @param code The assembled code, only sent if the request succeeded
+ * @param summary Summary of what relaxation did to the code, only sent if the request succeeded
+ * @return true if the response was sent, false if the client hung up
+ */
+static bool writeResponse(int fd, const AssemblerDiagnostic* const diagnostic, const CodeBuffer* const code, const CodeBuffer* const summary)
+{
+    uint32_t codeLength = diagnostic->code == 0 ? (uint32_t)code->length : 0;
+    uint32_t summaryLength = diagnostic->code == 0 ? (uint32_t)summary->length : 0;
+    uint8_t header[RESPONSE_HEADER_LENGTH];
+    header[0] = diagnostic->code;
+    putUint32(header + 1, diagnostic->line);
+    putUint32(header + 5, diagnostic->column);
+    putUint32(header + 9, codeLength);
+    putUint32(header + 13, summaryLength);
+    return writeFully(fd, header, RESPONSE_HEADER_LENGTH) && (codeLength == 0 || writeFully(fd, code->data, codeLength)) && (summaryLength == 0 || writeFully(fd, summary->data, summaryLength));
+}
+
+/**
+ * @brief Answer requests from one client until it hangs up
+ *
+ * @param fd The client's socket
+ */
+static void serveClient(int fd)
+{
+    uint8_t header[4];
+    while (readFully(fd, header, sizeof(header), true)) {
+        uint32_t length = getUint32(header);
+        AssemblerDiagnostic diagnostic = {0, 0, 0};
+        CodeBuffer code;
+        initGrowableCodeBuffer(&code);
+        CodeBuffer summary;
+        initGrowableCodeBuffer(&summary);
+        if (length > SERVER_MAX_REQUEST_LENGTH) {
+            diagnostic.code = ERROR_MALFORMED_REQUEST;
+            writeResponse(fd, &diagnostic, &code, &summary);
+            return;
+        }
+
+        char* source = (char*)malloc(length > 0 ? length : 1);
+        if (source == NULL) {
+            diagnostic.code = ERROR_OUT_OF_MEMORY;
+            writeResponse(fd, &diagnostic, &code, &summary);
+            return;
+        }
+        if (!readFully(fd, source, length, true)) {
+            free(source);
+            return;
+        }
+        // the client prints what relaxation did just as a local assembly would
+        RelaxationReport relaxation;
+        memset(&relaxation, 0, sizeof(relaxation));
+        AssemblerOptions options = {ASSEMBLER_MODE_TWO_PASS, 0, NULL, &relaxation};
+        SourceReader reader;
+        openSourceBuffer(&reader, source, length);
+        assembleSource(&reader, &code, &options, &diagnostic);
+        closeSource(&reader);
+        free(source);
+        if (diagnostic.code == 0 && !writeRelaxationSummary(&relaxation, &summary)) {
+            setDiagnostic(&diagnostic, ERROR_OUT_OF_MEMORY, 0, 0);
+        }
+        freeRelaxationReport(&relaxation);
+
+        bool sent = writeResponse(fd, &diagnostic, &code, &summary);
+        freeCodeBuffer(&code);
+        freeCodeBuffer(&summary);
+        if (!sent) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Accept and serve clients one at a time until the server is stopped, run by every thread of the pool
+ *
+ * @param context The AssemblerServer
+ * @param index Unused, every thread does the same thing
+ */
+static void serveConnections(void* context, uint32_t index)
+{
+    (void)index;
+    AssemblerServer* server = (AssemblerServer*)context;
+    while (!stopRequested) {
+        struct pollfd waiting = {server->listenFd, POLLIN, 0};
+        if (poll(&waiting, 1, POLL_INTERVAL_MS) <= 0) {
+            continue;
+        }
+        // the listening socket is non-blocking, so threads woken for the same client don't get stuck here
+        int client = accept(server->listenFd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
+        serveClient(client);
+        close(client);
+    }
+}
+
+/**
+ * @brief Fill in a Unix domain socket address
+ *
+ * @param address The address to fill in
+ * @param socketPath Path of the socket
+ * @return true if successful, false if the path is too long
+ */
+static bool makeSocketAddress(struct sockaddr_un* address, const char* const socketPath)
+{
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    strcpy(address->sun_path, socketPath);
+    return true;
+}
+
+/**
+ * @brief Check whether a server is already listening on a socket, removing the socket if nothing is
+ *
+ * @param address Address of the socket
+ * @return true if a server accepted the connection, false if the path is free to listen on
+ */
+static bool isServerRunning(const struct sockaddr_un* const address)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    bool running = connect(fd, (const struct sockaddr*)address, sizeof(struct sockaddr_un)) == 0;
+    if (!running && errno == ECONNREFUSED) {
+        unlink(address->sun_path);  // left behind by a server that was killed
+    }
+    close(fd);
+    return running;
+}
+
+/**
+ * @brief Serve assemble requests on a Unix domain socket until interrupted (SIGINT or SIGTERM)
+ *
+ * @param socketPath Path to listen on
+ * @param numThreads Number of clients to serve at once, 0 for one per processor
+ * @param logStream Where to print errors that stop the server from starting, or NULL to not print them
+ * @return 0 if the server shut down cleanly, ERROR_SERVER_UNAVAILABLE if it could not listen on socketPath or another
+ *         server already does
+ */
+uint8_t runAssemblerServer(const char* const socketPath, uint32_t numThreads, FILE* logStream)
+{
+    struct sockaddr_un address;
+    if (!makeSocketAddress(&address, socketPath)) {
+        if (logStream != NULL) {
+            fprintf(logStream, "Error: Socket path is too long.\n");
+        }
+        return ERROR_SERVER_UNAVAILABLE;
+    }
+    if (isServerRunning(&address)) {
+        if (logStream != NULL) {
+            fprintf(logStream, "Error: A server is already running on %s.\n", socketPath);
+        }
+        return ERROR_SERVER_UNAVAILABLE;
+    }
+    AssemblerServer server;
+    server.listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listenFd < 0 || bind(server.listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server.listenFd, 64) != 0) {
+        if (logStream != NULL) {
+            fprintf(logStream, "Error: Could not listen on %s.\n", socketPath);
+        }
+        if (server.listenFd >= 0) {
+            close(server.listenFd);
+        }
+        return ERROR_SERVER_UNAVAILABLE;
+    }
+    fcntl(server.listenFd, F_SETFL, fcntl(server.listenFd, F_GETFL) | O_NONBLOCK);
+
+    struct sigaction stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = &requestStop;
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    stopRequested = 0;
+
+    if (numThreads == 0) {
+        numThreads = getProcessorCount();
+    }
+    runWorkerPool(&serveConnections, &server, numThreads, numThreads);
+
+    close(server.listenFd);
+    unlink(socketPath);
+    return 0;
+}
+
+/**
+ * @brief Assemble a source through a running server instead of in this process
+ *
+ * @param socketPath Path the server is listening on
+ * @param data The source text
+ * @param length Number of bytes in data
+ * @param code Buffer to append the assembled code to, left as it was if the server could not be reached
+ * @param relaxation Empty report to fill in with the summary of what relaxation did to the code, may be NULL
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, ERROR_SERVER_UNAVAILABLE if the server could not be reached or hung up, otherwise the
+ *         error the server reported
+ */
+uint8_t assembleRemote(const char* const socketPath, const char* const data, size_t length, CodeBuffer* code, RelaxationReport* relaxation, AssemblerDiagnostic* diagnostic)
+{
+    setDiagnostic(diagnostic, ERROR_SERVER_UNAVAILABLE, 0, 0);
+    struct sockaddr_un address;
+    if (length > SERVER_MAX_REQUEST_LENGTH || !makeSocketAddress(&address, socketPath)) {
+        return ERROR_SERVER_UNAVAILABLE;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return ERROR_SERVER_UNAVAILABLE;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return ERROR_SERVER_UNAVAILABLE;
+    }
+
+    uint8_t header[RESPONSE_HEADER_LENGTH];
+    putUint32(header, (uint32_t)length);
+    if (!writeFully(fd, header, 4) || !writeFully(fd, data, length) || !readFully(fd, header, RESPONSE_HEADER_LENGTH, false)) {
+        close(fd);
+        return ERROR_SERVER_UNAVAILABLE;
+    }
+    uint8_t status = header[0];
+    uint32_t remaining = getUint32(header + 9);
+    uint32_t summaryLength = getUint32(header + 13);
+    size_t startLength = code->length;
+    uint8_t block[4096];
+    while (remaining > 0) {
+        uint32_t blockLength = remaining < sizeof(block) ? remaining : sizeof(block);
+        if (!readFully(fd, block, blockLength, false)) {
+            close(fd);
+            code->length = startLength;  // so a fallback to assembling locally starts clean
+            return ERROR_SERVER_UNAVAILABLE;
+        }
+        for (uint32_t i = 0; i < blockLength; i++) {
+            if (!appendCode(code, block[i])) {
+                close(fd);
+                setDiagnostic(diagnostic, ERROR_OUT_OF_MEMORY, 0, 0);
+                return ERROR_OUT_OF_MEMORY;
+            }
+        }
+        remaining -= blockLength;
+    }
+    uint8_t* summary = summaryLength <= SERVER_MAX_REQUEST_LENGTH ? (uint8_t*)malloc(summaryLength > 0 ? summaryLength : 1) : NULL;
+    bool received = summary != NULL && readFully(fd, summary, summaryLength, false);
+    close(fd);
+    if (received && status == 0 && relaxation != NULL) {
+        received = readRelaxationSummary(summary, summaryLength, relaxation);
+    }
+    free(summary);
+    if (!received) {
+        code->length = startLength;
+        return ERROR_SERVER_UNAVAILABLE;
+    }
+
+    if (status == 0 && !codeFits(code)) {
+        status = ERROR_OUTPUT_TOO_SMALL;
+    }
+    setDiagnostic(diagnostic, status, status == 0 ? 0 : getUint32(header + 1), status == 0 ? 0 : getUint32(header + 5));
+    return status;
+}
+
+#else
+
+uint8_t runAssemblerServer(const char* const socketPath, uint32_t numThreads, FILE* logStream)
+{
+    if (logStream != NULL) {
+        fprintf(logStream, "Error: Server mode is not supported on this platform.\n");
+    }
+    return ERROR_SERVER_UNAVAILABLE;
+}
+
+uint8_t assembleRemote(const char* const socketPath, const char* const data, size_t length, CodeBuffer* code, RelaxationReport* relaxation, AssemblerDiagnostic* diagnostic)
+{
+    setDiagnostic(diagnostic, ERROR_SERVER_UNAVAILABLE, 0, 0);
+    return ERROR_SERVER_UNAVAILABLE;
+}
+
+#endif
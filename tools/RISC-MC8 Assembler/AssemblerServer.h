@@ -0,0 +1,53 @@
+#ifndef ASSEMBLERSERVER_H
+#define ASSEMBLERSERVER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Relaxation.h"
+
+// environment variable naming a server socket, the CLI assembles through it when set
+#define SERVER_SOCKET_ENVIRONMENT "RISC_MC8_ASSEMBLER_SOCKET"
+#define SERVER_MAX_REQUEST_LENGTH (64u * 1024 * 1024)
+
+/*
+ * Protocol, all integers little-endian. A client may send any number of requests on one connection.
+ *   request:  u32 source length, source bytes
+ *   response: u8 status, u32 line, u32 column, u32 code length, u32 summary length, code bytes, summary bytes (both
+ *             lengths are 0 unless status is 0, the summary is what relaxation did, see Relaxation.h)
+ * A request longer than SERVER_MAX_REQUEST_LENGTH is answered with ERROR_MALFORMED_REQUEST and the connection closed.
+ */
+
+/**
+ * @brief Serve assemble requests on a Unix domain socket until interrupted (SIGINT or SIGTERM)
+ *
+ * A socket at socketPath that nothing listens on is replaced, one a running server listens on is left alone, and the
+ * socket is removed on exit. Connections are served by a fixed
+ * pool of threads, each handling one client at a time.
+ *
+ * @param socketPath Path to listen on
+ * @param numThreads Number of clients to serve at once, 0 for one per processor
+ * @param logStream Where to print errors that stop the server from starting, or NULL to not print them
+ * @return 0 if the server shut down cleanly, ERROR_SERVER_UNAVAILABLE if it could not listen on socketPath or another
+ *         server already does
+ */
+uint8_t runAssemblerServer(const char* const socketPath, uint32_t numThreads, FILE* logStream);
+
+/**
+ * @brief Assemble a source through a running server instead of in this process
+ *
+ * @param socketPath Path the server is listening on
+ * @param data The source text
+ * @param length Number of bytes in data
+ * @param code Buffer to append the assembled code to, left as it was if the server could not be reached
+ * @param relaxation Empty report to fill in with the summary of what relaxation did to the code, may be NULL
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, ERROR_SERVER_UNAVAILABLE if the server could not be reached or hung up, otherwise the
+ *         error the server reported
+ */
+uint8_t assembleRemote(const char* const socketPath, const char* const data, size_t length, CodeBuffer* code, RelaxationReport* relaxation, AssemblerDiagnostic* diagnostic);
+
+#endif
@@ -0,0 +1,136 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "AssemblerStats.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+atomic_bool statsCounting = false;
+atomic_uint_fast64_t statsAllocations = 0;
+atomic_uint_fast64_t statsAllocatedBytes = 0;
+atomic_uint_fast64_t statsSymbolLookups = 0;
+atomic_uint_fast64_t statsLabels = 0;
+
+/**
+ * @brief Zero the process-wide counters and start counting
+ */
+void startStatsCounting(void)
+{
+    atomic_store(&statsAllocations, 0);
+    atomic_store(&statsAllocatedBytes, 0);
+    atomic_store(&statsSymbolLookups, 0);
+    atomic_store(&statsLabels, 0);
+    atomic_store(&statsCounting, true);
+}
+
+/**
+ * @brief Stop counting and copy the process-wide counters into stats
+ *
+ * @param stats Receives the allocation, symbol lookup and label counts
+ */
+void readStatsCounters(AssemblerStats* stats)
+{
+    atomic_store(&statsCounting, false);
+    stats->allocations = atomic_load(&statsAllocations);
+    stats->allocatedBytes = atomic_load(&statsAllocatedBytes);
+    stats->symbolLookups = atomic_load(&statsSymbolLookups);
+    stats->labels = atomic_load(&statsLabels);
+}
+
+/**
+ * @brief Read the wall and CPU clocks
+ *
+ * @param wall Set to the monotonic time in seconds
+ * @param cpu Set to the CPU time used by the process in seconds
+ */
+static void readClocks(double* wall, double* cpu)
+{
+#if !defined(_WIN32)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    *wall = ts.tv_sec + ts.tv_nsec * 1e-9;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    *cpu = ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    *wall = ts.tv_sec + ts.tv_nsec * 1e-9;
+    *cpu = (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ * @brief Note the wall and CPU time at the start of a phase
+ *
+ * @param timer The timer to start
+ */
+void startPhase(PhaseTimer* timer)
+{
+    readClocks(&timer->wallStart, &timer->cpuStart);
+}
+
+/**
+ * @brief Add the time since startPhase to a phase
+ *
+ * @param timer The started timer
+ * @param phase The phase to add to, may be NULL
+ */
+void stopPhase(const PhaseTimer* const timer, PhaseStats* phase)
+{
+    if (phase == NULL) {
+        return;
+    }
+    double wall;
+    double cpu;
+    readClocks(&wall, &cpu);
+    phase->wallSeconds += wall - timer->wallStart;
+    phase->cpuSeconds += cpu - timer->cpuStart;
+}
+
+/**
+ * @brief Write stats as one line of JSON to a file descriptor
+ *
+ * @param fd The file descriptor to write to, such as 2 for stderr
+ * @param stats The stats to write
+ * @param status The status the assembly finished with
+ * @return true if successful, false if the descriptor could not be written
+ */
+bool writeStatsJson(int fd, const AssemblerStats* const stats, uint8_t status)
+{
+    char json[1024];
+    int length = snprintf(json, sizeof(json),
+                          "{\"status\":%u,\"phases\":{"
+                          "\"extractSymbols\":{\"wallSeconds\":%.6f,\"cpuSeconds\":%.6f},"
+                          "\"parseInstructions\":{\"wallSeconds\":%.6f,\"cpuSeconds\":%.6f},"
+                          "\"output\":{\"wallSeconds\":%.6f,\"cpuSeconds\":%.6f}},"
+                          "\"lines\":%" PRIu64 ",\"instructions\":%" PRIu64 ",\"labels\":%" PRIu64 ","
+                          "\"allocations\":%" PRIu64 ",\"allocatedBytes\":%" PRIu64 ",\"symbolLookups\":%" PRIu64 "}\n",
+                          status, stats->extraction.wallSeconds, stats->extraction.cpuSeconds, stats->parsing.wallSeconds,
+                          stats->parsing.cpuSeconds, stats->output.wallSeconds, stats->output.cpuSeconds, stats->lines,
+                          stats->instructions, stats->labels, stats->allocations, stats->allocatedBytes, stats->symbolLookups);
+    if (length < 0 || (size_t)length >= sizeof(json)) {
+        return false;
+    }
+    int written = 0;
+    while (written < length) {
+#if !defined(_WIN32)
+        ssize_t result = write(fd, json + written, length - written);
+#else
+        int result = _write(fd, json + written, length - written);
+#endif
+        if (result <= 0) {
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#ifndef ASSEMBLERSTATS_H
+#define ASSEMBLERSTATS_H
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct _PhaseStats {
+    double wallSeconds;
+    double cpuSeconds;  // of the whole process, so includes every worker thread
+} PhaseStats;
+
+typedef struct _PhaseTimer {
+    double wallStart;
+    double cpuStart;
+} PhaseTimer;
+
+/**
+ * Where the time and memory of one assembly went. Phases and line/instruction counts are filled in by assembleSource
+ * when asked for, the remaining counters are process-wide and only move between startStatsCounting and
+ * readStatsCounters. A phase that did not run (such as symbol extraction in a single pass) stays zero.
+ */
+typedef struct _AssemblerStats {
+    PhaseStats extraction;
+    PhaseStats parsing;
+    PhaseStats output;
+    uint64_t lines;
+    uint64_t instructions;
+    uint64_t labels;
+    uint64_t allocations;     // every malloc, calloc and realloc, a realloc counts its full new size
+    uint64_t allocatedBytes;
+    uint64_t symbolLookups;
+} AssemblerStats;
+
+extern atomic_bool statsCounting;
+extern atomic_uint_fast64_t statsAllocations;
+extern atomic_uint_fast64_t statsAllocatedBytes;
+extern atomic_uint_fast64_t statsSymbolLookups;
+extern atomic_uint_fast64_t statsLabels;
+
+/**
+ * @brief Record a heap allocation, if counting
+ *
+ * @param bytes Number of bytes requested
+ */
+static inline void countAllocation(size_t bytes)
+{
+    if (atomic_load_explicit(&statsCounting, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&statsAllocations, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&statsAllocatedBytes, bytes, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Record a symbol table lookup, if counting
+ */
+static inline void countSymbolLookup(void)
+{
+    if (atomic_load_explicit(&statsCounting, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&statsSymbolLookups, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Record a label definition, if counting
+ */
+static inline void countLabel(void)
+{
+    if (atomic_load_explicit(&statsCounting, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&statsLabels, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Zero the process-wide counters and start counting
+ */
+void startStatsCounting(void);
+
+/**
+ * @brief Stop counting and copy the process-wide counters into stats
+ *
+ * @param stats Receives the allocation, symbol lookup and label counts
+ */
+void readStatsCounters(AssemblerStats* stats);
+
+/**
+ * @brief Note the wall and CPU time at the start of a phase
+ *
+ * @param timer The timer to start
+ */
+void startPhase(PhaseTimer* timer);
+
+/**
+ * @brief Add the time since startPhase to a phase
+ *
+ * @param timer The started timer
+ * @param phase The phase to add to, may be NULL
+ */
+void stopPhase(const PhaseTimer* const timer, PhaseStats* phase);
+
+/**
+ * @brief Write stats as one line of JSON to a file descriptor
+ *
+ * @param fd The file descriptor to write to, such as 2 for stderr
+ * @param stats The stats to write
+ * @param status The status the assembly finished with
+ * @return true if successful, false if the descriptor could not be written
+ */
+bool writeStatsJson(int fd, const AssemblerStats* const stats, uint8_t status);
+
+#endif
@@ -0,0 +1,270 @@
+#include "BatchAssembler.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Assembler.h"
+#include "BuildCache.h"
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Schematic.h"
+#include "Source.h"
+#include "StatusCodes.h"
+#include "WorkerPool.h"
+
+void freeBatchList(BatchList** list)
+{
+    for (uint32_t i = 0; i < (*list)->length; i++) {
+        free(((*list)->jobs + i)->sourcePath);
+        free(((*list)->jobs + i)->outputPath);
+        if (((*list)->jobs + i)->errors != NULL) {
+            fclose(((*list)->jobs + i)->errors);
+        }
+    }
+    free((*list)->jobs);
+    free(*list);
+    *list = NULL;
+}
+
+/**
+ * @brief Copy a span into a newly allocated NUL terminated string
+ *
+ * @param str The characters to copy
+ * @param length Number of characters to copy
+ * @return The copy, or NULL if out of memory
+ */
+static char* copySpan(const char* const str, uint32_t length)
+{
+    char* copy = (char*)malloc(length + 1);
+    if (copy != NULL) {
+        memcpy(copy, str, length);
+        *(copy + length) = '\0';
+    }
+    return copy;
+}
+
+/**
+ * @brief Add a source -> output pair to a batch
+ *
+ * @param list List to add to
+ * @param sourcePath Path of the source, copied by the list
+ * @param sourceLength Number of characters in sourcePath
+ * @param outputPath Path of the output, copied by the list
+ * @param outputLength Number of characters in outputPath
+ * @return 0 if successful, otherwise an error code
+ */
+uint8_t addBatchJob(BatchList* list, const char* const sourcePath, uint32_t sourceLength, const char* const outputPath, uint32_t outputLength)
+{
+    if (list->length == list->capacity) {
+        uint32_t newCapacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        BatchJob* grown = (BatchJob*)realloc(list->jobs, newCapacity * sizeof(BatchJob));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        list->jobs = grown;
+        list->capacity = newCapacity;
+    }
+    BatchJob* job = list->jobs + list->length;
+    job->sourcePath = copySpan(sourcePath, sourceLength);
+    job->outputPath = copySpan(outputPath, outputLength);
+    job->status = 0;
+    job->errors = NULL;
+    if (job->sourcePath == NULL || job->outputPath == NULL) {
+        free(job->sourcePath);
+        free(job->outputPath);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    list->length++;
+    return 0;
+}
+
+/**
+ * @brief Read the next (possibly quoted) path from a manifest line
+ *
+ * @param line The manifest line
+ * @param length Number of characters in line
+ * @param pos Position to start at, moved past the path
+ * @param path Set to the start of the path
+ * @param pathLength Set to the number of characters in the path
+ * @return true if a path was read, false if the line has no more paths (or an unterminated quote)
+ */
+static bool readManifestPath(const char* const line, uint32_t length, uint32_t* pos, const char** path, uint32_t* pathLength)
+{
+    while (*pos < length && (*(line + *pos) == ' ' || *(line + *pos) == '\t' || *(line + *pos) == '\r')) {
+        (*pos)++;
+    }
+    if (*pos >= length || *(line + *pos) == '#') {
+        return false;
+    }
+    if (*(line + *pos) == '"') {
+        const char* close = (const char*)memchr(line + *pos + 1, '"', length - *pos - 1);
+        if (close == NULL) {
+            return false;
+        }
+        *path = line + *pos + 1;
+        *pathLength = close - *path;
+        *pos = close - line + 1;
+        return true;
+    }
+    uint32_t end = *pos;
+    while (end < length && *(line + end) != ' ' && *(line + end) != '\t' && *(line + end) != '\r') {
+        end++;
+    }
+    *path = line + *pos;
+    *pathLength = end - *pos;
+    *pos = end;
+    return true;
+}
+
+/**
+ * @brief Read source -> output pairs from a manifest, one `source.asm output.o` pair per line
+ *
+ * @param list List to add the pairs to
+ * @param manifest Source to read the manifest from
+ * @param errorStream Where to print errors, or NULL to not print them
+ * @return 0 if successful, otherwise an error code
+ */
+uint8_t readBatchManifest(BatchList* list, SourceReader* manifest, FILE* errorStream)
+{
+    const char* line;
+    uint32_t length;
+    while (readSourceLine(manifest, &line, &length)) {
+        uint32_t pos = 0;
+        const char* sourcePath;
+        const char* outputPath;
+        uint32_t sourceLength;
+        uint32_t outputLength;
+        if (!readManifestPath(line, length, &pos, &sourcePath, &sourceLength)) {
+            if (pos < length && *(line + pos) == '"') {
+                if (errorStream != NULL) {
+                    fprintf(errorStream, "Error: Malformed manifest entry on line %d.\n", manifest->lineNumber);
+                }
+                return ERROR_MALFORMED_MANIFEST;
+            }
+            continue;  // blank or comment
+        }
+        const char* extraPath;
+        uint32_t extraLength;
+        if (!readManifestPath(line, length, &pos, &outputPath, &outputLength) || readManifestPath(line, length, &pos, &extraPath, &extraLength)) {
+            if (errorStream != NULL) {
+                fprintf(errorStream, "Error: Malformed manifest entry on line %d (expected source and output).\n", manifest->lineNumber);
+            }
+            return ERROR_MALFORMED_MANIFEST;
+        }
+        uint8_t status = addBatchJob(list, sourcePath, sourceLength, outputPath, outputLength);
+        if (status != 0) {
+            return status;
+        }
+    }
+    if (manifest->status != 0 && errorStream != NULL) {
+        fprintf(errorStream, "Error: Out of memory reading line %d of the manifest.\n", manifest->lineNumber + 1);
+    }
+    return manifest->status;
+}
+
+/**
+ * @brief Assemble one file to another without printing progress, the output is removed if an error occurs
+ *
+ * @param sourcePath Path of the source to assemble
+ * @param outputPath Path to write the assembled code to
+ * @param cacheDirectory Build cache to reuse earlier results from, or NULL for none
+ * @param schematic true to write a Minecraft ROM schematic instead of the raw code
+ * @param errorStream Where to print errors, or NULL to not print them
+ * @return 0 if successful, otherwise the error that occurred
+ */
+uint8_t assembleFile(const char* const sourcePath, const char* const outputPath, const char* const cacheDirectory, bool schematic, FILE* errorStream)
+{
+    SourceReader source;
+    if (openSourceFile(&source, sourcePath) != 0) {
+        if (errorStream != NULL) {
+            fprintf(errorStream, "Error: Input file does not exist.\n");
+        }
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    FILE* outputFile = fopen(outputPath, "wb");
+    if (outputFile == NULL) {
+        if (errorStream != NULL) {
+            fprintf(errorStream, "Error: Could not open output file.\n");
+        }
+        closeSource(&source);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    CodeBuffer code;
+    initGrowableCodeBuffer(&code);
+    AssemblerDiagnostic diagnostic;
+    uint8_t status = assembleWithCache(cacheDirectory, &source, &code, NULL, &diagnostic);
+    if (status == 0 && schematic) {
+        status = writeRomSchematic(outputFile, code.data, code.length);
+        setDiagnostic(&diagnostic, status, 0, 0);
+    } else if (status == 0) {
+        fwrite(code.data, sizeof(uint8_t), code.length, outputFile);
+    }
+    if (status != 0 && errorStream != NULL) {
+        printDiagnostic(errorStream, &diagnostic);
+    }
+    freeCodeBuffer(&code);
+    closeSource(&source);
+    fclose(outputFile);
+    if (status != 0) {
+        remove(outputPath);  // nuke output file if there was an error
+    }
+    return status;
+}
+
+/**
+ * @brief Run one job of the batch, capturing its errors
+ *
+ * @param context The BatchList
+ * @param index Index of the job to run
+ */
+static void runBatchJob(void* context, uint32_t index)
+{
+    BatchList* list = (BatchList*)context;
+    BatchJob* job = list->jobs + index;
+    job->errors = tmpfile();
+    job->status = assembleFile(job->sourcePath, job->outputPath, list->cacheDirectory, list->schematic, job->errors != NULL ? job->errors : stderr);
+}
+
+/**
+ * @brief Assemble every job in the batch on a fixed pool of threads
+ *
+ * @param list The jobs to run
+ * @param numThreads Number of threads to use, 0 for one per processor
+ * @param cacheDirectory Build cache to reuse earlier results from, or NULL for none
+ * @param schematic true to write Minecraft ROM schematics instead of the raw code
+ * @param errorStream Where to print errors, or NULL to not print them
+ * @return 0 if every job succeeded, otherwise the error of the first job (in batch order) that failed
+ */
+uint8_t runBatch(BatchList* list, uint32_t numThreads, const char* const cacheDirectory, bool schematic, FILE* errorStream)
+{
+    list->cacheDirectory = cacheDirectory;
+    list->schematic = schematic;
+    runWorkerPool(&runBatchJob, list, list->length, numThreads);
+
+    uint8_t status = 0;
+    for (uint32_t i = 0; i < list->length; i++) {
+        BatchJob* job = list->jobs + i;
+        if (status == 0) {
+            status = job->status;
+        }
+        if (job->errors == NULL || errorStream == NULL) {
+            continue;
+        }
+        // replay the captured messages, prefixing each with the file it came from
+        rewind(job->errors);
+        bool atLineStart = true;
+        int c;
+        while ((c = fgetc(job->errors)) != EOF) {
+            if (atLineStart) {
+                fprintf(errorStream, "%s: ", job->sourcePath);
+            }
+            fputc(c, errorStream);
+            atLineStart = c == '\n';
+        }
+    }
+    return status;
+}
@@ -0,0 +1,78 @@
+#ifndef BATCHASSEMBLER_H
+#define BATCHASSEMBLER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "Source.h"
+
+typedef struct _BatchJob {
+    char* sourcePath;
+    char* outputPath;
+    uint8_t status;
+    FILE* errors;  // diagnostics captured while the job ran, NULL if they went straight to stderr
+} BatchJob;
+
+typedef struct _BatchList {
+    BatchJob* jobs;
+    const char* cacheDirectory;  // set by runBatch for the jobs to share
+    bool schematic;              // also set by runBatch, write ROM schematics instead of raw code
+    uint32_t length;
+    uint32_t capacity;
+} BatchList;
+
+void freeBatchList(BatchList** list);
+
+/**
+ * @brief Add a source -> output pair to a batch
+ *
+ * @param list List to add to
+ * @param sourcePath Path of the source, copied by the list
+ * @param sourceLength Number of characters in sourcePath
+ * @param outputPath Path of the output, copied by the list
+ * @param outputLength Number of characters in outputPath
+ * @return 0 if successful, otherwise an error code
+ */
+uint8_t addBatchJob(BatchList* list, const char* const sourcePath, uint32_t sourceLength, const char* const outputPath, uint32_t outputLength);
+
+/**
+ * @brief Read source -> output pairs from a manifest, one `source.asm output.o` pair per line
+ *
+ * Paths containing whitespace may be wrapped in double quotes. Blank lines and # comments are ignored.
+ *
+ * @param list List to add the pairs to
+ * @param manifest Source to read the manifest from
+ * @param errorStream Where to print errors, or NULL to not print them
+ * @return 0 if successful, otherwise an error code
+ */
+uint8_t readBatchManifest(BatchList* list, SourceReader* manifest, FILE* errorStream);
+
+/**
+ * @brief Assemble one file to another without printing progress, the output is removed if an error occurs
+ *
+ * @param sourcePath Path of the source to assemble
+ * @param outputPath Path to write the assembled code to
+ * @param cacheDirectory Build cache to reuse earlier results from, or NULL for none
+ * @param schematic true to write a Minecraft ROM schematic instead of the raw code
+ * @param errorStream Where to print errors, or NULL to not print them
+ * @return 0 if successful, otherwise the error that occurred
+ */
+uint8_t assembleFile(const char* const sourcePath, const char* const outputPath, const char* const cacheDirectory, bool schematic, FILE* errorStream);
+
+/**
+ * @brief Assemble every job in the batch on a fixed pool of threads
+ *
+ * Each job has its own symbols list and its errors are collected separately, then printed in batch order prefixed
+ * with the source path once every job has finished.
+ *
+ * @param list The jobs to run
+ * @param numThreads Number of threads to use, 0 for one per processor
+ * @param cacheDirectory Build cache to reuse earlier results from, or NULL for none
+ * @param schematic true to write Minecraft ROM schematics instead of the raw code
+ * @param errorStream Where to print errors, or NULL to not print them
+ * @return 0 if every job succeeded, otherwise the error of the first job (in batch order) that failed
+ */
+uint8_t runBatch(BatchList* list, uint32_t numThreads, const char* const cacheDirectory, bool schematic, FILE* errorStream);
+
+#endif
@@ -0,0 +1,148 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "InstructionParser.h"
+#include "Source.h"
+#include "Symbols.h"
+
+#define DEFAULT_REPETITIONS 5
+
+typedef struct _PhaseTiming {
+    double best;  // seconds
+    double total;
+} PhaseTiming;
+
+/**
+ * @return Current time in seconds
+ */
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Record one run of a phase
+ *
+ * @param timing The phase's timings
+ * @param elapsed Seconds the run took
+ */
+static void recordRun(PhaseTiming* timing, double elapsed)
+{
+    if (timing->total == 0 || elapsed < timing->best) {
+        timing->best = elapsed;
+    }
+    timing->total += elapsed;
+}
+
+/**
+ * @brief Print a phase as a JSON object, rates are from the best run
+ */
+static void printPhase(const char* const name, const PhaseTiming* const timing, uint32_t lines, size_t bytes, uint32_t repetitions, const char* const separator)
+{
+    printf("\"%s\":{\"bestSeconds\":%.6f,\"meanSeconds\":%.6f,\"linesPerSecond\":%.0f,\"bytesPerSecond\":%.0f}%s", name, timing->best, timing->total / repetitions, lines / timing->best, bytes / timing->best, separator);
+}
+
+/**
+ * @return Peak resident set size of this process in KiB, 0 if unknown
+ */
+static long peakRssKiB(void)
+{
+#if !defined(_WIN32)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return usage.ru_maxrss;  // KiB on Linux
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @brief Time symbol extraction and instruction parsing on a source, printing one JSON object
+ *
+ * @param argc Argument count
+ * @param argv Arguments, `source.asm [repetitions [label]]`, label is copied into the report (such as a commit hash)
+ * @return 0 if successful, otherwise the error the source produced
+ */
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Expected arguments: source.asm [repetitions [label]]\n");
+        return 1;
+    }
+    uint32_t repetitions = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : DEFAULT_REPETITIONS;
+    const char* label = argc > 3 ? argv[3] : "";
+    if (repetitions == 0) {
+        repetitions = 1;
+    }
+    SourceReader source;
+    if (openSourceFile(&source, argv[1]) != 0 || source.data == NULL) {
+        fprintf(stderr, "Error: Input file does not exist.\n");
+        return 1;
+    }
+
+    PhaseTiming extract = {0, 0};
+    PhaseTiming parse = {0, 0};
+    uint32_t lines = 0;
+    uint32_t labels = 0;
+    size_t instructions = 0;
+    CodeBuffer code;
+    initGrowableCodeBuffer(&code);
+    for (uint32_t i = 0; i < repetitions; i++) {
+        AssemblerDiagnostic diagnostic;
+        JumpLandings landings = {NULL, 0, 0, 0, 0, false, false};
+        rewindSource(&source);
+        double start = nowSeconds();
+        SymbolsList* symbols = extractSymbols(&source, &landings, &diagnostic);
+        if (symbols != NULL && landings.unsettled) {
+            freeSymbolsList(&symbols);
+            settleJumpLandings(&source, &landings);
+            symbols = extractSymbols(&source, &landings, &diagnostic);
+        }
+        recordRun(&extract, nowSeconds() - start);
+        if (symbols == NULL) {
+            printDiagnostic(stderr, &diagnostic);
+            return diagnostic.code;
+        }
+        lines = source.lineNumber;
+        labels = symbols->length;
+
+        rewindSource(&source);
+        rewindJumpLandings(&landings);
+        code.length = 0;
+        start = nowSeconds();
+        uint8_t status = parseInstructions(&source, &code, symbols, &landings, NULL, &diagnostic);
+        recordRun(&parse, nowSeconds() - start);
+        freeSymbolsList(&symbols);
+        freeJumpLandings(&landings);
+        if (status != 0) {
+            printDiagnostic(stderr, &diagnostic);
+            return status;
+        }
+        instructions = code.length;
+    }
+
+    printf("{\"benchmark\":\"assembler\",\"label\":\"%s\",\"source\":\"%s\",", label, argv[1]);
+    printf("\"bytes\":%zu,\"lines\":%" PRIu32 ",\"labels\":%" PRIu32 ",\"instructions\":%zu,\"repetitions\":%" PRIu32 ",", source.length, lines, labels, instructions, repetitions);
+    printf("\"phases\":{");
+    printPhase("extractSymbols", &extract, lines, source.length, repetitions, ",");
+    printPhase("parseInstructions", &parse, lines, source.length, repetitions, "");
+    printf("},\"peakRssKiB\":%ld}\n", peakRssKiB());
+
+    freeCodeBuffer(&code);
+    closeSource(&source);
+    return 0;
+}
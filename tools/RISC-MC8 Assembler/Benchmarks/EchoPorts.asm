@@ -0,0 +1,21 @@
+# Copy every byte from the input port to the output port until input ends, checking the status port (0x01) before
+# each byte, so both ports are exercised. 9 instructions per byte.
+
+WAIT:
+stlo 0b0001 # ireg = status port
+load r1
+andi r1 # keep the input ready bit
+skip r1
+jump IDLE
+xori ireg # ireg = data port
+load r2
+stor r2
+jump WAIT
+
+IDLE:
+load r1 # ireg is still the status port
+stlo 0b0010
+andi r1 # keep the input ended bit
+skip r1
+jump WAIT
+jump 0 # halts
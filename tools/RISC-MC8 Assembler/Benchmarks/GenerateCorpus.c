@@ -0,0 +1,146 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_LINES 1000000
+#define DEFAULT_SEED 0x5eed
+#define MAX_BLOCK_INSTRUCTIONS 8
+#define LONG_COMMENT_LENGTH 160
+#define JUMP_REACH 3
+
+// every mnemonic in InstructionLoaderLUT, grouped by operand kind
+static const char* const RegisterMnemonics[] = {
+    "andi", "nand", "addi", "subi", "iori", "xori", "dupi", "dupr", "load", "stor", "shif", "skip",
+};
+static const char* const ImmediateMnemonics[] = {"stlo", "sthi"};
+
+static const char* const Registers[] = {
+    "ireg", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+    "000", "001", "010", "011", "100", "101", "110", "111",
+};
+
+static uint64_t state;
+
+/**
+ * @brief xorshift64*, so every run with the same seed produces the same corpus
+ *
+ * @param bound Upper bound, exclusive
+ * @return A pseudo-random number in [0, bound)
+ */
+static uint32_t randomBelow(uint32_t bound)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (uint32_t)((state * 0x2545f4914f6cdd1dull) >> 32) % bound;
+}
+
+/**
+ * @brief Print whitespace used to indent an instruction, sometimes none and sometimes a lot
+ */
+static void printIndent(void)
+{
+    uint32_t style = randomBelow(8);
+    if (style < 5) {
+        fputs("    ", stdout);
+    } else if (style == 5) {
+        fputs("\t", stdout);
+    } else if (style == 6) {
+        printf("%*s", 24 + randomBelow(40), "");
+    }
+}
+
+/**
+ * @brief Print a trailing comment some of the time, occasionally a very long one
+ */
+static void printTrailingComment(void)
+{
+    uint32_t style = randomBelow(16);
+    if (style < 3) {
+        fputs(" # adjust the working value", stdout);
+    } else if (style == 3) {
+        fputs(" #", stdout);
+        for (uint32_t i = 0; i < LONG_COMMENT_LENGTH; i++) {
+            putchar('a' + randomBelow(26));
+        }
+    }
+}
+
+/**
+ * @brief Print one instruction, mixing mnemonics, operand forms and case
+ *
+ * @param block Index of the label that ends the current block, jumps reach a few blocks either way
+ */
+static void printInstruction(uint32_t block)
+{
+    printIndent();
+    uint32_t kind = randomBelow(16);
+    if (kind < 11) {
+        const char* mnemonic = RegisterMnemonics[randomBelow(sizeof(RegisterMnemonics) / sizeof(*RegisterMnemonics))];
+        const char* reg = Registers[randomBelow(sizeof(Registers) / sizeof(*Registers))];
+        if (randomBelow(10) == 0) {
+            printf("%c%s %s", mnemonic[0] - ('a' - 'A'), mnemonic + 1, reg);  // mnemonics are case insensitive
+        } else {
+            printf("%s %s", mnemonic, reg);
+        }
+    } else if (kind < 13) {
+        const char* mnemonic = ImmediateMnemonics[randomBelow(2)];
+        uint32_t value = randomBelow(16);
+        if (randomBelow(2) == 0) {
+            printf("%s %" PRIu32, mnemonic, value);
+        } else {
+            printf("%s 0b%d%d%d%d", mnemonic, (value >> 3) & 1, (value >> 2) & 1, (value >> 1) & 1, value & 1);
+        }
+    } else if (kind < 15) {
+        // at most 3 blocks of MAX_BLOCK_INSTRUCTIONS away, always within the 7-bit range
+        int32_t target = (int32_t)block + (int32_t)randomBelow(JUMP_REACH * 2) - JUMP_REACH;
+        printf("jump L%" PRId32, target < 0 ? 0 : target);
+    } else {
+        printf("jump %" PRId32, (int32_t)randomBelow(128) - 64);
+    }
+    printTrailingComment();
+    putchar('\n');
+}
+
+/**
+ * @brief Write a large, valid RISC-MC8 source to stdout for benchmarking
+ *
+ * The corpus is blocks of up to MAX_BLOCK_INSTRUCTIONS instructions, each ended by a label, with full-line comments,
+ * blank lines, long lines and jumps to nearby labels mixed in.
+ *
+ * @param argc Argument count
+ * @param argv Arguments, `[lines [seed]]`
+ * @return 0
+ */
+int main(int argc, char** argv)
+{
+    uint32_t numLines = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : DEFAULT_LINES;
+    state = argc > 2 ? strtoull(argv[2], NULL, 0) : DEFAULT_SEED;
+    if (state == 0) {
+        state = DEFAULT_SEED;
+    }
+    printf("# synthetic RISC-MC8 benchmark corpus, %" PRIu32 " lines\n", numLines);
+    uint32_t lines = 1;
+    uint32_t block = 0;
+    for (; lines < numLines; block++) {
+        uint32_t numInstructions = 1 + randomBelow(MAX_BLOCK_INSTRUCTIONS);
+        for (uint32_t i = 0; i < numInstructions && lines < numLines; i++, lines++) {
+            uint32_t filler = randomBelow(24);
+            if (filler == 0) {
+                puts("# full-line comment between instructions");
+            } else if (filler == 1) {
+                putchar('\n');
+            } else {
+                printInstruction(block);
+            }
+        }
+        printf("L%" PRIu32 ":%s\n", block, randomBelow(4) == 0 ? " # block boundary" : "");
+        lines++;
+    }
+    // define the labels that jumps in the last blocks reach forward to
+    for (uint32_t i = 0; i < JUMP_REACH; i++, block++) {
+        printf("L%" PRIu32 ":\n", block);
+    }
+    return 0;
+}
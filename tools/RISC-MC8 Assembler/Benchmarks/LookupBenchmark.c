@@ -0,0 +1,89 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Instructions.h"
+#include "Registers.h"
+
+#define ITERATIONS 2000000
+
+/**
+ * @brief The strncmp scan getInstructionLoaderDefinition used before the generated tables, kept for comparison
+ */
+static const InstructionLoaderDefinition* linearInstructionLookup(const char* const mnemonic)
+{
+    for (uint8_t i = 0; i < NUM_INSTRUCTIONS; i++) {
+        if (strncmp(mnemonic, InstructionLoaderLUT[i].mnemonic, 5) == 0) {
+            return &InstructionLoaderLUT[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief The strncmp scan getRegisterDefinition used before the generated tables, kept for comparison
+ */
+static const RegisterDefinition* linearRegisterLookup(const char* const name)
+{
+    for (uint8_t i = 0; i < NUM_REGISTERS; i++) {
+        if (strncmp(name, RegisterDefinitionLUT[i].name, 4) == 0) {
+            return &RegisterDefinitionLUT[i];
+        } else if (strncmp(name, RegisterDefinitionLUT[i].altName, 5) == 0) {
+            return &RegisterDefinitionLUT[i];
+        }
+    }
+    return NULL;
+}
+
+static const char* const Mnemonics[] = {
+    "andi", "nand", "addi", "subi", "iori", "xori", "dupi", "dupr",
+    "load", "stor", "shif", "skip", "stlo", "sthi", "jump", "nope",
+};
+
+static const char* const Registers[] = {
+    "000", "001", "010", "011", "100", "101", "110", "111",
+    "ireg", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+};
+
+/**
+ * @return Current time in nanoseconds
+ */
+static double nowNs(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief Time ITERATIONS passes over names with lookup, printing ns per lookup and a checksum of field
+ */
+#define TIME_LOOKUPS(label, names, lookup, type, field)                                             \
+    do {                                                                                            \
+        uint32_t sink = 0;                                                                          \
+        double start = nowNs();                                                                     \
+        for (uint32_t iter = 0; iter < ITERATIONS; iter++) {                                        \
+            for (uint32_t n = 0; n < sizeof(names) / sizeof(*names); n++) {                         \
+                const type* result = lookup(names[n]);                                              \
+                sink += result != NULL ? result->field : 0xFF;                                      \
+            }                                                                                       \
+        }                                                                                           \
+        double elapsed = nowNs() - start;                                                           \
+        double perLookup = elapsed / ((double)ITERATIONS * (sizeof(names) / sizeof(*names)));       \
+        printf("%-28s %6.2f ns/lookup (checksum %" PRIx32 ")\n", label, perLookup, sink);           \
+    } while (0)
+
+/**
+ * @brief Compare the linear strncmp lookups against the generated perfect-hash lookups
+ *
+ * @return 0
+ */
+int main(void)
+{
+    TIME_LOOKUPS("mnemonic, linear strncmp", Mnemonics, linearInstructionLookup, InstructionLoaderDefinition, instructionBase);
+    TIME_LOOKUPS("mnemonic, perfect hash", Mnemonics, getInstructionLoaderDefinition, InstructionLoaderDefinition, instructionBase);
+    TIME_LOOKUPS("register, linear strncmp", Registers, linearRegisterLookup, RegisterDefinition, value);
+    TIME_LOOKUPS("register, perfect hash", Registers, getRegisterDefinition, RegisterDefinition, value);
+    return 0;
+}
@@ -0,0 +1,524 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "BuildCache.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "StatusCodes.h"
+
+#define CACHE_MAGIC "RMC8"
+#define CACHE_HEADER_LENGTH 16  // magic, u64 source length, u32 code length, then the code and a relaxation summary
+#define CACHE_STATS_FILE "stats"
+#define CACHE_TEMP_PREFIX ".tmp-"
+#define CACHE_TEMP_MAX_AGE 3600  // temp files this old were left by a process that died while storing
+#define CACHE_PATH_LENGTH 4096
+
+/**
+ * @brief Mix bytes into a pair of 64-bit hashes, FNV-1a with two different primes and offsets
+ *
+ * @param hashes The two running hashes
+ * @param bytes Bytes to mix in
+ * @param length Number of bytes
+ */
+static void mixCacheHash(uint64_t* hashes, const char* const bytes, size_t length)
+{
+    uint64_t first = *hashes;
+    uint64_t second = *(hashes + 1);
+    for (size_t i = 0; i < length; i++) {
+        uint8_t byte = (uint8_t)*(bytes + i);
+        first = (first ^ byte) * 0x100000001b3ull;
+        second = (second ^ byte) * 0x9e3779b97f4a7c15ull;
+        second ^= second >> 29;
+    }
+    *hashes = first;
+    *(hashes + 1) = second;
+}
+
+/**
+ * @brief Compute the cache key of a source
+ *
+ * @param key Where to write the key
+ * @param source The source text
+ * @param length Number of bytes in source
+ */
+void computeCacheKey(CacheKey* key, const char* const source, size_t length)
+{
+    char version[128];
+    int versionLength = snprintf(version, sizeof(version), "RISC-MC8 %s build %s cache %d\n", ASSEMBLER_ISA_VERSION, ASSEMBLER_BUILD_ID, CACHE_FORMAT_VERSION);
+    uint64_t hashes[2] = {0xcbf29ce484222325ull, 0x84222325cbf29ce4ull};
+    mixCacheHash(hashes, version, (size_t)versionLength);
+    mixCacheHash(hashes, source, length);
+    snprintf(key->name, sizeof(key->name), "%016" PRIx64 "%016" PRIx64, hashes[0], hashes[1]);
+}
+
+#if !defined(_WIN32)
+
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint tempCounter = 0;
+
+/**
+ * @brief Build the path of a file inside the cache directory
+ *
+ * @param dest Where to write the path, CACHE_PATH_LENGTH bytes
+ * @param directory The cache directory
+ * @param name Name of the file
+ * @param suffix Appended to name, may be empty
+ * @return true if successful, false if the path is too long
+ */
+static bool makeCachePath(char* dest, const char* const directory, const char* const name, const char* const suffix)
+{
+    int written = snprintf(dest, CACHE_PATH_LENGTH, "%s/%s%s", directory, name, suffix);
+    return written > 0 && written < CACHE_PATH_LENGTH;
+}
+
+/**
+ * @param name A directory entry name
+ * @return true if it names a cache entry, i.e. CACHE_KEY_LENGTH hex digits followed by ".o"
+ */
+static bool isEntryName(const char* const name)
+{
+    for (uint32_t i = 0; i < CACHE_KEY_LENGTH; i++) {
+        char c = *(name + i);
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return strcmp(name + CACHE_KEY_LENGTH, ".o") == 0;
+}
+
+/**
+ * @brief Write exactly length bytes to a file descriptor
+ *
+ * @param fd Where to write
+ * @param bytes The bytes to write
+ * @param length Number of bytes
+ * @return true if successful, false otherwise
+ */
+static bool writeAll(int fd, const void* bytes, size_t length)
+{
+    const uint8_t* next = (const uint8_t*)bytes;
+    while (length > 0) {
+        ssize_t written = write(fd, next, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            return false;
+        }
+        next += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+/**
+ * @brief Read exactly length bytes from a file descriptor
+ *
+ * @param fd Where to read from
+ * @param bytes Where to write the bytes
+ * @param length Number of bytes
+ * @return true if successful, false if the file ended early or could not be read
+ */
+static bool readAll(int fd, void* bytes, size_t length)
+{
+    uint8_t* next = (uint8_t*)bytes;
+    while (length > 0) {
+        ssize_t got = read(fd, next, length);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        } else if (got <= 0) {
+            return false;
+        }
+        next += got;
+        length -= (size_t)got;
+    }
+    return true;
+}
+
+/**
+ * @brief Create the cache directory if it does not exist yet
+ *
+ * @param directory The cache directory
+ */
+static void makeCacheDirectory(const char* const directory)
+{
+    mkdir(directory, 0755);  // fails harmlessly if it already exists
+}
+
+/**
+ * @brief Count a hit or a miss in the directory's stats file, shared by every process using the cache
+ *
+ * @param directory The cache directory
+ * @param hit true to count a hit, false to count a miss
+ */
+static void recordCacheResult(const char* const directory, bool hit)
+{
+    char path[CACHE_PATH_LENGTH];
+    if (!makeCachePath(path, directory, CACHE_STATS_FILE, "")) {
+        return;
+    }
+    // record locks only exclude other processes, the mutex excludes other threads of this one
+    pthread_mutex_lock(&statsMutex);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd >= 0) {
+        struct flock lock;
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = F_WRLCK;
+        lock.l_whence = SEEK_SET;
+        if (fcntl(fd, F_SETLKW, &lock) == 0) {
+            char text[64] = {0};
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            ssize_t got = pread(fd, text, sizeof(text) - 1, 0);
+            if (got > 0) {
+                sscanf(text, "%" SCNu64 " %" SCNu64, &hits, &misses);
+            }
+            hits += hit;
+            misses += !hit;
+            int length = snprintf(text, sizeof(text), "%" PRIu64 " %" PRIu64 "\n", hits, misses);
+            if (pwrite(fd, text, (size_t)length, 0) == length) {
+                ftruncate(fd, length);
+            }
+            lock.l_type = F_UNLCK;
+            fcntl(fd, F_SETLK, &lock);
+        }
+        close(fd);
+    }
+    pthread_mutex_unlock(&statsMutex);
+}
+
+/**
+ * @brief Copy the code cached for a source into a buffer
+ *
+ * @param directory The cache directory
+ * @param key Key of the source
+ * @param sourceLength Number of bytes in the source, checked against the entry as a guard against collisions
+ * @param code Buffer to append the cached code to, untouched on a miss
+ * @param relaxation Empty report to fill in with the summary of what relaxation did to the code, may be NULL
+ * @return true on a hit, false on a miss
+ */
+bool loadCachedCode(const char* const directory, const CacheKey* const key, size_t sourceLength, CodeBuffer* code, RelaxationReport* relaxation)
+{
+    char path[CACHE_PATH_LENGTH];
+    if (!makeCachePath(path, directory, key->name, ".o")) {
+        return false;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    uint8_t header[CACHE_HEADER_LENGTH];
+    uint64_t storedLength = 0;
+    bool valid = fstat(fd, &info) == 0 && info.st_size >= CACHE_HEADER_LENGTH && readAll(fd, header, CACHE_HEADER_LENGTH) && memcmp(header, CACHE_MAGIC, 4) == 0;
+    for (uint8_t i = 0; valid && i < 8; i++) {
+        storedLength |= (uint64_t)header[4 + i] << (i * 8);
+    }
+    uint32_t codeLength = 0;
+    for (uint8_t i = 0; valid && i < 4; i++) {
+        codeLength |= (uint32_t)header[12 + i] << (i * 8);
+    }
+    size_t entryLength = valid ? (size_t)info.st_size - CACHE_HEADER_LENGTH : 0;
+    valid = valid && storedLength == sourceLength && codeLength <= entryLength;
+
+    // read the whole entry before touching the buffer, so a damaged entry is just a miss
+    uint8_t* cached = valid ? (uint8_t*)malloc(entryLength > 0 ? entryLength : 1) : NULL;
+    valid = cached != NULL && readAll(fd, cached, entryLength);
+    if (valid && relaxation != NULL) {
+        valid = readRelaxationSummary(cached + codeLength, entryLength - codeLength, relaxation);
+    }
+    for (size_t i = 0; valid && i < codeLength; i++) {
+        valid = appendCode(code, *(cached + i));
+    }
+    if (valid) {
+        futimens(fd, NULL);  // mark it as recently used for eviction
+    } else if (relaxation != NULL) {
+        freeRelaxationReport(relaxation);
+    }
+    free(cached);
+    close(fd);
+    return valid;
+}
+
+/**
+ * @brief Store the code assembled from a source, atomically so concurrent readers never see a partial entry
+ *
+ * @param directory The cache directory, created if it does not exist
+ * @param key Key of the source
+ * @param sourceLength Number of bytes in the source
+ * @param code The assembled code
+ * @param relaxation What relaxation did to the code, stored with it as a summary
+ * @return true if stored, false if the cache could not be written (assembly is unaffected)
+ */
+bool storeCachedCode(const char* const directory, const CacheKey* const key, size_t sourceLength, const CodeBuffer* const code, const RelaxationReport* const relaxation)
+{
+    char path[CACHE_PATH_LENGTH];
+    char tempName[128];
+    char tempPath[CACHE_PATH_LENGTH];
+    snprintf(tempName, sizeof(tempName), CACHE_TEMP_PREFIX "%ld-%u-%s", (long)getpid(), atomic_fetch_add(&tempCounter, 1), key->name);
+    if (!makeCachePath(path, directory, key->name, ".o") || !makeCachePath(tempPath, directory, tempName, "")) {
+        return false;
+    }
+    CodeBuffer summary;
+    initGrowableCodeBuffer(&summary);
+    if (code->length > UINT32_MAX || !writeRelaxationSummary(relaxation, &summary)) {
+        freeCodeBuffer(&summary);
+        return false;
+    }
+    makeCacheDirectory(directory);
+
+    // write a private temp file then rename it into place, so readers only ever see complete entries
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        freeCodeBuffer(&summary);
+        return false;
+    }
+    uint8_t header[CACHE_HEADER_LENGTH];
+    memcpy(header, CACHE_MAGIC, 4);
+    for (uint8_t i = 0; i < 8; i++) {
+        header[4 + i] = (uint8_t)((uint64_t)sourceLength >> (i * 8));
+    }
+    for (uint8_t i = 0; i < 4; i++) {
+        header[12 + i] = (uint8_t)((uint64_t)code->length >> (i * 8));
+    }
+    bool written = writeAll(fd, header, CACHE_HEADER_LENGTH) && writeAll(fd, code->data, code->length);
+    written = written && writeAll(fd, summary.data, summary.length);
+    written = close(fd) == 0 && written;
+    freeCodeBuffer(&summary);
+    if (!written || rename(tempPath, path) != 0) {
+        unlink(tempPath);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Read the hit and miss counters and measure the entries of a cache
+ *
+ * @param directory The cache directory
+ * @param stats Where to write the statistics
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the directory could not be read
+ */
+uint8_t readCacheStats(const char* const directory, CacheStats* stats)
+{
+    memset(stats, 0, sizeof(CacheStats));
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    char path[CACHE_PATH_LENGTH];
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        struct stat info;
+        if (isEntryName(entry->d_name) && makeCachePath(path, directory, entry->d_name, "") && stat(path, &info) == 0) {
+            stats->entries++;
+            stats->bytes += (uint64_t)info.st_size;
+        }
+    }
+    closedir(dir);
+
+    if (makeCachePath(path, directory, CACHE_STATS_FILE, "")) {
+        FILE* file = fopen(path, "r");
+        if (file != NULL) {
+            if (fscanf(file, "%" SCNu64 " %" SCNu64, &stats->hits, &stats->misses) != 2) {
+                stats->hits = 0;
+                stats->misses = 0;
+            }
+            fclose(file);
+        }
+    }
+    return 0;
+}
+
+typedef struct _CacheEntry {
+    char name[CACHE_KEY_LENGTH + 3];
+    struct timespec lastUsed;
+    uint64_t size;
+} CacheEntry;
+
+/**
+ * @brief Order entries from least to most recently used, larger entries first when used at the same time
+ */
+static int compareLastUsed(const void* a, const void* b)
+{
+    const CacheEntry* first = (const CacheEntry*)a;
+    const CacheEntry* second = (const CacheEntry*)b;
+    if (first->lastUsed.tv_sec != second->lastUsed.tv_sec) {
+        return first->lastUsed.tv_sec < second->lastUsed.tv_sec ? -1 : 1;
+    } else if (first->lastUsed.tv_nsec != second->lastUsed.tv_nsec) {
+        return first->lastUsed.tv_nsec < second->lastUsed.tv_nsec ? -1 : 1;
+    }
+    return (first->size < second->size) - (first->size > second->size);
+}
+
+/**
+ * @brief Remove entries older than maxAge, then the least recently used entries until the cache fits in maxBytes
+ *
+ * @param directory The cache directory
+ * @param maxBytes Largest total size of the entries to keep, 0 for no limit
+ * @param maxAge Age in seconds since last use after which an entry is removed, 0 for no limit
+ * @param removed Set to the number of entries removed, may be NULL
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the directory could not be read
+ */
+uint8_t evictCache(const char* const directory, uint64_t maxBytes, uint64_t maxAge, uint32_t* removed)
+{
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    time_t now = time(NULL);
+    CacheEntry* entries = NULL;
+    uint32_t length = 0;
+    uint32_t capacity = 0;
+    uint32_t numRemoved = 0;
+    uint64_t totalBytes = 0;
+    uint8_t status = 0;
+    char path[CACHE_PATH_LENGTH];
+    struct dirent* entry;
+    while (status == 0 && (entry = readdir(dir)) != NULL) {
+        struct stat info;
+        bool temp = strncmp(entry->d_name, CACHE_TEMP_PREFIX, strlen(CACHE_TEMP_PREFIX)) == 0;
+        if (!(temp || isEntryName(entry->d_name)) || !makeCachePath(path, directory, entry->d_name, "") || stat(path, &info) != 0) {
+            continue;
+        }
+        uint64_t age = now > info.st_mtime ? (uint64_t)(now - info.st_mtime) : 0;
+        if (temp) {
+            if (age > CACHE_TEMP_MAX_AGE) {
+                unlink(path);
+            }
+            continue;
+        } else if (maxAge != 0 && age > maxAge) {
+            numRemoved += unlink(path) == 0;
+            continue;
+        }
+        if (length == capacity) {
+            uint32_t newCapacity = capacity == 0 ? 64 : capacity * 2;
+            CacheEntry* grown = (CacheEntry*)realloc(entries, newCapacity * sizeof(CacheEntry));
+            if (grown == NULL) {
+                status = ERROR_OUT_OF_MEMORY;
+                continue;
+            }
+            entries = grown;
+            capacity = newCapacity;
+        }
+        strcpy((entries + length)->name, entry->d_name);
+        (entries + length)->lastUsed = info.st_mtim;
+        (entries + length)->size = (uint64_t)info.st_size;
+        totalBytes += (uint64_t)info.st_size;
+        length++;
+    }
+    closedir(dir);
+
+    if (status == 0 && maxBytes != 0 && totalBytes > maxBytes) {
+        qsort(entries, length, sizeof(CacheEntry), &compareLastUsed);
+        for (uint32_t i = 0; i < length && totalBytes > maxBytes; i++) {
+            if (makeCachePath(path, directory, (entries + i)->name, "") && unlink(path) == 0) {
+                numRemoved++;
+            }
+            totalBytes -= (entries + i)->size;
+        }
+    }
+    free(entries);
+    if (removed != NULL) {
+        *removed = numRemoved;
+    }
+    return status;
+}
+
+#else
+
+static void makeCacheDirectory(const char* const directory)
+{
+}
+
+static void recordCacheResult(const char* const directory, bool hit)
+{
+}
+
+bool loadCachedCode(const char* const directory, const CacheKey* const key, size_t sourceLength, CodeBuffer* code, RelaxationReport* relaxation)
+{
+    return false;
+}
+
+bool storeCachedCode(const char* const directory, const CacheKey* const key, size_t sourceLength, const CodeBuffer* const code, const RelaxationReport* const relaxation)
+{
+    return false;
+}
+
+uint8_t readCacheStats(const char* const directory, CacheStats* stats)
+{
+    memset(stats, 0, sizeof(CacheStats));
+    return ERROR_INVALID_ARGUMENTS;
+}
+
+uint8_t evictCache(const char* const directory, uint64_t maxBytes, uint64_t maxAge, uint32_t* removed)
+{
+    return ERROR_INVALID_ARGUMENTS;
+}
+
+#endif
+
+/**
+ * @brief Assemble a source, reusing the code from an earlier run of the same source when it is in the cache
+ *
+ * @param directory The cache directory, or NULL to assemble without a cache
+ * @param source Source to assemble, read from the beginning
+ * @param code Buffer to append the assembled code to
+ * @param options How to assemble on a miss, or NULL for the two-pass defaults
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise the error that occurred
+ */
+uint8_t assembleWithCache(const char* const directory, SourceReader* source, CodeBuffer* code, const AssemblerOptions* const options, AssemblerDiagnostic* diagnostic)
+{
+    if (directory == NULL || *directory == '\0' || source->data == NULL) {
+        return assembleSource(source, code, options, diagnostic);
+    }
+    makeCacheDirectory(directory);  // before counting, so the first miss of a new cache is not lost
+    CacheKey key;
+    computeCacheKey(&key, source->data, source->length);
+    size_t startLength = code->length;
+    if (loadCachedCode(directory, &key, source->length, code, options != NULL ? options->relaxation : NULL)) {
+        recordCacheResult(directory, true);
+        uint8_t status = codeFits(code) ? 0 : ERROR_OUTPUT_TOO_SMALL;
+        setDiagnostic(diagnostic, status, 0, 0);
+        return status;
+    }
+    recordCacheResult(directory, false);
+
+    // the entry keeps what relaxation did whether or not this caller asked, so later hits can report it
+    AssemblerOptions missOptions = {ASSEMBLER_MODE_TWO_PASS, 0, NULL, NULL};
+    if (options != NULL) {
+        missOptions = *options;
+    }
+    RelaxationReport relaxation;
+    memset(&relaxation, 0, sizeof(relaxation));
+    if (missOptions.relaxation == NULL) {
+        missOptions.relaxation = &relaxation;
+    }
+    uint8_t status = assembleSource(source, code, &missOptions, diagnostic);
+    if (status == 0) {
+        // store just this source's code, in case the buffer already held something
+        CodeBuffer assembled = *code;
+        assembled.data += startLength;
+        assembled.length -= startLength;
+        storeCachedCode(directory, &key, source->length, &assembled, missOptions.relaxation);
+    }
+    freeRelaxationReport(&relaxation);
+    return status;
+}
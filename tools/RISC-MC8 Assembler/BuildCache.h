@@ -0,0 +1,111 @@
+#ifndef BUILDCACHE_H
+#define BUILDCACHE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Assembler.h"
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Source.h"
+
+// environment variable naming a cache directory, used when --cache is not given
+#define CACHE_DIRECTORY_ENVIRONMENT "RISC_MC8_ASSEMBLER_CACHE"
+// bump whenever the entry layout or the meaning of the assembled code changes, so old entries stop matching
+#define CACHE_FORMAT_VERSION 2
+// identifies the code of the assembler itself, so entries from a build that assembled differently stop matching; the
+// Makefile passes a checksum of the sources, other builds fall back to when this was compiled
+#ifndef ASSEMBLER_BUILD_ID
+#define ASSEMBLER_BUILD_ID __DATE__ " " __TIME__
+#endif
+#define CACHE_KEY_LENGTH 32
+
+/**
+ * Name of a cache entry, hex digits of a 128-bit hash of the source bytes, ISA version, assembler build and cache format
+ * version
+ */
+typedef struct _CacheKey {
+    char name[CACHE_KEY_LENGTH + 1];
+} CacheKey;
+
+typedef struct _CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t entries;
+    uint64_t bytes;
+} CacheStats;
+
+/**
+ * @brief Compute the cache key of a source
+ *
+ * @param key Where to write the key
+ * @param source The source text
+ * @param length Number of bytes in source
+ */
+void computeCacheKey(CacheKey* key, const char* const source, size_t length);
+
+/**
+ * @brief Copy the code cached for a source into a buffer
+ *
+ * @param directory The cache directory
+ * @param key Key of the source
+ * @param sourceLength Number of bytes in the source, checked against the entry as a guard against collisions
+ * @param code Buffer to append the cached code to, untouched on a miss
+ * @param relaxation Empty report to fill in with the summary of what relaxation did to the code, may be NULL
+ * @return true on a hit, false on a miss
+ */
+bool loadCachedCode(const char* const directory, const CacheKey* const key, size_t sourceLength, CodeBuffer* code, RelaxationReport* relaxation);
+
+/**
+ * @brief Store the code assembled from a source, atomically so concurrent readers never see a partial entry
+ *
+ * @param directory The cache directory, created if it does not exist
+ * @param key Key of the source
+ * @param sourceLength Number of bytes in the source
+ * @param code The assembled code
+ * @param relaxation What relaxation did to the code, stored with it as a summary
+ * @return true if stored, false if the cache could not be written (assembly is unaffected)
+ */
+bool storeCachedCode(const char* const directory, const CacheKey* const key, size_t sourceLength, const CodeBuffer* const code, const RelaxationReport* const relaxation);
+
+/**
+ * @brief Assemble a source, reusing the code from an earlier run of the same source when it is in the cache
+ *
+ * Streams cannot be hashed before they are read, so they are always assembled and never cached. Only successful
+ * results are stored, with a summary of what relaxation did so a hit can report it too. The directory is created if
+ * it does not exist.
+ *
+ * @param directory The cache directory, or NULL to assemble without a cache
+ * @param source Source to assemble, read from the beginning
+ * @param code Buffer to append the assembled code to
+ * @param options How to assemble on a miss, or NULL for the two-pass defaults, its relaxation report has no offset
+ *                maps on a hit
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise the error that occurred
+ */
+uint8_t assembleWithCache(const char* const directory, SourceReader* source, CodeBuffer* code, const AssemblerOptions* const options, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Read the hit and miss counters and measure the entries of a cache
+ *
+ * @param directory The cache directory
+ * @param stats Where to write the statistics
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the directory could not be read
+ */
+uint8_t readCacheStats(const char* const directory, CacheStats* stats);
+
+/**
+ * @brief Remove entries older than maxAge, then the least recently used entries until the cache fits in maxBytes
+ *
+ * Safe to run while other processes use the cache: a removed entry is just a miss for them.
+ *
+ * @param directory The cache directory
+ * @param maxBytes Largest total size of the entries to keep, 0 for no limit
+ * @param maxAge Age in seconds since last use after which an entry is removed, 0 for no limit
+ * @param removed Set to the number of entries removed, may be NULL
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the directory could not be read
+ */
+uint8_t evictCache(const char* const directory, uint64_t maxBytes, uint64_t maxAge, uint32_t* removed);
+
+#endif
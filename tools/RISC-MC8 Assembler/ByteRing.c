@@ -0,0 +1,115 @@
+#include "ByteRing.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StatusCodes.h"
+
+/**
+ * @brief Start an empty ring
+ *
+ * @param ring The ring to initialize
+ * @param capacity Bytes it can hold, rounded up to a power of two
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t initByteRing(ByteRing* ring, size_t capacity)
+{
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->closed, false);
+    ring->capacity = rounded;
+    ring->data = (uint8_t*)malloc(rounded);
+    return ring->data == NULL ? ERROR_OUT_OF_MEMORY : 0;
+}
+
+void freeByteRing(ByteRing* ring)
+{
+    free(ring->data);
+    ring->data = NULL;
+}
+
+/**
+ * @brief Copy as many bytes as fit into the ring (producer only)
+ *
+ * @param ring The ring to write to
+ * @param data The bytes to write
+ * @param length Number of bytes in data
+ * @return Number of bytes written, 0 if the ring is full
+ */
+size_t writeByteRing(ByteRing* ring, const uint8_t* const data, size_t length)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);  // the consumer is done with those bytes
+    size_t room = ring->capacity - (head - tail);
+    if (length > room) {
+        length = room;
+    }
+    size_t start = head & (ring->capacity - 1);
+    size_t first = ring->capacity - start < length ? ring->capacity - start : length;  // up to the wrap
+    memcpy(ring->data + start, data, first);
+    memcpy(ring->data, data + first, length - first);
+    atomic_store_explicit(&ring->head, head + length, memory_order_release);  // publish the bytes
+    return length;
+}
+
+/**
+ * @brief Copy as many bytes as are available out of the ring (consumer only)
+ *
+ * @param ring The ring to read from
+ * @param data Where to copy the bytes
+ * @param length Most bytes to read
+ * @return Number of bytes read, 0 if the ring is empty
+ */
+size_t readByteRing(ByteRing* ring, uint8_t* data, size_t length)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);  // the producer's bytes are visible
+    if (length > head - tail) {
+        length = head - tail;
+    }
+    size_t start = tail & (ring->capacity - 1);
+    size_t first = ring->capacity - start < length ? ring->capacity - start : length;
+    memcpy(data, ring->data + start, first);
+    memcpy(data + first, ring->data, length - first);
+    atomic_store_explicit(&ring->tail, tail + length, memory_order_release);  // hand the space back
+    return length;
+}
+
+/**
+ * @brief Get how many bytes the consumer could read right now
+ *
+ * @param ring The ring
+ * @return Number of bytes held
+ */
+size_t getByteRingLength(ByteRing* ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    return atomic_load_explicit(&ring->head, memory_order_acquire) - tail;
+}
+
+/**
+ * @brief Mark the end of the stream (producer only), bytes already written can still be read
+ *
+ * @param ring The ring to close
+ */
+void closeByteRing(ByteRing* ring)
+{
+    atomic_store_explicit(&ring->closed, true, memory_order_release);
+}
+
+/**
+ * @brief Check whether the ring is closed and every byte has been read (consumer only)
+ *
+ * @param ring The ring
+ * @return true if nothing more will ever be read
+ */
+bool isByteRingFinished(ByteRing* ring)
+{
+    // closed is checked first, a byte written just before closing is then seen by the length check
+    return atomic_load_explicit(&ring->closed, memory_order_acquire) && getByteRingLength(ring) == 0;
+}
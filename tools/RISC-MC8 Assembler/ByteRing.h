@@ -0,0 +1,78 @@
+#ifndef BYTERING_H
+#define BYTERING_H
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BYTE_RING_CACHE_LINE 64
+
+/**
+ * Lock-free ring buffer of bytes for exactly one producer thread and one consumer thread. head and tail count every
+ * byte ever written and read, so the buffer holds head - tail bytes and neither side ever waits on a lock. They sit
+ * on their own cache lines so the two threads do not fight over them.
+ */
+typedef struct _ByteRing {
+    _Alignas(BYTE_RING_CACHE_LINE) atomic_size_t head;  // advanced by the producer
+    _Alignas(BYTE_RING_CACHE_LINE) atomic_size_t tail;  // advanced by the consumer
+    _Alignas(BYTE_RING_CACHE_LINE) atomic_bool closed;  // the producer will write nothing more
+    uint8_t* data;
+    size_t capacity;  // a power of two
+} ByteRing;
+
+/**
+ * @brief Start an empty ring
+ *
+ * @param ring The ring to initialize
+ * @param capacity Bytes it can hold, rounded up to a power of two
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t initByteRing(ByteRing* ring, size_t capacity);
+
+void freeByteRing(ByteRing* ring);
+
+/**
+ * @brief Copy as many bytes as fit into the ring (producer only)
+ *
+ * @param ring The ring to write to
+ * @param data The bytes to write
+ * @param length Number of bytes in data
+ * @return Number of bytes written, 0 if the ring is full
+ */
+size_t writeByteRing(ByteRing* ring, const uint8_t* const data, size_t length);
+
+/**
+ * @brief Copy as many bytes as are available out of the ring (consumer only)
+ *
+ * @param ring The ring to read from
+ * @param data Where to copy the bytes
+ * @param length Most bytes to read
+ * @return Number of bytes read, 0 if the ring is empty
+ */
+size_t readByteRing(ByteRing* ring, uint8_t* data, size_t length);
+
+/**
+ * @brief Get how many bytes the consumer could read right now
+ *
+ * @param ring The ring
+ * @return Number of bytes held
+ */
+size_t getByteRingLength(ByteRing* ring);
+
+/**
+ * @brief Mark the end of the stream (producer only), bytes already written can still be read
+ *
+ * @param ring The ring to close
+ */
+void closeByteRing(ByteRing* ring);
+
+/**
+ * @brief Check whether the ring is closed and every byte has been read (consumer only)
+ *
+ * @param ring The ring
+ * @return true if nothing more will ever be read
+ */
+bool isByteRingFinished(ByteRing* ring);
+
+#endif
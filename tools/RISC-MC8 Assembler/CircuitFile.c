@@ -0,0 +1,454 @@
+#include "CircuitFile.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StatusCodes.h"
+
+#define MAX_XML_ATTRIBUTES 16
+#define MAX_XML_DEPTH 64
+
+// what an open element is, so its children know where they belong
+#define ELEMENT_OTHER 0
+#define ELEMENT_CIRCUIT 1
+#define ELEMENT_COMPONENT 2
+#define ELEMENT_APPEAR 3
+#define ELEMENT_CONTENTS 4  // an `<a>` whose value is its text
+
+/**
+ * A start tag with its attributes, names and values terminated in place
+ */
+typedef struct _XmlTag {
+    const char* name;
+    const char* attributeNames[MAX_XML_ATTRIBUTES];
+    const char* attributeValues[MAX_XML_ATTRIBUTES];
+    uint32_t numAttributes;
+    bool empty;  // `<name/>`
+} XmlTag;
+
+/**
+ * @brief Decode the five predefined entities and character references in place
+ *
+ * @param text The text to decode, terminated
+ */
+static void decodeEntities(char* text)
+{
+    static const char* const names[] = {"&lt;", "&gt;", "&amp;", "&quot;", "&apos;"};
+    static const char values[] = {'<', '>', '&', '"', '\''};
+    char* out = text;
+    for (const char* in = text; *in != '\0';) {
+        bool decoded = false;
+        if (*in == '&' && *(in + 1) == '#') {
+            char* end;
+            unsigned long code = *(in + 2) == 'x' ? strtoul(in + 3, &end, 16) : strtoul(in + 2, &end, 10);
+            if (*end == ';' && code > 0 && code < 0x80) {
+                *out++ = (char)code;
+                in = end + 1;
+                decoded = true;
+            }
+        }
+        for (uint32_t i = 0; *in == '&' && !decoded && i < sizeof(values); i++) {
+            size_t length = strlen(names[i]);
+            if (strncmp(in, names[i], length) == 0) {
+                *out++ = values[i];
+                in += length;
+                decoded = true;
+            }
+        }
+        if (!decoded) {
+            *out++ = *in++;
+        }
+    }
+    *out = '\0';
+}
+
+static bool isXmlSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * @brief Parse a start or empty-element tag, cutting its name and attributes out of the text
+ *
+ * @param cursor Points just after the `<`, moved past the `>`
+ * @param tag Receives the tag
+ * @return true if successful, false if the tag is malformed
+ */
+static bool parseXmlTag(char** cursor, XmlTag* tag)
+{
+    char* c = *cursor;
+    tag->name = c;
+    tag->numAttributes = 0;
+    tag->empty = false;
+    while (*c != '\0' && !isXmlSpace(*c) && *c != '/' && *c != '>') {
+        c++;
+    }
+    while (true) {
+        while (isXmlSpace(*c)) {
+            *c++ = '\0';
+        }
+        if (*c == '/' && *(c + 1) == '>') {
+            *c = '\0';
+            tag->empty = true;
+            *cursor = c + 2;
+            return true;
+        } else if (*c == '>') {
+            *c = '\0';
+            *cursor = c + 1;
+            return true;
+        } else if (*c == '\0' || tag->numAttributes == MAX_XML_ATTRIBUTES) {
+            return false;
+        }
+        tag->attributeNames[tag->numAttributes] = c;
+        while (*c != '\0' && *c != '=' && !isXmlSpace(*c)) {
+            c++;
+        }
+        if (*c != '=' || (*(c + 1) != '"' && *(c + 1) != '\'')) {
+            return false;
+        }
+        *c = '\0';
+        char quote = *(c + 1);
+        char* value = c + 2;
+        c = strchr(value, quote);
+        if (c == NULL) {
+            return false;
+        }
+        *c++ = '\0';
+        decodeEntities(value);
+        tag->attributeValues[tag->numAttributes++] = value;
+    }
+}
+
+/**
+ * @brief Get the value of an attribute of a tag
+ *
+ * @param tag The tag
+ * @param name Name of the attribute
+ * @return The value, NULL if the tag does not have it
+ */
+static const char* getXmlAttribute(const XmlTag* const tag, const char* const name)
+{
+    for (uint32_t i = 0; i < tag->numAttributes; i++) {
+        if (strcmp(tag->attributeNames[i], name) == 0) {
+            return tag->attributeValues[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parse a point written as `(x,y)`, `x,y` or, for a single coordinate, `x`
+ *
+ * @param text The text
+ * @param x Receives the first coordinate
+ * @param y Receives the second coordinate, NULL to parse a single one
+ * @return true if successful, false if the text is not a point
+ */
+static bool parsePoint(const char* const text, int32_t* x, int32_t* y)
+{
+    if (text == NULL) {
+        return false;
+    }
+    const char* c = *text == '(' ? text + 1 : text;
+    char* end;
+    *x = (int32_t)strtol(c, &end, 10);
+    if (end == c) {
+        return false;
+    } else if (y == NULL) {
+        return *end == '\0';
+    } else if (*end != ',') {
+        return false;
+    }
+    c = end + 1;
+    *y = (int32_t)strtol(c, &end, 10);
+    return end != c && (*end == '\0' || (*end == ')' && *(end + 1) == '\0'));
+}
+
+/**
+ * @brief Make room for one more element of an array that grows by doubling
+ *
+ * @param array The array
+ * @param length Number of elements in use
+ * @param capacity Number of elements allocated, updated
+ * @param size Size of one element
+ * @return true if successful, false if out of memory
+ */
+static bool growCircuitArray(void** array, uint32_t length, uint32_t* capacity, size_t size)
+{
+    if (length < *capacity) {
+        return true;
+    }
+    uint32_t newCapacity = *capacity == 0 ? 16 : *capacity * 2;
+    void* grown = realloc(*array, newCapacity * size);
+    if (grown == NULL) {
+        return false;
+    }
+    *array = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+/**
+ * @brief Add an attribute to the project's pool
+ *
+ * @param project The project
+ * @param name Name of the attribute
+ * @param value Its value
+ * @return true if successful, false if out of memory
+ */
+static bool addCircuitAttribute(CircuitProject* project, const char* const name, const char* const value)
+{
+    if (!growCircuitArray((void**)&project->attributes, project->numAttributes, &project->attributeCapacity, sizeof(CircuitAttribute))) {
+        return false;
+    }
+    CircuitAttribute* attribute = project->attributes + project->numAttributes++;
+    attribute->name = name;
+    attribute->value = value;
+    return true;
+}
+
+/**
+ * @brief Handle a start tag inside a circuit
+ *
+ * @param project The project
+ * @param circuit The circuit being read
+ * @param parent What the enclosing element is
+ * @param tag The tag
+ * @param kind Receives what the new element is
+ * @param anchorX Receives the anchor of a custom appearance
+ * @param anchorY Receives the anchor of a custom appearance
+ * @return 0 if successful, ERROR_MALFORMED_CIRCUIT if the element is malformed, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t readCircuitElement(CircuitProject* project, CircuitDefinition* circuit, uint8_t parent, const XmlTag* const tag, uint8_t* kind, int32_t* anchorX, int32_t* anchorY)
+{
+    *kind = ELEMENT_OTHER;
+    if (strcmp(tag->name, "a") == 0 && (parent == ELEMENT_CIRCUIT || parent == ELEMENT_COMPONENT)) {
+        const char* name = getXmlAttribute(tag, "name");
+        const char* value = getXmlAttribute(tag, "val");
+        if (name == NULL) {
+            return ERROR_MALFORMED_CIRCUIT;
+        } else if (value == NULL) {
+            if (tag->empty) {
+                return ERROR_MALFORMED_CIRCUIT;
+            }
+            value = "";  // replaced by the text content
+            *kind = ELEMENT_CONTENTS;
+        }
+        // attributes of one element must be contiguous in the pool
+        uint32_t* first = parent == ELEMENT_CIRCUIT ? &circuit->firstAttribute : &(circuit->components + circuit->numComponents - 1)->firstAttribute;
+        uint32_t* count = parent == ELEMENT_CIRCUIT ? &circuit->numAttributes : &(circuit->components + circuit->numComponents - 1)->numAttributes;
+        if (*count == 0) {
+            *first = project->numAttributes;
+        } else if (*first + *count != project->numAttributes) {
+            return ERROR_MALFORMED_CIRCUIT;
+        }
+        (*count)++;
+        return addCircuitAttribute(project, name, value) ? 0 : ERROR_OUT_OF_MEMORY;
+    } else if (strcmp(tag->name, "comp") == 0 && parent == ELEMENT_CIRCUIT) {
+        if (!growCircuitArray((void**)&circuit->components, circuit->numComponents, &circuit->componentCapacity, sizeof(CircuitComponent))) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        CircuitComponent* component = circuit->components + circuit->numComponents++;
+        memset(component, 0, sizeof(CircuitComponent));
+        const char* library = getXmlAttribute(tag, "lib");
+        for (uint32_t i = 0; library != NULL && i < project->numLibraries && component->library == NULL; i++) {
+            if (strcmp((project->libraries + i)->name, library) == 0) {
+                component->library = (project->libraries + i)->value;
+            }
+        }
+        component->name = getXmlAttribute(tag, "name");
+        if (component->name == NULL || (library != NULL && component->library == NULL) || !parsePoint(getXmlAttribute(tag, "loc"), &component->x, &component->y)) {
+            return ERROR_MALFORMED_CIRCUIT;
+        }
+        *kind = ELEMENT_COMPONENT;
+    } else if (strcmp(tag->name, "wire") == 0 && parent == ELEMENT_CIRCUIT) {
+        if (!growCircuitArray((void**)&circuit->wires, circuit->numWires, &circuit->wireCapacity, sizeof(CircuitWire))) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        CircuitWire* wire = circuit->wires + circuit->numWires++;
+        if (!parsePoint(getXmlAttribute(tag, "from"), &wire->x0, &wire->y0) || !parsePoint(getXmlAttribute(tag, "to"), &wire->x1, &wire->y1)) {
+            return ERROR_MALFORMED_CIRCUIT;
+        }
+    } else if (strcmp(tag->name, "appear") == 0 && parent == ELEMENT_CIRCUIT) {
+        *kind = ELEMENT_APPEAR;
+    } else if (strcmp(tag->name, "circ-port") == 0 && parent == ELEMENT_APPEAR) {
+        if (!growCircuitArray((void**)&circuit->ports, circuit->numPorts, &circuit->portCapacity, sizeof(CircuitPort))) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        CircuitPort* port = circuit->ports + circuit->numPorts++;
+        if (!parsePoint(getXmlAttribute(tag, "pin"), &port->pinX, &port->pinY) || !parsePoint(getXmlAttribute(tag, "x"), &port->x, NULL) || !parsePoint(getXmlAttribute(tag, "y"), &port->y, NULL)) {
+            return ERROR_MALFORMED_CIRCUIT;
+        }
+    } else if (strcmp(tag->name, "circ-anchor") == 0 && parent == ELEMENT_APPEAR) {
+        if (!parsePoint(getXmlAttribute(tag, "x"), anchorX, NULL) || !parsePoint(getXmlAttribute(tag, "y"), anchorY, NULL)) {
+            return ERROR_MALFORMED_CIRCUIT;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse a Logisim-evolution project
+ *
+ * Only the parts that describe the circuits are kept: each circuit's attributes, components with their attributes,
+ * wires, and the ports of custom appearances. Libraries, toolbars and drawings are skipped.
+ *
+ * @param data The XML text
+ * @param length Length of data
+ * @param project The project to fill in
+ * @return 0 if successful, ERROR_MALFORMED_CIRCUIT if the XML is malformed, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t readCircuitProject(const char* const data, size_t length, CircuitProject* project)
+{
+    memset(project, 0, sizeof(CircuitProject));
+    project->text = (char*)malloc(length + 1);
+    if (project->text == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(project->text, data, length);
+    project->text[length] = '\0';
+
+    uint8_t stack[MAX_XML_DEPTH];
+    uint32_t depth = 0;
+    CircuitDefinition* circuit = NULL;
+    int32_t anchorX = 0;
+    int32_t anchorY = 0;
+    uint8_t status = 0;
+    char* cursor = project->text;
+    while (status == 0 && (cursor = strchr(cursor, '<')) != NULL) {
+        char* text = cursor;  // text content of an element ends here
+        cursor++;
+        if (strncmp(cursor, "!--", 3) == 0) {
+            cursor = strstr(cursor, "-->");
+            status = cursor == NULL ? ERROR_MALFORMED_CIRCUIT : 0;
+        } else if (*cursor == '?' || *cursor == '!') {
+            cursor = strchr(cursor, '>');
+            status = cursor == NULL ? ERROR_MALFORMED_CIRCUIT : 0;
+        } else if (*cursor == '/') {
+            if (depth == 0) {
+                status = ERROR_MALFORMED_CIRCUIT;
+            } else if (stack[--depth] == ELEMENT_CONTENTS) {
+                *text = '\0';
+                CircuitAttribute* attribute = project->attributes + project->numAttributes - 1;
+                char* value = (char*)attribute->value;
+                decodeEntities(value);
+            } else if (stack[depth] == ELEMENT_CIRCUIT) {
+                // custom appearance ports are kept relative to the anchor, which is where instances are placed
+                for (uint32_t i = 0; i < circuit->numPorts; i++) {
+                    (circuit->ports + i)->x -= anchorX;
+                    (circuit->ports + i)->y -= anchorY;
+                }
+                circuit = NULL;
+            }
+            cursor = strchr(cursor, '>');
+            status = cursor == NULL ? ERROR_MALFORMED_CIRCUIT : 0;
+        } else {
+            XmlTag tag;
+            if (!parseXmlTag(&cursor, &tag)) {
+                status = ERROR_MALFORMED_CIRCUIT;
+                break;
+            }
+            uint8_t kind = ELEMENT_OTHER;
+            uint8_t parent = depth == 0 ? ELEMENT_OTHER : stack[depth - 1];
+            if (strcmp(tag.name, "main") == 0) {
+                project->mainName = getXmlAttribute(&tag, "name");
+            } else if (strcmp(tag.name, "lib") == 0 && circuit == NULL) {
+                const char* name = getXmlAttribute(&tag, "name");
+                const char* description = getXmlAttribute(&tag, "desc");
+                if (name == NULL || description == NULL) {
+                    status = ERROR_MALFORMED_CIRCUIT;
+                } else if (!growCircuitArray((void**)&project->libraries, project->numLibraries, &project->libraryCapacity, sizeof(CircuitAttribute))) {
+                    status = ERROR_OUT_OF_MEMORY;
+                } else {
+                    (project->libraries + project->numLibraries)->name = name;
+                    (project->libraries + project->numLibraries++)->value = description;
+                }
+            } else if (strcmp(tag.name, "circuit") == 0 && circuit == NULL) {
+                if (!growCircuitArray((void**)&project->circuits, project->numCircuits, &project->circuitCapacity, sizeof(CircuitDefinition))) {
+                    status = ERROR_OUT_OF_MEMORY;
+                    break;
+                }
+                circuit = project->circuits + project->numCircuits++;
+                memset(circuit, 0, sizeof(CircuitDefinition));
+                circuit->name = getXmlAttribute(&tag, "name");
+                status = circuit->name == NULL ? ERROR_MALFORMED_CIRCUIT : 0;
+                anchorX = 0;
+                anchorY = 0;
+                kind = ELEMENT_CIRCUIT;
+            } else if (circuit != NULL) {
+                status = readCircuitElement(project, circuit, parent, &tag, &kind, &anchorX, &anchorY);
+                if (kind == ELEMENT_CONTENTS) {
+                    (project->attributes + project->numAttributes - 1)->value = cursor;
+                }
+            }
+            if (!tag.empty) {
+                if (depth == MAX_XML_DEPTH) {
+                    status = ERROR_MALFORMED_CIRCUIT;
+                } else {
+                    stack[depth++] = kind;
+                }
+            } else if (kind == ELEMENT_CIRCUIT) {
+                circuit = NULL;
+            }
+        }
+    }
+    if (status == 0 && (depth != 0 || project->numCircuits == 0)) {
+        status = ERROR_MALFORMED_CIRCUIT;
+    }
+    if (status != 0) {
+        freeCircuitProject(project);
+    }
+    return status;
+}
+
+void freeCircuitProject(CircuitProject* project)
+{
+    for (uint32_t i = 0; i < project->numCircuits; i++) {
+        free((project->circuits + i)->components);
+        free((project->circuits + i)->wires);
+        free((project->circuits + i)->ports);
+    }
+    free(project->circuits);
+    free(project->libraries);
+    free(project->attributes);
+    free(project->text);
+    memset(project, 0, sizeof(CircuitProject));
+}
+
+/**
+ * @brief Find a circuit of the project by name
+ *
+ * @param project The project
+ * @param name Name of the circuit
+ * @return The circuit, NULL if there is none with that name
+ */
+const CircuitDefinition* findCircuit(const CircuitProject* const project, const char* const name)
+{
+    for (uint32_t i = 0; i < project->numCircuits; i++) {
+        if (strcmp((project->circuits + i)->name, name) == 0) {
+            return project->circuits + i;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Look up an attribute
+ *
+ * @param project The project holding the attributes
+ * @param first Index of the first attribute of the component or circuit
+ * @param count Number of attributes it has
+ * @param name Name of the attribute
+ * @return Its value, NULL if it was not saved
+ */
+const char* findCircuitAttribute(const CircuitProject* const project, uint32_t first, uint32_t count, const char* const name)
+{
+    for (uint32_t i = first; i < first + count; i++) {
+        if (strcmp((project->attributes + i)->name, name) == 0) {
+            return (project->attributes + i)->value;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,117 @@
+#ifndef CIRCUITFILE_H
+#define CIRCUITFILE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * One `<a name="..." val="..."/>` of a component or circuit. Attributes missing from the file have their default value
+ * (see GateNetlist.c), Logisim only saves the ones that differ.
+ */
+typedef struct _CircuitAttribute {
+    const char* name;
+    const char* value;  // entities already decoded, the text content for `<a name="contents">...</a>`
+} CircuitAttribute;
+
+/**
+ * A placed component. Built-in components name their library, subcircuits have none.
+ */
+typedef struct _CircuitComponent {
+    const char* library;  // description of its library such as "#Gates", NULL for another circuit of the project
+    const char* name;     // such as "AND Gate", or the subcircuit's name
+    int32_t x;
+    int32_t y;
+    uint32_t firstAttribute;  // index into CircuitProject.attributes
+    uint32_t numAttributes;
+} CircuitComponent;
+
+/**
+ * A wire segment. Wires connect at their ends only, Logisim splits them wherever another wire or a component meets
+ * them in the middle.
+ */
+typedef struct _CircuitWire {
+    int32_t x0;
+    int32_t y0;
+    int32_t x1;
+    int32_t y1;
+} CircuitWire;
+
+/**
+ * Where a pin of a circuit with a custom appearance is drawn on instances of it (`<circ-port>`)
+ */
+typedef struct _CircuitPort {
+    int32_t pinX;  // location of the Pin component inside the circuit
+    int32_t pinY;
+    int32_t x;  // location on the appearance, relative to the anchor once loaded
+    int32_t y;
+} CircuitPort;
+
+typedef struct _CircuitDefinition {
+    const char* name;
+    uint32_t firstAttribute;
+    uint32_t numAttributes;
+    CircuitComponent* components;
+    uint32_t numComponents;
+    uint32_t componentCapacity;
+    CircuitWire* wires;
+    uint32_t numWires;
+    uint32_t wireCapacity;
+    CircuitPort* ports;  // only for custom appearances
+    uint32_t numPorts;
+    uint32_t portCapacity;
+} CircuitDefinition;
+
+/**
+ * A Logisim-evolution project (.circ). Every string points into one decoded copy of the file.
+ */
+typedef struct _CircuitProject {
+    char* text;
+    CircuitAttribute* libraries;  // `<lib name="1" desc="#Gates"/>` as name and value
+    uint32_t numLibraries;
+    uint32_t libraryCapacity;
+    CircuitAttribute* attributes;
+    uint32_t numAttributes;
+    uint32_t attributeCapacity;
+    CircuitDefinition* circuits;
+    uint32_t numCircuits;
+    uint32_t circuitCapacity;
+    const char* mainName;  // the circuit named by `<main>`, NULL if there is none
+} CircuitProject;
+
+/**
+ * @brief Parse a Logisim-evolution project
+ *
+ * Only the parts that describe the circuits are kept: each circuit's attributes, components with their attributes,
+ * wires, and the ports of custom appearances. Libraries, toolbars and drawings are skipped.
+ *
+ * @param data The XML text
+ * @param length Length of data
+ * @param project The project to fill in
+ * @return 0 if successful, ERROR_MALFORMED_CIRCUIT if the XML is malformed, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t readCircuitProject(const char* const data, size_t length, CircuitProject* project);
+
+void freeCircuitProject(CircuitProject* project);
+
+/**
+ * @brief Find a circuit of the project by name
+ *
+ * @param project The project
+ * @param name Name of the circuit
+ * @return The circuit, NULL if there is none with that name
+ */
+const CircuitDefinition* findCircuit(const CircuitProject* const project, const char* const name);
+
+/**
+ * @brief Look up an attribute
+ *
+ * @param project The project holding the attributes
+ * @param first Index of the first attribute of the component or circuit
+ * @param count Number of attributes it has
+ * @param name Name of the attribute
+ * @return Its value, NULL if it was not saved
+ */
+const char* findCircuitAttribute(const CircuitProject* const project, uint32_t first, uint32_t count, const char* const name);
+
+#endif
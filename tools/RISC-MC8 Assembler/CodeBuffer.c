@@ -0,0 +1,120 @@
+#include "CodeBuffer.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "AssemblerStats.h"
+
+/**
+ * @brief Start an empty growable buffer
+ *
+ * @param buffer The buffer to initialize
+ */
+void initGrowableCodeBuffer(CodeBuffer* buffer)
+{
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+    buffer->fixed = false;
+}
+
+/**
+ * @brief Start an empty buffer over caller-provided memory
+ *
+ * @param buffer The buffer to initialize
+ * @param data Memory to write code into
+ * @param capacity Number of bytes available at data
+ */
+void initFixedCodeBuffer(CodeBuffer* buffer, uint8_t* data, size_t capacity)
+{
+    buffer->data = data;
+    buffer->length = 0;
+    buffer->capacity = data == NULL ? 0 : capacity;
+    buffer->fixed = true;
+}
+
+/**
+ * @brief Make room for at least total bytes of code, for when the size is known up front
+ *
+ * @param buffer The buffer to grow
+ * @param total Number of bytes needed
+ * @return true if the room is available, false if out of memory or a fixed buffer is too small
+ */
+bool reserveCode(CodeBuffer* buffer, size_t total)
+{
+    if (total <= buffer->capacity) {
+        return true;
+    } else if (buffer->fixed) {
+        return false;
+    }
+    size_t newCapacity = buffer->capacity == 0 ? 256 : buffer->capacity;
+    while (newCapacity < total) {
+        newCapacity *= 2;
+    }
+    uint8_t* grown = (uint8_t*)realloc(buffer->data, newCapacity);
+    if (grown == NULL) {
+        return false;
+    }
+    countAllocation(newCapacity);
+    buffer->data = grown;
+    buffer->capacity = newCapacity;
+    return true;
+}
+
+/**
+ * @brief Append one instruction
+ *
+ * @param buffer The buffer to append to
+ * @param instruction The instruction to append
+ * @return true if successful, false if out of memory (a full fixed buffer only counts the byte and returns true)
+ */
+bool appendCode(CodeBuffer* buffer, uint8_t instruction)
+{
+    if (buffer->length == buffer->capacity && !buffer->fixed && !reserveCode(buffer, buffer->length + 1)) {
+        return false;
+    }
+    if (buffer->length < buffer->capacity) {
+        *(buffer->data + buffer->length) = instruction;
+    }
+    buffer->length++;
+    return true;
+}
+
+/**
+ * @brief OR bits into an instruction that was already appended, used to backpatch JUMP offsets
+ *
+ * @param buffer The buffer holding the instruction
+ * @param offset Offset of the instruction
+ * @param bits The bits to set
+ */
+void patchCode(CodeBuffer* buffer, uint32_t offset, uint8_t bits)
+{
+    if (offset < buffer->capacity) {
+        *(buffer->data + offset) |= bits;
+    }
+}
+
+/**
+ * @param buffer The buffer to check
+ * @return true if every byte of code emitted so far fit in the buffer
+ */
+bool codeFits(const CodeBuffer* const buffer)
+{
+    return buffer->length <= buffer->capacity;
+}
+
+/**
+ * @brief Free a growable buffer's memory (fixed buffers are left alone)
+ *
+ * @param buffer The buffer to free
+ */
+void freeCodeBuffer(CodeBuffer* buffer)
+{
+    if (!buffer->fixed) {
+        free(buffer->data);
+    }
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef CODEBUFFER_H
+#define CODEBUFFER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Destination for assembled code. A growable buffer owns its memory and reallocates as code is added. A fixed buffer
+ * writes into caller-provided memory and keeps counting past the end, so the caller learns how much room is needed.
+ */
+typedef struct _CodeBuffer {
+    uint8_t* data;
+    size_t length;  // bytes of code emitted, may exceed capacity for a fixed buffer
+    size_t capacity;
+    bool fixed;
+} CodeBuffer;
+
+/**
+ * @brief Start an empty growable buffer
+ *
+ * @param buffer The buffer to initialize
+ */
+void initGrowableCodeBuffer(CodeBuffer* buffer);
+
+/**
+ * @brief Start an empty buffer over caller-provided memory
+ *
+ * @param buffer The buffer to initialize
+ * @param data Memory to write code into
+ * @param capacity Number of bytes available at data
+ */
+void initFixedCodeBuffer(CodeBuffer* buffer, uint8_t* data, size_t capacity);
+
+/**
+ * @brief Make room for at least total bytes of code, for when the size is known up front
+ *
+ * @param buffer The buffer to grow
+ * @param total Number of bytes needed
+ * @return true if the room is available, false if out of memory or a fixed buffer is too small
+ */
+bool reserveCode(CodeBuffer* buffer, size_t total);
+
+/**
+ * @brief Append one instruction
+ *
+ * @param buffer The buffer to append to
+ * @param instruction The instruction to append
+ * @return true if successful, false if out of memory (a full fixed buffer only counts the byte and returns true)
+ */
+bool appendCode(CodeBuffer* buffer, uint8_t instruction);
+
+/**
+ * @brief OR bits into an instruction that was already appended, used to backpatch JUMP offsets
+ *
+ * @param buffer The buffer holding the instruction
+ * @param offset Offset of the instruction
+ * @param bits The bits to set
+ */
+void patchCode(CodeBuffer* buffer, uint32_t offset, uint8_t bits);
+
+/**
+ * @param buffer The buffer to check
+ * @return true if every byte of code emitted so far fit in the buffer
+ */
+bool codeFits(const CodeBuffer* const buffer);
+
+/**
+ * @brief Free a growable buffer's memory (fixed buffers are left alone)
+ *
+ * @param buffer The buffer to free
+ */
+void freeCodeBuffer(CodeBuffer* buffer);
+
+#endif
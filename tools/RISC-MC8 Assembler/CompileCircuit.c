@@ -0,0 +1,386 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "CircuitFile.h"
+#include "Diagnostics.h"
+#include "GateNetlist.h"
+#include "Source.h"
+#include "StatusCodes.h"
+
+/*
+ * Build-time compiler from a Logisim-evolution circuit to C for GateSim. The circuit is flattened to single-bit ops
+ * (GateNetlist.c), and each becomes one 64-bit bitwise statement, so 64 machines run in the bits of every word.
+ */
+
+#define USAGE "Expected arguments: circuit.circ\n"
+
+// where a signal's value comes from in the generated code
+#define SOURCE_FLOATING 0
+#define SOURCE_FIXED 1
+#define SOURCE_FLIP_FLOP 2
+#define SOURCE_OP 3
+#define SOURCE_MEMORY 4
+
+typedef struct _SignalSource {
+    uint8_t kind;
+    bool clocked;    // an op the clocks depend on
+    uint32_t index;  // flip-flop, or memory
+    uint32_t bit;    // of the memory's data
+} SignalSource;
+
+/**
+ * @brief Print a string as a C string literal
+ */
+static void printCString(const char* const text)
+{
+    putchar('"');
+    for (const char* c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            printf("\\%c", *c);
+        } else {
+            putchar(*c >= ' ' && *c <= '~' ? *c : '?');
+        }
+    }
+    putchar('"');
+}
+
+/**
+ * @brief Print the expression for a signal
+ *
+ * @param sources Where each signal comes from
+ * @param signal The signal
+ * @param afterEdge true for its value once the clock has changed, which differs for the clock and the ops it feeds
+ */
+static void printSignal(const SignalSource* const sources, uint32_t signal, bool afterEdge)
+{
+    const SignalSource* source = sources + signal;
+    switch (source->kind) {
+    case SOURCE_FIXED:
+        printf("%s", signal == GATE_SIGNAL_ONE ? "GATE_ONES" : signal == GATE_SIGNAL_CLOCK ? (afterEdge ? "next" : "clock") : "0");
+        break;
+    case SOURCE_FLIP_FLOP:
+        printf("f%" PRIu32, source->index);
+        break;
+    case SOURCE_OP:
+        printf("%c%" PRIu32, afterEdge && source->clocked ? 'c' : 's', signal);
+        break;
+    case SOURCE_MEMORY:
+        printf("m%" PRIu32 "[%" PRIu32 "]", source->index, source->bit);
+        break;
+    default:
+        printf("0");
+        break;
+    }
+}
+
+/**
+ * @brief Mark a signal as needed before or after the clock changes
+ *
+ * @param sources Where each signal comes from
+ * @param settled Signals needed as they are before the clock changes, updated
+ * @param edged Signals needed as they are after, updated
+ * @param signal The signal
+ * @param afterEdge Which value is needed
+ */
+static void markSignal(const SignalSource* const sources, bool* settled, bool* edged, uint32_t signal, bool afterEdge)
+{
+    if (afterEdge && (sources + signal)->kind == SOURCE_OP && (sources + signal)->clocked) {
+        *(edged + signal) = true;
+    } else if (!(afterEdge && signal == GATE_SIGNAL_CLOCK)) {
+        *(settled + signal) = true;
+    }
+}
+
+/**
+ * @brief Print one op as a declaration
+ */
+static void printOp(const SignalSource* const sources, const GateOp* const op, bool afterEdge)
+{
+    printf("    const uint64_t %c%" PRIu32 " = ", afterEdge ? 'c' : 's', op->output);
+    switch (op->kind) {
+    case GATE_OP_COPY:
+        printSignal(sources, op->inputs[0], afterEdge);
+        break;
+    case GATE_OP_NOT:
+        printf("~");
+        printSignal(sources, op->inputs[0], afterEdge);
+        break;
+    case GATE_OP_MUX:
+        printSignal(sources, op->inputs[1], afterEdge);
+        printf(" ^ (");
+        printSignal(sources, op->inputs[0], afterEdge);
+        printf(" & (");
+        printSignal(sources, op->inputs[1], afterEdge);
+        printf(" ^ ");
+        printSignal(sources, op->inputs[2], afterEdge);
+        printf("))");
+        break;
+    default:
+        printSignal(sources, op->inputs[0], afterEdge);
+        printf(" %s ", op->kind == GATE_OP_AND ? "&" : op->kind == GATE_OP_OR ? "|" : "^");
+        printSignal(sources, op->inputs[1], afterEdge);
+        break;
+    }
+    printf(";\n");
+}
+
+/**
+ * @brief Print the signals of a bus as an array initializer
+ */
+static void printBus(const SignalSource* const sources, const uint32_t* const signals, uint32_t width)
+{
+    printf("{");
+    for (uint32_t bit = 0; bit < width; bit++) {
+        printf(bit == 0 ? "" : ", ");
+        printSignal(sources, *(signals + bit), false);
+    }
+    printf("}");
+}
+
+/**
+ * @brief Print the edge mask of a clock input: the machines whose clock input just changed the way it triggers on
+ *
+ * @param sources Where each signal comes from
+ * @param input Index of the clock input in GateSim.clockInputs
+ * @param falling Whether it triggers on the falling edge
+ * @param enable Signal that must also be high, GATE_SIGNAL_ONE if none
+ */
+static void printEdge(const SignalSource* const sources, uint32_t input, bool falling, uint32_t enable)
+{
+    printf("            const uint64_t edge = %slast[%" PRIu32 "] & %snow", falling ? "" : "~", input, falling ? "~" : "");
+    if (enable != GATE_SIGNAL_ONE) {
+        printf(" & ");
+        printSignal(sources, enable, false);
+    }
+    printf(";\n");
+}
+
+/**
+ * @brief Print the C for a netlist
+ *
+ * @param netlist The netlist
+ * @param path Path of the circuit it was built from
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t emitCircuit(const GateNetlist* const netlist, const char* const path)
+{
+    SignalSource* sources = calloc(netlist->numSignals + 1, sizeof(SignalSource));
+    bool* settled = calloc(netlist->numSignals + 1, sizeof(bool));
+    bool* edged = calloc(netlist->numSignals + 1, sizeof(bool));
+    if (sources == NULL || settled == NULL || edged == NULL) {
+        free(sources);
+        free(settled);
+        free(edged);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    for (uint32_t i = 0; i < GATE_NUM_FIXED_SIGNALS; i++) {
+        (sources + i)->kind = SOURCE_FIXED;
+    }
+    for (uint32_t i = 0; i < netlist->numFlipFlops; i++) {
+        (sources + *(netlist->flipFlopOutputs + i))->kind = SOURCE_FLIP_FLOP;
+        (sources + *(netlist->flipFlopOutputs + i))->index = i;
+    }
+    for (uint32_t i = 0; i < netlist->numOps; i++) {
+        const GateOp* op = netlist->ops + i;
+        if (op->kind == GATE_OP_READ) {
+            const GateMemory* memory = netlist->memories + op->inputs[0];
+            for (uint32_t bit = 0; bit < memory->dataBits; bit++) {
+                (sources + memory->dataOut[bit])->kind = SOURCE_MEMORY;
+                (sources + memory->dataOut[bit])->index = op->inputs[0];
+                (sources + memory->dataOut[bit])->bit = bit;
+            }
+        } else {
+            (sources + op->output)->kind = SOURCE_OP;
+            (sources + op->output)->clocked = op->clocked;
+        }
+    }
+
+    // only declare what is used, so the generated code compiles without warnings
+    for (uint32_t i = 0; i < netlist->numRegisters; i++) {
+        const GateRegister* reg = netlist->registers + i;
+        markSignal(sources, settled, edged, reg->clock, true);
+        markSignal(sources, settled, edged, reg->enable, false);
+        markSignal(sources, settled, edged, reg->clear, false);
+        for (uint32_t bit = 0; bit < reg->width; bit++) {
+            markSignal(sources, settled, edged, *(netlist->flipFlopInputs + reg->firstFlipFlop + bit), false);
+        }
+    }
+    for (uint32_t i = 0; i < netlist->numMemories; i++) {
+        const GateMemory* memory = netlist->memories + i;
+        for (uint32_t bit = 0; bit < memory->addressBits; bit++) {
+            markSignal(sources, settled, edged, memory->address[bit], false);
+        }
+        if (memory->writable) {
+            markSignal(sources, settled, edged, memory->clock, true);
+            markSignal(sources, settled, edged, memory->writeEnable, false);
+            for (uint32_t bit = 0; bit < memory->dataBits; bit++) {
+                markSignal(sources, settled, edged, memory->dataIn[bit], false);
+            }
+        }
+    }
+    for (uint32_t i = netlist->numOps; i-- > 0;) {
+        const GateOp* op = netlist->ops + i;
+        uint32_t numInputs = op->kind == GATE_OP_COPY || op->kind == GATE_OP_NOT ? 1 : op->kind == GATE_OP_MUX ? 3 : 2;
+        for (uint32_t j = 0; j < numInputs && op->kind != GATE_OP_READ; j++) {
+            if (*(edged + op->output)) {
+                markSignal(sources, settled, edged, op->inputs[j], true);
+            }
+            if (*(settled + op->output)) {
+                markSignal(sources, settled, edged, op->inputs[j], false);
+            }
+        }
+    }
+
+    printf("// Generated by compile-risc-mc8-circuit from %s, do not edit.\n\n", path);
+    printf("#include \"GateSim.h\"\n\n");
+    for (uint32_t i = 0; i < netlist->numMemories; i++) {
+        const GateMemory* memory = netlist->memories + i;
+        uint32_t size = 1u << memory->addressBits;
+        printf("static const uint8_t contents%" PRIu32 "[%" PRIu32 "] = {", i, size);
+        for (uint32_t a = 0; a < size; a++) {
+            printf("%s0x%02X", a == 0 ? "\n    " : a % 16 == 0 ? ",\n    " : ", ", *(memory->contents + a));
+        }
+        printf("\n};\n\n");
+    }
+    printf("static const GateRegisterInfo registers[] = {\n");
+    for (uint32_t i = 0; i < netlist->numRegisters; i++) {
+        const GateRegister* reg = netlist->registers + i;
+        printf("    {");
+        printCString(reg->name);
+        printf(", %" PRIu32 ", %" PRIu32 "},\n", reg->width, reg->firstFlipFlop);
+    }
+    printf("};\n\nstatic const GateMemoryInfo memories[] = {\n");
+    for (uint32_t i = 0; i < netlist->numMemories; i++) {
+        const GateMemory* memory = netlist->memories + i;
+        printf("    {");
+        printCString(memory->name);
+        printf(", %" PRIu32 ", %" PRIu32 ", %s, contents%" PRIu32 "},\n", memory->addressBits, memory->dataBits, memory->writable ? "true" : "false", i);
+    }
+    printf("};\n\n");
+
+    printf("/**\n * @brief Settle the circuit, change the clock and latch whatever triggers on that edge\n *\n");
+    printf(" * @param sim The simulator\n * @param latch false to only record the clock inputs, leaving the clock as it is\n */\n");
+    printf("static inline void halfCycle(GateSim* sim, bool latch)\n{\n");
+    printf("    uint64_t* restrict q = sim->flipFlops;\n    uint64_t* restrict last = sim->clockInputs;\n");
+    printf("    const uint64_t clock = sim->clock;\n    const uint64_t next = latch ? ~clock : clock;\n");
+    for (uint32_t i = 0; i < netlist->numFlipFlops; i++) {
+        if (*(settled + *(netlist->flipFlopOutputs + i))) {
+            printf("    const uint64_t f%" PRIu32 " = q[%" PRIu32 "];\n", i, i);
+        }
+    }
+    for (uint32_t i = 0; i < netlist->numMemories; i++) {
+        printf("    uint64_t m%" PRIu32 "[%" PRIu32 "];\n", i, (netlist->memories + i)->dataBits);
+    }
+    for (uint32_t i = 0; i < netlist->numOps; i++) {
+        const GateOp* op = netlist->ops + i;
+        if (op->kind == GATE_OP_READ) {
+            const GateMemory* memory = netlist->memories + op->inputs[0];
+            printf("    {\n        const uint64_t address[] = ");
+            printBus(sources, memory->address, memory->addressBits);
+            printf(";\n        readGateMemory(sim->memories[%" PRIu32 "], %" PRIu32 ", %" PRIu32 ", address, m%" PRIu32 ");\n    }\n", op->inputs[0], memory->addressBits, memory->dataBits, op->inputs[0]);
+        } else if (*(settled + op->output)) {
+            printOp(sources, op, false);
+        }
+    }
+    for (uint32_t i = 0; i < netlist->numOps; i++) {
+        const GateOp* op = netlist->ops + i;
+        if (op->kind != GATE_OP_READ && *(edged + op->output)) {
+            printOp(sources, op, true);
+        }
+    }
+    for (uint32_t i = 0; i < netlist->numRegisters; i++) {
+        const GateRegister* reg = netlist->registers + i;
+        printf("    {  // ");
+        printCString(reg->name);
+        printf("\n        const uint64_t now = ");
+        printSignal(sources, reg->clock, true);
+        printf(";\n        if (latch) {\n");
+        printEdge(sources, i, reg->falling, reg->enable);
+        for (uint32_t bit = 0; bit < reg->width; bit++) {
+            uint32_t flipFlop = reg->firstFlipFlop + bit;
+            printf("            q[%" PRIu32 "] = (q[%" PRIu32 "] & ~edge) | (", flipFlop, flipFlop);
+            printSignal(sources, *(netlist->flipFlopInputs + flipFlop), false);
+            printf(" & edge)");
+            if (reg->clear != GATE_SIGNAL_ZERO) {
+                printf(" & ~");
+                printSignal(sources, reg->clear, false);
+            }
+            printf(";\n");
+        }
+        printf("        }\n        last[%" PRIu32 "] = now;\n    }\n", i);
+    }
+    for (uint32_t i = 0; i < netlist->numMemories; i++) {
+        const GateMemory* memory = netlist->memories + i;
+        if (!memory->writable) {
+            continue;
+        }
+        uint32_t input = netlist->numRegisters + i;
+        printf("    {  // ");
+        printCString(memory->name);
+        printf("\n        const uint64_t now = ");
+        printSignal(sources, memory->clock, true);
+        printf(";\n        if (latch) {\n");
+        printEdge(sources, input, memory->falling, memory->writeEnable);
+        printf("            if (edge != 0) {\n                const uint64_t address[] = ");
+        printBus(sources, memory->address, memory->addressBits);
+        printf(";\n                const uint64_t data[] = ");
+        printBus(sources, memory->dataIn, memory->dataBits);
+        printf(";\n                writeGateMemory(sim->memories[%" PRIu32 "], %" PRIu32 ", %" PRIu32 ", address, data, edge);\n            }\n", i, memory->addressBits, memory->dataBits);
+        printf("        }\n        last[%" PRIu32 "] = now;\n    }\n", input);
+    }
+    printf("    sim->clock = next;\n}\n\n");
+
+    printf("static void run(GateSim* sim, uint64_t halfCycles)\n{\n");
+    printf("    for (uint64_t i = 0; i < halfCycles; i++) {\n        halfCycle(sim, true);\n    }\n}\n\n");
+    printf("static void prime(GateSim* sim)\n{\n    halfCycle(sim, false);\n}\n\n");
+    printf("const GateCircuitInfo gateCircuit = {\n    ");
+    printCString(path);
+    printf(",\n    %" PRIu32 ",\n    %" PRIu32 ",\n    %" PRIu32 ",\n", netlist->numOps, netlist->numFlipFlops, netlist->numRegisters + netlist->numMemories);
+    printf("    registers,\n    %" PRIu32 ",\n    memories,\n    %" PRIu32 ",\n    &run,\n    &prime,\n};\n", netlist->numRegisters, netlist->numMemories);
+    free(sources);
+    free(settled);
+    free(edged);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, USAGE);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    SourceReader source;
+    if (openSourceFile(&source, argv[1]) != 0) {
+        fprintf(stderr, "Error: Input file does not exist.\n");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    CircuitProject project;
+    uint8_t status = readCircuitProject(source.data != NULL ? source.data : "", source.length, &project);
+    closeSource(&source);
+    if (status != 0) {
+        fprintf(stderr, "Error: %s in %s.\n", getStatusMessage(status), argv[1]);
+        return status;
+    }
+    GateNetlist netlist;
+    GateDiagnostic diagnostic;
+    status = buildGateNetlist(&project, &netlist, &diagnostic);
+    if (status != 0) {
+        if (diagnostic.circuit == NULL) {
+            fprintf(stderr, "Error: %s in %s.\n", getStatusMessage(status), argv[1]);
+        } else {
+            fprintf(stderr, "Error: %s at (%" PRId32 ",%" PRId32 ") in circuit %s%s%s.\n", getStatusMessage(status), diagnostic.x, diagnostic.y, diagnostic.circuit,
+                    diagnostic.component != NULL ? ", component " : "", diagnostic.component != NULL ? diagnostic.component : "");
+        }
+    } else {
+        status = emitCircuit(&netlist, argv[1]);
+        if (status != 0) {
+            fprintf(stderr, "Error: %s.\n", getStatusMessage(status));
+        }
+        fprintf(stderr, "%" PRIu32 " ops, %" PRIu32 " flip-flops in %" PRIu32 " registers, %" PRIu32 " memories.\n", netlist.numOps, netlist.numFlipFlops, netlist.numRegisters, netlist.numMemories);
+        freeGateNetlist(&netlist);
+    }
+    freeCircuitProject(&project);
+    return status;
+}
@@ -0,0 +1,152 @@
+#include "Diagnostics.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "StatusCodes.h"
+
+/**
+ * @brief Record an error, if the caller asked for diagnostics
+ *
+ * @param diagnostic Where to record the error, may be NULL
+ * @param code The error that occurred
+ * @param line The line it occurred on, 0 if none
+ * @param column The column it occurred at, 0 if none
+ */
+void setDiagnostic(AssemblerDiagnostic* diagnostic, uint8_t code, uint32_t line, uint32_t column)
+{
+    if (diagnostic != NULL) {
+        diagnostic->code = code;
+        diagnostic->line = line;
+        diagnostic->column = column;
+    }
+}
+
+/**
+ * @brief Get a short description of an error code
+ *
+ * @param code The error code
+ * @return Description such as "Invalid register name", never NULL
+ */
+const char* getStatusMessage(uint8_t code)
+{
+    switch (code) {
+        case 0:
+            return "Success";
+        case ERROR_VALUE_OUT_OF_RANGE:
+            return "Value out of range";
+        case ERROR_INVALID_NUMBER:
+            return "Invalid number";
+        case ERROR_INVALID_BINARY_STRING_CHARACTER:
+            return "Invalid binary string character";
+        case ERROR_INVALID_BINARY_STRING_LENGTH:
+            return "Invalid binary string length";
+        case ERROR_UNKNOWN_REGISTER:
+            return "Invalid register name";
+        case ERROR_UNKNOWN_MNEMONIC:
+            return "Unknown mnemonic";
+        case ERROR_DUPLICATE_LABEL:
+            return "Duplicate symbol";
+        case ERROR_MISSING_INSTRUCTION_PARAMETER:
+            return "Malformed instruction";
+        case ERROR_INVALID_ARGUMENTS:
+            return "Invalid arguments";
+        case ERROR_INSTRUCTION_FOLLOWS_LABEL:
+            return "Instruction follows label";
+        case ERROR_NO_SPACE_AFTER_LABEL:
+            return "Lacking space after label";
+        case ERROR_TOO_MANY_TOKENS:
+            return "Too many tokens";
+        case ERROR_UNKNOWN_LABEL:
+            return "Unknown label";
+        case ERROR_OUT_OF_MEMORY:
+            return "Out of memory";
+        case ERROR_MALFORMED_MANIFEST:
+            return "Malformed manifest entry";
+        case ERROR_OUTPUT_TOO_SMALL:
+            return "Output buffer too small";
+        case ERROR_MALFORMED_REQUEST:
+            return "Malformed server request";
+        case ERROR_SERVER_UNAVAILABLE:
+            return "Assembler server unavailable";
+        case ERROR_UNKNOWN_DIRECTIVE:
+            return "Unknown directive";
+        case ERROR_MALFORMED_OBJECT:
+            return "Malformed object file";
+        case ERROR_IO_UNAVAILABLE:
+            return "Host I/O unavailable";
+        case ERROR_MALFORMED_LINE_TABLE:
+            return "Malformed line table";
+        case ERROR_MALFORMED_TRACE:
+            return "Malformed trace";
+        case ERROR_MALFORMED_CIRCUIT:
+            return "Malformed circuit";
+        case ERROR_UNSUPPORTED_COMPONENT:
+            return "Unsupported circuit component";
+        case ERROR_INCOMPATIBLE_WIDTHS:
+            return "Incompatible bit widths";
+        case ERROR_MULTIPLE_DRIVERS:
+            return "Signal driven more than once";
+        case ERROR_COMBINATIONAL_LOOP:
+            return "Combinational loop";
+        case ERROR_MODEL_MISMATCH:
+            return "Hardware does not match the ISA model";
+        case ERROR_PROGRAM_TOO_LARGE:
+            return "Program does not fit in the 256-byte ROM";
+        case ERROR_ROUND_TRIP_MISMATCH:
+            return "Disassembly does not reassemble to the same code";
+        case ERROR_EXPANSION_AFTER_SKIP:
+            return "An li after a SKIP must assemble to one instruction";
+        case ERROR_RELAXATION_FAILED:
+            return "No room for a trampoline to carry an out of range JUMP";
+        case ERROR_MALFORMED_COUNTS:
+            return "Malformed execution count";
+        case ERROR_MALFORMED_TIMING:
+            return "Malformed timing model";
+        case ERROR_MALFORMED_LOOP_BOUND:
+            return "Malformed loop bound, expected @loop N or @loop M..N with 1 <= M <= N";
+        case ERROR_UNBOUNDED_LOOP:
+            return "Loop without a bound";
+        case ERROR_IRREDUCIBLE_LOOP:
+            return "Loop entered other than through its first instruction";
+        case ERROR_OVER_BUDGET:
+            return "Worst case exceeds the budget";
+        case ERROR_JUMP_INTO_LOAD_IMMEDIATE:
+            return "A JUMP by a number lands before an li that relied on known register values, which only two-pass mode sizes again";
+        default:
+            return "Unknown error";
+    }
+}
+
+/**
+ * @brief Format a diagnostic as the assembler prints it, e.g. "Error: Unknown mnemonic on line 3."
+ *
+ * @param dest Where to write the message
+ * @param size Size of dest, the message is truncated to fit
+ * @param diagnostic The diagnostic to format
+ * @return Number of characters in the full message, as snprintf
+ */
+int formatDiagnostic(char* dest, size_t size, const AssemblerDiagnostic* const diagnostic)
+{
+    const char* message = getStatusMessage(diagnostic->code);
+    const char* hint = diagnostic->code == ERROR_INSTRUCTION_FOLLOWS_LABEL ? " (labels must be on their own line)" : "";
+    if (diagnostic->line == 0) {
+        return snprintf(dest, size, "Error: %s.", message);
+    } else if (diagnostic->column == 0) {
+        return snprintf(dest, size, "Error: %s on line %" PRIu32 "%s.", message, diagnostic->line, hint);
+    }
+    return snprintf(dest, size, "Error: %s on line %" PRIu32 ", column %" PRIu32 "%s.", message, diagnostic->line, diagnostic->column, hint);
+}
+
+/**
+ * @brief Print a diagnostic followed by a newline
+ *
+ * @param stream Where to print it
+ * @param diagnostic The diagnostic to print
+ */
+void printDiagnostic(FILE* stream, const AssemblerDiagnostic* const diagnostic)
+{
+    char message[160];
+    formatDiagnostic(message, sizeof(message), diagnostic);
+    fprintf(stream, "%s\n", message);
+}
@@ -0,0 +1,53 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Where and why assembly failed. Line and column are 1-based, either is 0 if the error has no position.
+ */
+typedef struct _AssemblerDiagnostic {
+    uint8_t code;
+    uint32_t line;
+    uint32_t column;
+} AssemblerDiagnostic;
+
+/**
+ * @brief Record an error, if the caller asked for diagnostics
+ *
+ * @param diagnostic Where to record the error, may be NULL
+ * @param code The error that occurred
+ * @param line The line it occurred on, 0 if none
+ * @param column The column it occurred at, 0 if none
+ */
+void setDiagnostic(AssemblerDiagnostic* diagnostic, uint8_t code, uint32_t line, uint32_t column);
+
+/**
+ * @brief Get a short description of an error code
+ *
+ * @param code The error code
+ * @return Description such as "Invalid register name", never NULL
+ */
+const char* getStatusMessage(uint8_t code);
+
+/**
+ * @brief Format a diagnostic as the assembler prints it, e.g. "Error: Unknown mnemonic on line 3."
+ *
+ * @param dest Where to write the message
+ * @param size Size of dest, the message is truncated to fit
+ * @param diagnostic The diagnostic to format
+ * @return Number of characters in the full message, as snprintf
+ */
+int formatDiagnostic(char* dest, size_t size, const AssemblerDiagnostic* const diagnostic);
+
+/**
+ * @brief Print a diagnostic followed by a newline
+ *
+ * @param stream Where to print it
+ * @param diagnostic The diagnostic to print
+ */
+void printDiagnostic(FILE* stream, const AssemblerDiagnostic* const diagnostic);
+
+#endif
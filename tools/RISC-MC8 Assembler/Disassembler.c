@@ -0,0 +1,128 @@
+#include "Disassembler.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CodeBuffer.h"
+#include "DecoderTables.h"
+#include "StatusCodes.h"
+
+#define LABEL_MIN_DIGITS 4
+#define LABEL_MAX_DIGITS 8
+#define JUMP_PREFIX_LENGTH 5  // "jump "
+
+// two hexadecimal digits of every byte value, so labels are written a byte at a time
+static const char HexPairs[513] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+/**
+ * @brief Write the name of the label synthesized for an offset
+ *
+ * @param dest Where to write it
+ * @param offset The offset the label marks
+ * @param digits Number of hexadecimal digits, even and the same for every label of a program
+ * @return Number of characters written
+ */
+static uint32_t writeLabel(char* dest, uint32_t offset, uint32_t digits)
+{
+    memcpy(dest, DISASSEMBLY_LABEL_PREFIX, sizeof(DISASSEMBLY_LABEL_PREFIX) - 1);
+    dest += sizeof(DISASSEMBLY_LABEL_PREFIX) - 1;
+    for (uint32_t i = 0; i < digits; i += 2) {
+        memcpy(dest + i, HexPairs + 2 * ((offset >> (4 * (digits - 2 - i))) & 0xFF), 2);
+    }
+    return (uint32_t)sizeof(DISASSEMBLY_LABEL_PREFIX) - 1 + digits;
+}
+
+/**
+ * @brief Write one instruction as source text, with a JUMP's offset as a number
+ *
+ * @param dest Where to write the text, at least DISASSEMBLY_MAX_INSTRUCTION bytes, not NUL terminated
+ * @param instruction The instruction byte
+ * @return Number of characters written, including the trailing newline
+ */
+uint32_t disassembleInstruction(char* dest, uint8_t instruction)
+{
+    const DisassemblyEntry* entry = &DisassemblyTable[instruction];
+    memcpy(dest, entry->text, sizeof(entry->text));
+    return entry->length;
+}
+
+/**
+ * @brief Turn assembled code back into source that assembles to the same bytes
+ *
+ * @param code The assembled code
+ * @param length Number of bytes in code
+ * @param labels true to synthesize labels, false to write every JUMP offset as a number
+ * @param text Buffer to append the source text to
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t disassembleCode(const uint8_t* const code, uint32_t length, bool labels, CodeBuffer* text)
+{
+    // worst case per byte is a label line followed by a JUMP to another label
+    size_t labelLine = sizeof(DISASSEMBLY_LABEL_PREFIX) - 1 + LABEL_MAX_DIGITS + 2;
+    size_t worstCase = (size_t)length * (labelLine + DISASSEMBLY_MAX_INSTRUCTION) + labelLine + DISASSEMBLY_MAX_INSTRUCTION;
+    if (!reserveCode(text, text->length + worstCase)) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    char* out = (char*)text->data + text->length;
+    if (!labels) {
+        for (uint32_t pc = 0; pc < length; pc++) {
+            const DisassemblyEntry* entry = &DisassemblyTable[*(code + pc)];
+            memcpy(out, entry, sizeof(DisassemblyEntry));  // one 16-byte move, the tail is overwritten by the next
+            out += entry->length;
+        }
+        text->length = (size_t)(out - (char*)text->data);
+        return 0;
+    }
+
+    // one byte per offset, including the one just past the end, set where a JUMP lands
+    uint8_t* targets = calloc((size_t)length + 2, sizeof(uint8_t));
+    if (targets == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    // branch-free, whether a byte is a JUMP is as good as random; everything else marks the spare byte at the end,
+    // and plain stores never wait on each other the way read-modify-writes of a bitmap would
+    for (uint32_t pc = 0; pc < length; pc++) {
+        const DisassemblyEntry* entry = &DisassemblyTable[*(code + pc)];
+        int64_t target = (int64_t)pc + entry->offset;
+        bool marked = entry->isJump & (entry->offset != 0) & (target >= 0) & (target <= length);
+        *(targets + (marked ? (size_t)target : (size_t)length + 1)) = 1;
+    }
+    uint32_t digits = LABEL_MIN_DIGITS;
+    while (digits < LABEL_MAX_DIGITS && ((uint64_t)length >> (4 * digits)) != 0) {
+        digits += 2;
+    }
+
+    for (uint32_t pc = 0; pc <= length; pc++) {
+        if (*(targets + pc)) {
+            out += writeLabel(out, pc, digits);
+            *out++ = ':';
+            *out++ = '\n';
+        }
+        if (pc == length) {
+            break;
+        }
+        const DisassemblyEntry* entry = &DisassemblyTable[*(code + pc)];
+        memcpy(out, entry, sizeof(DisassemblyEntry));
+        int64_t target = (int64_t)pc + entry->offset;
+        if (entry->isJump && entry->offset != 0 && target >= 0 && target <= length) {
+            out += JUMP_PREFIX_LENGTH;
+            out += writeLabel(out, (uint32_t)target, digits);
+            *out++ = '\n';
+        } else {
+            out += entry->length;
+        }
+    }
+    text->length = (size_t)(out - (char*)text->data);
+    free(targets);
+    return 0;
+}
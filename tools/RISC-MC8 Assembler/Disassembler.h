@@ -0,0 +1,36 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "CodeBuffer.h"
+
+#define DISASSEMBLY_LABEL_PREFIX "L_"
+#define DISASSEMBLY_MAX_INSTRUCTION 16  // room for the text of one instruction, which is copied 16 bytes at a time
+
+/**
+ * @brief Write one instruction as source text, with a JUMP's offset as a number
+ *
+ * @param dest Where to write the text, at least DISASSEMBLY_MAX_INSTRUCTION bytes, not NUL terminated
+ * @param instruction The instruction byte
+ * @return Number of characters written, including the trailing newline
+ */
+uint32_t disassembleInstruction(char* dest, uint8_t instruction);
+
+/**
+ * @brief Turn assembled code back into source that assembles to the same bytes
+ *
+ * Every byte decodes through one table lookup. JUMPs to an offset inside the program (or just past its end) get a
+ * synthesized label such as `L_001A:`, named by the hexadecimal offset it marks; jumps to themselves and jumps out of
+ * the program keep their numeric offset.
+ *
+ * @param code The assembled code
+ * @param length Number of bytes in code
+ * @param labels true to synthesize labels, false to write every JUMP offset as a number
+ * @param text Buffer to append the source text to
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t disassembleCode(const uint8_t* const code, uint32_t length, bool labels, CodeBuffer* text);
+
+#endif
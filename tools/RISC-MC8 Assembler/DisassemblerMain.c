@@ -0,0 +1,288 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Assembler.h"
+#include "AssemblerStats.h"
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Disassembler.h"
+#include "Source.h"
+#include "StatusCodes.h"
+#include "WorkerPool.h"
+
+#define USAGE \
+    "Expected arguments: [--no-labels] (program.o | program.asm) [output.asm]\n" \
+    "                or: --verify [--threads N] [--time] source.asm...\n"
+
+#define MESSAGE_LENGTH 160
+#define BYTE_VALUES 256
+
+typedef struct _VerifyJob {
+    const char* path;  // NULL for the built-in program holding every byte
+    uint8_t status;
+    uint64_t bytes;           // disassembled, counting both round trips
+    double disassemblySeconds;
+    char message[MESSAGE_LENGTH];
+} VerifyJob;
+
+/**
+ * @brief Read a program, assembling it first if it is a .asm source
+ *
+ * @param path Path of the program
+ * @param code Buffer to append the program to
+ * @return 0 if successful, otherwise the error that occurred, after printing it
+ */
+static uint8_t loadProgram(const char* const path, CodeBuffer* code)
+{
+    SourceReader source;
+    if (openSourceFile(&source, path) != 0) {
+        fprintf(stderr, "Error: Input file does not exist.\n");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    uint8_t status = 0;
+    size_t pathLength = strlen(path);
+    if (pathLength >= 4 && strcmp(path + pathLength - 4, ".asm") == 0) {
+        AssemblerDiagnostic diagnostic;
+        status = assembleSource(&source, code, NULL, &diagnostic);
+        if (status != 0) {
+            printDiagnostic(stderr, &diagnostic);
+        }
+    } else if (source.data != NULL && source.length > 0) {
+        if (reserveCode(code, source.length)) {
+            memcpy(code->data, source.data, source.length);
+            code->length = source.length;
+        } else {
+            status = ERROR_OUT_OF_MEMORY;
+            fprintf(stderr, "Error: Out of memory.\n");
+        }
+    }
+    closeSource(&source);
+    return status;
+}
+
+/**
+ * @brief Disassemble a program and assemble the text again, checking the code comes back byte for byte
+ *
+ * @param job The job, receives the disassembly time and any mismatch
+ * @param code The program
+ * @param length Number of bytes in code
+ * @param labels Whether to synthesize labels
+ * @return 0 if the code came back unchanged, otherwise the error, described in job->message
+ */
+static uint8_t checkRoundTrip(VerifyJob* job, const uint8_t* const code, uint32_t length, bool labels)
+{
+    CodeBuffer text;
+    initGrowableCodeBuffer(&text);
+    PhaseTimer timer;
+    PhaseStats disassembly;
+    startPhase(&timer);
+    uint8_t status = disassembleCode(code, length, labels, &text);
+    stopPhase(&timer, &disassembly);
+    job->disassemblySeconds += disassembly.wallSeconds;
+    job->bytes += length;
+    if (status != 0) {
+        snprintf(job->message, MESSAGE_LENGTH, "Error: %s.", getStatusMessage(status));
+        freeCodeBuffer(&text);
+        return status;
+    }
+
+    SourceReader source;
+    openSourceBuffer(&source, (const char*)text.data, text.length);
+    CodeBuffer again;
+    initGrowableCodeBuffer(&again);
+    AssemblerDiagnostic diagnostic;
+    status = assembleSource(&source, &again, NULL, &diagnostic);
+    if (status != 0) {
+        char reason[MESSAGE_LENGTH];
+        formatDiagnostic(reason, sizeof(reason), &diagnostic);
+        snprintf(job->message, MESSAGE_LENGTH, "Error: The disassembly%s does not assemble: %.100s", labels ? "" : " without labels", reason);
+    } else if (again.length != length) {
+        status = ERROR_ROUND_TRIP_MISMATCH;
+        snprintf(job->message, MESSAGE_LENGTH, "Error: The disassembly%s reassembles to %zu bytes instead of %" PRIu32 ".", labels ? "" : " without labels", again.length, length);
+    } else {
+        for (uint32_t i = 0; i < length; i++) {
+            if (*(again.data + i) != *(code + i)) {
+                status = ERROR_ROUND_TRIP_MISMATCH;
+                snprintf(job->message, MESSAGE_LENGTH, "Error: The disassembly%s reassembles 0x%02X at offset %" PRIu32 " as 0x%02X.", labels ? "" : " without labels", *(code + i), i, *(again.data + i));
+                break;
+            }
+        }
+    }
+    closeSource(&source);
+    freeCodeBuffer(&again);
+    freeCodeBuffer(&text);
+    return status;
+}
+
+/**
+ * @brief Assemble one source and check it round trips with and without labels
+ *
+ * @param context Array of VerifyJob
+ * @param index Index of the job to run
+ */
+static void runVerifyJob(void* context, uint32_t index)
+{
+    VerifyJob* job = (VerifyJob*)context + index;
+    CodeBuffer code;
+    initGrowableCodeBuffer(&code);
+    if (job->path == NULL) {
+        job->status = reserveCode(&code, BYTE_VALUES) ? 0 : ERROR_OUT_OF_MEMORY;
+        for (uint32_t i = 0; i < BYTE_VALUES && job->status == 0; i++) {
+            *(code.data + i) = (uint8_t)i;
+        }
+        code.length = BYTE_VALUES;
+    } else {
+        SourceReader source;
+        if (openSourceFile(&source, job->path) != 0) {
+            job->status = ERROR_INVALID_ARGUMENTS;
+            snprintf(job->message, MESSAGE_LENGTH, "Error: Input file does not exist.");
+            freeCodeBuffer(&code);
+            return;
+        }
+        AssemblerDiagnostic diagnostic;
+        job->status = assembleSource(&source, &code, NULL, &diagnostic);
+        if (job->status != 0) {
+            formatDiagnostic(job->message, MESSAGE_LENGTH, &diagnostic);
+        }
+        closeSource(&source);
+    }
+    if (job->status == 0) {
+        job->status = checkRoundTrip(job, code.data, (uint32_t)code.length, true);
+    }
+    if (job->status == 0) {
+        job->status = checkRoundTrip(job, code.data, (uint32_t)code.length, false);
+    }
+    freeCodeBuffer(&code);
+}
+
+/**
+ * @brief Check that every source assembles, disassembles and reassembles to identical code
+ *
+ * Every possible byte is checked first as a program of its own, then the sources on a pool of threads.
+ *
+ * @param paths Paths of the sources
+ * @param numPaths Number of sources
+ * @param numThreads Threads to use, 0 for one per processor
+ * @param timed Whether to report the disassembly throughput
+ * @return 0 if everything round tripped, otherwise the error of the first source (in order) that did not
+ */
+static uint8_t verifySources(char** paths, int numPaths, uint32_t numThreads, bool timed)
+{
+    VerifyJob* jobs = calloc((size_t)numPaths + 1, sizeof(VerifyJob));
+    if (jobs == NULL) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return ERROR_OUT_OF_MEMORY;
+    }
+    for (int i = 0; i < numPaths; i++) {
+        (jobs + i + 1)->path = paths[i];
+    }
+    runWorkerPool(&runVerifyJob, jobs, (uint32_t)numPaths + 1, numThreads);
+
+    uint8_t status = 0;
+    uint32_t passed = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+    for (int i = 0; i <= numPaths; i++) {
+        const VerifyJob* job = jobs + i;
+        bytes += job->bytes;
+        seconds += job->disassemblySeconds;
+        if (job->status == 0) {
+            passed += i > 0;
+            continue;
+        }
+        fprintf(stderr, "%s: %s\n", job->path != NULL ? job->path : "(every byte)", job->message);
+        if (status == 0) {
+            status = job->status;
+        }
+    }
+    printf("%" PRIu32 " of %d sources round tripped.\n", passed, numPaths);
+    if (timed) {
+        double perSecond = seconds > 0 ? bytes / seconds : 0;
+        printf("Disassembled %" PRIu64 " bytes in %.6f seconds of thread time (%.1f million bytes per second per thread).\n", bytes, seconds, perSecond / 1e6);
+    }
+    free(jobs);
+    return status;
+}
+
+/**
+ * @brief Disassemble a RISC-MC8 program, or check that sources survive a round trip through the disassembler
+ *
+ * @param argc Argument count
+ * @param argv Arguments, should be `[--no-labels] program.o [output.asm]` to write the disassembly to output.asm (or
+ *             stdout), or `--verify [--threads N] [--time] source.asm...` to assemble, disassemble and reassemble every
+ *             source, with and without labels, and compare the code
+ * @return 0 if successful, otherwise a non-zero error code accompanied with a message on stderr
+ */
+int main(int argc, char** argv)
+{
+    bool labels = true;
+    bool verify = false;
+    bool timed = false;
+    uint32_t numThreads = 0;
+    char** paths = (char**)calloc(argc, sizeof(char*));
+    int numPaths = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-labels") == 0) {
+            labels = false;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if (strcmp(argv[i], "--time") == 0) {
+            timed = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            char* end;
+            numThreads = strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || *argv[i] == '\0' || *argv[i] == '-') {
+                fprintf(stderr, "Error: Invalid thread count.\n");
+                fprintf(stderr, USAGE);
+                free(paths);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+        } else {
+            paths[numPaths++] = argv[i];
+        }
+    }
+    if (verify ? (numPaths == 0 || !labels) : (numPaths < 1 || numPaths > 2 || timed || numThreads != 0)) {
+        fprintf(stderr, "Error: Wrong number of arguments.\n");
+        fprintf(stderr, USAGE);
+        free(paths);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    if (verify) {
+        uint8_t verifyStatus = verifySources(paths, numPaths, numThreads, timed);
+        free(paths);
+        return verifyStatus;
+    }
+    const char* programPath = paths[0];
+    const char* outputPath = numPaths == 2 ? paths[1] : NULL;
+    free(paths);
+
+    CodeBuffer code;
+    initGrowableCodeBuffer(&code);
+    uint8_t status = loadProgram(programPath, &code);
+    CodeBuffer text;
+    initGrowableCodeBuffer(&text);
+    if (status == 0) {
+        status = disassembleCode(code.data, (uint32_t)code.length, labels, &text);
+        if (status != 0) {
+            fprintf(stderr, "Error: %s.\n", getStatusMessage(status));
+        }
+    }
+    if (status == 0) {
+        FILE* outputFile = outputPath != NULL ? fopen(outputPath, "wb") : stdout;
+        if (outputFile == NULL) {
+            fprintf(stderr, "Error: Could not open output file.\n");
+            status = ERROR_INVALID_ARGUMENTS;
+        } else {
+            fwrite(text.data, 1, text.length, outputFile);
+            if (outputFile != stdout) {
+                fclose(outputFile);
+            }
+        }
+    }
+    freeCodeBuffer(&text);
+    freeCodeBuffer(&code);
+    return status;
+}
@@ -0,0 +1,604 @@
+#include "Emulator.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "EmulatorIo.h"
+#include "StatusCodes.h"
+
+/**
+ * @brief Decode one instruction
+ *
+ * @param decoded Where to store the decoded instruction
+ * @param instruction The instruction
+ * @param pc Offset of the instruction in the program
+ * @param length Number of instructions in the program, also the index of the first END sentinel
+ */
+static void decodeInstruction(DecodedInstruction* decoded, uint8_t instruction, uint32_t pc, uint32_t length)
+{
+    decoded->operand = instruction & 0b111;
+    decoded->target = pc + 1;
+    if (instruction & 0b10000000) {
+        int32_t offset = (int32_t)(instruction & 0b1111111) - ((instruction & 0b1000000) << 1);  // sign extend
+        int64_t target = (int64_t)pc + offset;
+        decoded->op = offset == 0 ? EMULATOR_OP_HALT : EMULATOR_OP_JUMP;
+        decoded->target = target < 0 || target >= length ? length : (uint32_t)target;
+    } else if ((instruction & 0b11110000) == 0b01100000) {
+        decoded->op = EMULATOR_OP_STLO;
+        decoded->operand = instruction & 0b1111;
+    } else if ((instruction & 0b11110000) == 0b01110000) {
+        decoded->op = EMULATOR_OP_STHI;
+        decoded->operand = (instruction & 0b1111) << 4;
+    } else {
+        decoded->op = instruction >> 3;  // the register instructions are numbered by their top 5 bits
+        if (decoded->op == EMULATOR_OP_SKIP) {
+            decoded->target = pc + 2 > length ? length + 1 : pc + 2;
+        }
+    }
+}
+
+/**
+ * @brief Predecode a program and reset the machine
+ *
+ * @param emulator The emulator to initialize
+ * @param code The program, one instruction per byte
+ * @param length Number of instructions in code
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY or ERROR_VALUE_OUT_OF_RANGE if the program is too long
+ */
+uint8_t initEmulator(Emulator* emulator, const uint8_t* const code, uint32_t length)
+{
+    emulator->program = NULL;
+    emulator->length = 0;
+    emulator->jumpSpan = 1;
+    emulator->io = NULL;
+    emulator->branchCounts = NULL;
+    resetEmulator(emulator);
+    if (length > UINT32_MAX - 2) {
+        return ERROR_VALUE_OUT_OF_RANGE;
+    }
+    DecodedInstruction* program = (DecodedInstruction*)malloc(((size_t)length + 2) * sizeof(DecodedInstruction));
+    if (program == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        decodeInstruction(program + i, *(code + i), i, length);
+    }
+    for (uint32_t i = length; i < length + 2; i++) {
+        (program + i)->op = EMULATOR_OP_END;
+        (program + i)->operand = 0;
+        (program + i)->target = i;
+    }
+    emulator->program = program;
+    emulator->length = length;
+
+    // without a JUMP the program counter only moves forward, so each instruction starts a run of bounded length
+    uint32_t next = 0;
+    uint32_t afterNext = 0;
+    uint32_t longest = 0;
+    for (uint32_t i = length; i-- > 0;) {
+        uint8_t op = (program + i)->op;
+        uint32_t run = 0;
+        if (op != EMULATOR_OP_JUMP && op != EMULATOR_OP_HALT) {
+            run = 1 + (op == EMULATOR_OP_SKIP && afterNext > next ? afterNext : next);
+        }
+        longest = run > longest ? run : longest;
+        afterNext = next;
+        next = run;
+    }
+    emulator->jumpSpan = longest + 1;
+    return 0;
+}
+
+/**
+ * @brief Free the decoded program
+ *
+ * @param emulator The emulator to free
+ */
+void freeEmulator(Emulator* emulator)
+{
+    free(emulator->program);
+    emulator->program = NULL;
+    emulator->length = 0;
+}
+
+/**
+ * @brief Zero the registers, RAM, program counter and executed count
+ *
+ * @param emulator The emulator to reset
+ */
+void resetEmulator(Emulator* emulator)
+{
+    memset(&emulator->state, 0, sizeof(EmulatorState));
+    emulator->executed = 0;
+}
+
+/**
+ * @brief Serve the I/O ports from host channels, or make them plain RAM again
+ *
+ * LOAD and STOR are decoded into handlers that check for the ports, so a program without I/O attached pays nothing
+ * for them.
+ *
+ * @param emulator The emulator
+ * @param io Started channels, or NULL to detach them
+ */
+void attachEmulatorIo(Emulator* emulator, struct _EmulatorIo* io)
+{
+    emulator->io = io;
+    for (uint32_t i = 0; i < emulator->length; i++) {
+        DecodedInstruction* instruction = emulator->program + i;
+        if (instruction->op == EMULATOR_OP_LOAD || instruction->op == EMULATOR_OP_LOAD_IO) {
+            instruction->op = io == NULL ? EMULATOR_OP_LOAD : EMULATOR_OP_LOAD_IO;
+        } else if (instruction->op == EMULATOR_OP_STOR || instruction->op == EMULATOR_OP_STOR_IO) {
+            instruction->op = io == NULL ? EMULATOR_OP_STOR : EMULATOR_OP_STOR_IO;
+        }
+    }
+}
+
+/**
+ * @brief Count how often each SKIP and JUMP goes each way, or stop counting
+ *
+ * Like attachEmulatorIo, SKIP and JUMP are decoded into counting handlers only while counting, so other runs pay
+ * nothing and counting runs only pay on branches.
+ *
+ * @param emulator The emulator
+ * @param branchCounts Zeroed counts, two per instruction (not taken then taken), or NULL to stop counting
+ */
+void attachBranchCounts(Emulator* emulator, uint64_t* branchCounts)
+{
+    emulator->branchCounts = branchCounts;
+    for (uint32_t i = 0; i < emulator->length; i++) {
+        DecodedInstruction* instruction = emulator->program + i;
+        if (instruction->op == EMULATOR_OP_SKIP || instruction->op == EMULATOR_OP_SKIP_PROFILED) {
+            instruction->op = branchCounts == NULL ? EMULATOR_OP_SKIP : EMULATOR_OP_SKIP_PROFILED;
+        } else if (instruction->op == EMULATOR_OP_JUMP || instruction->op == EMULATOR_OP_JUMP_PROFILED) {
+            instruction->op = branchCounts == NULL ? EMULATOR_OP_JUMP : EMULATOR_OP_JUMP_PROFILED;
+        }
+    }
+}
+
+/**
+ * @brief Shift a value by the signed 4-bit amount in the low bits of ireg
+ *
+ * @param value The value to shift
+ * @param amount ireg, only the low 4 bits are used
+ * @return The shifted value, unchanged for amounts of 0 and -8
+ */
+static inline uint8_t shiftValue(uint8_t value, uint8_t amount)
+{
+    amount &= 0b1111;
+    if (amount == 0 || amount == 0b1000) {
+        return value;
+    } else if (amount < 0b1000) {
+        return (uint8_t)(value << amount);
+    }
+    return value >> (16 - amount);  // logical, the sign is not extended
+}
+
+// computed goto threads each handler straight to the next, other compilers fall back to a switch in a loop
+#if defined(__GNUC__)
+#define HANDLER(op) handle_##op:
+#define DISPATCH() goto *handlers[(program + pc)->op]
+#else
+#define HANDLER(op) case op:
+#define DISPATCH() continue
+#endif
+
+/**
+ * @brief Find how many JUMPs runEmulator can take before it must check the step limit again
+ *
+ * @param emulator The emulator
+ * @param maxSteps Most instructions to execute, 0 for no limit
+ * @param executed Instructions executed so far
+ * @return At most EMULATOR_CHECK_INTERVAL, few enough that the limit cannot be passed before the check, 0 if it could
+ *         be passed before the next JUMP
+ */
+static uint32_t jumpsUntilLimit(const Emulator* const emulator, uint64_t maxSteps, uint64_t executed)
+{
+    if (maxSteps == 0) {
+        return EMULATOR_CHECK_INTERVAL;
+    }
+    uint64_t jumps = maxSteps > executed ? (maxSteps - executed) / emulator->jumpSpan : 0;
+    return jumps < EMULATOR_CHECK_INTERVAL ? (uint32_t)jumps : EMULATOR_CHECK_INTERVAL;
+}
+
+/**
+ * @brief Run until the program halts
+ *
+ * Cycles are found with Brent's algorithm on snapshots of the state taken every EMULATOR_CHECK_INTERVAL jumps
+ * (every infinite run takes infinitely many jumps), which costs nothing on other instructions. The step limit is
+ * checked at the same points, which come sooner as it nears so it is never passed, and the last few instructions
+ * before it are run by stepEmulator. I/O between two checkpoints restarts cycle detection, since the host side is not
+ * part of the state.
+ *
+ * @param emulator The emulator to run, continuing from its current state
+ * @param maxSteps Most instructions to execute, 0 for no limit
+ * @return The EMULATOR_HALT_* reason it stopped
+ */
+uint8_t runEmulator(Emulator* emulator, uint64_t maxSteps)
+{
+#if defined(__GNUC__)
+    static const void* const handlers[EMULATOR_NUM_OPS] = {
+        &&handle_EMULATOR_OP_ANDI, &&handle_EMULATOR_OP_NAND, &&handle_EMULATOR_OP_ADDI, &&handle_EMULATOR_OP_SUBI,
+        &&handle_EMULATOR_OP_IORI, &&handle_EMULATOR_OP_XORI, &&handle_EMULATOR_OP_DUPI, &&handle_EMULATOR_OP_DUPR,
+        &&handle_EMULATOR_OP_LOAD, &&handle_EMULATOR_OP_STOR, &&handle_EMULATOR_OP_SHIF, &&handle_EMULATOR_OP_SKIP,
+        &&handle_EMULATOR_OP_STLO, &&handle_EMULATOR_OP_STHI, &&handle_EMULATOR_OP_JUMP, &&handle_EMULATOR_OP_HALT,
+        &&handle_EMULATOR_OP_END, &&handle_EMULATOR_OP_LOAD_IO, &&handle_EMULATOR_OP_STOR_IO,
+        &&handle_EMULATOR_OP_SKIP_PROFILED, &&handle_EMULATOR_OP_JUMP_PROFILED,
+    };
+#endif
+    const DecodedInstruction* const program = emulator->program;
+    EmulatorState* state = &emulator->state;
+    uint8_t* const registers = state->registers;
+    uint8_t* const ram = state->ram;
+    uint32_t pc = state->pc;
+    uint64_t executed = emulator->executed;
+    uint32_t jumpsUntilCheck = jumpsUntilLimit(emulator, maxSteps, executed);
+    if (jumpsUntilCheck == 0) {
+        return stepEmulator(emulator, maxSteps > executed ? maxSteps - executed : 0, UINT32_MAX);
+    }
+    EmulatorIo* const io = emulator->io;
+    uint64_t* const branchCounts = emulator->branchCounts;
+    bool ioSinceCheck = false;
+
+    // Brent's cycle detection over the checkpoints
+    EmulatorState* snapshot = NULL;
+    uint64_t power = 1;
+    uint64_t sinceSnapshot = 0;
+    uint8_t reason;
+
+#if defined(__GNUC__)
+    DISPATCH();
+#else
+    while (true) {
+        switch ((program + pc)->op) {
+#endif
+    HANDLER(EMULATOR_OP_ANDI)
+    {
+        *(registers + (program + pc)->operand) &= *registers;
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_NAND)
+    {
+        *(registers + (program + pc)->operand) = ~(*registers & *(registers + (program + pc)->operand));
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_ADDI)
+    {
+        *(registers + (program + pc)->operand) += *registers;
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_SUBI)
+    {
+        *(registers + (program + pc)->operand) -= *registers;
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_IORI)
+    {
+        *(registers + (program + pc)->operand) |= *registers;
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_XORI)
+    {
+        *(registers + (program + pc)->operand) ^= *registers;
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_DUPI)
+    {
+        *(registers + (program + pc)->operand) = *registers;
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_DUPR)
+    {
+        *registers = *(registers + (program + pc)->operand);
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_LOAD)
+    {
+        *(registers + (program + pc)->operand) = *(ram + *registers);
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_STOR)
+    {
+        *(ram + *registers) = *(registers + (program + pc)->operand);
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_SHIF)
+    {
+        uint8_t* reg = registers + (program + pc)->operand;
+        *reg = shiftValue(*reg, *registers);
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_SKIP)
+    {
+        pc = *registers == *(registers + (program + pc)->operand) ? (program + pc)->target : pc + 1;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_STLO)
+    {
+        *registers = (*registers & 0b11110000) | (program + pc)->operand;
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_STHI)
+    {
+        *registers = (*registers & 0b00001111) | (program + pc)->operand;
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_JUMP)
+    {
+    jump:
+        if (--jumpsUntilCheck == 0) {
+            jumpsUntilCheck = jumpsUntilLimit(emulator, maxSteps, executed);
+            if (jumpsUntilCheck == 0) {
+                reason = EMULATOR_HALT_STEP_LIMIT;
+                goto halt;
+            }
+            state->pc = pc;
+            if (ioSinceCheck) {
+                // the machine talked to the host, so an earlier state coming back proves nothing
+                ioSinceCheck = false;
+                power = 1;
+                sinceSnapshot = 0;
+                if (snapshot != NULL) {
+                    *snapshot = *state;
+                }
+            } else if (snapshot == NULL) {
+                snapshot = (EmulatorState*)malloc(sizeof(EmulatorState));
+                if (snapshot != NULL) {
+                    *snapshot = *state;
+                }
+            } else if (memcmp(snapshot, state, sizeof(EmulatorState)) == 0) {
+                reason = EMULATOR_HALT_CYCLE;
+                goto halt;
+            } else if (++sinceSnapshot == power) {
+                *snapshot = *state;
+                power *= 2;
+                sinceSnapshot = 0;
+            }
+        }
+        pc = (program + pc)->target;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_HALT)
+    {
+        reason = EMULATOR_HALT_SELF_JUMP;
+        goto halt;
+    }
+    HANDLER(EMULATOR_OP_END)
+    {
+        pc = emulator->length;  // a SKIP may have landed on the second sentinel
+        reason = EMULATOR_HALT_END;
+        goto halt;
+    }
+    HANDLER(EMULATOR_OP_LOAD_IO)
+    {
+        if (*registers < EMULATOR_IO_PORTS) {
+            *(registers + (program + pc)->operand) = readIoPort(io, *registers);
+            ioSinceCheck = true;
+        } else {
+            *(registers + (program + pc)->operand) = *(ram + *registers);
+        }
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_STOR_IO)
+    {
+        if (*registers < EMULATOR_IO_PORTS) {
+            writeIoPort(io, *registers, *(registers + (program + pc)->operand));
+            ioSinceCheck = true;
+        } else {
+            *(ram + *registers) = *(registers + (program + pc)->operand);
+        }
+        pc++;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_SKIP_PROFILED)
+    {
+        bool taken = *registers == *(registers + (program + pc)->operand);
+        (*(branchCounts + 2 * (uint64_t)pc + taken))++;
+        pc = taken ? (program + pc)->target : pc + 1;
+        executed++;
+        DISPATCH();
+    }
+    HANDLER(EMULATOR_OP_JUMP_PROFILED)
+    {
+        (*(branchCounts + 2 * (uint64_t)pc + 1))++;
+        goto jump;
+    }
+#if !defined(__GNUC__)
+        }
+    }
+#endif
+
+halt:
+    if ((reason == EMULATOR_HALT_STEP_LIMIT || reason == EMULATOR_HALT_CYCLE) && branchCounts != NULL) {
+        (*(branchCounts + 2 * (uint64_t)pc + 1))--;  // the JUMP that stopped at the checkpoint was counted but not taken
+    }
+    state->pc = pc;
+    emulator->executed = executed;
+    free(snapshot);
+    if (reason == EMULATOR_HALT_STEP_LIMIT) {
+        // the limit may come before the next JUMP, so the rest of the way is stepped exactly
+        reason = stepEmulator(emulator, maxSteps - executed, UINT32_MAX);
+    }
+    return reason;
+}
+
+/**
+ * @brief Execute an exact number of instructions, one at a time
+ *
+ * Much slower than runEmulator, but it stops exactly where asked, which replaying a trace needs. There is no cycle
+ * detection, and branches are counted only while attachBranchCounts is counting them.
+ *
+ * @param emulator The emulator to step, continuing from its current state
+ * @param steps Most instructions to execute
+ * @param breakPc Stop as soon as the program counter reaches this, UINT32_MAX for no breakpoint
+ * @return EMULATOR_HALT_STEP_LIMIT after executing every step, EMULATOR_HALT_BREAKPOINT, or why the program halted
+ */
+uint8_t stepEmulator(Emulator* emulator, uint64_t steps, uint32_t breakPc)
+{
+    uint8_t* const registers = emulator->state.registers;
+    uint8_t* const ram = emulator->state.ram;
+    uint8_t reason = EMULATOR_HALT_STEP_LIMIT;
+    for (uint64_t i = 0; i < steps && reason == EMULATOR_HALT_STEP_LIMIT; i++) {
+        const DecodedInstruction* instruction = emulator->program + emulator->state.pc;
+        uint8_t* reg = registers + instruction->operand;
+        uint32_t next = emulator->state.pc + 1;
+        switch (instruction->op) {
+            case EMULATOR_OP_ANDI:
+                *reg &= *registers;
+                break;
+            case EMULATOR_OP_NAND:
+                *reg = ~(*registers & *reg);
+                break;
+            case EMULATOR_OP_ADDI:
+                *reg += *registers;
+                break;
+            case EMULATOR_OP_SUBI:
+                *reg -= *registers;
+                break;
+            case EMULATOR_OP_IORI:
+                *reg |= *registers;
+                break;
+            case EMULATOR_OP_XORI:
+                *reg ^= *registers;
+                break;
+            case EMULATOR_OP_DUPI:
+                *reg = *registers;
+                break;
+            case EMULATOR_OP_DUPR:
+                *registers = *reg;
+                break;
+            case EMULATOR_OP_LOAD_IO:
+                if (*registers < EMULATOR_IO_PORTS) {
+                    *reg = readIoPort(emulator->io, *registers);
+                    break;
+                }
+                // fall through
+            case EMULATOR_OP_LOAD:
+                *reg = *(ram + *registers);
+                break;
+            case EMULATOR_OP_STOR_IO:
+                if (*registers < EMULATOR_IO_PORTS) {
+                    writeIoPort(emulator->io, *registers, *reg);
+                    break;
+                }
+                // fall through
+            case EMULATOR_OP_STOR:
+                *(ram + *registers) = *reg;
+                break;
+            case EMULATOR_OP_SHIF:
+                *reg = shiftValue(*reg, *registers);
+                break;
+            case EMULATOR_OP_SKIP_PROFILED:
+                (*(emulator->branchCounts + 2 * (uint64_t)emulator->state.pc + (*registers == *reg)))++;
+                // fall through
+            case EMULATOR_OP_SKIP:
+                next = *registers == *reg ? instruction->target : next;
+                break;
+            case EMULATOR_OP_STLO:
+                *registers = (*registers & 0b11110000) | instruction->operand;
+                break;
+            case EMULATOR_OP_STHI:
+                *registers = (*registers & 0b00001111) | instruction->operand;
+                break;
+            case EMULATOR_OP_JUMP_PROFILED:
+                (*(emulator->branchCounts + 2 * (uint64_t)emulator->state.pc + 1))++;
+                // fall through
+            case EMULATOR_OP_JUMP:
+                next = instruction->target;
+                break;
+            case EMULATOR_OP_HALT:
+                return EMULATOR_HALT_SELF_JUMP;
+            default:
+                emulator->state.pc = emulator->length;
+                return EMULATOR_HALT_END;
+        }
+        emulator->state.pc = next;
+        emulator->executed++;
+        if (next == breakPc) {
+            reason = EMULATOR_HALT_BREAKPOINT;
+        }
+    }
+    return reason;
+}
+
+/**
+ * @brief Get a description of a halt reason
+ *
+ * @param reason An EMULATOR_HALT_* reason
+ * @return The description, such as "jump to itself"
+ */
+const char* getHaltReason(uint8_t reason)
+{
+    switch (reason) {
+        case EMULATOR_HALT_SELF_JUMP:
+            return "jump to itself";
+        case EMULATOR_HALT_CYCLE:
+            return "infinite loop";
+        case EMULATOR_HALT_END:
+            return "end of program";
+        case EMULATOR_HALT_STEP_LIMIT:
+            return "step limit";
+        case EMULATOR_HALT_BREAKPOINT:
+            return "breakpoint";
+        default:
+            return "unknown reason";
+    }
+}
+
+/**
+ * @brief Print the register file in the format of the FINAL STATE block in testcode.asm
+ *
+ * @param stream Where to print
+ * @param title Heading of the block, such as "FINAL STATE"
+ * @param state The state to print
+ */
+void printEmulatorState(FILE* stream, const char* const title, const EmulatorState* const state)
+{
+    fprintf(stream, "# %s\n", title);
+    for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+        char bits[9];
+        for (uint32_t bit = 0; bit < 8; bit++) {
+            bits[bit] = (state->registers[i] >> (7 - bit)) & 1 ? '1' : '0';
+        }
+        bits[8] = '\0';
+        if (i == 0) {
+            fprintf(stream, "# ireg - 0b%s - 0x%02X\n", bits, state->registers[i]);
+        } else {
+            fprintf(stream, "# r%" PRIu32 "   - 0b%s - 0x%02X\n", i, bits, state->registers[i]);
+        }
+    }
+}
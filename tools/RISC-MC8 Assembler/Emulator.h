@@ -0,0 +1,167 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define EMULATOR_NUM_REGISTERS 8
+#define EMULATOR_RAM_SIZE 256
+#define EMULATOR_CHECK_INTERVAL 4096  // jumps between cycle and step limit checks
+
+// why runEmulator returned
+#define EMULATOR_HALT_SELF_JUMP 0   // reached a JUMP to itself, such as `jump 0`
+#define EMULATOR_HALT_CYCLE 1       // the whole machine state repeated, so it would loop forever
+#define EMULATOR_HALT_END 2         // the program counter left the program
+#define EMULATOR_HALT_STEP_LIMIT 3  // executed the most instructions allowed
+#define EMULATOR_HALT_BREAKPOINT 4  // stepEmulator reached the breakpoint
+
+// handlers of predecoded instructions, the first 15 in InstructionLoaderLUT order
+#define EMULATOR_OP_ANDI 0
+#define EMULATOR_OP_NAND 1
+#define EMULATOR_OP_ADDI 2
+#define EMULATOR_OP_SUBI 3
+#define EMULATOR_OP_IORI 4
+#define EMULATOR_OP_XORI 5
+#define EMULATOR_OP_DUPI 6
+#define EMULATOR_OP_DUPR 7
+#define EMULATOR_OP_LOAD 8
+#define EMULATOR_OP_STOR 9
+#define EMULATOR_OP_SHIF 10
+#define EMULATOR_OP_SKIP 11
+#define EMULATOR_OP_STLO 12
+#define EMULATOR_OP_STHI 13
+#define EMULATOR_OP_JUMP 14
+#define EMULATOR_OP_HALT 15     // a JUMP to itself
+#define EMULATOR_OP_END 16      // past the end of the program
+#define EMULATOR_OP_LOAD_IO 17  // a LOAD while I/O is attached
+#define EMULATOR_OP_STOR_IO 18  // a STOR while I/O is attached
+#define EMULATOR_OP_SKIP_PROFILED 19  // a SKIP while branches are counted
+#define EMULATOR_OP_JUMP_PROFILED 20  // a JUMP while branches are counted
+#define EMULATOR_NUM_OPS 21
+
+/**
+ * Everything an instruction can observe. Two machines with equal state run identically from then on.
+ */
+typedef struct _EmulatorState {
+    uint8_t registers[EMULATOR_NUM_REGISTERS];  // registers[0] is ireg
+    uint8_t ram[EMULATOR_RAM_SIZE];
+    uint32_t pc;
+} EmulatorState;
+
+/**
+ * An instruction decoded once when the program is loaded, so running it is a single indirect jump with its operands
+ * ready to use.
+ */
+typedef struct _DecodedInstruction {
+    uint8_t op;       // EMULATOR_OP_*
+    uint8_t operand;  // register index, or the STLO/STHI bits already shifted into place
+    uint32_t target;  // PC after a taken JUMP or SKIP, the END sentinel if that leaves the program
+} DecodedInstruction;
+
+/**
+ * A RISC-MC8 (ISA 4.5) machine with its program predecoded. The decoded program has two END sentinels after the
+ * last instruction, so running off the end (even by a SKIP of the last instruction) needs no bounds checks.
+ */
+typedef struct _Emulator {
+    EmulatorState state;
+    DecodedInstruction* program;
+    uint32_t length;    // instructions in the program, not counting sentinels
+    uint64_t executed;  // instructions executed since the last reset, not counting a halting JUMP
+    uint32_t jumpSpan;  // most instructions from taking a JUMP to reaching the next one, bounding those between checks
+    struct _EmulatorIo* io;  // serves RAM addresses 0x00 and 0x01, NULL if they are plain RAM
+    uint64_t* branchCounts;  // two per instruction, times a SKIP or JUMP was not taken and taken, NULL if not counted
+} Emulator;
+
+/**
+ * @brief Predecode a program and reset the machine
+ *
+ * @param emulator The emulator to initialize
+ * @param code The program, one instruction per byte
+ * @param length Number of instructions in code
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY or ERROR_VALUE_OUT_OF_RANGE if the program is too long
+ */
+uint8_t initEmulator(Emulator* emulator, const uint8_t* const code, uint32_t length);
+
+/**
+ * @brief Free the decoded program
+ *
+ * @param emulator The emulator to free
+ */
+void freeEmulator(Emulator* emulator);
+
+/**
+ * @brief Zero the registers, RAM, program counter and executed count
+ *
+ * @param emulator The emulator to reset
+ */
+void resetEmulator(Emulator* emulator);
+
+/**
+ * @brief Serve the I/O ports from host channels, or make them plain RAM again
+ *
+ * LOAD and STOR are decoded into handlers that check for the ports, so a program without I/O attached pays nothing
+ * for them.
+ *
+ * @param emulator The emulator
+ * @param io Started channels, or NULL to detach them
+ */
+void attachEmulatorIo(Emulator* emulator, struct _EmulatorIo* io);
+
+/**
+ * @brief Count how often each SKIP and JUMP goes each way, or stop counting
+ *
+ * Like attachEmulatorIo, SKIP and JUMP are decoded into counting handlers only while counting, so other runs pay
+ * nothing and counting runs only pay on branches.
+ *
+ * @param emulator The emulator
+ * @param branchCounts Zeroed counts, two per instruction (not taken then taken), or NULL to stop counting
+ */
+void attachBranchCounts(Emulator* emulator, uint64_t* branchCounts);
+
+/**
+ * @brief Run until the program halts
+ *
+ * Cycles are found with Brent's algorithm on snapshots of the state taken every EMULATOR_CHECK_INTERVAL jumps
+ * (every infinite run takes infinitely many jumps), which costs nothing on other instructions. The step limit is
+ * checked at the same points, which come sooner as it nears so it is never passed, and the last few instructions
+ * before it are run by stepEmulator. I/O between two checkpoints restarts cycle detection, since the host side is not
+ * part of the state.
+ *
+ * @param emulator The emulator to run, continuing from its current state
+ * @param maxSteps Most instructions to execute, 0 for no limit
+ * @return The EMULATOR_HALT_* reason it stopped
+ */
+uint8_t runEmulator(Emulator* emulator, uint64_t maxSteps);
+
+/**
+ * @brief Execute an exact number of instructions, one at a time
+ *
+ * Much slower than runEmulator, but it stops exactly where asked, which replaying a trace needs. There is no cycle
+ * detection, and branches are counted only while attachBranchCounts is counting them.
+ *
+ * @param emulator The emulator to step, continuing from its current state
+ * @param steps Most instructions to execute
+ * @param breakPc Stop as soon as the program counter reaches this, UINT32_MAX for no breakpoint
+ * @return EMULATOR_HALT_STEP_LIMIT after executing every step, EMULATOR_HALT_BREAKPOINT, or why the program halted
+ */
+uint8_t stepEmulator(Emulator* emulator, uint64_t steps, uint32_t breakPc);
+
+/**
+ * @brief Get a description of a halt reason
+ *
+ * @param reason An EMULATOR_HALT_* reason
+ * @return The description, such as "jump to itself"
+ */
+const char* getHaltReason(uint8_t reason);
+
+/**
+ * @brief Print the register file in the format of the FINAL STATE block in testcode.asm
+ *
+ * @param stream Where to print
+ * @param title Heading of the block, such as "FINAL STATE"
+ * @param state The state to print
+ */
+void printEmulatorState(FILE* stream, const char* const title, const EmulatorState* const state);
+
+#endif
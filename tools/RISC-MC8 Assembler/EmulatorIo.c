@@ -0,0 +1,432 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "EmulatorIo.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "StatusCodes.h"
+
+#define IO_CHUNK 65536           // bytes a host thread moves per read or write call
+#define IO_SPINS 64              // yields before backing off to sleeps
+#define IO_SLEEP_NS 100000       // sleep while a ring stays full or empty
+#define IO_POLL_INTERVAL_MS 250  // how often the reader checks whether it should stop
+
+#if !defined(_WIN32)
+
+/**
+ * @brief Wait a little for the other side of a ring, yielding at first and then sleeping
+ *
+ * @param idle Number of times waited in a row, reset it once the ring moves
+ */
+static void backOff(uint32_t* idle)
+{
+    if (*idle < IO_SPINS) {
+        (*idle)++;
+        sched_yield();
+    } else {
+        struct timespec pause = {0, IO_SLEEP_NS};
+        nanosleep(&pause, NULL);
+    }
+}
+
+/**
+ * @brief Reader thread, copy the input file descriptor into the input ring until it ends
+ *
+ * @param argument The EmulatorIo
+ * @return NULL
+ */
+static void* readHostInput(void* argument)
+{
+    EmulatorIo* io = (EmulatorIo*)argument;
+    uint8_t* buffer = (uint8_t*)malloc(IO_CHUNK);
+    size_t length = 0;
+    size_t written = 0;
+    uint32_t idle = 0;
+    if (buffer == NULL) {
+        atomic_store(&io->failed, true);
+    }
+    while (buffer != NULL && !atomic_load_explicit(&io->stopping, memory_order_relaxed)) {
+        if (written == length) {
+            // poll first so a quiet pipe or terminal does not keep finishEmulatorIo waiting
+            struct pollfd request = {io->inputFd, POLLIN, 0};
+            int ready = poll(&request, 1, IO_POLL_INTERVAL_MS);
+            if (ready == 0 || (ready < 0 && errno == EINTR)) {
+                continue;
+            }
+            ssize_t received = ready < 0 ? -1 : read(io->inputFd, buffer, IO_CHUNK);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            } else if (received < 0) {
+                atomic_store(&io->failed, true);
+                break;
+            } else if (received == 0) {
+                break;
+            }
+            length = (size_t)received;
+            written = 0;
+        }
+        size_t moved = writeByteRing(&io->input, buffer + written, length - written);
+        written += moved;
+        if (moved == 0) {
+            backOff(&idle);
+        } else {
+            idle = 0;
+        }
+    }
+    closeByteRing(&io->input);
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * @brief Writer thread, copy the output ring to the output file descriptor until the ring is closed and drained
+ *
+ * @param argument The EmulatorIo
+ * @return NULL
+ */
+static void* writeHostOutput(void* argument)
+{
+    EmulatorIo* io = (EmulatorIo*)argument;
+    uint8_t* buffer = (uint8_t*)malloc(IO_CHUNK);
+    uint8_t discard[EMULATOR_IO_BATCH];
+    uint32_t idle = 0;
+    bool writing = io->outputFd >= 0 && buffer != NULL;
+    if (buffer == NULL) {
+        atomic_store(&io->failed, true);
+    }
+    while (true) {
+        // keep draining after a failure, the CPU would otherwise wait forever on a full ring
+        size_t length = readByteRing(&io->output, writing ? buffer : discard, writing ? IO_CHUNK : sizeof(discard));
+        if (length == 0) {
+            if (isByteRingFinished(&io->output)) {
+                break;
+            }
+            backOff(&idle);
+            continue;
+        }
+        idle = 0;
+        size_t sent = 0;
+        while (writing && sent < length) {
+            ssize_t result = write(io->outputFd, buffer + sent, length - sent);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            } else if (result < 0) {
+                atomic_store(&io->failed, true);
+                writing = false;
+            } else {
+                sent += (size_t)result;
+            }
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * @brief Connect the ports to host file descriptors and start the I/O threads
+ *
+ * @param io The channels to start
+ * @param inputFd Where input bytes come from, -1 for none
+ * @param outputFd Where output bytes go, -1 to discard them
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY or ERROR_IO_UNAVAILABLE
+ */
+uint8_t startEmulatorIo(EmulatorIo* io, int inputFd, int outputFd)
+{
+    io->inputFd = inputFd;
+    io->outputFd = outputFd;
+    io->ownsInput = false;
+    io->ownsOutput = false;
+    io->inputPosition = 0;
+    io->inputLength = 0;
+    io->outputLength = 0;
+    io->idlePolls = 0;
+    io->bytesIn = 0;
+    io->bytesOut = 0;
+    io->portAccesses = 0;
+    io->recording = NULL;
+    io->replay = NULL;
+    atomic_init(&io->stopping, false);
+    atomic_init(&io->failed, false);
+    if (initByteRing(&io->input, EMULATOR_IO_RING_SIZE) != 0) {
+        freeByteRing(&io->input);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    if (initByteRing(&io->output, EMULATOR_IO_RING_SIZE) != 0) {
+        freeByteRing(&io->input);
+        freeByteRing(&io->output);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    if (inputFd < 0) {
+        closeByteRing(&io->input);
+    } else if (pthread_create(&io->reader, NULL, readHostInput, io) != 0) {
+        freeByteRing(&io->input);
+        freeByteRing(&io->output);
+        return ERROR_IO_UNAVAILABLE;
+    }
+    if (pthread_create(&io->writer, NULL, writeHostOutput, io) != 0) {
+        if (inputFd >= 0) {
+            atomic_store(&io->stopping, true);
+            pthread_join(io->reader, NULL);
+        }
+        freeByteRing(&io->input);
+        freeByteRing(&io->output);
+        return ERROR_IO_UNAVAILABLE;
+    }
+    return 0;
+}
+
+/**
+ * @brief Open host files (or `-` for stdin and stdout) and start the I/O threads on them
+ *
+ * @param io The channels to start
+ * @param inputPath File to read input from, `-` for stdin, NULL for none
+ * @param outputPath File to create for output, `-` for stdout, NULL to discard output
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if a file could not be opened, otherwise as startEmulatorIo
+ */
+uint8_t openEmulatorIo(EmulatorIo* io, const char* const inputPath, const char* const outputPath)
+{
+    int inputFd = -1;
+    int outputFd = -1;
+    if (inputPath != NULL) {
+        inputFd = strcmp(inputPath, "-") == 0 ? STDIN_FILENO : open(inputPath, O_RDONLY);
+    }
+    if (outputPath != NULL) {
+        outputFd = strcmp(outputPath, "-") == 0 ? STDOUT_FILENO : open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+    bool ownsInput = inputFd >= 0 && inputFd != STDIN_FILENO;
+    bool ownsOutput = outputFd >= 0 && outputFd != STDOUT_FILENO;
+    uint8_t status = 0;
+    if ((inputPath != NULL && inputFd < 0) || (outputPath != NULL && outputFd < 0)) {
+        status = ERROR_INVALID_ARGUMENTS;
+    } else {
+        status = startEmulatorIo(io, inputFd, outputFd);
+    }
+    if (status != 0) {
+        if (ownsInput) {
+            close(inputFd);
+        }
+        if (ownsOutput) {
+            close(outputFd);
+        }
+        return status;
+    }
+    io->ownsInput = ownsInput;
+    io->ownsOutput = ownsOutput;
+    return 0;
+}
+
+/**
+ * @brief Move the CPU side's output batch into the output ring, waiting while it is full
+ *
+ * @param io The channels
+ */
+static void flushOutput(EmulatorIo* io)
+{
+    uint32_t sent = 0;
+    uint32_t idle = 0;
+    while (sent < io->outputLength) {
+        size_t moved = writeByteRing(&io->output, io->outputBatch + sent, io->outputLength - sent);
+        sent += (uint32_t)moved;
+        if (moved == 0) {
+            backOff(&idle);
+        }
+    }
+    io->outputLength = 0;
+}
+
+/**
+ * @brief Send the remaining output, stop the I/O threads, free the rings and close the files openEmulatorIo opened
+ *
+ * @param io The channels to finish
+ * @return 0 if successful, ERROR_IO_UNAVAILABLE if a read or write on the host side failed
+ */
+uint8_t finishEmulatorIo(EmulatorIo* io)
+{
+    if (io->replay != NULL) {
+        return 0;
+    }
+    flushOutput(io);
+    closeByteRing(&io->output);
+    atomic_store(&io->stopping, true);
+    if (io->inputFd >= 0) {
+        pthread_join(io->reader, NULL);
+    }
+    pthread_join(io->writer, NULL);
+    freeByteRing(&io->input);
+    freeByteRing(&io->output);
+    if (io->ownsInput) {
+        close(io->inputFd);
+    }
+    if (io->ownsOutput && close(io->outputFd) != 0) {
+        atomic_store(&io->failed, true);
+    }
+    return atomic_load(&io->failed) ? ERROR_IO_UNAVAILABLE : 0;
+}
+
+/**
+ * @brief Make sure the CPU side's input batch has a byte, taking the next batch from the input ring if needed
+ *
+ * @param io The channels
+ * @return true if a byte is ready
+ */
+static inline bool refillInput(EmulatorIo* io)
+{
+    if (io->inputPosition < io->inputLength) {
+        return true;
+    }
+    io->inputLength = (uint32_t)readByteRing(&io->input, io->inputBatch, EMULATOR_IO_BATCH);
+    io->inputPosition = 0;
+    return io->inputLength != 0;
+}
+
+/**
+ * @brief LOAD from a port connected to the host, waiting for input on the data port
+ *
+ * @param io The channels
+ * @param address EMULATOR_IO_DATA or EMULATOR_IO_STATUS
+ * @return The byte read
+ */
+static uint8_t readHostPort(EmulatorIo* io, uint8_t address)
+{
+    if (address == EMULATOR_IO_STATUS) {
+        uint8_t status = io->outputLength < EMULATOR_IO_BATCH || getByteRingLength(&io->output) < io->output.capacity ? EMULATOR_IO_STATUS_OUTPUT : 0;
+        if (refillInput(io)) {
+            io->idlePolls = 0;
+            return status | EMULATOR_IO_STATUS_INPUT;
+        } else if (isByteRingFinished(&io->input)) {
+            return status | EMULATOR_IO_STATUS_ENDED;
+        }
+        // the program is busy-waiting, so whatever it wrote so far should reach the host, and the host threads need
+        // the processor more than it does
+        flushOutput(io);
+        if (++io->idlePolls >= IO_SPINS) {
+            io->idlePolls = 0;
+            sched_yield();
+        }
+        return status;
+    }
+    uint32_t idle = 0;
+    while (!refillInput(io)) {
+        if (isByteRingFinished(&io->input)) {
+            return 0;
+        }
+        flushOutput(io);  // a prompt has to be seen before its answer can arrive
+        backOff(&idle);
+    }
+    io->bytesIn++;
+    return *(io->inputBatch + io->inputPosition++);
+}
+
+/**
+ * @brief STOR to a port connected to the host, waiting while the output ring is full
+ *
+ * @param io The channels
+ * @param address EMULATOR_IO_DATA or EMULATOR_IO_STATUS
+ * @param value The byte stored
+ */
+static void writeHostPort(EmulatorIo* io, uint8_t address, uint8_t value)
+{
+    if (address != EMULATOR_IO_DATA) {
+        return;
+    }
+    if (io->outputLength == EMULATOR_IO_BATCH) {
+        flushOutput(io);
+    }
+    *(io->outputBatch + io->outputLength++) = value;
+    io->bytesOut++;
+}
+
+#else
+
+uint8_t startEmulatorIo(EmulatorIo* io, int inputFd, int outputFd)
+{
+    fprintf(stderr, "Error: Emulator I/O is not supported on this platform.\n");
+    return ERROR_IO_UNAVAILABLE;
+}
+
+uint8_t openEmulatorIo(EmulatorIo* io, const char* const inputPath, const char* const outputPath)
+{
+    return startEmulatorIo(io, -1, -1);
+}
+
+uint8_t finishEmulatorIo(EmulatorIo* io)
+{
+    return 0;
+}
+
+static uint8_t readHostPort(EmulatorIo* io, uint8_t address)
+{
+    return address == EMULATOR_IO_STATUS ? EMULATOR_IO_STATUS_ENDED | EMULATOR_IO_STATUS_OUTPUT : 0;
+}
+
+static void writeHostPort(EmulatorIo* io, uint8_t address, uint8_t value) {}
+
+#endif
+
+/**
+ * @brief Serve the ports from bytes recorded earlier instead of the host, without starting any threads
+ *
+ * @param io The channels to start
+ * @param data Bytes the ports returned when recording, must outlive the channels
+ * @param length Number of bytes in data
+ */
+void startReplayIo(EmulatorIo* io, const uint8_t* const data, size_t length)
+{
+    memset(io, 0, sizeof(EmulatorIo));
+    atomic_init(&io->stopping, false);
+    atomic_init(&io->failed, false);
+    io->inputFd = -1;
+    io->outputFd = -1;
+    io->replay = data;
+    io->replayLength = length;
+}
+
+/**
+ * @brief LOAD from an I/O port, waiting for input on the data port
+ *
+ * @param io The channels
+ * @param address EMULATOR_IO_DATA or EMULATOR_IO_STATUS
+ * @return The byte read
+ */
+uint8_t readIoPort(EmulatorIo* io, uint8_t address)
+{
+    io->portAccesses++;
+    if (io->replay != NULL) {
+        return io->replayPosition < io->replayLength ? *(io->replay + io->replayPosition++) : 0;
+    }
+    uint8_t value = readHostPort(io, address);
+    if (io->recording != NULL && !appendCode(io->recording, value)) {
+        atomic_store(&io->failed, true);
+    }
+    return value;
+}
+
+/**
+ * @brief STOR to an I/O port, waiting while the output ring is full
+ *
+ * @param io The channels
+ * @param address EMULATOR_IO_DATA or EMULATOR_IO_STATUS
+ * @param value The byte stored
+ */
+void writeIoPort(EmulatorIo* io, uint8_t address, uint8_t value)
+{
+    io->portAccesses++;
+    if (io->replay == NULL) {
+        writeHostPort(io, address, value);
+    }
+}
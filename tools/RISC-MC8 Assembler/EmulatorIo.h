@@ -0,0 +1,113 @@
+#ifndef EMULATORIO_H
+#define EMULATORIO_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "ByteRing.h"
+#include "CodeBuffer.h"
+
+// RAM addresses ISA 4.5 reserves for I/O
+#define EMULATOR_IO_DATA 0x00    // LOAD takes the next input byte, STOR sends an output byte
+#define EMULATOR_IO_STATUS 0x01  // LOAD reads EMULATOR_IO_STATUS_* bits, STOR is ignored
+#define EMULATOR_IO_PORTS 2
+
+// bits of the status port
+#define EMULATOR_IO_STATUS_INPUT 0b001   // an input byte is ready, LOAD of the data port will not wait
+#define EMULATOR_IO_STATUS_ENDED 0b010   // input has ended and every byte was read, the data port reads 0
+#define EMULATOR_IO_STATUS_OUTPUT 0b100  // STOR to the data port will not wait
+
+#define EMULATOR_IO_RING_SIZE (1u << 20)
+#define EMULATOR_IO_BATCH 256  // bytes the CPU side moves through a ring at a time
+
+/**
+ * Host channels behind the I/O ports. A reader thread fills the input ring from a file descriptor and a writer thread
+ * drains the output ring into another, so the CPU loop only ever touches the rings. The CPU side also batches its
+ * bytes so it does not pay for the ring's atomics on every LOAD and STOR.
+ */
+typedef struct _EmulatorIo {
+    ByteRing input;
+    ByteRing output;
+    int inputFd;   // -1 for no input, the data port then reads as ended
+    int outputFd;  // -1 to discard output
+    bool ownsInput;   // inputFd was opened by openEmulatorIo and is closed when finished
+    bool ownsOutput;
+    pthread_t reader;
+    pthread_t writer;
+    atomic_bool stopping;
+    atomic_bool failed;  // a read or write on the host side failed
+    // CPU side batches
+    uint8_t inputBatch[EMULATOR_IO_BATCH];
+    uint32_t inputPosition;
+    uint32_t inputLength;
+    uint8_t outputBatch[EMULATOR_IO_BATCH];
+    uint32_t outputLength;
+    uint32_t idlePolls;  // status reads in a row that found nothing to do
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t portAccesses;  // LOADs and STORs of the ports so far
+    // record and replay, see Trace.h
+    CodeBuffer* recording;  // receives every byte a LOAD of a port returns, NULL if not recording
+    const uint8_t* replay;  // LOADs of the ports return these bytes instead and STORs are dropped, NULL if live
+    size_t replayLength;
+    size_t replayPosition;
+} EmulatorIo;
+
+/**
+ * @brief Connect the ports to host file descriptors and start the I/O threads
+ *
+ * @param io The channels to start
+ * @param inputFd Where input bytes come from, -1 for none
+ * @param outputFd Where output bytes go, -1 to discard them
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY or ERROR_IO_UNAVAILABLE
+ */
+uint8_t startEmulatorIo(EmulatorIo* io, int inputFd, int outputFd);
+
+/**
+ * @brief Open host files (or `-` for stdin and stdout) and start the I/O threads on them
+ *
+ * @param io The channels to start
+ * @param inputPath File to read input from, `-` for stdin, NULL for none
+ * @param outputPath File to create for output, `-` for stdout, NULL to discard output
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if a file could not be opened, otherwise as startEmulatorIo
+ */
+uint8_t openEmulatorIo(EmulatorIo* io, const char* const inputPath, const char* const outputPath);
+
+/**
+ * @brief Serve the ports from bytes recorded earlier instead of the host, without starting any threads
+ *
+ * @param io The channels to start
+ * @param data Bytes the ports returned when recording, must outlive the channels
+ * @param length Number of bytes in data
+ */
+void startReplayIo(EmulatorIo* io, const uint8_t* const data, size_t length);
+
+/**
+ * @brief Send the remaining output, stop the I/O threads, free the rings and close the files openEmulatorIo opened
+ *
+ * @param io The channels to finish
+ * @return 0 if successful, ERROR_IO_UNAVAILABLE if a read or write on the host side failed
+ */
+uint8_t finishEmulatorIo(EmulatorIo* io);
+
+/**
+ * @brief LOAD from an I/O port, waiting for input on the data port
+ *
+ * @param io The channels
+ * @param address EMULATOR_IO_DATA or EMULATOR_IO_STATUS
+ * @return The byte read
+ */
+uint8_t readIoPort(EmulatorIo* io, uint8_t address);
+
+/**
+ * @brief STOR to an I/O port, waiting while the output ring is full
+ *
+ * @param io The channels
+ * @param address EMULATOR_IO_DATA or EMULATOR_IO_STATUS
+ * @param value The byte stored
+ */
+void writeIoPort(EmulatorIo* io, uint8_t address, uint8_t value);
+
+#endif
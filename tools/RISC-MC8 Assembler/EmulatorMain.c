@@ -0,0 +1,718 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Assembler.h"
+#include "AssemblerStats.h"
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Disassembler.h"
+#include "Emulator.h"
+#include "EmulatorIo.h"
+#include "LineTable.h"
+#include "LockstepEmulator.h"
+#include "Profiler.h"
+#include "Registers.h"
+#include "Source.h"
+#include "StatusCodes.h"
+#include "Trace.h"
+
+#define USAGE \
+    "Expected arguments: [--max-steps N] [--time] [--input path | -] [--output path | -] [--profile | --annotate]\n" \
+    "                    [--label-counts path] [--record trace [--checkpoint-interval N]] program.o | program.asm\n" \
+    "                or: (--sweep cell[,cell...] | --random N [--seed S]) [--states] [--threads N] [--max-steps N]\n" \
+    "                    [--time] program.o | program.asm\n" \
+    "                or: --replay trace\n"
+
+#define REPLAY_HELP \
+    "Commands: seek N, step [N], rstep [N], continue [pc], rcontinue [pc], state, ram, quit\n"
+
+#define MAX_SWEEP_CELLS 3
+#define LOCKSTEP_BATCH_SIZE (1u << 20)  // instances run between printing or counting results
+
+/**
+ * Initial states for lockstep runs. A sweep enumerates every combination of values of a few registers and RAM cells
+ * (the rest start at zero), otherwise every register and RAM cell is random, seeded per instance.
+ */
+typedef struct _InitialStates {
+    uint32_t numCells;
+    int32_t cells[MAX_SWEEP_CELLS];  // register index, or EMULATOR_NUM_REGISTERS + RAM address
+    uint64_t seed;
+} InitialStates;
+
+/**
+ * @brief Load the line table the assembler wrote next to a program with --line-table
+ *
+ * @param path Path of the assembled program
+ * @param table Empty table to fill in, left empty if there is none
+ */
+static void loadLineTable(const char* const path, LineTable* table)
+{
+    size_t pathLength = strlen(path);
+    char* tablePath = (char*)malloc(pathLength + sizeof(LINE_TABLE_EXTENSION));
+    SourceReader file;
+    if (tablePath == NULL) {
+        return;
+    }
+    memcpy(tablePath, path, pathLength);
+    memcpy(tablePath + pathLength, LINE_TABLE_EXTENSION, sizeof(LINE_TABLE_EXTENSION));
+    if (openSourceFile(&file, tablePath) != 0) {
+        fprintf(stderr, "Note: No line table at %s, assemble with --line-table to profile by source line.\n", tablePath);
+    } else {
+        if (file.data == NULL || readLineTable((const uint8_t*)file.data, file.length, table) != 0) {
+            fprintf(stderr, "Note: Ignoring malformed line table %s.\n", tablePath);
+            freeLineTable(table);
+        }
+        closeSource(&file);
+    }
+    free(tablePath);
+}
+
+/**
+ * @brief Load a program, assembling it first if it is a .asm source
+ *
+ * @param path Path of an assembled program or of a source ending in .asm
+ * @param code Buffer to append the program to
+ * @param table Receives the program's line table if not NULL, left empty if there is none
+ * @return 0 if successful, otherwise the error that occurred (already printed)
+ */
+static uint8_t loadProgram(const char* const path, CodeBuffer* code, LineTable* table)
+{
+    SourceReader source;
+    if (openSourceFile(&source, path) != 0) {
+        fprintf(stderr, "Error: Input file does not exist.\n");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    uint8_t status = 0;
+    size_t pathLength = strlen(path);
+    if (pathLength >= 4 && strcmp(path + pathLength - 4, ".asm") == 0) {
+        AssemblerDiagnostic diagnostic;
+        RelaxationReport relaxation;
+        AssemblerOptions options = {ASSEMBLER_MODE_TWO_PASS, 1, NULL, &relaxation};
+        status = assembleSource(&source, code, &options, &diagnostic);
+        if (status != 0) {
+            printDiagnostic(stderr, &diagnostic);
+        } else if (table != NULL && (!rewindSource(&source) || buildLineTable(&source, path, table) != 0 || relaxLineTable(table, &relaxation) != 0)) {
+            freeLineTable(table);  // profiling still works by program offset
+        }
+        freeRelaxationReport(&relaxation);
+    } else if (source.data != NULL && source.length > 0) {
+        if (reserveCode(code, source.length)) {
+            memcpy(code->data, source.data, source.length);
+            code->length = source.length;
+        } else {
+            status = ERROR_OUT_OF_MEMORY;
+            fprintf(stderr, "Error: Out of memory.\n");
+        }
+        if (table != NULL) {
+            loadLineTable(path, table);
+        }
+    }
+    closeSource(&source);
+    return status;
+}
+
+/**
+ * @brief Parse a comma-separated list of registers (`ireg`, `r1`, `001`...) and RAM cells (`m0` to `m255`)
+ *
+ * @param text The list
+ * @param states Receives the cells
+ * @return true if successful, false if a cell is unknown or there are more than MAX_SWEEP_CELLS
+ */
+static bool parseSweepCells(const char* const text, InitialStates* states)
+{
+    const char* start = text;
+    states->numCells = 0;
+    while (true) {
+        const char* end = strchr(start, ',');
+        uint32_t length = end == NULL ? (uint32_t)strlen(start) : (uint32_t)(end - start);
+        if (states->numCells == MAX_SWEEP_CELLS || length == 0) {
+            return false;
+        }
+        const RegisterDefinition* reg = getRegisterDefinitionN(start, length);
+        if (reg != NULL) {
+            states->cells[states->numCells] = reg->value;
+        } else if (*start == 'm' || *start == 'M') {
+            char* numberEnd;
+            unsigned long address = strtoul(start + 1, &numberEnd, 10);
+            if (numberEnd != start + length || numberEnd == start + 1 || address >= EMULATOR_RAM_SIZE) {
+                return false;
+            }
+            states->cells[states->numCells] = EMULATOR_NUM_REGISTERS + (int32_t)address;
+        } else {
+            return false;
+        }
+        states->numCells++;
+        if (end == NULL) {
+            return true;
+        }
+        start = end + 1;
+    }
+}
+
+/**
+ * @brief Set the swept cells from the bytes of the instance number
+ *
+ * @param context The InitialStates
+ * @param instance The instance, its lowest byte is the first cell's value
+ * @param state The zeroed state to fill in
+ */
+static void generateSweepState(void* context, uint64_t instance, EmulatorState* state)
+{
+    const InitialStates* states = (const InitialStates*)context;
+    for (uint32_t i = 0; i < states->numCells; i++) {
+        uint8_t value = (uint8_t)(instance >> (8 * i));
+        if (states->cells[i] < EMULATOR_NUM_REGISTERS) {
+            state->registers[states->cells[i]] = value;
+        } else {
+            state->ram[states->cells[i] - EMULATOR_NUM_REGISTERS] = value;
+        }
+    }
+}
+
+/**
+ * @brief splitmix64, so every instance gets its own independent stream from the seed
+ *
+ * @param x The state to advance
+ * @return The next random number
+ */
+static uint64_t nextRandom(uint64_t* x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Fill every register and RAM cell with random values
+ *
+ * @param context The InitialStates
+ * @param instance The instance, mixed into the seed
+ * @param state The zeroed state to fill in
+ */
+static void generateRandomState(void* context, uint64_t instance, EmulatorState* state)
+{
+    uint64_t x = ((const InitialStates*)context)->seed ^ (instance * 0xd1b54a32d192ed03ull);
+    uint64_t word = nextRandom(&x);
+    memcpy(state->registers, &word, sizeof(state->registers));
+    for (uint32_t i = 0; i < EMULATOR_RAM_SIZE; i += sizeof(word)) {
+        word = nextRandom(&x);
+        memcpy(state->ram + i, &word, sizeof(word));
+    }
+}
+
+/**
+ * @brief Print one register file as hex bytes, ireg first
+ */
+static void printRegisters(const uint8_t* const registers)
+{
+    for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+        printf(" %02X", *(registers + i));
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Run a program from many initial states in SIMD lockstep, printing each final state or a histogram of them
+ *
+ * @param emulator Holds the predecoded program
+ * @param states How to generate the initial states
+ * @param numInstances Number of instances
+ * @param printStates true to print every instance's final state, false to print a histogram of outcomes
+ * @param maxSteps Most lockstep steps per group of instances, 0 for the default
+ * @param numThreads Number of threads to use, 0 for one per processor
+ * @param timed true to print how long the run took
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t runInstances(const Emulator* const emulator, InitialStates* states, uint64_t numInstances, bool printStates, uint64_t maxSteps, uint32_t numThreads, bool timed)
+{
+    InitialStateGenerator generate = states->numCells > 0 ? &generateSweepState : &generateRandomState;
+    uint64_t batchSize = numInstances < LOCKSTEP_BATCH_SIZE ? numInstances : LOCKSTEP_BATCH_SIZE;
+    LockstepResult* results = (LockstepResult*)malloc((batchSize > 0 ? batchSize : 1) * sizeof(LockstepResult));
+    if (results == NULL) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return ERROR_OUT_OF_MEMORY;
+    }
+    OutcomeHistogram histogram;
+    memset(&histogram, 0, sizeof(histogram));
+    uint64_t executed = 0;
+    double seconds = 0;
+
+    uint8_t status = 0;
+    if (printStates) {
+        printf("  instance  halt             pc         executed  ireg r1 r2 r3 r4 r5 r6 r7\n");
+    }
+    for (uint64_t first = 0; first < numInstances && status == 0; first += batchSize) {
+        uint64_t count = numInstances - first < batchSize ? numInstances - first : batchSize;
+        PhaseStats run = {0, 0};
+        PhaseTimer timer;
+        startPhase(&timer);
+        status = runLockstep(emulator, first, count, generate, states, maxSteps, numThreads, results);
+        stopPhase(&timer, &run);
+        seconds += run.wallSeconds;
+        for (uint64_t i = 0; i < count && status == 0; i++) {
+            const LockstepResult* result = results + i;
+            executed += result->executed;
+            if (printStates) {
+                printf("%10" PRIu64 "  %-15s  %-9" PRIu32 "  %9" PRIu64 " ", first + i, getHaltReason(result->reason), result->pc, result->executed);
+                printRegisters(result->registers);
+            }
+        }
+        if (status == 0 && !printStates) {
+            status = addOutcomes(&histogram, results, count);
+        }
+    }
+
+    if (status == 0 && !printStates) {
+        sortOutcomes(&histogram);
+        printf("%" PRIu64 " instances ended in %" PRIu32 " distinct states.\n", histogram.total, histogram.length);
+        printf("     count  halt             ireg r1 r2 r3 r4 r5 r6 r7\n");
+        for (uint32_t i = 0; i < histogram.length; i++) {
+            const OutcomeCount* outcome = histogram.outcomes + i;
+            printf("%10" PRIu64 "  %-15s ", outcome->count, getHaltReason(outcome->reason));
+            printRegisters(outcome->registers);
+        }
+    }
+    if (status == 0 && timed) {
+        double perSecond = seconds > 0 ? executed / seconds : 0;
+        printf("Ran %" PRIu64 " instructions in %.6f seconds (%.1f million instructions per second).\n", executed, seconds, perSecond / 1e6);
+    }
+    if (status != 0) {
+        AssemblerDiagnostic diagnostic = {status, 0, 0};
+        printDiagnostic(stderr, &diagnostic);
+    }
+    freeOutcomeHistogram(&histogram);
+    free(results);
+    return status;
+}
+
+/**
+ * @brief Run a program in slices of a checkpoint interval, writing a checkpoint after each
+ *
+ * runEmulator starts its cycle detection over in every slice, so cycles are found here instead with Brent's algorithm
+ * on the checkpoint states. Each slice is as long as the last one left it, so a cycle without I/O reaches the same
+ * states at its checkpoints every time around.
+ *
+ * @param emulator The emulator to run, with the I/O recording into the writer if attached
+ * @param writer The trace to write
+ * @param interval Instructions between checkpoints
+ * @param maxSteps Most instructions to execute, 0 for no limit
+ * @return The EMULATOR_HALT_* reason it stopped, EMULATOR_HALT_STEP_LIMIT if the trace could not be written
+ */
+static uint8_t recordRun(Emulator* emulator, TraceWriter* writer, uint32_t interval, uint64_t maxSteps)
+{
+    EmulatorState snapshot = emulator->state;
+    uint64_t power = 1;
+    uint64_t sinceSnapshot = 0;
+    uint64_t accesses = emulator->io != NULL ? emulator->io->portAccesses : 0;
+    while (true) {
+        uint64_t target = emulator->executed + interval;
+        if (maxSteps != 0 && target > maxSteps) {
+            target = maxSteps;
+        }
+        uint8_t reason = runEmulator(emulator, target);
+        if (reason != EMULATOR_HALT_STEP_LIMIT || (maxSteps != 0 && emulator->executed >= maxSteps)) {
+            return reason;
+        } else if (writeTraceCheckpoint(writer, emulator) != 0) {
+            return EMULATOR_HALT_STEP_LIMIT;
+        }
+        uint64_t nowAccesses = emulator->io != NULL ? emulator->io->portAccesses : 0;
+        if (nowAccesses != accesses) {
+            accesses = nowAccesses;
+            power = 1;
+            sinceSnapshot = 0;
+            snapshot = emulator->state;
+        } else if (memcmp(&snapshot, &emulator->state, sizeof(EmulatorState)) == 0) {
+            return EMULATOR_HALT_CYCLE;
+        } else if (++sinceSnapshot == power) {
+            power *= 2;
+            sinceSnapshot = 0;
+            snapshot = emulator->state;
+        }
+    }
+}
+
+/**
+ * @brief Parse an optional number after a replay command
+ *
+ * @param text The rest of the command line
+ * @param fallback The value if there is no number
+ * @param value Receives the number
+ * @return true if successful, false if there is something other than a number
+ */
+static bool parseReplayNumber(const char* const text, uint64_t fallback, uint64_t* value)
+{
+    const char* start = text;
+    while (*start == ' ' || *start == '\t') {
+        start++;
+    }
+    if (*start == '\0' || *start == '\n') {
+        *value = fallback;
+        return true;
+    }
+    char* end;
+    *value = strtoull(start, &end, 0);
+    while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n') {
+        end++;
+    }
+    return *end == '\0' && *start != '-';
+}
+
+/**
+ * @brief Print where a replay is and the instruction about to run there
+ *
+ * @param replay The replay
+ */
+static void printReplayPosition(const TraceReplay* const replay)
+{
+    uint32_t pc = replay->emulator.state.pc;
+    printf("At instruction %" PRIu64 ", pc %" PRIu32 ".\n", replay->emulator.executed, pc);
+    if (pc < replay->programLength) {
+        char instruction[DISASSEMBLY_MAX_INSTRUCTION];
+        printf("Next: %.*s", (int)disassembleInstruction(instruction, *(replay->program + pc)), instruction);
+    }
+    if (replay->emulator.executed == replay->endExecuted) {
+        printf("End of the recording, halted by %s.\n", getHaltReason(replay->endReason));
+    } else if (replay->emulator.executed == 0) {
+        printf("Start of the recording.\n");
+    }
+}
+
+/**
+ * @brief Move around a recorded run with commands read from stdin
+ *
+ * @param path Path of the trace
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t replayTrace(const char* const path)
+{
+    TraceReplay replay;
+    uint8_t status = openTraceReplay(&replay, path);
+    if (status != 0) {
+        if (status == ERROR_INVALID_ARGUMENTS) {
+            fprintf(stderr, "Error: Input file does not exist.\n");
+        } else {
+            AssemblerDiagnostic diagnostic = {status, 0, 0};
+            printDiagnostic(stderr, &diagnostic);
+        }
+        return status;
+    }
+    printf("Replaying %" PRIu64 " instructions of a %" PRIu32 " byte program, %" PRIu32 " checkpoints.\n", replay.endExecuted, replay.programLength, replay.numCheckpoints);
+    printf(REPLAY_HELP);
+    printReplayPosition(&replay);
+
+    char line[256];
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        char* arguments = line + strcspn(line, " \t\r\n");
+        size_t commandLength = (size_t)(arguments - line);
+        uint64_t now = replay.emulator.executed;
+        uint64_t value;
+        bool moved = true;
+        bool valid = true;
+        if (commandLength == 0) {
+            moved = false;
+        } else if (strncmp(line, "quit", commandLength) == 0 && commandLength == 4) {
+            break;
+        } else if (strncmp(line, "seek", commandLength) == 0 && commandLength == 4) {
+            valid = parseReplayNumber(arguments, now, &value);
+            if (valid) {
+                seekTrace(&replay, value);
+            }
+        } else if ((strncmp(line, "step", commandLength) == 0 && commandLength == 4) || (strncmp(line, "rstep", commandLength) == 0 && commandLength == 5)) {
+            valid = parseReplayNumber(arguments, 1, &value);
+            if (valid && *line == 'r') {
+                seekTrace(&replay, value < now ? now - value : 0);
+            } else if (valid) {
+                seekTrace(&replay, value < UINT64_MAX - now ? now + value : UINT64_MAX);
+            }
+        } else if ((strncmp(line, "continue", commandLength) == 0 && commandLength == 8) || (strncmp(line, "rcontinue", commandLength) == 0 && commandLength == 9)) {
+            valid = parseReplayNumber(arguments, UINT32_MAX, &value) && value <= UINT32_MAX;
+            bool stopped = false;
+            if (valid && *line == 'r') {
+                stopped = reverseContinueTrace(&replay, (uint32_t)value);
+            } else if (valid) {
+                stopped = continueTrace(&replay, (uint32_t)value);
+            }
+            if (stopped) {
+                printf("Stopped at the breakpoint.\n");
+            }
+        } else if (strncmp(line, "state", commandLength) == 0 && commandLength == 5) {
+            moved = false;
+            printEmulatorState(stdout, "STATE", &replay.emulator.state);
+        } else if (strncmp(line, "ram", commandLength) == 0 && commandLength == 3) {
+            moved = false;
+            for (uint32_t row = 0; row < EMULATOR_RAM_SIZE; row += 16) {
+                printf("%02" PRIX32 ":", row);
+                for (uint32_t i = row; i < row + 16; i++) {
+                    printf(" %02X", *(replay.emulator.state.ram + i));
+                }
+                printf("\n");
+            }
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            printf("Error: Unknown command.\n" REPLAY_HELP);
+        } else if (moved) {
+            printReplayPosition(&replay);
+        }
+        fflush(stdout);
+    }
+    closeTraceReplay(&replay);
+    return 0;
+}
+
+/**
+ * @brief Run a RISC-MC8 program until it halts and print its final registers
+ *
+ * @param argc Argument count
+ * @param argv Arguments, should be `[--max-steps N] [--time] program`, where program is an assembled binary or a
+ *             source ending in .asm. Programs halt at a jump to itself (such as `jump 0`), when the machine state
+ *             repeats, when they run off the end, or after --max-steps instructions. --time reports the run speed.
+ *             `--input` and `--output` connect the I/O ports at RAM addresses 0x00 and 0x01 to files, `-` being stdin
+ *             and stdout, and the final state is then printed on stderr. `--profile` reports the most executed
+ *             labels, lines and branches by source line (from the assembler's --line-table file for a program.o),
+ *             and `--annotate` also prints the source with execution counts in the margin. `--label-counts path`
+ *             writes how often each label was reached, for the assembler's --layout. `--record trace` writes
+ *             the run with a checkpoint every --checkpoint-interval instructions, and `--replay trace` moves forward
+ *             and backward through a recorded run with commands read from stdin.
+ *             `--sweep cells` runs the program from every combination of values of up to 3 registers or RAM cells
+ *             (such as `ireg,r1,m0`), and `--random N` from N random states, in SIMD lockstep on --threads threads,
+ *             printing a histogram of final states or, with --states, each instance's final state.
+ * @return 0 if the program halted, otherwise a non-zero error code accompanied with a message on stderr
+ */
+int main(int argc, char** argv)
+{
+    const char* path = NULL;
+    const char* inputPath = NULL;
+    const char* outputPath = NULL;
+    const char* tracePath = NULL;
+    const char* replayPath = NULL;
+    uint32_t interval = TRACE_DEFAULT_INTERVAL;
+    bool profiled = false;
+    bool annotated = false;
+    const char* countsPath = NULL;
+    uint64_t maxSteps = 0;
+    bool timed = false;
+    bool lockstep = false;
+    bool printStates = false;
+    bool random = false;
+    uint64_t numInstances = 0;
+    uint32_t numThreads = 0;
+    InitialStates states;
+    memset(&states, 0, sizeof(states));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            char* end;
+            maxSteps = strtoull(argv[++i], &end, 10);
+            if (*end != '\0' || *argv[i] == '\0' || *argv[i] == '-') {
+                fprintf(stderr, "Error: Invalid step count.\n");
+                fprintf(stderr, USAGE);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+        } else if (strcmp(argv[i], "--time") == 0) {
+            timed = true;
+        } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            if (!parseSweepCells(argv[++i], &states)) {
+                fprintf(stderr, "Error: Invalid sweep, expected up to %d registers or RAM cells.\n", MAX_SWEEP_CELLS);
+                fprintf(stderr, USAGE);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+            lockstep = true;
+            numInstances = 1ull << (8 * states.numCells);
+        } else if ((strcmp(argv[i], "--random") == 0 || strcmp(argv[i], "--seed") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc) {
+            char* end;
+            const char* option = argv[i];
+            uint64_t value = strtoull(argv[++i], &end, 0);
+            if (*end != '\0' || *argv[i] == '\0' || *argv[i] == '-' || (*(option + 2) == 't' && value > UINT32_MAX)) {
+                fprintf(stderr, "Error: Invalid %s.\n", option + 2);
+                fprintf(stderr, USAGE);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+            if (*(option + 2) == 'r') {
+                lockstep = true;
+                random = true;
+                numInstances = value;
+            } else if (*(option + 2) == 's') {
+                states.seed = value;
+            } else {
+                numThreads = (uint32_t)value;
+            }
+        } else if (strcmp(argv[i], "--checkpoint-interval") == 0 && i + 1 < argc) {
+            char* end;
+            unsigned long long value = strtoull(argv[++i], &end, 0);
+            if (*end != '\0' || *argv[i] == '\0' || *argv[i] == '-' || value == 0 || value > UINT32_MAX) {
+                fprintf(stderr, "Error: Invalid checkpoint interval.\n");
+                fprintf(stderr, USAGE);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+            interval = (uint32_t)value;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            inputPath = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0 || strcmp(argv[i], "--annotate") == 0) {
+            profiled = true;
+            annotated = annotated || strcmp(argv[i], "--annotate") == 0;
+        } else if (strcmp(argv[i], "--label-counts") == 0 && i + 1 < argc) {
+            countsPath = argv[++i];
+        } else if (strcmp(argv[i], "--states") == 0) {
+            printStates = true;
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    bool attachIo = inputPath != NULL || outputPath != NULL;
+    bool counted = profiled || countsPath != NULL;
+    if (replayPath != NULL && argc == 3) {
+        return replayTrace(replayPath);
+    }
+    if (path == NULL || replayPath != NULL || (random && states.numCells > 0) || (!lockstep && (printStates || numThreads != 0)) || (lockstep && (attachIo || counted || tracePath != NULL))) {
+        fprintf(stderr, "Error: Wrong number of arguments.\n");
+        fprintf(stderr, USAGE);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+
+    CodeBuffer code;
+    initGrowableCodeBuffer(&code);
+    LineTable table;
+    initLineTable(&table);
+    uint8_t status = loadProgram(path, &code, counted ? &table : NULL);
+    Emulator emulator;
+    if (status == 0) {
+        status = initEmulator(&emulator, code.data, code.length > UINT32_MAX ? UINT32_MAX : (uint32_t)code.length);
+        if (status != 0) {
+            AssemblerDiagnostic diagnostic = {status, 0, 0};
+            printDiagnostic(stderr, &diagnostic);
+        }
+    }
+    if (status != 0) {
+        freeCodeBuffer(&code);
+        freeLineTable(&table);
+        return status;
+    }
+
+    if (lockstep) {
+        freeCodeBuffer(&code);
+        status = runInstances(&emulator, &states, numInstances, printStates, maxSteps, numThreads, timed);
+        freeEmulator(&emulator);
+        return status;
+    }
+
+    // the trace holds the program, so it is opened before the code is freed
+    TraceWriter writer;
+    if (tracePath != NULL) {
+        status = openTraceWriter(&writer, tracePath, code.data, emulator.length, interval, &emulator);
+        if (status == ERROR_INVALID_ARGUMENTS) {
+            fprintf(stderr, "Error: Could not create the trace.\n");
+        }
+    }
+    freeCodeBuffer(&code);
+    if (status != 0) {
+        freeLineTable(&table);
+        freeEmulator(&emulator);
+        return status;
+    }
+
+    EmulatorProfile profile;
+    if (counted && startProfile(&profile, &emulator) != 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        if (tracePath != NULL) {
+            closeTraceWriter(&writer, &emulator, EMULATOR_HALT_STEP_LIMIT);
+        }
+        freeLineTable(&table);
+        freeEmulator(&emulator);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    EmulatorIo io;
+    FILE* report = stdout;
+    if (attachIo) {
+        status = openEmulatorIo(&io, inputPath, outputPath);
+        if (status == ERROR_INVALID_ARGUMENTS) {
+            fprintf(stderr, "Error: Could not open I/O file.\n");
+        } else if (status != 0) {
+            AssemblerDiagnostic diagnostic = {status, 0, 0};
+            printDiagnostic(stderr, &diagnostic);
+        }
+        if (status != 0) {
+            if (counted) {
+                freeProfile(&profile);
+            }
+            if (tracePath != NULL) {
+                closeTraceWriter(&writer, &emulator, EMULATOR_HALT_STEP_LIMIT);
+            }
+            freeLineTable(&table);
+            freeEmulator(&emulator);
+            return status;
+        }
+        attachEmulatorIo(&emulator, &io);
+        if (tracePath != NULL) {
+            io.recording = &writer.input;
+        }
+        report = stderr;  // stdout may be the output port
+    }
+
+    PhaseStats run = {0, 0};
+    PhaseTimer timer;
+    startPhase(&timer);
+    uint8_t reason = tracePath != NULL ? recordRun(&emulator, &writer, interval, maxSteps) : runEmulator(&emulator, maxSteps);
+    if (counted) {
+        finishProfile(&profile, &emulator);
+    }
+    if (attachIo) {
+        status = finishEmulatorIo(&io);  // the output is only all out once the writer is done
+    }
+    if (tracePath != NULL && closeTraceWriter(&writer, &emulator, reason) != 0) {
+        fprintf(stderr, "Error: Could not write the trace.\n");
+        status = status != 0 ? status : ERROR_INVALID_ARGUMENTS;
+    }
+    stopPhase(&timer, &run);
+
+    fprintf(report, "Halted by %s at %" PRIu32 " after %" PRIu64 " instructions.\n", getHaltReason(reason), emulator.state.pc, emulator.executed);
+    if (timed) {
+        double perSecond = run.wallSeconds > 0 ? emulator.executed / run.wallSeconds : 0;
+        fprintf(report, "Ran for %.6f seconds (%.1f million instructions per second).\n", run.wallSeconds, perSecond / 1e6);
+        if (attachIo) {
+            double bytesPerSecond = run.wallSeconds > 0 ? (io.bytesIn + io.bytesOut) / run.wallSeconds : 0;
+            fprintf(report, "Moved %" PRIu64 " bytes in and %" PRIu64 " bytes out (%.1f MB per second).\n", io.bytesIn, io.bytesOut, bytesPerSecond / 1e6);
+        }
+    }
+    printEmulatorState(report, "FINAL STATE", &emulator.state);
+    if (status != 0) {
+        fprintf(stderr, "Error: Could not read or write an I/O file.\n");
+    }
+    if (profiled) {
+        printProfile(report, &profile, &emulator, table.length == emulator.length ? &table : NULL);
+        if (annotated && printAnnotatedSource(report, &profile, &table) != 0) {
+            fprintf(stderr, "Error: Could not read the source to annotate.\n");
+            status = ERROR_INVALID_ARGUMENTS;
+        }
+    }
+    if (countsPath != NULL) {
+        FILE* countsFile = table.length == emulator.length ? fopen(countsPath, "w") : NULL;
+        uint8_t countsStatus = countsFile == NULL ? ERROR_INVALID_ARGUMENTS : writeLabelCounts(countsFile, &profile, &table);
+        if (countsFile != NULL && fclose(countsFile) != 0) {
+            countsStatus = ERROR_INVALID_ARGUMENTS;
+        }
+        if (countsStatus != 0) {
+            fprintf(stderr, "Error: Could not write label counts%s.\n", table.length == emulator.length ? "" : " without a line table");
+            status = ERROR_INVALID_ARGUMENTS;
+        }
+    }
+    if (counted) {
+        freeProfile(&profile);
+    }
+    freeLineTable(&table);
+    freeEmulator(&emulator);
+    return status;
+}
@@ -0,0 +1,122 @@
+#include "Fixups.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AssemblerStats.h"
+#include "StatusCodes.h"
+
+void freeFixupsList(FixupsList** list)
+{
+    free((*list)->fixups);
+    free((*list)->labels.symbols);
+    free((*list)->labels.buckets);
+    free((*list)->labels.pool);
+    free(*list);
+    *list = NULL;
+}
+
+/**
+ * @brief Record a JUMP at offset whose label has not been defined yet
+ *
+ * @param list List to add to
+ * @param symbol The label being referenced, case insensitive, copied by the list
+ * @param length Number of characters in symbol, which need not be NUL terminated
+ * @param offset Offset of the JUMP instruction in the output
+ * @param line Source line of the JUMP, for error reporting
+ * @param column Column of the label in the JUMP, for error reporting
+ * @return 0 if successful, otherwise an error code
+ */
+uint8_t addFixupToList(FixupsList* list, const char* const symbol, uint32_t length, uint32_t offset, uint32_t line, uint32_t column)
+{
+    if (list->length == list->capacity) {
+        uint32_t newCapacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        Fixup* grown = (Fixup*)realloc(list->fixups, newCapacity * sizeof(Fixup));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        countAllocation(newCapacity * sizeof(Fixup));
+        list->fixups = grown;
+        list->capacity = newCapacity;
+    }
+
+    // chain onto any earlier fixups for the same label
+    uint32_t previous = 0;
+    const Symbol* label = findSymbolN(&list->labels, symbol, length);
+    if (label == NULL) {
+        uint8_t addStatus = addSymbolToListN(&list->labels, symbol, length, list->length + 1);
+        if (addStatus != 0) {
+            return addStatus;
+        }
+    } else {
+        previous = label->value;
+        (list->labels.symbols + (label - list->labels.symbols))->value = list->length + 1;
+    }
+
+    Fixup* added = list->fixups + list->length;
+    added->offset = offset;
+    added->previous = previous;
+    added->line = line;
+    added->column = column;
+    added->resolved = false;
+    list->length++;
+    list->pending++;
+    return 0;
+}
+
+/**
+ * @brief Patch every pending JUMP to symbol now that its value is known
+ *
+ * @param list List of pending fixups
+ * @param symbol The label that was just defined
+ * @param value The value of the label
+ * @param code The code emitted so far, indexed by offset
+ * @param farJumps List to record JUMPs whose offset does not fit in 7 bits in, leaving them `jump 0`, or NULL
+ * @param diagnostic Set to the error and the offending JUMP if an error occurs, may be NULL
+ * @return 0 if successful, ERROR_VALUE_OUT_OF_RANGE if a patched offset does not fit in 7 bits and farJumps is NULL,
+ *         otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t resolveFixups(FixupsList* list, const char* const symbol, uint32_t value, CodeBuffer* code, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic)
+{
+    const Symbol* label = findSymbol(&list->labels, symbol);
+    if (label == NULL) {
+        return 0;  // nothing was waiting on this label
+    }
+    uint32_t next = label->value;
+    while (next != 0) {
+        Fixup* fixup = list->fixups + next - 1;
+        // same arithmetic as load7BitSImm, so patched jumps match the two-pass output
+        int32_t distance = (int32_t)value - (int32_t)fixup->offset;
+        if (distance < -64 || distance > 63) {
+            uint8_t status = farJumps == NULL ? ERROR_VALUE_OUT_OF_RANGE : addFarJump(farJumps, fixup->offset, value, fixup->line);
+            if (status != 0) {
+                setDiagnostic(diagnostic, status, fixup->line, fixup->column);
+                return status;
+            }
+        } else {
+            patchCode(code, fixup->offset, distance & 0b1111111);  // drop high bits
+        }
+        fixup->resolved = true;
+        list->pending--;
+        next = fixup->previous;
+    }
+    return 0;
+}
+
+/**
+ * @brief Get the earliest JUMP in the source that is still waiting on a label
+ *
+ * @param list List of fixups
+ * @return The fixup, or NULL if nothing is pending
+ */
+const Fixup* firstPendingFixup(const FixupsList* const list)
+{
+    // fixups are recorded in source order
+    for (uint32_t i = 0; i < list->length; i++) {
+        if (!(list->fixups + i)->resolved) {
+            return list->fixups + i;
+        }
+    }
+    return NULL;
+}
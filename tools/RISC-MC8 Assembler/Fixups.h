@@ -0,0 +1,69 @@
+#ifndef FIXUPS_H
+#define FIXUPS_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Relaxation.h"
+#include "Symbols.h"
+
+typedef struct _Fixup {
+    uint32_t offset;
+    uint32_t previous;  // (index + 1) of the previous fixup waiting on the same label, 0 if none
+    uint32_t line;
+    uint32_t column;
+    bool resolved;
+} Fixup;
+
+/**
+ * JUMPs waiting on labels that have not been defined yet. Each referenced label is kept in a symbols list whose
+ * value is (index + 1) of the newest fixup for it, so all fixups for a label can be walked without a scan.
+ */
+typedef struct _FixupsList {
+    Fixup* fixups;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t pending;
+    SymbolsList labels;
+} FixupsList;
+
+void freeFixupsList(FixupsList** list);
+
+/**
+ * @brief Record a JUMP at offset whose label has not been defined yet
+ *
+ * @param list List to add to
+ * @param symbol The label being referenced, case insensitive, copied by the list
+ * @param length Number of characters in symbol, which need not be NUL terminated
+ * @param offset Offset of the JUMP instruction in the output
+ * @param line Source line of the JUMP, for error reporting
+ * @param column Column of the label in the JUMP, for error reporting
+ * @return 0 if successful, otherwise an error code
+ */
+uint8_t addFixupToList(FixupsList* list, const char* const symbol, uint32_t length, uint32_t offset, uint32_t line, uint32_t column);
+
+/**
+ * @brief Patch every pending JUMP to symbol now that its value is known
+ *
+ * @param list List of pending fixups
+ * @param symbol The label that was just defined
+ * @param value The value of the label
+ * @param code The code emitted so far, indexed by offset
+ * @param farJumps List to record JUMPs whose offset does not fit in 7 bits in, leaving them `jump 0`, or NULL
+ * @param diagnostic Set to the error and the offending JUMP if an error occurs, may be NULL
+ * @return 0 if successful, ERROR_VALUE_OUT_OF_RANGE if a patched offset does not fit in 7 bits and farJumps is NULL,
+ *         otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t resolveFixups(FixupsList* list, const char* const symbol, uint32_t value, CodeBuffer* code, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Get the earliest JUMP in the source that is still waiting on a label
+ *
+ * @param list List of fixups
+ * @return The fixup, or NULL if nothing is pending
+ */
+const Fixup* firstPendingFixup(const FixupsList* const list);
+
+#endif
@@ -0,0 +1,1609 @@
+#include "GateNetlist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StatusCodes.h"
+
+#define NO_SIGNAL UINT32_MAX
+#define MAX_COMPONENT_PORTS 128
+#define MAX_CIRCUIT_DEPTH 32
+#define SUBCIRCUIT_BOX_WIDTH 220  // distance between the input and output sides of a fixed-size generated appearance
+
+// how a component is simulated
+#define KIND_IGNORED 0
+#define KIND_PIN 1
+#define KIND_CONSTANT 2
+#define KIND_CLOCK 3
+#define KIND_BUTTON 4
+#define KIND_SPLITTER 5
+#define KIND_AND 6
+#define KIND_OR 7
+#define KIND_XOR 8
+#define KIND_NAND 9
+#define KIND_NOR 10
+#define KIND_XNOR 11
+#define KIND_NOT 12
+#define KIND_MULTIPLEXER 13
+#define KIND_DEMULTIPLEXER 14
+#define KIND_ADDER 15
+#define KIND_SHIFTER 16
+#define KIND_REGISTER 17
+#define KIND_RAM 18
+#define KIND_ROM 19
+#define KIND_SUBCIRCUIT 20
+#define KIND_UNSUPPORTED 21
+
+#define FACING_EAST 0
+#define FACING_WEST 1
+#define FACING_NORTH 2
+#define FACING_SOUTH 3
+
+typedef struct _ComponentKind {
+    const char* library;
+    const char* name;
+    uint8_t kind;
+} ComponentKind;
+
+static const ComponentKind ComponentKinds[] = {
+    {"#Wiring", "Pin", KIND_PIN},
+    {"#Wiring", "Constant", KIND_CONSTANT},
+    {"#Wiring", "Clock", KIND_CLOCK},
+    {"#Wiring", "Splitter", KIND_SPLITTER},
+    {"#Wiring", "Probe", KIND_IGNORED},
+    {"#Gates", "AND Gate", KIND_AND},
+    {"#Gates", "OR Gate", KIND_OR},
+    {"#Gates", "XOR Gate", KIND_XOR},
+    {"#Gates", "NAND Gate", KIND_NAND},
+    {"#Gates", "NOR Gate", KIND_NOR},
+    {"#Gates", "XNOR Gate", KIND_XNOR},
+    {"#Gates", "NOT Gate", KIND_NOT},
+    {"#Plexers", "Multiplexer", KIND_MULTIPLEXER},
+    {"#Plexers", "Demultiplexer", KIND_DEMULTIPLEXER},
+    {"#Arithmetic", "Adder", KIND_ADDER},
+    {"#Arithmetic", "Shifter", KIND_SHIFTER},
+    {"#Memory", "Register", KIND_REGISTER},
+    {"#Memory", "RAM", KIND_RAM},
+    {"#Memory", "ROM", KIND_ROM},
+    {"#I/O", "Button", KIND_BUTTON},
+    {"#Base", "Text", KIND_IGNORED},
+};
+
+/**
+ * Where a component connects. Outputs are what the component drives; pins, constants and splitters drive nothing
+ * since they only join signals.
+ */
+typedef struct _ComponentPort {
+    int32_t x;
+    int32_t y;
+    uint32_t width;
+    bool output;
+    uint32_t pin;  // for subcircuits, index of the Pin component inside the circuit
+    uint32_t net;
+} ComponentPort;
+
+/**
+ * The wiring of one circuit definition, shared by all of its instances
+ */
+typedef struct _CircuitLayout {
+    bool ready;
+    uint8_t* kinds;        // KIND_* of each component
+    uint32_t* firstPorts;  // index of each component's first port, numComponents + 1 entries
+    ComponentPort* ports;
+    uint32_t numNets;
+    uint32_t* netWidths;  // 0 for nets no port touches
+} CircuitLayout;
+
+/**
+ * A component of an instance that becomes ops, a register or a memory
+ */
+typedef struct _PlacedComponent {
+    uint32_t circuit;  // index of its circuit definition
+    uint32_t component;
+    uint8_t kind;
+    uint32_t firstSignal;  // index into NetlistBuilder.portSignals of the first signal of its first port
+    char* name;            // registers and memories
+} PlacedComponent;
+
+typedef struct _NetlistBuilder {
+    const CircuitProject* project;
+    GateNetlist* netlist;
+    GateDiagnostic* diagnostic;
+    CircuitLayout* layouts;  // one per circuit definition
+    uint32_t* parents;       // union-find over signals, a fixed signal is always the root of its set
+    uint32_t parentCapacity;
+    bool* driven;  // of each root, once every component is placed
+    PlacedComponent* placed;
+    uint32_t numPlaced;
+    uint32_t placedCapacity;
+    uint32_t* portSignals;
+    uint32_t numPortSignals;
+    uint32_t portSignalCapacity;
+    uint32_t origin;  // component the ops being added come from
+} NetlistBuilder;
+
+typedef struct _PointRef {
+    int32_t x;
+    int32_t y;
+    uint32_t id;  // wire end (2 * wire + end) or 2 * numWires + port
+} PointRef;
+
+/**
+ * @brief Make room for one more element of an array that grows by doubling
+ *
+ * @param array The array
+ * @param length Number of elements in use
+ * @param capacity Number of elements allocated, updated
+ * @param size Size of one element
+ * @return true if successful, false if out of memory
+ */
+static bool growNetlistArray(void** array, uint32_t length, uint32_t* capacity, size_t size)
+{
+    if (length < *capacity) {
+        return true;
+    }
+    uint32_t newCapacity = *capacity == 0 ? 64 : *capacity * 2;
+    while (newCapacity <= length) {
+        newCapacity *= 2;
+    }
+    void* grown = realloc(*array, newCapacity * size);
+    if (grown == NULL) {
+        return false;
+    }
+    *array = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+/**
+ * @brief Record what went wrong and where
+ *
+ * @param builder The builder
+ * @param status The status code
+ * @param circuit Index of the circuit definition
+ * @param component Index of the component in it, UINT32_MAX for none
+ * @return status
+ */
+static uint8_t reportNetlistProblem(NetlistBuilder* builder, uint8_t status, uint32_t circuit, uint32_t component)
+{
+    const CircuitDefinition* definition = builder->project->circuits + circuit;
+    builder->diagnostic->status = status;
+    builder->diagnostic->circuit = definition->name;
+    builder->diagnostic->component = NULL;
+    builder->diagnostic->x = 0;
+    builder->diagnostic->y = 0;
+    if (component != UINT32_MAX) {
+        const CircuitComponent* placed = definition->components + component;
+        builder->diagnostic->component = placed->name;
+        builder->diagnostic->x = placed->x;
+        builder->diagnostic->y = placed->y;
+    }
+    return status;
+}
+
+static const char* getAttribute(const NetlistBuilder* const builder, const CircuitComponent* const component, const char* const name)
+{
+    return findCircuitAttribute(builder->project, component->firstAttribute, component->numAttributes, name);
+}
+
+/**
+ * @brief Get a numeric attribute, in decimal or with a 0x prefix
+ *
+ * @param builder The builder
+ * @param component The component
+ * @param name Name of the attribute
+ * @param defaultValue Value when the attribute is not saved
+ * @return The value
+ */
+static uint32_t getNumberAttribute(const NetlistBuilder* const builder, const CircuitComponent* const component, const char* const name, uint32_t defaultValue)
+{
+    const char* value = getAttribute(builder, component, name);
+    return value == NULL ? defaultValue : (uint32_t)strtoul(value, NULL, 0);
+}
+
+static bool hasAttributeValue(const NetlistBuilder* const builder, const CircuitComponent* const component, const char* const name, const char* const value)
+{
+    const char* actual = getAttribute(builder, component, name);
+    return actual != NULL && strcmp(actual, value) == 0;
+}
+
+static uint8_t getFacing(const NetlistBuilder* const builder, const CircuitComponent* const component, uint8_t defaultFacing)
+{
+    const char* facing = getAttribute(builder, component, "facing");
+    if (facing == NULL) {
+        return defaultFacing;
+    } else if (strcmp(facing, "west") == 0) {
+        return FACING_WEST;
+    } else if (strcmp(facing, "north") == 0) {
+        return FACING_NORTH;
+    } else if (strcmp(facing, "south") == 0) {
+        return FACING_SOUTH;
+    }
+    return FACING_EAST;
+}
+
+static uint8_t getComponentKind(const CircuitComponent* const component)
+{
+    if (component->library == NULL) {
+        return KIND_SUBCIRCUIT;
+    }
+    for (uint32_t i = 0; i < sizeof(ComponentKinds) / sizeof(ComponentKinds[0]); i++) {
+        if (strcmp(ComponentKinds[i].library, component->library) == 0 && strcmp(ComponentKinds[i].name, component->name) == 0) {
+            return ComponentKinds[i].kind;
+        }
+    }
+    return KIND_UNSUPPORTED;
+}
+
+/**
+ * @brief Add a port at an offset from the component's location
+ *
+ * @param ports The ports so far
+ * @param numPorts Number of ports so far, incremented
+ * @param component The component
+ * @param dx Offset of the port
+ * @param dy Offset of the port
+ * @param width Bit width
+ * @param output Whether the component drives it
+ * @return true if successful, false if the component has too many ports
+ */
+static bool addPort(ComponentPort* ports, uint32_t* numPorts, const CircuitComponent* const component, int32_t dx, int32_t dy, uint32_t width, bool output)
+{
+    if (*numPorts == MAX_COMPONENT_PORTS) {
+        return false;
+    }
+    ComponentPort* port = ports + (*numPorts)++;
+    port->x = component->x + dx;
+    port->y = component->y + dy;
+    port->width = width;
+    port->output = output;
+    port->pin = 0;
+    port->net = 0;
+    return true;
+}
+
+/**
+ * @brief Place the ports of a gate, output first then the inputs, as Logisim-evolution lays them out
+ *
+ * @param builder The builder
+ * @param component The gate
+ * @param kind Its KIND_*
+ * @param ports Receives the ports
+ * @param numPorts Receives the number of ports
+ * @return true if successful, false if it has too many inputs
+ */
+static bool getGatePorts(const NetlistBuilder* const builder, const CircuitComponent* const component, uint8_t kind, ComponentPort* ports, uint32_t* numPorts)
+{
+    uint32_t width = getNumberAttribute(builder, component, "width", 1);
+    uint8_t facing = getFacing(builder, component, FACING_EAST);
+    addPort(ports, numPorts, component, 0, 0, width, true);
+    if (kind == KIND_NOT) {
+        int32_t size = (int32_t)getNumberAttribute(builder, component, "size", 30);
+        int32_t dx = facing == FACING_EAST ? -size : facing == FACING_WEST ? size : 0;
+        int32_t dy = facing == FACING_NORTH ? size : facing == FACING_SOUTH ? -size : 0;
+        return addPort(ports, numPorts, component, dx, dy, width, false);
+    }
+    int32_t size = (int32_t)getNumberAttribute(builder, component, "size", 50);
+    int32_t inputs = (int32_t)getNumberAttribute(builder, component, "inputs", 2);
+    int32_t axisLength = size + (kind == KIND_XOR || kind == KIND_XNOR ? 10 : 0) + (kind == KIND_NAND || kind == KIND_NOR || kind == KIND_XNOR ? 10 : 0);
+    int32_t skipStart;
+    int32_t skipDistance;
+    int32_t skipLowerEven;
+    if (inputs <= 3) {
+        if (size < 40) {
+            skipStart = -5;
+            skipDistance = 10;
+            skipLowerEven = 10;
+        } else if (size < 60 || inputs <= 2) {
+            skipStart = -10;
+            skipDistance = 20;
+            skipLowerEven = 20;
+        } else {
+            skipStart = -15;
+            skipDistance = 30;
+            skipLowerEven = 30;
+        }
+    } else if (inputs == 4 && size >= 60) {
+        skipStart = -5;
+        skipDistance = 20;
+        skipLowerEven = 0;
+    } else {
+        skipStart = -5;
+        skipDistance = 10;
+        skipLowerEven = 10;
+    }
+    for (int32_t i = 0; i < inputs; i++) {
+        char negateName[24];
+        snprintf(negateName, sizeof(negateName), "negate%" PRId32, i);
+        int32_t dx = axisLength + (hasAttributeValue(builder, component, negateName, "true") ? 10 : 0);
+        int32_t dy;
+        if (inputs % 2 == 1) {
+            dy = skipStart * (inputs - 1) + skipDistance * i;
+        } else {
+            dy = skipStart * inputs + skipDistance * i + (i >= inputs / 2 ? skipLowerEven : 0);
+        }
+        bool added;
+        if (facing == FACING_WEST) {
+            added = addPort(ports, numPorts, component, dx, dy, width, false);
+        } else if (facing == FACING_NORTH) {
+            added = addPort(ports, numPorts, component, dy, dx, width, false);
+        } else if (facing == FACING_SOUTH) {
+            added = addPort(ports, numPorts, component, dy, -dx, width, false);
+        } else {
+            added = addPort(ports, numPorts, component, -dx, dy, width, false);
+        }
+        if (!added) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Place the ports of a multiplexer (output, inputs, select) or demultiplexer (input, outputs, select)
+ *
+ * @param builder The builder
+ * @param component The component
+ * @param demultiplexer Whether it is a demultiplexer, which mirrors the multiplexer around its location
+ * @param ports Receives the ports
+ * @param numPorts Receives the number of ports
+ * @return true if successful, false if it has too many ports
+ */
+static bool getPlexerPorts(const NetlistBuilder* const builder, const CircuitComponent* const component, bool demultiplexer, ComponentPort* ports, uint32_t* numPorts)
+{
+    uint32_t width = getNumberAttribute(builder, component, "width", 1);
+    uint32_t selectBits = getNumberAttribute(builder, component, "select", 1);
+    uint8_t facing = getFacing(builder, component, FACING_EAST);
+    int32_t selectMultiplier = hasAttributeValue(builder, component, "selloc", "tr") ? -1 : 1;
+    int32_t mirror = demultiplexer ? -1 : 1;
+    if (selectBits == 0 || selectBits > 6) {
+        return false;
+    }
+    int32_t inputs = 1 << selectBits;
+    addPort(ports, numPorts, component, 0, 0, width, !demultiplexer);
+    int32_t selectX;
+    int32_t selectY;
+    if (inputs == 2) {
+        for (int32_t i = 0; i < 2; i++) {
+            int32_t across = i == 0 ? -10 : 10;
+            if (facing == FACING_WEST) {
+                addPort(ports, numPorts, component, mirror * 30, across, width, demultiplexer);
+            } else if (facing == FACING_NORTH) {
+                addPort(ports, numPorts, component, across, mirror * 30, width, demultiplexer);
+            } else if (facing == FACING_SOUTH) {
+                addPort(ports, numPorts, component, across, mirror * -30, width, demultiplexer);
+            } else {
+                addPort(ports, numPorts, component, mirror * -30, across, width, demultiplexer);
+            }
+        }
+        selectX = facing == FACING_WEST ? mirror * 20 : facing == FACING_EAST ? mirror * -20 : selectMultiplier * -20;
+        selectY = facing == FACING_NORTH ? mirror * 20 : facing == FACING_SOUTH ? mirror * -20 : selectMultiplier * 20;
+    } else {
+        int32_t first = -(inputs / 2) * 10;
+        for (int32_t i = 0; i < inputs; i++) {
+            int32_t across = first + 10 * i;
+            if (facing == FACING_WEST) {
+                addPort(ports, numPorts, component, mirror * 40, across, width, demultiplexer);
+            } else if (facing == FACING_NORTH) {
+                addPort(ports, numPorts, component, across, mirror * 40, width, demultiplexer);
+            } else if (facing == FACING_SOUTH) {
+                addPort(ports, numPorts, component, across, mirror * -40, width, demultiplexer);
+            } else {
+                addPort(ports, numPorts, component, mirror * -40, across, width, demultiplexer);
+            }
+        }
+        if (facing == FACING_EAST || facing == FACING_WEST) {
+            selectX = (facing == FACING_WEST ? 20 : -20) * mirror;
+            selectY = selectMultiplier * (first + 10 * inputs);
+        } else {
+            selectX = selectMultiplier * first;
+            selectY = (facing == FACING_NORTH ? 20 : -20) * mirror;
+        }
+    }
+    return addPort(ports, numPorts, component, selectX, selectY, selectBits, false);
+}
+
+/**
+ * @brief Place the ports of a splitter, the combined end first then each split end
+ *
+ * @param builder The builder
+ * @param component The splitter
+ * @param ports Receives the ports
+ * @param numPorts Receives the number of ports
+ * @return true if successful, false if the splitter is malformed
+ */
+static bool getSplitterPorts(const NetlistBuilder* const builder, const CircuitComponent* const component, ComponentPort* ports, uint32_t* numPorts)
+{
+    int32_t fanout = (int32_t)getNumberAttribute(builder, component, "fanout", 2);
+    uint32_t incoming = getNumberAttribute(builder, component, "incoming", 2);
+    int32_t spacing = (int32_t)getNumberAttribute(builder, component, "spacing", 1);
+    uint8_t facing = getFacing(builder, component, FACING_EAST);
+    const char* appear = getAttribute(builder, component, "appear");
+    int32_t justify = appear == NULL || strcmp(appear, "left") == 0 ? -1 : strcmp(appear, "right") == 0 ? 1 : 0;
+    if (fanout < 1 || fanout >= MAX_COMPONENT_PORTS || incoming > 64) {
+        return false;
+    }
+    addPort(ports, numPorts, component, 0, 0, incoming, false);
+    uint32_t widths[MAX_COMPONENT_PORTS] = {0};
+    for (uint32_t bit = 0; bit < incoming; bit++) {
+        char name[24];
+        snprintf(name, sizeof(name), "bit%" PRIu32, bit);
+        const char* end = getAttribute(builder, component, name);
+        if (end == NULL ? bit < (uint32_t)fanout : strcmp(end, "none") != 0) {
+            uint32_t index = end == NULL ? bit : (uint32_t)strtoul(end, NULL, 10);
+            if (index >= (uint32_t)fanout) {
+                return false;
+            }
+            widths[index]++;
+        }
+    }
+    for (int32_t i = 0; i < fanout; i++) {
+        if (facing == FACING_EAST || facing == FACING_WEST) {
+            int32_t m = facing == FACING_WEST ? -1 : 1;
+            int32_t dy = justify == 0 ? -10 * (fanout / 2) : (m * justify > 0 ? 10 : -10 * fanout * spacing);
+            addPort(ports, numPorts, component, m * 20, dy + 10 * spacing * i, widths[i], false);
+        } else {
+            int32_t m = facing == FACING_NORTH ? 1 : -1;
+            int32_t dx = justify == 0 ? 10 * ((fanout + 1) / 2 - 1) : (m * justify < 0 ? -10 : 10 * fanout * spacing);
+            addPort(ports, numPorts, component, dx - 10 * spacing * i, -m * 20, widths[i], false);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Rotate an offset drawn facing east to a facing
+ */
+static void rotateOffset(uint8_t facing, int32_t* dx, int32_t* dy)
+{
+    int32_t x = *dx;
+    int32_t y = *dy;
+    if (facing == FACING_WEST) {
+        *dx = -x;
+        *dy = -y;
+    } else if (facing == FACING_NORTH) {
+        *dx = y;
+        *dy = -x;
+    } else if (facing == FACING_SOUTH) {
+        *dx = -y;
+        *dy = x;
+    }
+}
+
+/**
+ * @brief Place the ports of a subcircuit instance, one per Pin of the circuit
+ *
+ * A custom appearance says where each pin is drawn. The generated Logisim-evolution appearance puts output pins on
+ * the east side and input pins on the west side, each ordered top to bottom, 20 apart from the anchor down.
+ *
+ * @param builder The builder
+ * @param component The instance
+ * @param child Index of the circuit it instantiates
+ * @param ports Receives the ports
+ * @param numPorts Receives the number of ports
+ * @return 0 if successful, otherwise the status code of the problem
+ */
+static uint8_t getSubcircuitPorts(const NetlistBuilder* const builder, const CircuitComponent* const component, uint32_t child, ComponentPort* ports, uint32_t* numPorts)
+{
+    const CircuitDefinition* circuit = builder->project->circuits + child;
+    uint8_t facing = getFacing(builder, component, FACING_EAST);
+    const char* appearance = findCircuitAttribute(builder->project, circuit->firstAttribute, circuit->numAttributes, "appearance");
+    if (appearance != NULL && strcmp(appearance, "custom") == 0) {
+        for (uint32_t i = 0; i < circuit->numPorts; i++) {
+            const CircuitPort* port = circuit->ports + i;
+            uint32_t pin = 0;
+            while (pin < circuit->numComponents && !((circuit->components + pin)->x == port->pinX && (circuit->components + pin)->y == port->pinY && getComponentKind(circuit->components + pin) == KIND_PIN)) {
+                pin++;
+            }
+            if (pin == circuit->numComponents) {
+                return ERROR_MALFORMED_CIRCUIT;
+            }
+            int32_t dx = port->x;
+            int32_t dy = port->y;
+            rotateOffset(facing, &dx, &dy);
+            if (!addPort(ports, numPorts, component, dx, dy, getNumberAttribute(builder, circuit->components + pin, "width", 1), false)) {
+                return ERROR_UNSUPPORTED_COMPONENT;
+            }
+            (ports + *numPorts - 1)->pin = pin;
+        }
+        return 0;
+    }
+    const char* fixedSize = findCircuitAttribute(builder->project, circuit->firstAttribute, circuit->numAttributes, "circuitnamedboxfixedsize");
+    if ((appearance != NULL && strcmp(appearance, "logisim_evolution") != 0) || (fixedSize != NULL && strcmp(fixedSize, "true") != 0)) {
+        return ERROR_UNSUPPORTED_COMPONENT;  // the classic and variable-width appearances depend on label text widths
+    }
+    uint32_t pins[2][MAX_COMPONENT_PORTS];
+    uint32_t numPins[2] = {0, 0};
+    for (uint32_t i = 0; i < circuit->numComponents; i++) {
+        const CircuitComponent* pin = circuit->components + i;
+        if (getComponentKind(pin) != KIND_PIN) {
+            continue;
+        }
+        uint32_t side = hasAttributeValue(builder, pin, "output", "true") ? 1 : 0;
+        if (numPins[side] == MAX_COMPONENT_PORTS) {
+            return ERROR_UNSUPPORTED_COMPONENT;
+        }
+        uint32_t j = numPins[side]++;
+        while (j > 0) {  // insertion sort by y then x
+            const CircuitComponent* before = circuit->components + pins[side][j - 1];
+            if (before->y < pin->y || (before->y == pin->y && before->x <= pin->x)) {
+                break;
+            }
+            pins[side][j] = pins[side][j - 1];
+            j--;
+        }
+        pins[side][j] = i;
+    }
+    for (uint32_t side = 0; side < 2; side++) {
+        for (uint32_t i = 0; i < numPins[side]; i++) {
+            int32_t dx = side == 0 && numPins[1] > 0 ? -SUBCIRCUIT_BOX_WIDTH : 0;
+            int32_t dy = 20 * (int32_t)i;
+            rotateOffset(facing, &dx, &dy);
+            if (!addPort(ports, numPorts, component, dx, dy, getNumberAttribute(builder, circuit->components + pins[side][i], "width", 1), false)) {
+                return ERROR_UNSUPPORTED_COMPONENT;
+            }
+            (ports + *numPorts - 1)->pin = pins[side][i];
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Place the ports of a component in the order lowerComponent expects them
+ *
+ * @param builder The builder
+ * @param component The component
+ * @param kind Its KIND_*
+ * @param ports Receives the ports
+ * @param numPorts Receives the number of ports
+ * @return 0 if successful, otherwise the status code of the problem
+ */
+static uint8_t getComponentPorts(const NetlistBuilder* const builder, const CircuitComponent* const component, uint8_t kind, ComponentPort* ports, uint32_t* numPorts)
+{
+    *numPorts = 0;
+    uint32_t width = getNumberAttribute(builder, component, "width", kind == KIND_ADDER || kind == KIND_SHIFTER || kind == KIND_REGISTER ? 8 : 1);
+    bool evolution = hasAttributeValue(builder, component, "appearance", "logisim_evolution");
+    switch (kind) {
+    case KIND_IGNORED:
+        return 0;
+    case KIND_PIN:
+    case KIND_CONSTANT:
+    case KIND_CLOCK:
+    case KIND_BUTTON:
+        addPort(ports, numPorts, component, 0, 0, kind == KIND_PIN || kind == KIND_CONSTANT ? width : 1, false);
+        return 0;
+    case KIND_SPLITTER:
+        return getSplitterPorts(builder, component, ports, numPorts) ? 0 : ERROR_MALFORMED_CIRCUIT;
+    case KIND_MULTIPLEXER:
+    case KIND_DEMULTIPLEXER:
+        if (hasAttributeValue(builder, component, "enable", "true")) {
+            return ERROR_UNSUPPORTED_COMPONENT;
+        }
+        return getPlexerPorts(builder, component, kind == KIND_DEMULTIPLEXER, ports, numPorts) ? 0 : ERROR_UNSUPPORTED_COMPONENT;
+    case KIND_ADDER:
+        addPort(ports, numPorts, component, 0, 0, width, true);
+        addPort(ports, numPorts, component, -40, -10, width, false);
+        addPort(ports, numPorts, component, -40, 10, width, false);
+        addPort(ports, numPorts, component, -20, -20, 1, false);
+        addPort(ports, numPorts, component, -20, 20, 1, true);
+        return 0;
+    case KIND_SHIFTER: {
+        uint32_t distanceBits = 1;
+        while ((1u << distanceBits) < width) {
+            distanceBits++;
+        }
+        addPort(ports, numPorts, component, 0, 0, width, true);
+        addPort(ports, numPorts, component, -40, -10, width, false);
+        addPort(ports, numPorts, component, -40, 10, distanceBits, false);
+        return 0;
+    }
+    case KIND_REGISTER:
+        if (!evolution) {
+            return ERROR_UNSUPPORTED_COMPONENT;
+        }
+        addPort(ports, numPorts, component, 60, 30, width, true);
+        addPort(ports, numPorts, component, 0, 30, width, false);
+        addPort(ports, numPorts, component, 0, 50, 1, false);
+        addPort(ports, numPorts, component, 0, 70, 1, false);
+        addPort(ports, numPorts, component, 30, 90, 1, false);
+        return 0;
+    case KIND_RAM:
+    case KIND_ROM: {
+        uint32_t addressBits = getNumberAttribute(builder, component, "addrWidth", 8);
+        uint32_t dataBits = getNumberAttribute(builder, component, "dataWidth", 8);
+        if (!evolution || addressBits == 0 || addressBits > GATE_MAX_ADDRESS_BITS || dataBits == 0 || dataBits > GATE_MAX_DATA_BITS) {
+            return ERROR_UNSUPPORTED_COMPONENT;
+        }
+        addPort(ports, numPorts, component, 0, 10, addressBits, false);
+        if (kind == KIND_ROM) {
+            addPort(ports, numPorts, component, 240, 60, dataBits, true);
+            return 0;
+        }
+        const char* bus = getAttribute(builder, component, "databus");
+        if (bus != NULL && strcmp(bus, "separate") != 0) {
+            return ERROR_UNSUPPORTED_COMPONENT;
+        }
+        addPort(ports, numPorts, component, 0, 50, 1, false);
+        addPort(ports, numPorts, component, 0, 60, 1, false);
+        addPort(ports, numPorts, component, 0, 70, 1, false);
+        addPort(ports, numPorts, component, 0, 90, dataBits, false);
+        addPort(ports, numPorts, component, 240, 90, dataBits, true);
+        return 0;
+    }
+    case KIND_SUBCIRCUIT: {
+        const CircuitDefinition* child = findCircuit(builder->project, component->name);
+        if (child == NULL) {
+            return ERROR_MALFORMED_CIRCUIT;
+        }
+        return getSubcircuitPorts(builder, component, (uint32_t)(child - builder->project->circuits), ports, numPorts);
+    }
+    case KIND_UNSUPPORTED:
+        return ERROR_UNSUPPORTED_COMPONENT;
+    default:
+        return getGatePorts(builder, component, kind, ports, numPorts) ? 0 : ERROR_UNSUPPORTED_COMPONENT;
+    }
+}
+
+static uint32_t findPoint(uint32_t* parents, uint32_t point)
+{
+    while (*(parents + point) != point) {
+        *(parents + point) = *(parents + *(parents + point));
+        point = *(parents + point);
+    }
+    return point;
+}
+
+static int comparePointRefs(const void* a, const void* b)
+{
+    const PointRef* first = a;
+    const PointRef* second = b;
+    if (first->x != second->x) {
+        return first->x < second->x ? -1 : 1;
+    } else if (first->y != second->y) {
+        return first->y < second->y ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Work out the ports of every component of a circuit and which of them the wires join into nets
+ *
+ * @param builder The builder
+ * @param index Index of the circuit definition
+ * @return 0 if successful, otherwise the status code of the problem
+ */
+static uint8_t layoutCircuit(NetlistBuilder* builder, uint32_t index)
+{
+    const CircuitDefinition* circuit = builder->project->circuits + index;
+    CircuitLayout* layout = builder->layouts + index;
+    if (layout->ready) {
+        return 0;
+    }
+    layout->kinds = malloc((circuit->numComponents + 1) * sizeof(uint8_t));
+    layout->firstPorts = malloc((circuit->numComponents + 1) * sizeof(uint32_t));
+    if (layout->kinds == NULL || layout->firstPorts == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    uint32_t numPorts = 0;
+    uint32_t portCapacity = 0;
+    ComponentPort found[MAX_COMPONENT_PORTS];
+    for (uint32_t i = 0; i < circuit->numComponents; i++) {
+        *(layout->kinds + i) = getComponentKind(circuit->components + i);
+        *(layout->firstPorts + i) = numPorts;
+        uint32_t numFound;
+        uint8_t status = getComponentPorts(builder, circuit->components + i, *(layout->kinds + i), found, &numFound);
+        if (status != 0) {
+            return reportNetlistProblem(builder, status, index, i);
+        } else if (!growNetlistArray((void**)&layout->ports, numPorts + numFound, &portCapacity, sizeof(ComponentPort))) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        memcpy(layout->ports + numPorts, found, numFound * sizeof(ComponentPort));
+        numPorts += numFound;
+    }
+    *(layout->firstPorts + circuit->numComponents) = numPorts;
+
+    // sorting every wire end and port by location gives each distinct point a number, then wires join points
+    uint32_t numRefs = 2 * circuit->numWires + numPorts;
+    PointRef* refs = malloc((numRefs + 1) * sizeof(PointRef));
+    uint32_t* pointOfRef = malloc((numRefs + 1) * sizeof(uint32_t));
+    uint32_t* parents = malloc((numRefs + 1) * sizeof(uint32_t));
+    uint32_t* netOfRoot = malloc((numRefs + 1) * sizeof(uint32_t));
+    if (refs == NULL || pointOfRef == NULL || parents == NULL || netOfRoot == NULL) {
+        free(refs);
+        free(pointOfRef);
+        free(parents);
+        free(netOfRoot);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    for (uint32_t i = 0; i < circuit->numWires; i++) {
+        const CircuitWire* wire = circuit->wires + i;
+        *(refs + 2 * i) = (PointRef){wire->x0, wire->y0, 2 * i};
+        *(refs + 2 * i + 1) = (PointRef){wire->x1, wire->y1, 2 * i + 1};
+    }
+    for (uint32_t i = 0; i < numPorts; i++) {
+        *(refs + 2 * circuit->numWires + i) = (PointRef){(layout->ports + i)->x, (layout->ports + i)->y, 2 * circuit->numWires + i};
+    }
+    qsort(refs, numRefs, sizeof(PointRef), comparePointRefs);
+    uint32_t numPoints = 0;
+    for (uint32_t i = 0; i < numRefs; i++) {
+        if (i == 0 || comparePointRefs(refs + i - 1, refs + i) != 0) {
+            *(parents + numPoints) = numPoints;
+            numPoints++;
+        }
+        *(pointOfRef + (refs + i)->id) = numPoints - 1;
+    }
+    for (uint32_t i = 0; i < circuit->numWires; i++) {
+        uint32_t a = findPoint(parents, *(pointOfRef + 2 * i));
+        uint32_t b = findPoint(parents, *(pointOfRef + 2 * i + 1));
+        *(parents + a) = b;
+    }
+    layout->numNets = 0;
+    for (uint32_t i = 0; i < numPoints; i++) {
+        *(netOfRoot + i) = UINT32_MAX;
+    }
+    for (uint32_t i = 0; i < numPoints; i++) {
+        uint32_t root = findPoint(parents, i);
+        if (*(netOfRoot + root) == UINT32_MAX) {
+            *(netOfRoot + root) = layout->numNets++;
+        }
+    }
+    layout->netWidths = calloc(layout->numNets + 1, sizeof(uint32_t));
+    uint8_t status = layout->netWidths == NULL ? ERROR_OUT_OF_MEMORY : 0;
+    for (uint32_t i = 0; i < numPorts && status == 0; i++) {
+        ComponentPort* port = layout->ports + i;
+        port->net = *(netOfRoot + findPoint(parents, *(pointOfRef + 2 * circuit->numWires + i)));
+        uint32_t* width = layout->netWidths + port->net;
+        if (*width == 0) {
+            *width = port->width;
+        } else if (*width != port->width && port->width != 0) {
+            uint32_t component = 0;
+            while (*(layout->firstPorts + component + 1) <= i) {
+                component++;
+            }
+            status = reportNetlistProblem(builder, ERROR_INCOMPATIBLE_WIDTHS, index, component);
+            builder->diagnostic->x = port->x;
+            builder->diagnostic->y = port->y;
+        }
+    }
+    free(refs);
+    free(pointOfRef);
+    free(parents);
+    free(netOfRoot);
+    layout->ready = status == 0;
+    return status;
+}
+
+/**
+ * @brief Allocate consecutive signals, each in a set of its own
+ *
+ * @param builder The builder
+ * @param count Number of signals
+ * @return The first one, NO_SIGNAL if out of memory
+ */
+static uint32_t newSignals(NetlistBuilder* builder, uint32_t count)
+{
+    GateNetlist* netlist = builder->netlist;
+    if (!growNetlistArray((void**)&builder->parents, netlist->numSignals + count, &builder->parentCapacity, sizeof(uint32_t))) {
+        return NO_SIGNAL;
+    }
+    uint32_t first = netlist->numSignals;
+    for (uint32_t i = 0; i < count; i++) {
+        *(builder->parents + first + i) = first + i;
+    }
+    netlist->numSignals += count;
+    return first;
+}
+
+static uint32_t findSignal(NetlistBuilder* builder, uint32_t signal)
+{
+    return findPoint(builder->parents, signal);
+}
+
+/**
+ * @brief Join two signals into one
+ *
+ * @return true if successful, false if they are two different fixed signals
+ */
+static bool unionSignals(NetlistBuilder* builder, uint32_t a, uint32_t b)
+{
+    uint32_t rootA = findSignal(builder, a);
+    uint32_t rootB = findSignal(builder, b);
+    if (rootA == rootB) {
+        return true;
+    } else if (rootA < GATE_NUM_FIXED_SIGNALS && rootB < GATE_NUM_FIXED_SIGNALS) {
+        return false;
+    }
+    *(builder->parents + (rootA < rootB ? rootB : rootA)) = rootA < rootB ? rootA : rootB;
+    return true;
+}
+
+static char* joinPath(const char* const path, const char* const name)
+{
+    size_t pathLength = strlen(path);
+    char* joined = malloc(pathLength + strlen(name) + 2);
+    if (joined != NULL) {
+        strcpy(joined, path);
+        if (pathLength > 0) {
+            strcat(joined, "/");
+        }
+        strcat(joined, name);
+    }
+    return joined;
+}
+
+/**
+ * @brief Give every net of a circuit instance its signals, join them across splitters, fixed values and subcircuit
+ * pins, and queue its other components for lowering
+ *
+ * @param builder The builder
+ * @param index Index of the circuit definition
+ * @param path Names of the enclosing instances, "" for the main circuit
+ * @param depth How deeply nested the instance is
+ * @param netSignals Receives the first signal of each net, to be freed by the caller
+ * @return 0 if successful, otherwise the status code of the problem
+ */
+static uint8_t placeCircuit(NetlistBuilder* builder, uint32_t index, const char* const path, uint32_t depth, uint32_t** netSignals)
+{
+    const CircuitDefinition* circuit = builder->project->circuits + index;
+    if (depth == MAX_CIRCUIT_DEPTH) {
+        return reportNetlistProblem(builder, ERROR_MALFORMED_CIRCUIT, index, UINT32_MAX);  // it contains itself
+    }
+    uint8_t status = layoutCircuit(builder, index);
+    if (status != 0) {
+        return status;
+    }
+    const CircuitLayout* layout = builder->layouts + index;
+    *netSignals = malloc((layout->numNets + 1) * sizeof(uint32_t));
+    if (*netSignals == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    for (uint32_t net = 0; net < layout->numNets; net++) {
+        *(*netSignals + net) = newSignals(builder, *(layout->netWidths + net));
+        if (*(*netSignals + net) == NO_SIGNAL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+    }
+    for (uint32_t i = 0; i < circuit->numComponents && status == 0; i++) {
+        const CircuitComponent* component = circuit->components + i;
+        const ComponentPort* ports = layout->ports + *(layout->firstPorts + i);
+        uint32_t numPorts = *(layout->firstPorts + i + 1) - *(layout->firstPorts + i);
+        uint8_t kind = *(layout->kinds + i);
+        bool joined = true;
+        if (kind == KIND_IGNORED || kind == KIND_PIN) {
+            continue;
+        } else if (kind == KIND_CONSTANT) {
+            uint32_t value = getNumberAttribute(builder, component, "value", 1);
+            for (uint32_t bit = 0; bit < ports->width; bit++) {
+                joined = joined && unionSignals(builder, *(*netSignals + ports->net) + bit, bit < 32 && ((value >> bit) & 1) ? GATE_SIGNAL_ONE : GATE_SIGNAL_ZERO);
+            }
+        } else if (kind == KIND_CLOCK) {
+            joined = unionSignals(builder, *(*netSignals + ports->net), GATE_SIGNAL_CLOCK);
+        } else if (kind == KIND_BUTTON) {
+            joined = unionSignals(builder, *(*netSignals + ports->net), GATE_SIGNAL_ZERO);  // nobody presses it
+        } else if (kind == KIND_SPLITTER) {
+            uint32_t used[MAX_COMPONENT_PORTS] = {0};
+            for (uint32_t bit = 0; bit < ports->width; bit++) {
+                char name[24];
+                snprintf(name, sizeof(name), "bit%" PRIu32, bit);
+                const char* end = getAttribute(builder, component, name);
+                if (end == NULL ? bit < numPorts - 1 : strcmp(end, "none") != 0) {
+                    uint32_t split = end == NULL ? bit : (uint32_t)strtoul(end, NULL, 10);
+                    const ComponentPort* splitPort = ports + 1 + split;
+                    joined = joined && unionSignals(builder, *(*netSignals + ports->net) + bit, *(*netSignals + splitPort->net) + used[split]++);
+                }
+            }
+        } else if (kind == KIND_SUBCIRCUIT) {
+            const CircuitDefinition* child = findCircuit(builder->project, component->name);
+            uint32_t childIndex = (uint32_t)(child - builder->project->circuits);
+            const char* label = getAttribute(builder, component, "label");
+            char* childPath = joinPath(path, label != NULL && *label != '\0' ? label : component->name);
+            uint32_t* childSignals = NULL;
+            status = childPath == NULL ? ERROR_OUT_OF_MEMORY : placeCircuit(builder, childIndex, childPath, depth + 1, &childSignals);
+            const CircuitLayout* childLayout = builder->layouts + childIndex;
+            for (uint32_t p = 0; p < numPorts && status == 0; p++) {
+                const ComponentPort* port = ports + p;
+                const ComponentPort* pin = childLayout->ports + *(childLayout->firstPorts + port->pin);
+                for (uint32_t bit = 0; bit < port->width; bit++) {
+                    joined = joined && unionSignals(builder, *(*netSignals + port->net) + bit, *(childSignals + pin->net) + bit);
+                }
+            }
+            free(childPath);
+            free(childSignals);
+        } else {
+            if (!growNetlistArray((void**)&builder->placed, builder->numPlaced, &builder->placedCapacity, sizeof(PlacedComponent)) ||
+                !growNetlistArray((void**)&builder->portSignals, builder->numPortSignals + numPorts, &builder->portSignalCapacity, sizeof(uint32_t))) {
+                return ERROR_OUT_OF_MEMORY;
+            }
+            PlacedComponent* placed = builder->placed + builder->numPlaced++;
+            placed->circuit = index;
+            placed->component = i;
+            placed->kind = kind;
+            placed->firstSignal = builder->numPortSignals;
+            placed->name = NULL;
+            for (uint32_t p = 0; p < numPorts; p++) {
+                *(builder->portSignals + builder->numPortSignals++) = *(*netSignals + (ports + p)->net);
+            }
+            if (kind == KIND_REGISTER || kind == KIND_RAM || kind == KIND_ROM) {
+                char location[32];
+                snprintf(location, sizeof(location), "%s@%" PRId32 ",%" PRId32, kind == KIND_REGISTER ? "Register" : kind == KIND_RAM ? "RAM" : "ROM", component->x, component->y);
+                const char* label = getAttribute(builder, component, "label");
+                placed->name = joinPath(path, label != NULL && *label != '\0' ? label : location);
+                if (placed->name == NULL) {
+                    return ERROR_OUT_OF_MEMORY;
+                }
+            }
+        }
+        if (status == 0 && !joined) {
+            status = reportNetlistProblem(builder, ERROR_MULTIPLE_DRIVERS, index, i);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Get the value a component sees on one of its inputs
+ *
+ * @param builder The builder
+ * @param signal The signal the input is connected to
+ * @param floating What to see when nothing drives it, NO_SIGNAL to ignore the input
+ * @return The signal, floating if it is not driven
+ */
+static uint32_t readSignal(NetlistBuilder* builder, uint32_t signal, uint32_t floating)
+{
+    uint32_t root = findSignal(builder, signal);
+    return *(builder->driven + root) ? root : floating;
+}
+
+/**
+ * @brief Add an op writing an existing signal
+ *
+ * @return true if successful, false if out of memory
+ */
+static bool addOp(NetlistBuilder* builder, uint8_t kind, uint32_t output, uint32_t a, uint32_t b, uint32_t c)
+{
+    GateNetlist* netlist = builder->netlist;
+    if (!growNetlistArray((void**)&netlist->ops, netlist->numOps, &netlist->opCapacity, sizeof(GateOp))) {
+        return false;
+    }
+    GateOp* op = netlist->ops + netlist->numOps++;
+    op->kind = kind;
+    op->output = output;
+    op->inputs[0] = a;
+    op->inputs[1] = b;
+    op->inputs[2] = c;
+    op->origin = builder->origin;
+    op->clocked = false;
+    return true;
+}
+
+/**
+ * @brief Add an op writing a new signal, folding constant inputs away
+ *
+ * @return The signal with the result, NO_SIGNAL if out of memory
+ */
+static uint32_t emitOp(NetlistBuilder* builder, uint8_t kind, uint32_t a, uint32_t b, uint32_t c)
+{
+    switch (kind) {
+    case GATE_OP_NOT:
+        if (a < GATE_SIGNAL_CLOCK) {
+            return a == GATE_SIGNAL_ZERO ? GATE_SIGNAL_ONE : GATE_SIGNAL_ZERO;
+        }
+        break;
+    case GATE_OP_AND:
+        if (a == GATE_SIGNAL_ZERO || b == GATE_SIGNAL_ZERO) {
+            return GATE_SIGNAL_ZERO;
+        } else if (a == GATE_SIGNAL_ONE || a == b) {
+            return b;
+        } else if (b == GATE_SIGNAL_ONE) {
+            return a;
+        }
+        break;
+    case GATE_OP_OR:
+        if (a == GATE_SIGNAL_ONE || b == GATE_SIGNAL_ONE) {
+            return GATE_SIGNAL_ONE;
+        } else if (a == GATE_SIGNAL_ZERO || a == b) {
+            return b;
+        } else if (b == GATE_SIGNAL_ZERO) {
+            return a;
+        }
+        break;
+    case GATE_OP_XOR:
+        if (a == b) {
+            return GATE_SIGNAL_ZERO;
+        } else if (a == GATE_SIGNAL_ZERO) {
+            return b;
+        } else if (b == GATE_SIGNAL_ZERO) {
+            return a;
+        } else if (a == GATE_SIGNAL_ONE) {
+            return emitOp(builder, GATE_OP_NOT, b, 0, 0);
+        } else if (b == GATE_SIGNAL_ONE) {
+            return emitOp(builder, GATE_OP_NOT, a, 0, 0);
+        }
+        break;
+    case GATE_OP_MUX:
+        if (a == GATE_SIGNAL_ZERO || b == c) {
+            return b;
+        } else if (a == GATE_SIGNAL_ONE) {
+            return c;
+        }
+        break;
+    }
+    uint32_t output = newSignals(builder, 1);
+    return output == NO_SIGNAL || !addOp(builder, kind, output, a, b, c) ? NO_SIGNAL : output;
+}
+
+/**
+ * @brief Make the signal of an output port carry a value
+ */
+static bool driveSignal(NetlistBuilder* builder, uint32_t output, uint32_t value)
+{
+    return value != NO_SIGNAL && addOp(builder, GATE_OP_COPY, findSignal(builder, output), value, 0, 0);
+}
+
+/**
+ * @brief Lower one bit of an AND, OR, XOR, NAND, NOR or XNOR gate
+ *
+ * Floating inputs are ignored, like Logisim's default; with every input floating the output is 0. An XOR of more than
+ * two inputs is true when exactly one input is, unless its "xor" attribute asks for odd parity.
+ *
+ * @return true if successful, false if out of memory
+ */
+static bool lowerGateBit(NetlistBuilder* builder, const CircuitComponent* const component, uint8_t kind, const uint32_t* const signals, uint32_t numInputs, uint32_t bit)
+{
+    bool xorLike = kind == KIND_XOR || kind == KIND_XNOR;
+    bool parity = hasAttributeValue(builder, component, "xor", "odd");
+    uint32_t result = kind == KIND_AND || kind == KIND_NAND ? GATE_SIGNAL_ONE : GATE_SIGNAL_ZERO;
+    uint32_t several = GATE_SIGNAL_ZERO;  // at least two inputs of an XOR were true
+    bool any = false;
+    for (uint32_t i = 0; i < numInputs && result != NO_SIGNAL; i++) {
+        uint32_t input = readSignal(builder, *(signals + 1 + i) + bit, NO_SIGNAL);
+        if (input == NO_SIGNAL) {
+            continue;
+        }
+        char negateName[24];
+        snprintf(negateName, sizeof(negateName), "negate%" PRIu32, i);
+        if (hasAttributeValue(builder, component, negateName, "true")) {
+            input = emitOp(builder, GATE_OP_NOT, input, 0, 0);
+        }
+        any = true;
+        if (kind == KIND_AND || kind == KIND_NAND) {
+            result = emitOp(builder, GATE_OP_AND, result, input, 0);
+        } else if (kind == KIND_OR || kind == KIND_NOR) {
+            result = emitOp(builder, GATE_OP_OR, result, input, 0);
+        } else {
+            if (!parity) {
+                several = emitOp(builder, GATE_OP_OR, several, emitOp(builder, GATE_OP_AND, result, input, 0), 0);
+            }
+            result = emitOp(builder, GATE_OP_XOR, result, input, 0);
+        }
+    }
+    if (xorLike && !parity && several != GATE_SIGNAL_ZERO) {
+        result = emitOp(builder, GATE_OP_AND, result, emitOp(builder, GATE_OP_NOT, several, 0, 0), 0);
+    }
+    if (any && (kind == KIND_NAND || kind == KIND_NOR || kind == KIND_XNOR)) {
+        result = emitOp(builder, GATE_OP_NOT, result, 0, 0);
+    }
+    return driveSignal(builder, *signals + bit, any ? result : GATE_SIGNAL_ZERO);
+}
+
+/**
+ * @brief Parse ROM contents, "addr/data: 8 8" followed by hexadecimal values, runs written as count*value
+ *
+ * @param text The contents attribute
+ * @param contents Receives the values, already zeroed
+ * @param size Number of values
+ * @return true if successful, false if the contents are malformed
+ */
+static bool parseMemoryContents(const char* const text, uint8_t* contents, uint32_t size)
+{
+    const char* c = strchr(text, '\n');
+    if (strncmp(text, "addr/data:", 10) != 0 || c == NULL) {
+        return false;
+    }
+    uint32_t address = 0;
+    while (*c != '\0') {
+        while (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n') {
+            c++;
+        }
+        if (*c == '\0') {
+            break;
+        }
+        char* end;
+        unsigned long value = strtoul(c, &end, 16);
+        unsigned long count = 1;
+        if (end == c) {
+            return false;
+        } else if (*end == '*') {
+            count = strtoul(c, NULL, 10);
+            c = end + 1;
+            value = strtoul(c, &end, 16);
+            if (end == c) {
+                return false;
+            }
+        }
+        for (unsigned long i = 0; i < count && address < size; i++) {
+            *(contents + address++) = (uint8_t)value;
+        }
+        c = end;
+    }
+    return true;
+}
+
+/**
+ * @brief Turn a placed component into ops, a register or a memory
+ *
+ * @param builder The builder
+ * @param placed The component
+ * @return 0 if successful, otherwise the status code of the problem
+ */
+static uint8_t lowerComponent(NetlistBuilder* builder, PlacedComponent* placed)
+{
+    GateNetlist* netlist = builder->netlist;
+    const CircuitComponent* component = (builder->project->circuits + placed->circuit)->components + placed->component;
+    const CircuitLayout* layout = builder->layouts + placed->circuit;
+    const ComponentPort* ports = layout->ports + *(layout->firstPorts + placed->component);
+    uint32_t numPorts = *(layout->firstPorts + placed->component + 1) - *(layout->firstPorts + placed->component);
+    const uint32_t* signals = builder->portSignals + placed->firstSignal;
+    uint32_t width = ports->width;
+    bool ok = true;
+    switch (placed->kind) {
+    case KIND_NOT:
+        for (uint32_t bit = 0; bit < width && ok; bit++) {
+            uint32_t input = readSignal(builder, *(signals + 1) + bit, NO_SIGNAL);
+            ok = driveSignal(builder, *signals + bit, input == NO_SIGNAL ? GATE_SIGNAL_ZERO : emitOp(builder, GATE_OP_NOT, input, 0, 0));
+        }
+        break;
+    case KIND_MULTIPLEXER: {
+        uint32_t numInputs = numPorts - 2;
+        const uint32_t* select = signals + 1 + numInputs;
+        uint32_t level[MAX_COMPONENT_PORTS];
+        for (uint32_t bit = 0; bit < width && ok; bit++) {
+            for (uint32_t i = 0; i < numInputs; i++) {
+                level[i] = readSignal(builder, *(signals + 1 + i) + bit, GATE_SIGNAL_ZERO);
+            }
+            for (uint32_t s = 0, n = numInputs; n > 1; s++, n /= 2) {
+                uint32_t selectBit = readSignal(builder, *select + s, GATE_SIGNAL_ZERO);
+                for (uint32_t i = 0; i < n / 2; i++) {
+                    level[i] = emitOp(builder, GATE_OP_MUX, selectBit, level[2 * i], level[2 * i + 1]);
+                }
+            }
+            ok = driveSignal(builder, *signals + bit, level[0]);
+        }
+        break;
+    }
+    case KIND_DEMULTIPLEXER: {
+        uint32_t numOutputs = numPorts - 2;
+        uint32_t selectBits = (ports + numPorts - 1)->width;
+        const uint32_t* select = signals + 1 + numOutputs;
+        for (uint32_t i = 0; i < numOutputs && ok; i++) {
+            uint32_t selected = GATE_SIGNAL_ONE;
+            for (uint32_t s = 0; s < selectBits; s++) {
+                uint32_t selectBit = readSignal(builder, *select + s, GATE_SIGNAL_ZERO);
+                selected = emitOp(builder, GATE_OP_AND, selected, (i >> s) & 1 ? selectBit : emitOp(builder, GATE_OP_NOT, selectBit, 0, 0), 0);
+            }
+            for (uint32_t bit = 0; bit < width && ok; bit++) {
+                ok = driveSignal(builder, *(signals + 1 + i) + bit, emitOp(builder, GATE_OP_AND, selected, readSignal(builder, *signals + bit, GATE_SIGNAL_ZERO), 0));
+            }
+        }
+        break;
+    }
+    case KIND_ADDER: {
+        uint32_t carry = readSignal(builder, *(signals + 3), GATE_SIGNAL_ZERO);
+        for (uint32_t bit = 0; bit < width && ok; bit++) {
+            uint32_t a = readSignal(builder, *(signals + 1) + bit, GATE_SIGNAL_ZERO);
+            uint32_t b = readSignal(builder, *(signals + 2) + bit, GATE_SIGNAL_ZERO);
+            uint32_t half = emitOp(builder, GATE_OP_XOR, a, b, 0);
+            ok = driveSignal(builder, *signals + bit, emitOp(builder, GATE_OP_XOR, half, carry, 0));
+            carry = emitOp(builder, GATE_OP_OR, emitOp(builder, GATE_OP_AND, a, b, 0), emitOp(builder, GATE_OP_AND, half, carry, 0), 0);
+        }
+        ok = ok && driveSignal(builder, *(signals + 4), carry);
+        break;
+    }
+    case KIND_SHIFTER: {
+        const char* type = getAttribute(builder, component, "shift");
+        type = type == NULL ? "ll" : type;
+        uint32_t current[64];
+        uint32_t shifted[64];
+        if (width > 64) {
+            return reportNetlistProblem(builder, ERROR_UNSUPPORTED_COMPONENT, placed->circuit, placed->component);
+        }
+        for (uint32_t bit = 0; bit < width; bit++) {
+            current[bit] = readSignal(builder, *(signals + 1) + bit, GATE_SIGNAL_ZERO);
+        }
+        for (uint32_t s = 0; s < (ports + 2)->width; s++) {  // a barrel shifter, one stage per distance bit
+            uint32_t distance = (1u << s) % width;
+            uint32_t selectBit = readSignal(builder, *(signals + 2) + s, GATE_SIGNAL_ZERO);
+            for (uint32_t bit = 0; bit < width; bit++) {
+                uint32_t from;
+                if (strcmp(type, "lr") == 0) {
+                    from = bit + (1u << s) < width ? current[bit + (1u << s)] : GATE_SIGNAL_ZERO;
+                } else if (strcmp(type, "ar") == 0) {
+                    from = bit + (1u << s) < width ? current[bit + (1u << s)] : current[width - 1];
+                } else if (strcmp(type, "rl") == 0) {
+                    from = current[(bit + width - distance) % width];
+                } else if (strcmp(type, "rr") == 0) {
+                    from = current[(bit + distance) % width];
+                } else {
+                    from = bit >= (1u << s) ? current[bit - (1u << s)] : GATE_SIGNAL_ZERO;
+                }
+                shifted[bit] = emitOp(builder, GATE_OP_MUX, selectBit, current[bit], from);
+            }
+            memcpy(current, shifted, width * sizeof(uint32_t));
+        }
+        for (uint32_t bit = 0; bit < width && ok; bit++) {
+            ok = driveSignal(builder, *signals + bit, current[bit]);
+        }
+        break;
+    }
+    case KIND_REGISTER: {
+        const char* trigger = getAttribute(builder, component, "trigger");
+        if (trigger != NULL && strcmp(trigger, "rising") != 0 && strcmp(trigger, "falling") != 0) {
+            return reportNetlistProblem(builder, ERROR_UNSUPPORTED_COMPONENT, placed->circuit, placed->component);  // latches
+        }
+        uint32_t outputCapacity = netlist->flipFlopCapacity;  // both arrays grow in step
+        if (!growNetlistArray((void**)&netlist->registers, netlist->numRegisters, &netlist->registerCapacity, sizeof(GateRegister)) ||
+            !growNetlistArray((void**)&netlist->flipFlopOutputs, netlist->numFlipFlops + width, &outputCapacity, sizeof(uint32_t)) ||
+            !growNetlistArray((void**)&netlist->flipFlopInputs, netlist->numFlipFlops + width, &netlist->flipFlopCapacity, sizeof(uint32_t))) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        GateRegister* reg = netlist->registers + netlist->numRegisters++;
+        reg->name = placed->name;
+        placed->name = NULL;
+        reg->width = width;
+        reg->firstFlipFlop = netlist->numFlipFlops;
+        reg->enable = readSignal(builder, *(signals + 2), GATE_SIGNAL_ONE);
+        reg->clock = readSignal(builder, *(signals + 3), GATE_SIGNAL_ZERO);
+        reg->clear = readSignal(builder, *(signals + 4), GATE_SIGNAL_ZERO);
+        reg->falling = trigger != NULL && strcmp(trigger, "falling") == 0;
+        for (uint32_t bit = 0; bit < width; bit++) {
+            *(netlist->flipFlopInputs + netlist->numFlipFlops) = readSignal(builder, *(signals + 1) + bit, GATE_SIGNAL_ZERO);
+            *(netlist->flipFlopOutputs + netlist->numFlipFlops++) = findSignal(builder, *signals + bit);
+        }
+        break;
+    }
+    case KIND_RAM:
+    case KIND_ROM: {
+        const char* trigger = getAttribute(builder, component, "trigger");
+        if (trigger != NULL && strcmp(trigger, "rising") != 0 && strcmp(trigger, "falling") != 0) {
+            return reportNetlistProblem(builder, ERROR_UNSUPPORTED_COMPONENT, placed->circuit, placed->component);
+        } else if (!growNetlistArray((void**)&netlist->memories, netlist->numMemories, &netlist->memoryCapacity, sizeof(GateMemory))) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        uint32_t index = netlist->numMemories;
+        GateMemory* memory = netlist->memories + netlist->numMemories++;
+        memset(memory, 0, sizeof(GateMemory));
+        memory->name = placed->name;
+        placed->name = NULL;
+        memory->addressBits = ports->width;
+        memory->dataBits = (ports + numPorts - 1)->width;
+        memory->writable = placed->kind == KIND_RAM;
+        memory->falling = trigger != NULL && strcmp(trigger, "falling") == 0;
+        memory->contents = calloc((size_t)1 << memory->addressBits, sizeof(uint8_t));
+        if (memory->contents == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        const char* contents = getAttribute(builder, component, "contents");
+        if (contents != NULL && !parseMemoryContents(contents, memory->contents, 1u << memory->addressBits)) {
+            return reportNetlistProblem(builder, ERROR_MALFORMED_CIRCUIT, placed->circuit, placed->component);
+        }
+        for (uint32_t bit = 0; bit < memory->addressBits; bit++) {
+            memory->address[bit] = readSignal(builder, *signals + bit, GATE_SIGNAL_ZERO);
+        }
+        uint32_t load = GATE_SIGNAL_ONE;
+        if (memory->writable) {
+            memory->writeEnable = readSignal(builder, *(signals + 1), GATE_SIGNAL_ZERO);
+            load = readSignal(builder, *(signals + 2), GATE_SIGNAL_ONE);
+            memory->clock = readSignal(builder, *(signals + 3), GATE_SIGNAL_ZERO);
+            for (uint32_t bit = 0; bit < memory->dataBits; bit++) {
+                memory->dataIn[bit] = readSignal(builder, *(signals + 4) + bit, GATE_SIGNAL_ZERO);
+            }
+        }
+        uint32_t first = newSignals(builder, memory->dataBits);
+        if (first == NO_SIGNAL || !addOp(builder, GATE_OP_READ, NO_SIGNAL, index, 0, 0)) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        for (uint32_t bit = 0; bit < memory->dataBits && ok; bit++) {
+            memory = netlist->memories + index;
+            memory->dataOut[bit] = first + bit;
+            ok = driveSignal(builder, *(signals + numPorts - 1) + bit, emitOp(builder, GATE_OP_AND, load, first + bit, 0));
+        }
+        break;
+    }
+    default:
+        for (uint32_t bit = 0; bit < width && ok; bit++) {
+            ok = lowerGateBit(builder, component, placed->kind, signals, numPorts - 1, bit);
+        }
+        break;
+    }
+    return ok ? 0 : ERROR_OUT_OF_MEMORY;
+}
+
+/**
+ * @brief Get the signals an op reads
+ *
+ * @param netlist The netlist
+ * @param op The op
+ * @param inputs Receives the signals
+ * @return How many there are
+ */
+static uint32_t getOpInputs(const GateNetlist* const netlist, const GateOp* const op, const uint32_t** inputs)
+{
+    *inputs = op->inputs;
+    switch (op->kind) {
+    case GATE_OP_COPY:
+    case GATE_OP_NOT:
+        return 1;
+    case GATE_OP_MUX:
+        return 3;
+    case GATE_OP_READ:
+        *inputs = (netlist->memories + op->inputs[0])->address;
+        return (netlist->memories + op->inputs[0])->addressBits;
+    default:
+        return 2;
+    }
+}
+
+/**
+ * @brief Depth-first search from some signals back through the ops driving them
+ *
+ * @param builder The builder
+ * @param driverOps The op driving each signal, UINT32_MAX for none
+ * @param marks State of each op: 0 unvisited, 1 in progress, 2 done; updated
+ * @param stack Scratch space, one entry per op
+ * @param roots Signals to start from
+ * @param numRoots Number of roots
+ * @param order Receives each op after every op it depends on, NULL if not needed
+ * @param numOrdered Number of ops in order, updated
+ * @return 0 if successful, ERROR_COMBINATIONAL_LOOP if an op depends on itself
+ */
+static uint8_t searchOps(NetlistBuilder* builder, const uint32_t* const driverOps, uint8_t* marks, uint32_t* stack, const uint32_t* const roots, uint32_t numRoots, uint32_t* order, uint32_t* numOrdered)
+{
+    const GateNetlist* netlist = builder->netlist;
+    for (uint32_t r = 0; r < numRoots; r++) {
+        uint32_t root = *(driverOps + *(roots + r));
+        if (root == UINT32_MAX || *(marks + root) != 0) {
+            continue;
+        }
+        uint32_t depth = 0;
+        *(stack + depth++) = root;
+        *(marks + root) = 1;
+        while (depth > 0) {
+            uint32_t index = *(stack + depth - 1);
+            const uint32_t* inputs;
+            uint32_t numInputs = getOpInputs(netlist, netlist->ops + index, &inputs);
+            bool descended = false;
+            for (uint32_t i = 0; i < numInputs && !descended; i++) {
+                uint32_t driver = *(driverOps + *(inputs + i));
+                if (driver == UINT32_MAX || *(marks + driver) == 2) {
+                    continue;
+                } else if (*(marks + driver) == 1) {
+                    const PlacedComponent* placed = builder->placed + (netlist->ops + driver)->origin;
+                    return reportNetlistProblem(builder, ERROR_COMBINATIONAL_LOOP, placed->circuit, placed->component);
+                }
+                *(marks + driver) = 1;
+                *(stack + depth++) = driver;
+                descended = true;
+            }
+            if (!descended) {
+                *(marks + index) = 2;
+                depth--;
+                if (order != NULL) {
+                    *(order + (*numOrdered)++) = index;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Sort the ops so each comes after its inputs, drop the ones nothing stateful depends on, and mark the ones
+ * the clocks depend on
+ *
+ * @param builder The builder
+ * @return 0 if successful, otherwise the status code of the problem
+ */
+static uint8_t levelizeOps(NetlistBuilder* builder)
+{
+    GateNetlist* netlist = builder->netlist;
+    uint32_t numRoots = 0;
+    for (uint32_t i = 0; i < netlist->numMemories; i++) {
+        numRoots += (netlist->memories + i)->addressBits + (netlist->memories + i)->dataBits + 2;
+    }
+    numRoots += netlist->numFlipFlops + 3 * netlist->numRegisters;
+    uint32_t* driverOps = malloc((netlist->numSignals + 1) * sizeof(uint32_t));
+    uint8_t* marks = calloc(netlist->numOps + 1, sizeof(uint8_t));
+    uint32_t* stack = malloc((netlist->numOps + 1) * sizeof(uint32_t));
+    uint32_t* order = malloc((netlist->numOps + 1) * sizeof(uint32_t));
+    uint32_t* roots = malloc((numRoots + 1) * sizeof(uint32_t));
+    GateOp* sorted = malloc((netlist->numOps + 1) * sizeof(GateOp));
+    uint8_t status = driverOps == NULL || marks == NULL || stack == NULL || order == NULL || roots == NULL || sorted == NULL ? ERROR_OUT_OF_MEMORY : 0;
+    if (status == 0) {
+        for (uint32_t i = 0; i < netlist->numSignals; i++) {
+            *(driverOps + i) = UINT32_MAX;
+        }
+        for (uint32_t i = 0; i < netlist->numOps; i++) {
+            const GateOp* op = netlist->ops + i;
+            if (op->kind == GATE_OP_READ) {
+                const GateMemory* memory = netlist->memories + op->inputs[0];
+                for (uint32_t bit = 0; bit < memory->dataBits; bit++) {
+                    *(driverOps + memory->dataOut[bit]) = i;
+                }
+            } else {
+                *(driverOps + op->output) = i;
+            }
+        }
+
+        // clocks first, so their cone can be marked before the rest of the search visits it
+        numRoots = 0;
+        for (uint32_t i = 0; i < netlist->numRegisters; i++) {
+            *(roots + numRoots++) = (netlist->registers + i)->clock;
+        }
+        for (uint32_t i = 0; i < netlist->numMemories; i++) {
+            if ((netlist->memories + i)->writable) {
+                *(roots + numRoots++) = (netlist->memories + i)->clock;
+            }
+        }
+        uint32_t numOrdered = 0;
+        status = searchOps(builder, driverOps, marks, stack, roots, numRoots, order, &numOrdered);
+        for (uint32_t i = 0; i < numOrdered && status == 0; i++) {
+            GateOp* op = netlist->ops + *(order + i);
+            op->clocked = true;
+            if (op->kind == GATE_OP_READ) {
+                const PlacedComponent* placed = builder->placed + op->origin;
+                status = reportNetlistProblem(builder, ERROR_UNSUPPORTED_COMPONENT, placed->circuit, placed->component);  // a clock through memory
+            }
+        }
+        numRoots = 0;
+        for (uint32_t i = 0; i < netlist->numRegisters; i++) {
+            *(roots + numRoots++) = (netlist->registers + i)->enable;
+            *(roots + numRoots++) = (netlist->registers + i)->clear;
+        }
+        for (uint32_t i = 0; i < netlist->numFlipFlops; i++) {
+            *(roots + numRoots++) = *(netlist->flipFlopInputs + i);
+        }
+        for (uint32_t i = 0; i < netlist->numMemories; i++) {
+            const GateMemory* memory = netlist->memories + i;
+            if (memory->writable) {
+                memcpy(roots + numRoots, memory->address, memory->addressBits * sizeof(uint32_t));
+                numRoots += memory->addressBits;
+                memcpy(roots + numRoots, memory->dataIn, memory->dataBits * sizeof(uint32_t));
+                numRoots += memory->dataBits;
+                *(roots + numRoots++) = memory->writeEnable;
+            }
+        }
+        if (status == 0) {
+            status = searchOps(builder, driverOps, marks, stack, roots, numRoots, order, &numOrdered);
+        }
+        if (status == 0) {
+            for (uint32_t i = 0; i < numOrdered; i++) {
+                *(sorted + i) = *(netlist->ops + *(order + i));
+            }
+            free(netlist->ops);
+            netlist->ops = sorted;
+            netlist->numOps = numOrdered;
+            netlist->opCapacity = numOrdered + 1;
+            sorted = NULL;
+        }
+    }
+    free(driverOps);
+    free(marks);
+    free(stack);
+    free(order);
+    free(roots);
+    free(sorted);
+    return status;
+}
+
+/**
+ * @brief Flatten the main circuit of a project into bit-level operations
+ *
+ * Subcircuits are inlined, splitters and wires disappear into signal numbering, and arithmetic, multiplexers and
+ * shifters are lowered to gates. The ops are then levelized and everything the flip-flops and memories do not depend
+ * on is dropped. Only the components RISC-MC8_Computer.circ is built from are supported.
+ *
+ * @param project The project
+ * @param netlist The netlist to fill in, freed on failure
+ * @param diagnostic Receives where the problem is on failure
+ * @return 0 if successful, otherwise the status code of the problem, such as ERROR_COMBINATIONAL_LOOP
+ */
+uint8_t buildGateNetlist(const CircuitProject* const project, GateNetlist* netlist, GateDiagnostic* diagnostic)
+{
+    memset(netlist, 0, sizeof(GateNetlist));
+    memset(diagnostic, 0, sizeof(GateDiagnostic));
+    NetlistBuilder builder = {0};
+    builder.project = project;
+    builder.netlist = netlist;
+    builder.diagnostic = diagnostic;
+    const CircuitDefinition* main = findCircuit(project, project->mainName != NULL ? project->mainName : "main");
+    if (main == NULL) {
+        diagnostic->status = ERROR_MALFORMED_CIRCUIT;
+        return ERROR_MALFORMED_CIRCUIT;
+    }
+    builder.layouts = calloc(project->numCircuits, sizeof(CircuitLayout));
+    uint8_t status = builder.layouts == NULL || newSignals(&builder, GATE_NUM_FIXED_SIGNALS) == NO_SIGNAL ? ERROR_OUT_OF_MEMORY : 0;
+    uint32_t* netSignals = NULL;
+    if (status == 0) {
+        status = placeCircuit(&builder, (uint32_t)(main - project->circuits), "", 0, &netSignals);
+    }
+    free(netSignals);
+
+    // every output port drives its signal, and only one may
+    if (status == 0) {
+        builder.driven = calloc(netlist->numSignals + 1, sizeof(bool));
+        status = builder.driven == NULL ? ERROR_OUT_OF_MEMORY : 0;
+    }
+    if (status == 0) {
+        for (uint32_t i = 0; i < GATE_NUM_FIXED_SIGNALS; i++) {
+            *(builder.driven + i) = true;
+        }
+    }
+    for (uint32_t i = 0; i < builder.numPlaced && status == 0; i++) {
+        const PlacedComponent* placed = builder.placed + i;
+        const CircuitLayout* layout = builder.layouts + placed->circuit;
+        for (uint32_t p = *(layout->firstPorts + placed->component); p < *(layout->firstPorts + placed->component + 1) && status == 0; p++) {
+            const ComponentPort* port = layout->ports + p;
+            uint32_t first = *(builder.portSignals + placed->firstSignal + p - *(layout->firstPorts + placed->component));
+            for (uint32_t bit = 0; bit < port->width && port->output; bit++) {
+                uint32_t root = findSignal(&builder, first + bit);
+                if (*(builder.driven + root)) {
+                    status = reportNetlistProblem(&builder, ERROR_MULTIPLE_DRIVERS, placed->circuit, placed->component);
+                    builder.diagnostic->x = port->x;
+                    builder.diagnostic->y = port->y;
+                    break;
+                }
+                *(builder.driven + root) = true;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < builder.numPlaced && status == 0; i++) {
+        builder.origin = i;
+        status = lowerComponent(&builder, builder.placed + i);
+    }
+    if (status == 0) {
+        status = levelizeOps(&builder);
+    }
+
+    for (uint32_t i = 0; i < project->numCircuits && builder.layouts != NULL; i++) {
+        free((builder.layouts + i)->kinds);
+        free((builder.layouts + i)->firstPorts);
+        free((builder.layouts + i)->ports);
+        free((builder.layouts + i)->netWidths);
+    }
+    for (uint32_t i = 0; i < builder.numPlaced; i++) {
+        free((builder.placed + i)->name);
+    }
+    free(builder.layouts);
+    free(builder.parents);
+    free(builder.driven);
+    free(builder.placed);
+    free(builder.portSignals);
+    if (status != 0) {
+        diagnostic->status = status;
+        freeGateNetlist(netlist);
+    }
+    return status;
+}
+
+/**
+ * @brief Free the ops, registers and memories of a netlist
+ *
+ * @param netlist The netlist to free
+ */
+void freeGateNetlist(GateNetlist* netlist)
+{
+    for (uint32_t i = 0; i < netlist->numRegisters; i++) {
+        free((netlist->registers + i)->name);
+    }
+    for (uint32_t i = 0; i < netlist->numMemories; i++) {
+        free((netlist->memories + i)->name);
+        free((netlist->memories + i)->contents);
+    }
+    free(netlist->ops);
+    free(netlist->registers);
+    free(netlist->flipFlopInputs);
+    free(netlist->flipFlopOutputs);
+    free(netlist->memories);
+    memset(netlist, 0, sizeof(GateNetlist));
+}
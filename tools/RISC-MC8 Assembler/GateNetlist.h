@@ -0,0 +1,122 @@
+#ifndef GATENETLIST_H
+#define GATENETLIST_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "CircuitFile.h"
+
+#define GATE_MAX_ADDRESS_BITS 16
+#define GATE_MAX_DATA_BITS 8
+
+// signals every netlist has
+#define GATE_SIGNAL_ZERO 0
+#define GATE_SIGNAL_ONE 1
+#define GATE_SIGNAL_CLOCK 2  // every Clock component
+#define GATE_NUM_FIXED_SIGNALS 3
+
+// what a GateOp computes, each bit of a signal being one machine
+#define GATE_OP_COPY 0  // inputs[0]
+#define GATE_OP_NOT 1   // ~inputs[0]
+#define GATE_OP_AND 2   // inputs[0] & inputs[1]
+#define GATE_OP_OR 3    // inputs[0] | inputs[1]
+#define GATE_OP_XOR 4   // inputs[0] ^ inputs[1]
+#define GATE_OP_MUX 5   // inputs[0] ? inputs[2] : inputs[1]
+#define GATE_OP_READ 6  // read memory inputs[0] into its dataOut signals, output is unused
+
+/**
+ * One bit-level operation. Every combinational component is lowered to these, so the whole machine is a straight
+ * line of them once they are levelized.
+ */
+typedef struct _GateOp {
+    uint8_t kind;  // GATE_OP_*
+    uint32_t output;
+    uint32_t inputs[3];
+    uint32_t origin;  // index of the component it came from, for diagnostics
+    bool clocked;     // a register or memory clock depends on it, so it is evaluated again when the clock changes
+} GateOp;
+
+/**
+ * A Register component, one flip-flop per bit. Q of flip-flop i is signal GateNetlist.flipFlopOutputs[i].
+ */
+typedef struct _GateRegister {
+    char* name;  // its label, prefixed by the subcircuits it is in, such as "RegisterFile/r1"
+    uint32_t width;
+    uint32_t firstFlipFlop;
+    uint32_t clock;
+    uint32_t enable;  // GATE_SIGNAL_ONE when not connected
+    uint32_t clear;   // GATE_SIGNAL_ZERO when not connected
+    bool falling;     // triggered by the falling edge of its clock instead of the rising one
+} GateRegister;
+
+/**
+ * A RAM or ROM component. Reads are combinational, RAM writes happen on its clock edge.
+ */
+typedef struct _GateMemory {
+    char* name;
+    uint32_t addressBits;
+    uint32_t dataBits;
+    bool writable;  // RAM
+    bool falling;
+    uint32_t address[GATE_MAX_ADDRESS_BITS];
+    uint32_t dataIn[GATE_MAX_DATA_BITS];   // RAM only
+    uint32_t dataOut[GATE_MAX_DATA_BITS];  // written by its GATE_OP_READ
+    uint32_t clock;                        // RAM only
+    uint32_t writeEnable;                  // RAM only
+    uint8_t* contents;  // initial contents of every machine, (1 << addressBits) bytes
+} GateMemory;
+
+/**
+ * Where a circuit could not be compiled
+ */
+typedef struct _GateDiagnostic {
+    uint8_t status;
+    const char* circuit;  // name of the circuit the problem is in
+    int32_t x;            // location in it
+    int32_t y;
+    const char* component;  // name of the component involved, NULL if none
+} GateDiagnostic;
+
+/**
+ * A flattened circuit. Signals are single bits identified by index; after buildGateNetlist every signal is either
+ * fixed, a flip-flop output, driven by exactly one op, or floating (read as 0).
+ */
+typedef struct _GateNetlist {
+    uint32_t numSignals;
+    GateOp* ops;  // levelized: every op comes after the ops driving its inputs
+    uint32_t numOps;
+    uint32_t opCapacity;
+    GateRegister* registers;
+    uint32_t numRegisters;
+    uint32_t registerCapacity;
+    uint32_t* flipFlopInputs;  // D signal of each flip-flop
+    uint32_t* flipFlopOutputs;
+    uint32_t numFlipFlops;
+    uint32_t flipFlopCapacity;
+    GateMemory* memories;
+    uint32_t numMemories;
+    uint32_t memoryCapacity;
+} GateNetlist;
+
+/**
+ * @brief Flatten the main circuit of a project into bit-level operations
+ *
+ * Subcircuits are inlined, splitters and wires disappear into signal numbering, and arithmetic, multiplexers and
+ * shifters are lowered to gates. The ops are then levelized and everything the flip-flops and memories do not depend
+ * on is dropped. Only the components RISC-MC8_Computer.circ is built from are supported.
+ *
+ * @param project The project
+ * @param netlist The netlist to fill in, freed on failure
+ * @param diagnostic Receives where the problem is on failure
+ * @return 0 if successful, otherwise the status code of the problem, such as ERROR_COMBINATIONAL_LOOP
+ */
+uint8_t buildGateNetlist(const CircuitProject* const project, GateNetlist* netlist, GateDiagnostic* diagnostic);
+
+/**
+ * @brief Free the ops, registers and memories of a netlist
+ *
+ * @param netlist The netlist to free
+ */
+void freeGateNetlist(GateNetlist* netlist);
+
+#endif
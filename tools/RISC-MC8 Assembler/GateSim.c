@@ -0,0 +1,191 @@
+#include "GateSim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "StatusCodes.h"
+
+/**
+ * @brief Power on every machine: flip-flops cleared, memories holding their initial contents, clock low
+ *
+ * @param sim The simulator to initialize
+ * @param circuit The compiled circuit
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t initGateSim(GateSim* sim, const GateCircuitInfo* const circuit)
+{
+    memset(sim, 0, sizeof(GateSim));
+    sim->circuit = circuit;
+    sim->flipFlops = calloc(circuit->numFlipFlops + 1, sizeof(uint64_t));
+    sim->clockInputs = calloc(circuit->numClockInputs + 1, sizeof(uint64_t));
+    sim->memories = calloc(circuit->numMemories + 1, sizeof(uint8_t*));
+    if (sim->flipFlops == NULL || sim->clockInputs == NULL || sim->memories == NULL) {
+        freeGateSim(sim);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    for (uint32_t m = 0; m < circuit->numMemories; m++) {
+        const GateMemoryInfo* info = circuit->memories + m;
+        size_t size = (size_t)1 << info->addressBits;
+        *(sim->memories + m) = malloc(size * GATE_LANES);
+        if (*(sim->memories + m) == NULL) {
+            freeGateSim(sim);
+            return ERROR_OUT_OF_MEMORY;
+        }
+        for (uint32_t lane = 0; lane < GATE_LANES; lane++) {
+            memcpy(*(sim->memories + m) + lane * size, info->contents, size);
+        }
+    }
+    primeGateSim(sim);
+    return 0;
+}
+
+/**
+ * @brief Free the flip-flops and memories of every machine
+ *
+ * @param sim The simulator to free
+ */
+void freeGateSim(GateSim* sim)
+{
+    for (uint32_t m = 0; sim->memories != NULL && m < sim->circuit->numMemories; m++) {
+        free(*(sim->memories + m));
+    }
+    free(sim->memories);
+    free(sim->flipFlops);
+    free(sim->clockInputs);
+    memset(sim, 0, sizeof(GateSim));
+}
+
+/**
+ * @brief Record the clock inputs again after setting flip-flops or memories directly, so the next cycle does not see
+ * an edge that never happened
+ *
+ * @param sim The simulator
+ */
+void primeGateSim(GateSim* sim)
+{
+    sim->circuit->prime(sim);
+}
+
+/**
+ * @brief Run full clock cycles, each a rising then a falling edge
+ *
+ * @param sim The simulator
+ * @param cycles Number of cycles
+ */
+void runGateSim(GateSim* sim, uint64_t cycles)
+{
+    sim->circuit->run(sim, 2 * cycles);
+}
+
+/**
+ * @brief Find a register or memory of the circuit by name
+ *
+ * @param circuit The compiled circuit
+ * @param name Its name, such as "PC" or "RegisterFile/r1"
+ * @param memory true to look for a memory, false for a register
+ * @return Its index, -1 if there is none
+ */
+int32_t findGateElement(const GateCircuitInfo* const circuit, const char* const name, bool memory)
+{
+    uint32_t count = memory ? circuit->numMemories : circuit->numRegisters;
+    for (uint32_t i = 0; i < count; i++) {
+        if (strcmp(memory ? (circuit->memories + i)->name : (circuit->registers + i)->name, name) == 0) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Read the value of a register in one machine
+ *
+ * @param sim The simulator
+ * @param index Index of the register
+ * @param lane The machine
+ * @return The value, truncated to 32 bits
+ */
+uint32_t getGateRegister(const GateSim* const sim, uint32_t index, uint32_t lane)
+{
+    const GateRegisterInfo* info = sim->circuit->registers + index;
+    uint32_t value = 0;
+    for (uint32_t bit = 0; bit < info->width && bit < 32; bit++) {
+        value |= (uint32_t)((*(sim->flipFlops + info->firstFlipFlop + bit) >> lane) & 1) << bit;
+    }
+    return value;
+}
+
+/**
+ * @brief Set the value of a register in one machine, followed by primeGateSim before running
+ *
+ * @param sim The simulator
+ * @param index Index of the register
+ * @param lane The machine
+ * @param value The value, truncated to the register width
+ */
+void setGateRegister(GateSim* sim, uint32_t index, uint32_t lane, uint32_t value)
+{
+    const GateRegisterInfo* info = sim->circuit->registers + index;
+    for (uint32_t bit = 0; bit < info->width && bit < 32; bit++) {
+        uint64_t* word = sim->flipFlops + info->firstFlipFlop + bit;
+        *word = (*word & ~((uint64_t)1 << lane)) | ((uint64_t)((value >> bit) & 1) << lane);
+    }
+}
+
+/**
+ * @brief Look up a memory in every machine at once, called by the generated code
+ *
+ * @param memory The memory
+ * @param addressBits Address width
+ * @param dataBits Data width
+ * @param address One word per address bit
+ * @param data Receives one word per data bit
+ */
+void readGateMemory(const uint8_t* const memory, uint32_t addressBits, uint32_t dataBits, const uint64_t* const address, uint64_t* data)
+{
+    uint32_t addresses[GATE_LANES] = {0};
+    for (uint32_t bit = 0; bit < addressBits; bit++) {
+        uint64_t word = *(address + bit);
+        for (uint32_t lane = 0; lane < GATE_LANES; lane++) {
+            addresses[lane] |= (uint32_t)((word >> lane) & 1) << bit;
+        }
+    }
+    uint64_t values[GATE_LANES];
+    for (uint32_t lane = 0; lane < GATE_LANES; lane++) {
+        values[lane] = *(memory + ((size_t)lane << addressBits) + addresses[lane]);
+    }
+    for (uint32_t bit = 0; bit < dataBits; bit++) {
+        uint64_t word = 0;
+        for (uint32_t lane = 0; lane < GATE_LANES; lane++) {
+            word |= ((values[lane] >> bit) & 1) << lane;
+        }
+        *(data + bit) = word;
+    }
+}
+
+/**
+ * @brief Store into a memory in some of the machines, called by the generated code
+ *
+ * @param memory The memory
+ * @param addressBits Address width
+ * @param dataBits Data width
+ * @param address One word per address bit
+ * @param data One word per data bit
+ * @param lanes The machines that write
+ */
+void writeGateMemory(uint8_t* memory, uint32_t addressBits, uint32_t dataBits, const uint64_t* const address, const uint64_t* const data, uint64_t lanes)
+{
+    for (uint32_t lane = 0; lane < GATE_LANES; lane++) {
+        if (((lanes >> lane) & 1) == 0) {
+            continue;
+        }
+        uint32_t at = 0;
+        uint8_t value = 0;
+        for (uint32_t bit = 0; bit < addressBits; bit++) {
+            at |= (uint32_t)((*(address + bit) >> lane) & 1) << bit;
+        }
+        for (uint32_t bit = 0; bit < dataBits; bit++) {
+            value |= (uint8_t)(((*(data + bit) >> lane) & 1) << bit);
+        }
+        *(memory + ((size_t)lane << addressBits) + at) = value;
+    }
+}
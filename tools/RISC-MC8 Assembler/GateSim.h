@@ -0,0 +1,141 @@
+#ifndef GATESIM_H
+#define GATESIM_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#define GATE_LANES 64  // machines simulated at once, bit l of every signal word belongs to machine l
+#define GATE_ONES UINT64_MAX
+
+struct _GateSim;
+
+typedef struct _GateRegisterInfo {
+    const char* name;  // such as "RegisterFile/r1"
+    uint32_t width;
+    uint32_t firstFlipFlop;
+} GateRegisterInfo;
+
+typedef struct _GateMemoryInfo {
+    const char* name;
+    uint32_t addressBits;
+    uint32_t dataBits;
+    bool writable;
+    const uint8_t* contents;  // initial contents, (1 << addressBits) bytes
+} GateMemoryInfo;
+
+/**
+ * A circuit compiled by compile-risc-mc8-circuit. The generated code evaluates every gate once per half clock cycle
+ * as a straight line of 64-bit bitwise operations.
+ */
+typedef struct _GateCircuitInfo {
+    const char* source;  // the .circ it was compiled from
+    uint32_t numOps;
+    uint32_t numFlipFlops;
+    uint32_t numClockInputs;  // one per register, then one per RAM
+    const GateRegisterInfo* registers;
+    uint32_t numRegisters;
+    const GateMemoryInfo* memories;
+    uint32_t numMemories;
+    void (*run)(struct _GateSim* sim, uint64_t halfCycles);
+    void (*prime)(struct _GateSim* sim);  // record the clock inputs without triggering anything
+} GateCircuitInfo;
+
+/**
+ * GATE_LANES copies of a circuit sharing one clock
+ */
+typedef struct _GateSim {
+    const GateCircuitInfo* circuit;
+    uint64_t clock;         // 0 or GATE_ONES
+    uint64_t* flipFlops;    // bit l of flipFlops[i] is flip-flop i of machine l
+    uint64_t* clockInputs;  // what each register and RAM clock input was at the last half cycle, to find edges
+    uint8_t** memories;     // byte a of machine l is memories[m][(l << addressBits) | a]
+} GateSim;
+
+extern const GateCircuitInfo gateCircuit;  // GateCircuit.c, generated from resources/RISC-MC8_Computer.circ
+
+/**
+ * @brief Power on every machine: flip-flops cleared, memories holding their initial contents, clock low
+ *
+ * @param sim The simulator to initialize
+ * @param circuit The compiled circuit
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t initGateSim(GateSim* sim, const GateCircuitInfo* const circuit);
+
+/**
+ * @brief Free the flip-flops and memories of every machine
+ *
+ * @param sim The simulator to free
+ */
+void freeGateSim(GateSim* sim);
+
+/**
+ * @brief Record the clock inputs again after setting flip-flops or memories directly, so the next cycle does not see
+ * an edge that never happened
+ *
+ * @param sim The simulator
+ */
+void primeGateSim(GateSim* sim);
+
+/**
+ * @brief Run full clock cycles, each a rising then a falling edge
+ *
+ * @param sim The simulator
+ * @param cycles Number of cycles
+ */
+void runGateSim(GateSim* sim, uint64_t cycles);
+
+/**
+ * @brief Find a register or memory of the circuit by name
+ *
+ * @param circuit The compiled circuit
+ * @param name Its name, such as "PC" or "RegisterFile/r1"
+ * @param memory true to look for a memory, false for a register
+ * @return Its index, -1 if there is none
+ */
+int32_t findGateElement(const GateCircuitInfo* const circuit, const char* const name, bool memory);
+
+/**
+ * @brief Read the value of a register in one machine
+ *
+ * @param sim The simulator
+ * @param index Index of the register
+ * @param lane The machine
+ * @return The value, truncated to 32 bits
+ */
+uint32_t getGateRegister(const GateSim* const sim, uint32_t index, uint32_t lane);
+
+/**
+ * @brief Set the value of a register in one machine, followed by primeGateSim before running
+ *
+ * @param sim The simulator
+ * @param index Index of the register
+ * @param lane The machine
+ * @param value The value, truncated to the register width
+ */
+void setGateRegister(GateSim* sim, uint32_t index, uint32_t lane, uint32_t value);
+
+/**
+ * @brief Look up a memory in every machine at once, called by the generated code
+ *
+ * @param memory The memory
+ * @param addressBits Address width
+ * @param dataBits Data width
+ * @param address One word per address bit
+ * @param data Receives one word per data bit
+ */
+void readGateMemory(const uint8_t* const memory, uint32_t addressBits, uint32_t dataBits, const uint64_t* const address, uint64_t* data);
+
+/**
+ * @brief Store into a memory in some of the machines, called by the generated code
+ *
+ * @param memory The memory
+ * @param addressBits Address width
+ * @param dataBits Data width
+ * @param address One word per address bit
+ * @param data One word per data bit
+ * @param lanes The machines that write
+ */
+void writeGateMemory(uint8_t* memory, uint32_t addressBits, uint32_t dataBits, const uint64_t* const address, const uint64_t* const data, uint64_t lanes);
+
+#endif
@@ -0,0 +1,468 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Assembler.h"
+#include "AssemblerStats.h"
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Emulator.h"
+#include "GateSim.h"
+#include "Source.h"
+#include "StatusCodes.h"
+#include "WorkerPool.h"
+
+#define USAGE "Expected arguments: [--cycles N] [--random N [--seed S]] [--threads N] [--time] [program.o | program.asm]\n"
+
+#define DEFAULT_MAX_CYCLES (1u << 16)
+#define BATCHES_PER_ROUND 4096  // batches of GATE_LANES instances run between collecting results
+#define MAX_REPORTED_MISMATCHES 10
+#define MISMATCH_LENGTH 160
+
+// where the ISA's state lives in the hardware
+#define PC_NAME "PC"
+#define ROM_NAME "InstructionMemory"
+#define RAM_NAME "DataMemory"
+static const char* const RegisterNames[EMULATOR_NUM_REGISTERS] = {
+    "RegisterFile/ireg", "RegisterFile/r1", "RegisterFile/r2", "RegisterFile/r3",
+    "RegisterFile/r4", "RegisterFile/r5", "RegisterFile/r6", "RegisterFile/r7",
+};
+
+/**
+ * The circuit's registers and memories that hold each part of the ISA's state
+ */
+typedef struct _HardwareMap {
+    uint32_t pc;
+    uint32_t registers[EMULATOR_NUM_REGISTERS];
+    uint32_t rom;
+    uint32_t ram;
+} HardwareMap;
+
+typedef struct _BatchResult {
+    uint8_t status;
+    uint32_t mismatches;
+    uint64_t cycles;  // machine cycles simulated, GATE_LANES per clock cycle
+    char firstMismatch[MISMATCH_LENGTH];
+    EmulatorState finalState;  // of the batch's first instance
+    uint8_t finalReason;
+    uint64_t finalExecuted;
+} BatchResult;
+
+typedef struct _GateSimRun {
+    const Emulator* emulator;  // the ISA model, holds the predecoded program
+    const uint8_t* program;
+    HardwareMap map;
+    uint64_t numInstances;
+    bool random;
+    uint64_t seed;
+    uint64_t maxCycles;
+    uint64_t firstBatch;  // of the current round
+    BatchResult* results;
+} GateSimRun;
+
+/**
+ * @brief Load a program, assembling it first if it is a .asm source
+ *
+ * @param path Path of an assembled program or of a source ending in .asm
+ * @param code Buffer to append the program to
+ * @return 0 if successful, otherwise the error that occurred (already printed)
+ */
+static uint8_t loadProgram(const char* const path, CodeBuffer* code)
+{
+    SourceReader source;
+    if (openSourceFile(&source, path) != 0) {
+        fprintf(stderr, "Error: Input file does not exist.\n");
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    uint8_t status = 0;
+    size_t pathLength = strlen(path);
+    if (pathLength >= 4 && strcmp(path + pathLength - 4, ".asm") == 0) {
+        AssemblerDiagnostic diagnostic;
+        status = assembleSource(&source, code, NULL, &diagnostic);
+        if (status != 0) {
+            printDiagnostic(stderr, &diagnostic);
+        }
+    } else if (source.data != NULL && source.length > 0) {
+        if (reserveCode(code, source.length)) {
+            memcpy(code->data, source.data, source.length);
+            code->length = source.length;
+        } else {
+            status = ERROR_OUT_OF_MEMORY;
+            fprintf(stderr, "Error: Out of memory.\n");
+        }
+    }
+    closeSource(&source);
+    return status;
+}
+
+/**
+ * @brief Find where the circuit keeps the ISA's state
+ *
+ * @param circuit The compiled circuit
+ * @param map Receives the indices
+ * @return true if successful, false if something is missing (already printed)
+ */
+static bool mapHardware(const GateCircuitInfo* const circuit, HardwareMap* map)
+{
+    int32_t found[EMULATOR_NUM_REGISTERS + 3];
+    const char* names[EMULATOR_NUM_REGISTERS + 3] = {PC_NAME, ROM_NAME, RAM_NAME};
+    for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+        names[3 + i] = RegisterNames[i];
+    }
+    for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS + 3; i++) {
+        found[i] = findGateElement(circuit, names[i], i == 1 || i == 2);
+        if (found[i] < 0) {
+            fprintf(stderr, "Error: %s has no %s named %s.\n", circuit->source, i == 1 || i == 2 ? "memory" : "register", names[i]);
+            return false;
+        }
+    }
+    map->pc = (uint32_t)found[0];
+    map->rom = (uint32_t)found[1];
+    map->ram = (uint32_t)found[2];
+    for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+        map->registers[i] = (uint32_t)found[3 + i];
+    }
+    return true;
+}
+
+/**
+ * @brief splitmix64, the same as emulate-risc-mc8 uses so a seed gives the same initial states
+ *
+ * @param x The state to advance
+ * @return The next random number
+ */
+static uint64_t nextRandom(uint64_t* x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Fill every register and RAM cell with random values, as emulate-risc-mc8 --random does
+ *
+ * @param seed The seed
+ * @param instance The instance, mixed into the seed
+ * @param state The zeroed state to fill in
+ */
+static void generateRandomState(uint64_t seed, uint64_t instance, EmulatorState* state)
+{
+    uint64_t x = seed ^ (instance * 0xd1b54a32d192ed03ull);
+    uint64_t word = nextRandom(&x);
+    memcpy(state->registers, &word, sizeof(state->registers));
+    for (uint32_t i = 0; i < EMULATOR_RAM_SIZE; i += sizeof(word)) {
+        word = nextRandom(&x);
+        memcpy(state->ram + i, &word, sizeof(word));
+    }
+}
+
+/**
+ * @brief Read one machine's ISA state out of the simulator
+ */
+static void readMachineState(const GateSim* const sim, const HardwareMap* const map, uint32_t lane, EmulatorState* state)
+{
+    for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+        state->registers[i] = (uint8_t)getGateRegister(sim, map->registers[i], lane);
+    }
+    memcpy(state->ram, *(sim->memories + map->ram) + lane * EMULATOR_RAM_SIZE, EMULATOR_RAM_SIZE);
+    state->pc = getGateRegister(sim, map->pc, lane);
+}
+
+/**
+ * @brief Find the machines whose program counter has left the program
+ *
+ * @param sim The simulator
+ * @param pc Index of the program counter register
+ * @param length Length of the program
+ * @return The machines with PC >= length
+ */
+static uint64_t findEndedMachines(const GateSim* const sim, uint32_t pc, uint32_t length)
+{
+    const GateRegisterInfo* info = sim->circuit->registers + pc;
+    if (info->width < 32 && length >= (1u << info->width)) {
+        return 0;
+    }
+    uint64_t greater = 0;
+    uint64_t equal = GATE_ONES;
+    for (uint32_t bit = info->width; bit-- > 0;) {  // compare from the top bit down, in every machine at once
+        uint64_t word = *(sim->flipFlops + info->firstFlipFlop + bit);
+        if ((length >> bit) & 1) {
+            equal &= word;
+        } else {
+            greater |= equal & word;
+            equal &= ~word;
+        }
+    }
+    return greater | equal;
+}
+
+/**
+ * @brief Describe how one machine's run differs between the hardware and the ISA model
+ *
+ * @param dest Receives the description
+ * @param instance The instance
+ * @param hardwareReason How the hardware stopped
+ * @param hardwareExecuted Instructions it executed
+ * @param hardware Its final state
+ * @param model The ISA model after the same run
+ * @param modelReason How the model stopped
+ * @return true if they differ
+ */
+static bool describeMismatch(char* dest, uint64_t instance, uint8_t hardwareReason, uint64_t hardwareExecuted, const EmulatorState* const hardware, const Emulator* const model, uint8_t modelReason)
+{
+    if (hardwareReason != modelReason || hardwareExecuted != model->executed) {
+        snprintf(dest, MISMATCH_LENGTH, "instance %" PRIu64 ": the hardware stopped at %s after %" PRIu64 " instructions, the ISA model at %s after %" PRIu64 ".", instance,
+                 getHaltReason(hardwareReason), hardwareExecuted, getHaltReason(modelReason), model->executed);
+        return true;
+    } else if (modelReason != EMULATOR_HALT_END && hardware->pc != model->state.pc) {
+        snprintf(dest, MISMATCH_LENGTH, "instance %" PRIu64 ": the hardware PC is %" PRIu32 ", the ISA model's is %" PRIu32 ".", instance, hardware->pc, model->state.pc);
+        return true;
+    }
+    for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+        if (hardware->registers[i] != model->state.registers[i]) {
+            snprintf(dest, MISMATCH_LENGTH, "instance %" PRIu64 ": %s is 0x%02X in the hardware, 0x%02X in the ISA model.", instance, strchr(RegisterNames[i], '/') + 1,
+                     hardware->registers[i], model->state.registers[i]);
+            return true;
+        }
+    }
+    for (uint32_t i = 0; i < EMULATOR_RAM_SIZE; i++) {
+        if (hardware->ram[i] != model->state.ram[i]) {
+            snprintf(dest, MISMATCH_LENGTH, "instance %" PRIu64 ": RAM[0x%02X] is 0x%02X in the hardware, 0x%02X in the ISA model.", instance, i, hardware->ram[i],
+                     model->state.ram[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Run GATE_LANES instances on the gate-level circuit, then each on the ISA model, and compare them
+ *
+ * Each machine stops at the same points the model does: on leaving the program before a cycle, on a jump to itself
+ * (a cycle that leaves the PC unchanged, not counted), or after the cycle limit.
+ *
+ * @param context The GateSimRun
+ * @param index Index of the batch in the current round
+ */
+static void runBatch(void* context, uint32_t index)
+{
+    const GateSimRun* run = context;
+    BatchResult* result = run->results + index;
+    const HardwareMap* map = &run->map;
+    uint64_t first = (run->firstBatch + index) * GATE_LANES;
+    uint32_t lanes = run->numInstances - first < GATE_LANES ? (uint32_t)(run->numInstances - first) : GATE_LANES;
+    memset(result, 0, sizeof(BatchResult));
+    GateSim sim;
+    EmulatorState* states = malloc(2 * GATE_LANES * sizeof(EmulatorState));  // initial then final
+    uint8_t reasons[GATE_LANES];
+    uint64_t executed[GATE_LANES];
+    if (states == NULL || initGateSim(&sim, &gateCircuit) != 0) {
+        free(states);
+        result->status = ERROR_OUT_OF_MEMORY;
+        return;
+    }
+    for (uint32_t lane = 0; lane < GATE_LANES; lane++) {
+        EmulatorState* initial = states + lane;
+        memset(initial, 0, sizeof(EmulatorState));
+        if (run->random) {
+            generateRandomState(run->seed, first + lane, initial);
+        }
+        for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+            setGateRegister(&sim, map->registers[i], lane, initial->registers[i]);
+        }
+        memcpy(*(sim.memories + map->ram) + lane * EMULATOR_RAM_SIZE, initial->ram, EMULATOR_RAM_SIZE);
+        memset(*(sim.memories + map->rom) + lane * EMULATOR_RAM_SIZE, 0, EMULATOR_RAM_SIZE);
+        memcpy(*(sim.memories + map->rom) + lane * EMULATOR_RAM_SIZE, run->program, run->emulator->length);
+    }
+    primeGateSim(&sim);
+
+    const GateRegisterInfo* pc = sim.circuit->registers + map->pc;
+    uint64_t running = lanes == GATE_LANES ? GATE_ONES : ((uint64_t)1 << lanes) - 1;
+    uint64_t cycles = 0;
+    while (running != 0) {
+        uint64_t stopped = running;
+        uint8_t reason = EMULATOR_HALT_STEP_LIMIT;
+        if (cycles < run->maxCycles) {
+            stopped = findEndedMachines(&sim, map->pc, run->emulator->length) & running;
+            reason = EMULATOR_HALT_END;
+        }
+        if (stopped == 0) {
+            uint64_t before[8];
+            memcpy(before, sim.flipFlops + pc->firstFlipFlop, pc->width * sizeof(uint64_t));
+            runGateSim(&sim, 1);
+            cycles++;
+            result->cycles += lanes;
+            uint64_t changed = 0;
+            for (uint32_t bit = 0; bit < pc->width; bit++) {
+                changed |= before[bit] ^ *(sim.flipFlops + pc->firstFlipFlop + bit);
+            }
+            stopped = running & ~changed;
+            reason = EMULATOR_HALT_SELF_JUMP;
+        }
+        for (uint32_t lane = 0; lane < lanes; lane++) {
+            if ((stopped >> lane) & 1) {
+                readMachineState(&sim, map, lane, states + GATE_LANES + lane);
+                reasons[lane] = reason;
+                executed[lane] = reason == EMULATOR_HALT_SELF_JUMP ? cycles - 1 : cycles;  // the jump to itself is not counted
+            }
+        }
+        running &= ~stopped;
+    }
+    freeGateSim(&sim);
+
+    for (uint32_t lane = 0; lane < lanes; lane++) {
+        Emulator model = *run->emulator;
+        model.state = *(states + lane);
+        model.executed = 0;
+        uint8_t reason = stepEmulator(&model, run->maxCycles, UINT32_MAX);
+        char description[MISMATCH_LENGTH];
+        if (describeMismatch(description, first + lane, reasons[lane], executed[lane], states + GATE_LANES + lane, &model, reason)) {
+            if (result->mismatches++ == 0) {
+                memcpy(result->firstMismatch, description, MISMATCH_LENGTH);
+            }
+        }
+    }
+    result->finalState = *(states + GATE_LANES);
+    result->finalReason = reasons[0];
+    result->finalExecuted = executed[0];
+    free(states);
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = NULL;
+    uint64_t numInstances = 1;
+    uint64_t seed = 0;
+    uint64_t maxCycles = DEFAULT_MAX_CYCLES;
+    uint32_t numThreads = 0;
+    bool random = false;
+    bool timed = false;
+    for (int i = 1; i < argc; i++) {
+        char* end = NULL;
+        if (strcmp(*(argv + i), "--cycles") == 0 && i + 1 < argc) {
+            maxCycles = strtoull(*(argv + ++i), &end, 10);
+        } else if (strcmp(*(argv + i), "--random") == 0 && i + 1 < argc) {
+            numInstances = strtoull(*(argv + ++i), &end, 10);
+            random = true;
+        } else if (strcmp(*(argv + i), "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(*(argv + ++i), &end, 10);
+        } else if (strcmp(*(argv + i), "--threads") == 0 && i + 1 < argc) {
+            numThreads = (uint32_t)strtoul(*(argv + ++i), &end, 10);
+        } else if (strcmp(*(argv + i), "--time") == 0) {
+            timed = true;
+        } else if (path == NULL && **(argv + i) != '-') {
+            path = *(argv + i);
+        } else {
+            fprintf(stderr, USAGE);
+            return ERROR_INVALID_ARGUMENTS;
+        }
+        if (end != NULL && (*end != '\0' || end == *(argv + i))) {
+            fprintf(stderr, USAGE);
+            return ERROR_INVALID_ARGUMENTS;
+        }
+    }
+
+    GateSimRun run;
+    memset(&run, 0, sizeof(run));
+    if (!mapHardware(&gateCircuit, &run.map)) {
+        return ERROR_MODEL_MISMATCH;
+    }
+    const GateMemoryInfo* rom = gateCircuit.memories + run.map.rom;
+    const GateMemoryInfo* ram = gateCircuit.memories + run.map.ram;
+    if (rom->addressBits != 8 || rom->dataBits != 8 || ram->addressBits != 8 || ram->dataBits != 8 || (gateCircuit.registers + run.map.pc)->width != 8) {
+        fprintf(stderr, "Error: %s must have an 8-bit PC and 256 bytes of instruction and data memory.\n", gateCircuit.source);
+        return ERROR_MODEL_MISMATCH;
+    }
+
+    // without a program, run the one the circuit's ROM holds, up to its last non-zero byte
+    CodeBuffer code;
+    initGrowableCodeBuffer(&code);
+    uint8_t status = 0;
+    if (path != NULL) {
+        status = loadProgram(path, &code);
+    } else if (reserveCode(&code, EMULATOR_RAM_SIZE)) {
+        code.length = EMULATOR_RAM_SIZE;
+        while (code.length > 0 && *(rom->contents + code.length - 1) == 0) {
+            code.length--;
+        }
+        memcpy(code.data, rom->contents, code.length);
+    } else {
+        status = ERROR_OUT_OF_MEMORY;
+    }
+    if (status == 0 && code.length > EMULATOR_RAM_SIZE) {
+        fprintf(stderr, "Error: The program is longer than the %d bytes of instruction memory.\n", EMULATOR_RAM_SIZE);
+        status = ERROR_VALUE_OUT_OF_RANGE;
+    }
+    Emulator emulator;
+    if (status == 0) {
+        status = initEmulator(&emulator, code.data, (uint32_t)code.length);
+        if (status != 0) {
+            AssemblerDiagnostic diagnostic = {status, 0, 0};
+            printDiagnostic(stderr, &diagnostic);
+            freeCodeBuffer(&code);
+            return status;
+        }
+    }
+    if (status != 0) {
+        freeCodeBuffer(&code);
+        return status;
+    }
+
+    run.emulator = &emulator;
+    run.program = code.data;
+    run.numInstances = numInstances;
+    run.random = random;
+    run.seed = seed;
+    run.maxCycles = maxCycles;
+    uint64_t numBatches = (numInstances + GATE_LANES - 1) / GATE_LANES;
+    uint32_t roundSize = numBatches < BATCHES_PER_ROUND ? (uint32_t)numBatches : BATCHES_PER_ROUND;
+    run.results = malloc((roundSize > 0 ? roundSize : 1) * sizeof(BatchResult));
+    if (run.results == NULL) {
+        status = ERROR_OUT_OF_MEMORY;
+    }
+    uint64_t mismatches = 0;
+    uint64_t cycles = 0;
+    PhaseStats phase = {0, 0};
+    PhaseTimer timer;
+    startPhase(&timer);
+    for (run.firstBatch = 0; run.firstBatch < numBatches && status == 0; run.firstBatch += roundSize) {
+        uint32_t count = numBatches - run.firstBatch < roundSize ? (uint32_t)(numBatches - run.firstBatch) : roundSize;
+        runWorkerPool(&runBatch, &run, count, numThreads);
+        for (uint32_t i = 0; i < count && status == 0; i++) {
+            const BatchResult* result = run.results + i;
+            status = result->status;
+            cycles += result->cycles;
+            if (result->mismatches > 0 && mismatches < MAX_REPORTED_MISMATCHES) {
+                printf("Mismatch in %s\n", result->firstMismatch);
+            }
+            mismatches += result->mismatches;
+        }
+    }
+    stopPhase(&timer, &phase);
+
+    if (status == 0 && !random) {
+        printf("The hardware stopped at %s after %" PRIu64 " instructions, with PC = %" PRIu32 ".\n", getHaltReason(run.results->finalReason), run.results->finalExecuted,
+               run.results->finalState.pc);
+        printEmulatorState(stdout, "FINAL STATE", &run.results->finalState);
+    }
+    if (status == 0) {
+        printf("%" PRIu64 " of %" PRIu64 " instances matched the ISA model.\n", numInstances - mismatches, numInstances);
+        status = mismatches > 0 ? ERROR_MODEL_MISMATCH : 0;
+    }
+    if (timed && (status == 0 || status == ERROR_MODEL_MISMATCH)) {
+        double perSecond = phase.wallSeconds > 0 ? cycles / phase.wallSeconds : 0;
+        printf("Simulated %" PRIu64 " machine cycles with %" PRIu32 " ops each in %.6f seconds (%.1f million cycles per second, checking included).\n", cycles,
+               gateCircuit.numOps, phase.wallSeconds, perSecond / 1e6);
+    }
+    if (status != 0 && status != ERROR_MODEL_MISMATCH) {
+        AssemblerDiagnostic diagnostic = {status, 0, 0};
+        printDiagnostic(stderr, &diagnostic);
+    }
+    free(run.results);
+    freeEmulator(&emulator);
+    freeCodeBuffer(&code);
+    return status;
+}
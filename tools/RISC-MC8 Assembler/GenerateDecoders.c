@@ -0,0 +1,213 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "PackedKeys.h"
+#include "Instructions.h"
+#include "Registers.h"
+
+#define BYTE_VALUES 256
+
+/*
+ * Build-time generator for DecoderTables.h. The loaders are never called here, these stubs only satisfy the
+ * function pointers in InstructionLoaderLUT so this program links without the rest of the assembler.
+ */
+uint8_t loadReg(uint8_t* const instruction, uint32_t offset, const char* const token, uint32_t length, SymbolsList* symbols)
+{
+    return 0;
+}
+
+uint8_t load4BitImm(uint8_t* const instruction, uint32_t offset, const char* const token, uint32_t length, SymbolsList* symbols)
+{
+    return 0;
+}
+
+uint8_t load7BitSImm(uint8_t* const instruction, uint32_t offset, const char* const token, uint32_t length, SymbolsList* symbols)
+{
+    return 0;
+}
+
+/**
+ * @brief Search for a multiplier that hashes every key to a distinct slot
+ *
+ * @param keys Packed keys to place
+ * @param numKeys Number of keys
+ * @param multiplier Where to write the multiplier that was found
+ * @return true if successful, false if no multiplier was found
+ */
+static bool findPerfectMultiplier(const uint32_t* const keys, uint32_t numKeys, uint32_t* const multiplier)
+{
+    uint32_t candidate = 0x9E3779B1u;  // start at the golden ratio and walk odd multipliers with an LCG
+    for (uint32_t attempt = 0; attempt < 1000000; attempt++) {
+        bool used[PACKED_KEY_HASH_SLOTS] = {false};
+        bool collision = false;
+        for (uint32_t i = 0; i < numKeys && !collision; i++) {
+            uint32_t slot = PACKED_KEY_HASH(keys[i], candidate);
+            collision = used[slot];
+            used[slot] = true;
+        }
+        if (!collision) {
+            *multiplier = candidate;
+            return true;
+        }
+        candidate = (candidate * 1664525u + 1013904223u) | 1;
+    }
+    return false;
+}
+
+/**
+ * @brief Write the multiplier, slot and key tables for one set of names
+ *
+ * @param prefix Prefix of the emitted identifiers, e.g. "Mnemonic"
+ * @param macroPrefix Prefix of the emitted macros, e.g. "MNEMONIC"
+ * @param names Names to place
+ * @param indices LUT index that each name decodes to
+ * @param numNames Number of names
+ * @return true if successful, false if the names could not be placed
+ */
+static bool emitTable(const char* prefix, const char* macroPrefix, const char* const* names, const uint8_t* indices, uint32_t numNames)
+{
+    uint32_t keys[PACKED_KEY_HASH_SLOTS];
+    for (uint32_t i = 0; i < numNames; i++) {
+        if (!packKey(&keys[i], names[i], strlen(names[i]))) {
+            fprintf(stderr, "Error: \"%s\" is longer than %d characters.\n", names[i], PACKED_KEY_MAX_LENGTH);
+            return false;
+        }
+    }
+    uint32_t multiplier;
+    if (numNames > PACKED_KEY_HASH_SLOTS || !findPerfectMultiplier(keys, numNames, &multiplier)) {
+        fprintf(stderr, "Error: No perfect hash found for %s table.\n", prefix);
+        return false;
+    }
+
+    uint8_t slots[PACKED_KEY_HASH_SLOTS] = {0};
+    uint32_t slotKeys[PACKED_KEY_HASH_SLOTS] = {0};
+    for (uint32_t i = 0; i < numNames; i++) {
+        uint32_t slot = PACKED_KEY_HASH(keys[i], multiplier);
+        slots[slot] = indices[i] + 1;
+        slotKeys[slot] = keys[i];
+    }
+
+    printf("#define %s_HASH_MULTIPLIER 0x%08" PRIX32 "u\n\n", macroPrefix, multiplier);
+    printf("// LUT index + 1 for each slot, 0 if the slot is empty\n");
+    printf("static const uint8_t %sHashSlots[PACKED_KEY_HASH_SLOTS] = {", prefix);
+    for (uint32_t i = 0; i < PACKED_KEY_HASH_SLOTS; i++) {
+        printf("%s%" PRIu8, i % 16 == 0 ? "\n    " : " ", slots[i]);
+        printf(",");
+    }
+    printf("\n};\n\n");
+    printf("// packed name that must match exactly for each slot\n");
+    printf("static const uint32_t %sHashKeys[PACKED_KEY_HASH_SLOTS] = {", prefix);
+    for (uint32_t i = 0; i < PACKED_KEY_HASH_SLOTS; i++) {
+        printf("%s0x%08" PRIX32 "u,", i % 4 == 0 ? "\n    " : " ", slotKeys[i]);
+    }
+    printf("\n};\n\n");
+    return true;
+}
+
+/**
+ * @brief Write the text of every possible instruction byte, for the disassembler
+ *
+ * Each byte is matched against the base of every LUT entry, ignoring the bits its operand occupies, so an entry added
+ * to InstructionLoaderLUT or RegisterDefinitionLUT shows up here without any other change.
+ *
+ * @return true if successful, false if some byte decodes to no instruction or to more than one
+ */
+static bool emitDisassemblyTable(void)
+{
+    printf("// text of each instruction byte, not NUL terminated, with a JUMP's offset as a number; the disassembler keeps\n");
+    printf("// only the mnemonic and space of a JUMP when it writes a label instead\n");
+    printf("typedef struct _DisassemblyEntry {\n");
+    printf("    char text[13];\n    uint8_t length;\n    uint8_t isJump;\n    int8_t offset;\n");
+    printf("} DisassemblyEntry;\n\n");
+    printf("static const DisassemblyEntry DisassemblyTable[%d] = {\n", BYTE_VALUES);
+    for (uint32_t value = 0; value < BYTE_VALUES; value++) {
+        int32_t match = -1;
+        uint32_t operandBits = 0;
+        for (uint32_t i = 0; i < NUM_INSTRUCTIONS; i++) {
+            const InstructionLoaderDefinition* definition = &InstructionLoaderLUT[i];
+            uint32_t bits = definition->tokenLoader == &loadReg ? 3 : definition->tokenLoader == &load4BitImm ? 4 : 7;
+            if ((value & ~((1u << bits) - 1) & 0xFF) != definition->instructionBase) {
+                continue;
+            }
+            if (match >= 0) {
+                fprintf(stderr, "Error: 0x%02" PRIX32 " decodes to both %s and %s.\n", value, InstructionLoaderLUT[match].mnemonic, definition->mnemonic);
+                return false;
+            }
+            match = (int32_t)i;
+            operandBits = bits;
+        }
+        if (match < 0) {
+            fprintf(stderr, "Error: 0x%02" PRIX32 " decodes to no instruction.\n", value);
+            return false;
+        }
+        const InstructionLoaderDefinition* definition = &InstructionLoaderLUT[match];
+        uint32_t operand = value & ((1u << operandBits) - 1);
+        char text[16];
+        int32_t offset = 0;
+        if (operandBits == 7) {
+            offset = (operand & 0x40) ? (int32_t)operand - 0x80 : (int32_t)operand;
+            snprintf(text, sizeof(text), "%s %" PRId32 "\\n", definition->mnemonic, offset);
+        } else if (operandBits == 4) {
+            snprintf(text, sizeof(text), "%s 0b%c%c%c%c\\n", definition->mnemonic, '0' + ((operand >> 3) & 1), '0' + ((operand >> 2) & 1), '0' + ((operand >> 1) & 1), '0' + (operand & 1));
+        } else {
+            const char* name = NULL;
+            for (uint32_t r = 0; r < NUM_REGISTERS; r++) {
+                if (RegisterDefinitionLUT[r].value == operand) {
+                    name = RegisterDefinitionLUT[r].altName;
+                }
+            }
+            if (name == NULL) {
+                fprintf(stderr, "Error: Register %" PRIu32 " has no definition.\n", operand);
+                return false;
+            }
+            snprintf(text, sizeof(text), "%s %s\\n", definition->mnemonic, name);
+        }
+        // an escaped newline is two characters in the generated source but one in the table
+        uint32_t length = (uint32_t)strlen(text) - 1;
+        printf("    {\"%s\", %" PRIu32 ", %d, %" PRId32 "},\n", text, length, operandBits == 7, offset);
+    }
+    printf("};\n\n");
+    return true;
+}
+
+/**
+ * @brief Generate DecoderTables.h on stdout from InstructionLoaderLUT and RegisterDefinitionLUT
+ *
+ * @return 0 if successful, 1 if a table could not be generated
+ */
+int main(void)
+{
+    printf("// Generated by GenerateDecoders.c from InstructionLoaderLUT and RegisterDefinitionLUT, do not edit.\n\n");
+    printf("#ifndef DECODERTABLES_H\n#define DECODERTABLES_H\n\n#include <inttypes.h>\n\n#include \"PackedKeys.h\"\n\n");
+
+    const char* mnemonics[NUM_INSTRUCTIONS];
+    uint8_t mnemonicIndices[NUM_INSTRUCTIONS];
+    for (uint8_t i = 0; i < NUM_INSTRUCTIONS; i++) {
+        mnemonics[i] = InstructionLoaderLUT[i].mnemonic;
+        mnemonicIndices[i] = i;
+    }
+    if (!emitTable("Mnemonic", "MNEMONIC", mnemonics, mnemonicIndices, NUM_INSTRUCTIONS)) {
+        return 1;
+    }
+
+    // both spellings of a register decode to the same entry
+    const char* registers[NUM_REGISTERS * 2];
+    uint8_t registerIndices[NUM_REGISTERS * 2];
+    for (uint8_t i = 0; i < NUM_REGISTERS; i++) {
+        registers[i * 2] = RegisterDefinitionLUT[i].name;
+        registers[i * 2 + 1] = RegisterDefinitionLUT[i].altName;
+        registerIndices[i * 2] = i;
+        registerIndices[i * 2 + 1] = i;
+    }
+    if (!emitTable("Register", "REGISTER", registers, registerIndices, NUM_REGISTERS * 2)) {
+        return 1;
+    }
+    if (!emitDisassemblyTable()) {
+        return 1;
+    }
+
+    printf("#endif\n");
+    return 0;
+}
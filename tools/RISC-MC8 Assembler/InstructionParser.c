@@ -1,119 +1,381 @@
 #include "InstructionParser.h"
 
-#include <ctype.h>
 #include <inttypes.h>
 #include <stdbool.h>
-#include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
 
+#include "AssemblerStats.h"
+#include "Fixups.h"
 #include "Instructions.h"
+#include "LoadImmediate.h"
 #include "StatusCodes.h"
 
+/**
+ * @brief Check that a directive is one the assembler knows and is well formed
+ *
+ * @param line The lexed directive
+ * @return STATUS_LINE_NOT_INSTRUCTION if it is valid, otherwise the error found
+ */
+static uint8_t checkDirective(const SourceLine* const line)
+{
+    if (!tokenEquals(&line->tokens[0], ".global")) {
+        return ERROR_UNKNOWN_DIRECTIVE;
+    } else if (line->tokenCount < 2) {
+        return ERROR_MISSING_INSTRUCTION_PARAMETER;
+    } else if (line->tooManyTokens) {
+        return ERROR_TOO_MANY_TOKENS;
+    }
+    return STATUS_LINE_NOT_INSTRUCTION;
+}
+
 /**
  * @brief Parse the given instruction
  *
  * @param instructionDest The place to write the finished instruction
- * @param instructionLine The source instruction line, case insensitive
+ * @param line The lexed source line
  * @param currentOffset The offset of the instruction being parsed
  * @param symbols List of symbols to use for translating
  * @return 0 if successful, otherwise returns the error that occurred
  */
-uint8_t parseInstruction(uint8_t* const instructionDest, const char* const instructionLine, uint16_t currentOffset, SymbolsList* symbols)
+uint8_t parseInstruction(uint8_t* const instructionDest, const SourceLine* const line, uint32_t currentOffset, SymbolsList* symbols)
 {
-    // get a local copy of instruction to use in strtok and other functions
-    uint16_t length = strlen(instructionLine);
-    char* instInParse = (char*)calloc(sizeof(char), length + 1);
-    for (uint16_t i = 0; i < length && *(instructionLine + i) != '#'; i++) {
-        *(instInParse + i) = tolower(*(instructionLine + i));
-    }
-
-    // create our token breaker and get the mnemonic
-    char* token;
-    token = strtok(instInParse, " \t\r\n");
-    if (token == NULL || *(token + strlen(token) - 1) == ':') {
-        free(instInParse);
+    if (line->kind == LINE_KIND_DIRECTIVE) {
+        return checkDirective(line);  // directives emit no code, but are checked in every mode
+    } else if (line->kind != LINE_KIND_INSTRUCTION) {
         return STATUS_LINE_NOT_INSTRUCTION;
     }
 
     // using the name, get the instruction information
-    const InstructionLoaderDefinition* iDef = getInstructionLoaderDefinition(token);
+    const Token* mnemonic = &line->tokens[0];
+    const InstructionLoaderDefinition* iDef = getInstructionLoaderDefinitionN(mnemonic->start, mnemonic->length);
     if (iDef == NULL) {
-        free(instInParse);
         return ERROR_UNKNOWN_MNEMONIC;
     }
 
     // load the parts of the instruction
     *instructionDest = iDef->instructionBase;
-    token = strtok(NULL, " \t\r\n");
-    if (token == NULL) {
-        free(instInParse);
+    if (line->tokenCount < 2) {
         return ERROR_MISSING_INSTRUCTION_PARAMETER;
     }
-    uint8_t loaderStatus = iDef->tokenLoader(instructionDest, currentOffset, token, symbols);
+    const Token* operand = &line->tokens[1];
+    uint8_t loaderStatus = iDef->tokenLoader(instructionDest, currentOffset, operand->start, operand->length, symbols);
 
     // error on `addi 000 000`
-    token = strtok(NULL, " \t\r\n");
-    if (token != NULL) {
-        free(instInParse);
+    if (line->tooManyTokens) {
         return ERROR_TOO_MANY_TOKENS;
     }
 
     // return and say if we got an error
-    free(instInParse);
     return loaderStatus;
 }
 
 /**
- * @brief Parse an assembly file and output the results to outputFile (overwrite)
+ * @brief Forget the registers at a label, after the instructions not yet given to the tracker
+ *
+ * @param tracker The tracker
+ * @param untracked The instructions assembled since the tracker was last updated
+ * @param numUntracked Number of instructions in untracked
+ */
+static void forgetAtLabel(ValueTracker* tracker, const uint8_t* const untracked, uint32_t numUntracked)
+{
+    // only whether the last one was a SKIP matters past a label
+    if (numUntracked > 0) {
+        trackInstruction(tracker, *(untracked + numUntracked - 1));
+    }
+    forgetValues(tracker);
+}
+
+/**
+ * @brief Record a JUMP to a label too far away for its 7-bit offset, so relaxJumps can route it later
+ *
+ * @param farJumps List to record it in, NULL to leave it an error
+ * @param line The lexed JUMP
+ * @param instruction The JUMP as parseInstruction left it
+ * @param currentOffset The offset of the JUMP
+ * @param lineNumber The line the JUMP is on
+ * @param symbols List of symbols to use for translating
+ * @return 0 if it was recorded, ERROR_VALUE_OUT_OF_RANGE if it is not a JUMP to a label, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t deferFarJump(FarJumpsList* farJumps, const SourceLine* const line, uint8_t instruction, uint32_t currentOffset, uint32_t lineNumber, SymbolsList* symbols)
+{
+    if (farJumps == NULL || instruction != 0b10000000) {
+        return ERROR_VALUE_OUT_OF_RANGE;
+    }
+    const Symbol* label = findSymbolN(symbols, line->tokens[1].start, line->tokens[1].length);
+    if (label == NULL) {
+        return ERROR_VALUE_OUT_OF_RANGE;  // a numeric offset, which says exactly where to go
+    }
+    return addFarJump(farJumps, currentOffset, label->value, lineNumber);
+}
+
+/**
+ * @brief Assemble one line, expanding li
+ *
+ * The tracker is only brought up to date at labels, landings and li, so code without li never pays for it. A JUMP to a
+ * label out of range is assembled as `jump 0` and recorded in farJumps, if given.
  *
- * @param inputFile File to read instructions from
- * @param outputFile File to write assembled code to
+ * @param dest Where to write the instructions, room for LOAD_IMMEDIATE_MAX_LENGTH
+ * @param count Set to the number of instructions written, including a JUMP waiting on a label
+ * @param tracker What the registers hold at trackedTo
+ * @param trackedTo Offset the tracker is up to date with, moved to after the line at a label or li
+ * @param untracked The instructions assembled from trackedTo up to currentOffset, or NULL to track every instruction
+ *                  as it is assembled, for a fixed buffer that may not have kept them
+ * @param line The lexed source line
+ * @param currentOffset The offset of the first instruction of the line
+ * @param lineNumber The line number of the line
  * @param symbols List of symbols to use for translating
- * @param printErrors If true, print errors, noting the line that they occurred on
- * @return 0 if successful, otherwise returns the error that occurred (output file may be partially written to)
+ * @param landings Where JUMPs by a number land, NULL if the source has none that matter
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @return 0 if successful, ERROR_JUMP_INTO_LOAD_IMMEDIATE if a JUMP by a number unsettled the landings, otherwise
+ *         returns the status of parseInstruction or expandLoadImmediate
  */
-uint8_t parseInstructionsFile(FILE* inputFile, FILE* outputFile, SymbolsList* symbols, bool printErrors)
+static uint8_t assembleLine(uint8_t* dest, uint32_t* count, ValueTracker* tracker, uint32_t* trackedTo, const uint8_t* const untracked, const SourceLine* const line, uint32_t currentOffset, uint32_t lineNumber, SymbolsList* symbols, JumpLandings* landings, FarJumpsList* farJumps)
 {
-    char* lineBuffer = (char*)calloc(64, sizeof(char));
-    uint8_t* instruction = (uint8_t*)calloc(1, sizeof(uint8_t));
-    uint32_t line = 1;
-    uint16_t currentOffset = 0;
-    while (fgets(lineBuffer, 64, inputFile) != NULL) {
-        uint8_t status = parseInstruction(instruction, lineBuffer, currentOffset, symbols);
+    *count = 0;
+    if (line->kind == LINE_KIND_LABEL) {
+        forgetAtLabel(tracker, untracked, currentOffset - *trackedTo);
+        *trackedTo = currentOffset;
+        return STATUS_LINE_NOT_INSTRUCTION;
+    }
+    if (landings != NULL && line->kind == LINE_KIND_INSTRUCTION && reachJumpLandings(landings, currentOffset, currentOffset + 1)) {
+        forgetAtLabel(tracker, untracked, currentOffset - *trackedTo);
+        *trackedTo = currentOffset;
+    }
+    if (isLoadImmediate(line)) {
+        for (uint32_t i = 0; i < currentOffset - *trackedTo; i++) {
+            trackInstruction(tracker, *(untracked + i));
+        }
+        bool relied = valuesKnown(tracker);
+        uint8_t status = expandLoadImmediate(tracker, line, dest, count);
+        *trackedTo = currentOffset + *count;
+        if (landings != NULL && status == 0) {
+            noteLoadImmediate(landings, relied, currentOffset, *count);
+            if (*count > 1 && reachJumpLandings(landings, currentOffset + 1, currentOffset + *count)) {
+                forgetValues(tracker);  // landing inside the li
+            }
+        }
+        return status;
+    }
+    uint8_t status = parseInstruction(dest, line, currentOffset, symbols);
+    if (status == ERROR_VALUE_OUT_OF_RANGE) {
+        status = deferFarJump(farJumps, line, *dest, currentOffset, lineNumber, symbols);
+    }
+    if (status == 0 || status == STATUS_UNRESOLVED_SYMBOL) {
+        *count = 1;
+        if (untracked == NULL) {
+            trackInstruction(tracker, *dest);
+            *trackedTo = currentOffset + 1;
+        }
+        if (landings != NULL && (*dest & 0b10000000)) {
+            addJumpLanding(landings, line, currentOffset);
+            if (landings->unsettled) {
+                // a single pass cannot size again what it already emitted, only extractSymbols can
+                status = landings->untracked ? ERROR_OUT_OF_MEMORY : ERROR_JUMP_INTO_LOAD_IMMEDIATE;
+            }
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Encode every instruction in a source into a buffer, for when the number of instructions is already known
+ *
+ * Where JUMPs by a number land is not looked for, so a source with li must not have any, see jumpsByNumber.
+ *
+ * @param source Source to read instructions from, read from its current position
+ * @param code Where to write the instructions, must have room for all of them
+ * @param baseOffset The offset of the first instruction in source
+ * @param entry What the registers hold before the first line, for li, NULL if nothing is known
+ * @param symbols List of symbols to use for translating, only read so it may be shared between threads
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise returns the first error that occurred
+ */
+uint8_t encodeInstructions(SourceReader* source, uint8_t* code, uint32_t baseOffset, const ValueTracker* const entry, SymbolsList* symbols, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic)
+{
+    ValueTracker tracker;
+    if (entry != NULL) {
+        tracker = *entry;
+    } else {
+        resetValueTracker(&tracker);
+    }
+    uint32_t currentOffset = baseOffset;
+    uint32_t trackedTo = baseOffset;
+    const uint8_t* const start = code;
+    const char* text;
+    uint32_t length;
+    SourceLine line;
+    while (readSourceLine(source, &text, &length)) {
+        lexLine(&line, text, length);
+        uint32_t count;
+        uint8_t status = assembleLine(code, &count, &tracker, &trackedTo, start + (trackedTo - baseOffset), &line, currentOffset, source->lineNumber, symbols, NULL, farJumps);
         if (status == 0) {
-            fputc(*instruction, outputFile);
-            currentOffset++;
+            code += count;
+            currentOffset += count;
         } else if (status != STATUS_LINE_NOT_INSTRUCTION) {
-            if (printErrors) {
-                if (status == ERROR_UNKNOWN_REGISTER) {
-                    fprintf(stderr, "Error: Invalid register name on line %d.\n", line);
-                } else if (status == ERROR_VALUE_OUT_OF_RANGE) {
-                    fprintf(stderr, "Error: Value out of range on line %d.\n", line);
-                } else if (status == ERROR_INVALID_NUMBER) {
-                    fprintf(stderr, "Error: Invalid number on line %d.\n", line);
-                } else if (status == ERROR_INVALID_BINARY_STRING_CHARACTER) {
-                    fprintf(stderr, "Error: Invalid binary string character on line %d.\n", line);
-                } else if (status == ERROR_INVALID_BINARY_STRING_LENGTH) {
-                    fprintf(stderr, "Error: Invalid binary string length on line %d.\n", line);
-                } else if (status == ERROR_UNKNOWN_MNEMONIC) {
-                    fprintf(stderr, "Error: Unknown mnemonic on line %d.\n", line);
-                } else if (status == ERROR_MISSING_INSTRUCTION_PARAMETER) {
-                    fprintf(stderr, "Error: Malformed instruction on line %d.\n", line);
-                } else if (status == ERROR_TOO_MANY_TOKENS) {
-                    fprintf(stderr, "Error: Too many tokens on line %d.\n", line);
-                } else {
-                    fprintf(stderr, "Error: Unknown error on line %d.\n", line);
+            if (status == STATUS_UNRESOLVED_SYMBOL) {
+                status = ERROR_UNKNOWN_LABEL;  // every label is known by now
+            }
+            setDiagnostic(diagnostic, status, source->lineNumber, getStatusColumn(&line, status));
+            return status;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse an assembly source, appending the assembled code to a buffer
+ *
+ * @param source Source to read instructions from, read from its current position
+ * @param code Buffer to append assembled code to
+ * @param symbols List of symbols to use for translating
+ * @param landings Where JUMPs by a number land, settled and rewound as extractSymbols left them
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise returns the error that occurred (code may be partially written to)
+ */
+uint8_t parseInstructions(SourceReader* source, CodeBuffer* code, SymbolsList* symbols, JumpLandings* landings, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic)
+{
+    ValueTracker tracker;
+    resetValueTracker(&tracker);
+    uint32_t currentOffset = 0;
+    uint32_t trackedTo = 0;
+    size_t start = code->length;
+    const char* text;
+    uint32_t length;
+    SourceLine line;
+    while (readSourceLine(source, &text, &length)) {
+        lexLine(&line, text, length);
+        uint8_t instructions[LOAD_IMMEDIATE_MAX_LENGTH];
+        uint32_t count;
+        uint8_t status = assembleLine(instructions, &count, &tracker, &trackedTo, code->fixed ? NULL : code->data + start + trackedTo, &line, currentOffset, source->lineNumber, symbols, landings, farJumps);
+        if (status == 0) {
+            for (uint32_t i = 0; i < count; i++) {
+                if (!appendCode(code, *(instructions + i))) {
+                    setDiagnostic(diagnostic, ERROR_OUT_OF_MEMORY, source->lineNumber, 0);
+                    return ERROR_OUT_OF_MEMORY;
                 }
             }
-            free(lineBuffer);
-            free(instruction);
+            currentOffset += count;
+        } else if (status != STATUS_LINE_NOT_INSTRUCTION) {
+            if (status == STATUS_UNRESOLVED_SYMBOL) {
+                status = ERROR_UNKNOWN_LABEL;  // every label is known by now
+            }
+            setDiagnostic(diagnostic, status, source->lineNumber, getStatusColumn(&line, status));
             return status;
         }
-        *instruction = 0;
-        line++;
     }
-    free(lineBuffer);
-    free(instruction);
     return 0;
 }
+
+/**
+ * @brief Assemble a source in a single pass, leaving JUMPs to labels that are never defined in fixups
+ *
+ * @param source Source to read instructions from, may be a pipe
+ * @param code Buffer to append assembled code to
+ * @param symbols List to add the labels defined in source to
+ * @param fixups List of JUMPs waiting on labels, those still pending at the end refer to undefined labels
+ * @param exports List to add the names given to `.global` directives to, with their line as the value, or NULL
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise returns the error that occurred
+ */
+uint8_t parseInstructionsDeferred(SourceReader* source, CodeBuffer* code, SymbolsList* symbols, FixupsList* fixups, SymbolsList* exports, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic)
+{
+    ValueTracker tracker;
+    resetValueTracker(&tracker);
+    uint32_t currentOffset = 0;
+    uint32_t trackedTo = 0;
+    size_t start = code->length;
+    JumpLandings landings = {NULL, 0, 0, 0, 0, false, false};
+    uint8_t status = 0;
+    const char* text;
+    uint32_t length;
+    SourceLine line;
+    while (status == 0 && readSourceLine(source, &text, &length)) {
+        uint32_t lineNumber = source->lineNumber;
+        lexLine(&line, text, length);
+
+        // labels are defined as soon as they are seen, patching any JUMPs that were waiting on them
+        if (line.kind == LINE_KIND_LABEL) {
+            forgetAtLabel(&tracker, code->fixed ? NULL : code->data + start + trackedTo, currentOffset - trackedTo);
+            trackedTo = currentOffset;
+            status = attemptSymbolExtraction(symbols, &line, currentOffset);
+            if (status == 0) {
+                const Symbol* defined = symbols->symbols + symbols->length - 1;
+                status = resolveFixups(fixups, getSymbolName(symbols, defined), defined->value, code, farJumps, diagnostic);
+            } else {
+                setDiagnostic(diagnostic, status, lineNumber, getStatusColumn(&line, status));
+            }
+            continue;
+        } else if (line.kind == LINE_KIND_EMPTY) {
+            continue;
+        }
+
+        uint8_t instructions[LOAD_IMMEDIATE_MAX_LENGTH];
+        uint32_t count;
+        status = assembleLine(instructions, &count, &tracker, &trackedTo, code->fixed ? NULL : code->data + start + trackedTo, &line, currentOffset, lineNumber, symbols, &landings, farJumps);
+        if (status == STATUS_LINE_NOT_INSTRUCTION) {
+            // a valid directive, only .global exists so far
+            const Token* name = &line.tokens[1];
+            status = 0;
+            if (exports != NULL && findSymbolN(exports, name->start, name->length) == NULL) {
+                status = addSymbolToListN(exports, name->start, name->length, lineNumber);
+            }
+            if (status != 0) {
+                setDiagnostic(diagnostic, status, lineNumber, 0);
+            }
+            continue;
+        } else if (status == STATUS_UNRESOLVED_SYMBOL) {
+            // emit the JUMP with a zero offset and patch it once the label shows up
+            uint32_t column = getStatusColumn(&line, status);
+            status = addFixupToList(fixups, line.tokens[1].start, line.tokens[1].length, currentOffset, lineNumber, column);
+        }
+        for (uint32_t i = 0; status == 0 && i < count; i++) {
+            if (!appendCode(code, *(instructions + i))) {
+                status = ERROR_OUT_OF_MEMORY;
+            }
+        }
+        if (status == 0) {
+            currentOffset += count;
+        } else {
+            setDiagnostic(diagnostic, status, lineNumber, getStatusColumn(&line, status));
+        }
+    }
+    freeJumpLandings(&landings);
+    return status;
+}
+
+/**
+ * @brief Assemble a source in a single pass, backpatching JUMPs to labels that are defined later
+ *
+ * @param source Source to read instructions from, may be a pipe
+ * @param code Buffer to append assembled code to, only complete if assembly succeeds
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise returns the error that occurred
+ */
+uint8_t parseInstructionsSinglePass(SourceReader* source, CodeBuffer* code, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic)
+{
+    SymbolsList* symbols = (SymbolsList*)calloc(1, sizeof(SymbolsList));
+    FixupsList* fixups = (FixupsList*)calloc(1, sizeof(FixupsList));
+    if (symbols == NULL || fixups == NULL) {
+        free(symbols);
+        free(fixups);
+        setDiagnostic(diagnostic, ERROR_OUT_OF_MEMORY, 0, 0);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    countAllocation(sizeof(SymbolsList) + sizeof(FixupsList));
+    uint8_t status = parseInstructionsDeferred(source, code, symbols, fixups, NULL, farJumps, diagnostic);
+
+    // anything still pending refers to a label that was never defined, report the earliest one
+    if (status == 0 && fixups->pending > 0) {
+        const Fixup* pending = firstPendingFixup(fixups);
+        status = ERROR_UNKNOWN_LABEL;
+        setDiagnostic(diagnostic, status, pending->line, pending->column);
+    }
+
+    freeFixupsList(&fixups);
+    freeSymbolsList(&symbols);
+    return status;
+}
@@ -4,28 +4,78 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Fixups.h"
+#include "Lexer.h"
+#include "LoadImmediate.h"
+#include "Relaxation.h"
+#include "Source.h"
 #include "Symbols.h"
 
 /**
  * @brief Parse the given instruction
  *
  * @param instructionDest The place to write the finished instruction
- * @param instructionLine The source instruction line, case insensitive
+ * @param line The lexed source line
  * @param currentOffset The offset of the instruction being parsed
  * @param symbols List of symbols to use for translating
  * @return 0 if successful, otherwise returns the error that occurred
  */
-uint8_t parseInstruction(uint8_t* const instructionDest, const char* const instructionLine, uint16_t currentOffset, SymbolsList* symbols);
+uint8_t parseInstruction(uint8_t* const instructionDest, const SourceLine* const line, uint32_t currentOffset, SymbolsList* symbols);
 
 /**
- * @brief Parse an assembly file and output the results to outputFile (overwrite)
+ * @brief Encode every instruction in a source into a buffer, for when the number of instructions is already known
  *
- * @param inputFile File to read instructions from
- * @param outputFile File to write assembled code to
+ * Where JUMPs by a number land is not looked for, so a source with li must not have any, see jumpsByNumber.
+ *
+ * @param source Source to read instructions from, read from its current position
+ * @param code Where to write the instructions, must have room for all of them
+ * @param baseOffset The offset of the first instruction in source
+ * @param entry What the registers hold before the first line, for li, NULL if nothing is known
+ * @param symbols List of symbols to use for translating, only read so it may be shared between threads
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise returns the first error that occurred
+ */
+uint8_t encodeInstructions(SourceReader* source, uint8_t* code, uint32_t baseOffset, const ValueTracker* const entry, SymbolsList* symbols, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Parse an assembly source, appending the assembled code to a buffer
+ *
+ * @param source Source to read instructions from, read from its current position
+ * @param code Buffer to append assembled code to
  * @param symbols List of symbols to use for translating
- * @param printErrors If true, print errors, noting the line that they occurred on
- * @return 0 if successful, otherwise returns the error that occurred (output file may be partially written to)
+ * @param landings Where JUMPs by a number land, settled and rewound as extractSymbols left them
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise returns the error that occurred (code may be partially written to)
+ */
+uint8_t parseInstructions(SourceReader* source, CodeBuffer* code, SymbolsList* symbols, JumpLandings* landings, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Assemble a source in a single pass, leaving JUMPs to labels that are never defined in fixups
+ *
+ * @param source Source to read instructions from, may be a pipe
+ * @param code Buffer to append assembled code to
+ * @param symbols List to add the labels defined in source to
+ * @param fixups List of JUMPs waiting on labels, those still pending at the end refer to undefined labels
+ * @param exports List to add the names given to `.global` directives to, with their line as the value, or NULL
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise returns the error that occurred
+ */
+uint8_t parseInstructionsDeferred(SourceReader* source, CodeBuffer* code, SymbolsList* symbols, FixupsList* fixups, SymbolsList* exports, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Assemble a source in a single pass, backpatching JUMPs to labels that are defined later
+ *
+ * @param source Source to read instructions from, may be a pipe
+ * @param code Buffer to append assembled code to, only complete if assembly succeeds
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise returns the error that occurred
  */
-uint8_t parseInstructionsFile(FILE* inputFile, FILE* outputFile, SymbolsList* symbols, bool printErrors);
+uint8_t parseInstructionsSinglePass(SourceReader* source, CodeBuffer* code, FarJumpsList* farJumps, AssemblerDiagnostic* diagnostic);
 
 #endif
@@ -1,49 +1,99 @@
 #include "Instructions.h"
 
-#include <ctype.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "DecoderTables.h"
 #include "Registers.h"
 #include "StatusCodes.h"
 #include "Symbols.h"
 
 /**
- * @param str String to test
- * @return true if the given string is entirely composed of digits, false otherwise
+ * @brief Parse a decimal integer, optionally negative
+ *
+ * @param str String to parse, does not need to be NUL terminated
+ * @param length Number of characters in str
+ * @param value Set to the parsed value, clamped to +-1000000 so out-of-range input stays out of range
+ * @return true if the given string is entirely composed of digits (after an optional -), false otherwise
  */
-bool isInteger(const char* const str)
+static bool parseInteger(const char* const str, uint32_t length, int32_t* const value)
 {
-    uint32_t length = strlen(str);
     uint32_t i = 0;
+    bool negative = false;
     // first character might be - for negative number
-    if (*str == '-') {
+    if (length > 0 && *str == '-') {
+        negative = true;
         i++;
     }
     // rest should be digits
+    int32_t magnitude = 0;
     while (i < length) {
-        if (!isdigit(*(str + i))) {
+        char c = *(str + i);
+        if (c < '0' || c > '9') {
             return false;
         }
+        if (magnitude < 1000000) {
+            magnitude = magnitude * 10 + (c - '0');
+        }
         i++;
     }
+    *value = negative ? -magnitude : magnitude;
     return true;
 }
 
+/**
+ * @brief Parse a "0b1010"-style binary string of an exact number of bits
+ *
+ * @param token The token to parse, known to start with 0b, does not need to be NUL terminated
+ * @param length Number of characters in token
+ * @param bits Number of bits the string must contain
+ * @param value Set to the parsed bits
+ * @return error code, 0 if successful
+ */
+static uint8_t parseBinaryString(const char* const token, uint32_t length, uint8_t bits, uint8_t* const value)
+{
+    if (length != 2u + bits) {
+        return ERROR_INVALID_BINARY_STRING_LENGTH;
+    }
+    uint8_t parsed = 0;
+    for (uint8_t i = 0; i < bits; i++) {
+        char nextVal = *(token + 2 + i);
+        // if invalid character
+        if (nextVal != '0' && nextVal != '1') {
+            return ERROR_INVALID_BINARY_STRING_CHARACTER;
+        }
+        // get bit 1 or 0 and shift it into where it belongs
+        parsed |= (nextVal - '0') << (bits - 1 - i);
+    }
+    *value = parsed;
+    return 0;
+}
+
+/**
+ * @param token Token to test
+ * @param length Number of characters in token
+ * @return true if the token starts with 0b (either case), false otherwise
+ */
+static bool isBinaryString(const char* const token, uint32_t length)
+{
+    return length >= 2 && *token == '0' && toLowerAscii(*(token + 1)) == 'b';
+}
+
 /**
  * @brief Insert the given register into (according to token) into the instruction, using 000 if token is malformed
  *
  * @param instruction The 8-bit instruction to load the register into
  * @param offset Current offset of this instruction
- * @param token The token name of the register, either "000"-style, "r1"-style, or "ireg"
+ * @param token The token name of the register, either "000"-style, "r1"-style, or "ireg", case insensitive
+ * @param length Number of characters in token
  * @param symbols List of symbols
  * @return error code, 0 if successful
  */
-uint8_t loadReg(uint8_t* const instruction, uint16_t offset, const char* const token, SymbolsList* symbols)
+uint8_t loadReg(uint8_t* const instruction, uint32_t offset, const char* const token, uint32_t length, SymbolsList* symbols)
 {
-    const RegisterDefinition* rDef = getRegisterDefinition(token);
+    const RegisterDefinition* rDef = getRegisterDefinitionN(token, length);
     if (rDef == NULL) {
         return ERROR_UNKNOWN_REGISTER;
     }
@@ -57,37 +107,30 @@ uint8_t loadReg(uint8_t* const instruction, uint16_t offset, const char* const t
  * @param instruction The 8-bit instruction to load the immediate into
  * @param offset Current offset of this instruction
  * @param token The token to load, either "0b1010"-style or an integer in the range 0-15
+ * @param length Number of characters in token
  * @param symbols List of symbols
  * @return error code, 0 if successful
  */
-uint8_t load4BitImm(uint8_t* const instruction, uint16_t offset, const char* const token, SymbolsList* symbols)
+uint8_t load4BitImm(uint8_t* const instruction, uint32_t offset, const char* const token, uint32_t length, SymbolsList* symbols)
 {
-    int8_t insertValue = 0;
+    uint8_t insertValue = 0;
     // loading 0b1010 value
-    if (*token == '0' && *(token + 1) == 'b') {
-        if (strlen(token) != 6) {
-            return ERROR_INVALID_BINARY_STRING_LENGTH;
-        }
-        for (uint8_t i = 0; i < 4; i++) {
-            char nextVal = *(token + 2 + i);
-            // if invalid character
-            if (nextVal != '0' && nextVal != '1') {
-                return ERROR_INVALID_BINARY_STRING_CHARACTER;
-            }
-            // get bit 1 or 0 and shift it into where it belongs
-            insertValue |= (nextVal - 48) << (3 - i);
+    if (isBinaryString(token, length)) {
+        uint8_t status = parseBinaryString(token, length, 4, &insertValue);
+        if (status != 0) {
+            return status;
         }
     }
     // loading direct "int"
     else {
-        if (!isInteger(token)) {
+        int32_t parsedValue;
+        if (!parseInteger(token, length, &parsedValue)) {
             return ERROR_INVALID_NUMBER;
         }
-        insertValue = atoi(token);
-        if (insertValue < 0 || insertValue > 15) {
+        if (parsedValue < 0 || parsedValue > 15) {
             return ERROR_VALUE_OUT_OF_RANGE;
         }
-        insertValue &= 0b1111;  // drop high bits
+        insertValue = parsedValue & 0b1111;  // drop high bits
     }
     *instruction |= insertValue;
     return 0;
@@ -99,66 +142,96 @@ uint8_t load4BitImm(uint8_t* const instruction, uint16_t offset, const char* con
  * @param instruction The 8-bit instruction to load the immediate into
  * @param offset Current offset of this instruction
  * @param token The token to load, either "0b1010101"-style or an integer in the range -64 to 63
+ * @param length Number of characters in token
  * @param symbols List of symbols, if token matches a symbol then its value is used instead
- * @return error code, 0 if successful
+ * @return error code, 0 if successful, STATUS_UNRESOLVED_SYMBOL if token is neither a known symbol nor a number
  */
-uint8_t load7BitSImm(uint8_t* const instruction, uint16_t offset, const char* const token, SymbolsList* symbols)
+uint8_t load7BitSImm(uint8_t* const instruction, uint32_t offset, const char* const token, uint32_t length, SymbolsList* symbols)
 {
-    int8_t insertValue = 0;
     // try to load a symbol first
-    for (uint16_t i = 0; i < symbols->length; i++) {
-        if (strcmp(token, (symbols->symbols + i)->symbol) == 0) {
-            insertValue = (symbols->symbols + i)->value - offset;
-            if (insertValue < -64 || insertValue > 63) {
-                return ERROR_VALUE_OUT_OF_RANGE;
-            }
-            insertValue &= 0b1111111;  // drop high bits
-            *instruction |= insertValue;
-            return 0;
+    const Symbol* symbol = findSymbolN(symbols, token, length);
+    if (symbol != NULL) {
+        int32_t distance = (int32_t)symbol->value - (int32_t)offset;
+        if (distance < -64 || distance > 63) {
+            return ERROR_VALUE_OUT_OF_RANGE;
         }
+        *instruction |= distance & 0b1111111;  // drop high bits
+        return 0;
     }
+    uint8_t insertValue = 0;
     // loading 0b101010 value
-    if (*token == '0' && *(token + 1) == 'b') {
-        if (strlen(token) != 9) {
-            return ERROR_INVALID_BINARY_STRING_LENGTH;
-        }
-        for (uint8_t i = 0; i < 7; i++) {
-            char nextVal = *(token + 2 + i);
-            // if invalid character
-            if (nextVal != '0' && nextVal != '1') {
-                return ERROR_INVALID_BINARY_STRING_CHARACTER;
-            }
-            // get bit 1 or 0 and shift it into where it belongs
-            insertValue |= (nextVal - 48) << (6 - i);
+    if (isBinaryString(token, length)) {
+        uint8_t status = parseBinaryString(token, length, 7, &insertValue);
+        if (status != 0) {
+            return status;
         }
     }
     // loading direct "int"
     else {
-        if (!isInteger(token)) {
-            return ERROR_INVALID_NUMBER;
+        int32_t parsedValue;
+        if (!parseInteger(token, length, &parsedValue)) {
+            return STATUS_UNRESOLVED_SYMBOL;  // not a number, so it must be a label we have not seen
         }
-        insertValue = atoi(token);
-        if (insertValue < -64 || insertValue > 63) {
+        if (parsedValue < -64 || parsedValue > 63) {
             return ERROR_VALUE_OUT_OF_RANGE;
         }
-        insertValue &= 0b1111111;  // drop high bits
+        insertValue = parsedValue & 0b1111111;  // drop high bits
     }
     *instruction |= insertValue;
     return 0;
 }
 
+/**
+ * @brief Parse an 8-bit immediate, for pseudo-instructions that set a whole register
+ *
+ * @param value Set to the value, negative numbers in two's complement
+ * @param token The token to parse, either "0b10101010"-style or an integer in the range -128 to 255
+ * @param length Number of characters in token
+ * @return error code, 0 if successful
+ */
+uint8_t parse8BitImm(uint8_t* const value, const char* const token, uint32_t length)
+{
+    if (isBinaryString(token, length)) {
+        return parseBinaryString(token, length, 8, value);
+    }
+    int32_t parsedValue;
+    if (!parseInteger(token, length, &parsedValue)) {
+        return ERROR_INVALID_NUMBER;
+    }
+    if (parsedValue < -128 || parsedValue > 255) {
+        return ERROR_VALUE_OUT_OF_RANGE;
+    }
+    *value = (uint8_t)(parsedValue & 0xFF);
+    return 0;
+}
+
 /**
  * @brief Get the instruction loader information for a given mnemonic
  *
- * @param mnemonic The instruction mnemonic to get, not NULL
+ * @param mnemonic The instruction mnemonic to get, case insensitive
+ * @param length Number of characters in mnemonic, which need not be NUL terminated
  * @return The corresponding InstructionLoaderDefinition, or NULL if the mnemonic was invalid
  */
-const InstructionLoaderDefinition* getInstructionLoaderDefinition(const char* const mnemonic)
+const InstructionLoaderDefinition* getInstructionLoaderDefinitionN(const char* const mnemonic, uint32_t length)
 {
-    for (uint8_t i = 0; i < NUM_INSTRUCTIONS; i++) {
-        if (strncmp(mnemonic, InstructionLoaderLUT[i].mnemonic, 5) == 0) {
-            return &InstructionLoaderLUT[i];
-        }
+    uint32_t key;
+    if (!packKey(&key, mnemonic, length)) {
+        return NULL;
+    }
+    uint32_t slot = PACKED_KEY_HASH(key, MNEMONIC_HASH_MULTIPLIER);
+    if (MnemonicHashSlots[slot] == 0 || MnemonicHashKeys[slot] != key) {
+        return NULL;
     }
-    return NULL;
+    return &InstructionLoaderLUT[MnemonicHashSlots[slot] - 1];
+}
+
+/**
+ * @brief Get the instruction loader information for a given mnemonic
+ *
+ * @param mnemonic The instruction mnemonic to get, not NULL, case insensitive
+ * @return The corresponding InstructionLoaderDefinition, or NULL if the mnemonic was invalid
+ */
+const InstructionLoaderDefinition* getInstructionLoaderDefinition(const char* const mnemonic)
+{
+    return getInstructionLoaderDefinitionN(mnemonic, strlen(mnemonic));
 }
@@ -10,11 +10,12 @@
  *
  * @param instruction The 8-bit instruction to load the register into
  * @param offset Current offset of this instruction
- * @param token The token name of the register, either "000"-style, "r1"-style, or "ireg"
+ * @param token The token name of the register, either "000"-style, "r1"-style, or "ireg", case insensitive
+ * @param length Number of characters in token
  * @param symbols List of symbols
  * @return error code, 0 if successful
  */
-uint8_t loadReg(uint8_t* const instruction, uint16_t offset, const char* const token, SymbolsList* symbols);
+uint8_t loadReg(uint8_t* const instruction, uint32_t offset, const char* const token, uint32_t length, SymbolsList* symbols);
 
 /**
  * @brief Insert the given 4-bit unsigned immediate into the instruction
@@ -22,10 +23,11 @@ uint8_t loadReg(uint8_t* const instruction, uint16_t offset, const char* const t
  * @param instruction The 8-bit instruction to load the immediate into
  * @param offset Current offset of this instruction
  * @param token The token to load, either "0b1010"-style or an integer in the range 0-15
+ * @param length Number of characters in token
  * @param symbols List of symbols
  * @return error code, 0 if successful
  */
-uint8_t load4BitImm(uint8_t* const instruction, uint16_t offset, const char* const token, SymbolsList* symbols);
+uint8_t load4BitImm(uint8_t* const instruction, uint32_t offset, const char* const token, uint32_t length, SymbolsList* symbols);
 
 /**
  * @brief Insert the given 7-bit signed immediate into the instruction
@@ -33,17 +35,28 @@ uint8_t load4BitImm(uint8_t* const instruction, uint16_t offset, const char* con
  * @param instruction The 8-bit instruction to load the immediate into
  * @param offset Current offset of this instruction
  * @param token The token to load, either "0b1010101"-style or an integer in the range -64 to 63
+ * @param length Number of characters in token
  * @param symbols List of symbols, if token matches a symbol then its value is used instead
+ * @return error code, 0 if successful, STATUS_UNRESOLVED_SYMBOL if token is neither a known symbol nor a number
+ */
+uint8_t load7BitSImm(uint8_t* const instruction, uint32_t offset, const char* const token, uint32_t length, SymbolsList* symbols);
+
+/**
+ * @brief Parse an 8-bit immediate, for pseudo-instructions that set a whole register
+ *
+ * @param value Set to the value, negative numbers in two's complement
+ * @param token The token to parse, either "0b10101010"-style or an integer in the range -128 to 255
+ * @param length Number of characters in token
  * @return error code, 0 if successful
  */
-uint8_t load7BitSImm(uint8_t* const instruction, uint16_t offset, const char* const token, SymbolsList* symbols);
+uint8_t parse8BitImm(uint8_t* const value, const char* const token, uint32_t length);
 
 #define NUM_INSTRUCTIONS 15
 
 static const struct _InstructionLoaderDefinition {
     char* mnemonic;
     uint8_t instructionBase;
-    uint8_t (*tokenLoader)(uint8_t* const, uint16_t, const char* const, SymbolsList*);
+    uint8_t (*tokenLoader)(uint8_t* const, uint32_t, const char* const, uint32_t, SymbolsList*);
 } InstructionLoaderLUT[] = {
     {"andi", 0b00000000, &loadReg},
     {"nand", 0b00001000, &loadReg},
@@ -66,9 +79,18 @@ typedef struct _InstructionLoaderDefinition InstructionLoaderDefinition;
 /**
  * @brief Get the instruction loader information for a given mnemonic
  *
- * @param mnemonic The instruction mnemonic to get
+ * @param mnemonic The instruction mnemonic to get, case insensitive
  * @return The corresponding InstructionLoaderDefinition, or NULL if the mnemonic was invalid
  */
 const InstructionLoaderDefinition* getInstructionLoaderDefinition(const char* const mnemonic);
 
+/**
+ * @brief Get the instruction loader information for a given mnemonic
+ *
+ * @param mnemonic The instruction mnemonic to get, case insensitive
+ * @param length Number of characters in mnemonic, which need not be NUL terminated
+ * @return The corresponding InstructionLoaderDefinition, or NULL if the mnemonic was invalid
+ */
+const InstructionLoaderDefinition* getInstructionLoaderDefinitionN(const char* const mnemonic, uint32_t length);
+
 #endif
@@ -0,0 +1,808 @@
+#include "Layout.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AssemblerStats.h"
+#include "CodeBuffer.h"
+#include "StatusCodes.h"
+#include "Symbols.h"
+
+#define JUMP_MIN_OFFSET -64
+#define JUMP_MAX_OFFSET 63
+#define LAYOUT_MAX_SKIPS 64  // placements given up one at a time before giving up the rest at once
+
+#define NO_BLOCK UINT32_MAX
+#define NO_EDGE UINT32_MAX
+
+#define CHAIN_ENTRY 1  // holds the first block, so goes first
+#define CHAIN_END 2    // holds the end of the program, so goes last
+
+/**
+ * One basic block of the program being laid out. The end of the program is a block of its own after the real ones,
+ * followed by two more that only exist as ends of edges: out of the program, and into it at the start.
+ */
+typedef struct _LayoutBlock {
+    uint32_t start;     // offset of the first instruction
+    uint32_t end;       // offset after the last instruction
+    uint32_t target;    // block the JUMP at the end goes to, NO_BLOCK if the block does not end with a JUMP
+    uint32_t fall;      // block control reaches past the end, NO_BLOCK if it ends with a JUMP that is always taken
+    uint32_t jumpEdge;  // edge of the JUMP at the end, NO_EDGE if none
+    uint32_t fallEdge;  // edge past the end, NO_EDGE if none
+    bool glued;         // ends with a SKIP, which has to stay right before the instruction it may skip
+    bool countKnown;
+    uint64_t count;     // times control reached the block
+} LayoutBlock;
+
+typedef struct _LayoutEdge {
+    uint32_t from;
+    uint32_t to;
+    bool known;
+    uint64_t weight;  // times control went this way
+} LayoutEdge;
+
+/**
+ * A block that can be placed right after another for free: the target of an unconditional JUMP, whose JUMP then goes,
+ * or the block control falls into, which would otherwise need a JUMP.
+ */
+typedef struct _LayoutCandidate {
+    uint32_t from;
+    uint32_t to;
+    uint64_t weight;
+    bool falls;
+    bool forced;  // after a SKIP, so has to be placed there
+} LayoutCandidate;
+
+typedef struct _Layout {
+    const uint8_t* code;
+    uint32_t length;
+    uint32_t maxLength;
+    uint32_t numBlocks;  // real blocks, the end of the program is block numBlocks
+    LayoutBlock* blocks;
+    uint32_t* blockAt;  // block starting at each offset, up to and including the length
+    LayoutEdge* edges;
+    uint32_t numEdges;
+    uint32_t* inStart;  // edges into block i are inEdges[inStart[i]] to inEdges[inStart[i + 1]]
+    uint32_t* inEdges;
+    uint32_t* worklist;
+    bool* queued;
+    LayoutCandidate* candidates;
+    uint32_t numCandidates;
+    bool* skipped;   // candidates left out because placing them broke a JUMP or the ROM
+    uint32_t* next;  // chains of blocks, NO_BLOCK at either end
+    uint32_t* prev;
+    uint32_t* parent;  // union-find of the chain each block is in
+    uint8_t* chainFlags;
+    uint32_t* order;
+    uint32_t* positions;
+    uint8_t* output;
+    uint32_t* offsetMap;
+    uint32_t* origins;
+    uint32_t outputLength;
+    uint64_t cycles;  // estimated cycles spent executing JUMPs in the output
+    uint32_t jumpsRemoved;
+    uint32_t jumpsAdded;
+} Layout;
+
+/**
+ * @brief Read how often control reached each label, one `label count` pair per line, # starting a comment
+ *
+ * @param file The execution count file, as written by `emulate-risc-mc8 --label-counts`
+ * @param table Line table of the program, for the offset of every label
+ * @param counts Receives the count of each labelled offset, needs room for the table length + 1 entries which should
+ *               start as LAYOUT_UNKNOWN_COUNT
+ * @param unknownLabels Receives the number of labels in the file that are not in the program
+ * @param diagnostic Set to the error and the line of the file it occurred on if one occurs, may be NULL
+ * @return 0 if successful, ERROR_MALFORMED_COUNTS if a line is not a label and a count, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t readLabelCounts(SourceReader* file, const LineTable* const table, uint64_t* counts, uint32_t* unknownLabels, AssemblerDiagnostic* diagnostic)
+{
+    *unknownLabels = 0;
+    SymbolsList* labels = (SymbolsList*)calloc(1, sizeof(SymbolsList));
+    if (labels == NULL) {
+        setDiagnostic(diagnostic, ERROR_OUT_OF_MEMORY, 0, 0);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    countAllocation(sizeof(SymbolsList));
+    uint8_t status = 0;
+    for (uint32_t i = 0; i < table->numLabels && status == 0; i++) {
+        status = addSymbolToList(labels, (table->labels + i)->name, (table->labels + i)->offset);
+        status = status == ERROR_DUPLICATE_LABEL ? 0 : status;
+    }
+    const char* line;
+    uint32_t length;
+    while (status == 0 && readSourceLine(file, &line, &length)) {
+        uint32_t pos = 0;
+        while (pos < length && (*(line + pos) == ' ' || *(line + pos) == '\t')) {
+            pos++;
+        }
+        uint32_t nameStart = pos;
+        while (pos < length && *(line + pos) != ' ' && *(line + pos) != '\t' && *(line + pos) != '\r' && *(line + pos) != '#') {
+            pos++;
+        }
+        uint32_t nameLength = pos - nameStart;
+        while (pos < length && (*(line + pos) == ' ' || *(line + pos) == '\t')) {
+            pos++;
+        }
+        uint64_t count = 0;
+        uint32_t digits = 0;
+        while (pos < length && *(line + pos) >= '0' && *(line + pos) <= '9' && count <= (UINT64_MAX - 9) / 10) {
+            count = count * 10 + (uint64_t)(*(line + pos++) - '0');
+            digits++;
+        }
+        while (pos < length && (*(line + pos) == ' ' || *(line + pos) == '\t' || *(line + pos) == '\r')) {
+            pos++;
+        }
+        if (pos < length && *(line + pos) != '#') {
+            digits = 0;  // anything but a comment after the count
+        }
+        if (nameLength == 0 && digits == 0) {
+            continue;  // blank or comment
+        }
+        if (nameLength == 0 || digits == 0) {
+            status = ERROR_MALFORMED_COUNTS;
+            break;
+        }
+        const Symbol* label = findSymbolN(labels, line + nameStart, nameLength);
+        if (label == NULL) {
+            (*unknownLabels)++;  // the profile is older than the source, the rest of it still helps
+        } else {
+            *(counts + label->value) = count;
+        }
+    }
+    freeSymbolsList(&labels);
+    setDiagnostic(diagnostic, status, status == ERROR_MALFORMED_COUNTS ? file->lineNumber : 0, 0);
+    return status;
+}
+
+/**
+ * @param instruction An instruction
+ * @return true if it is a SKIP
+ */
+static bool isSkip(uint8_t instruction)
+{
+    return (instruction >> 3) == 0b01011;
+}
+
+/**
+ * @brief Find where a JUMP goes
+ *
+ * @param instruction The JUMP
+ * @param pc Offset of the JUMP
+ * @return Offset of its target, outside 0..length if it leaves the program
+ */
+static int64_t jumpTarget(uint8_t instruction, uint32_t pc)
+{
+    return (int64_t)pc + (int32_t)(instruction & 0b1111111) - ((instruction & 0b1000000) << 1);  // sign extend
+}
+
+/**
+ * @brief Free everything a layout allocated
+ *
+ * @param layout The layout
+ */
+static void freeLayout(Layout* layout)
+{
+    free(layout->blocks);
+    free(layout->blockAt);
+    free(layout->edges);
+    free(layout->inStart);
+    free(layout->inEdges);
+    free(layout->worklist);
+    free(layout->queued);
+    free(layout->candidates);
+    free(layout->skipped);
+    free(layout->next);
+    free(layout->prev);
+    free(layout->parent);
+    free(layout->chainFlags);
+    free(layout->order);
+    free(layout->positions);
+    free(layout->output);
+    free(layout->offsetMap);
+    free(layout->origins);
+}
+
+/**
+ * @brief Allocate a zeroed array and count it
+ *
+ * @param count Number of elements
+ * @param size Size of each element
+ * @return The array, or NULL if out of memory
+ */
+static void* allocateLayoutArray(size_t count, size_t size)
+{
+    void* array = calloc(count > 0 ? count : 1, size);
+    if (array != NULL) {
+        countAllocation(count * size);
+    }
+    return array;
+}
+
+/**
+ * @brief Add an edge between two blocks
+ *
+ * @param layout The layout, with room for the edge
+ * @param from Block the edge leaves
+ * @param to Block the edge enters
+ * @return Index of the edge
+ */
+static uint32_t addEdge(Layout* layout, uint32_t from, uint32_t to)
+{
+    LayoutEdge* edge = layout->edges + layout->numEdges;
+    edge->from = from;
+    edge->to = to;
+    edge->known = false;
+    edge->weight = 0;
+    return layout->numEdges++;
+}
+
+/**
+ * @brief Split the program into basic blocks and connect them with edges
+ *
+ * @param layout The layout, with its arrays allocated
+ * @param counts Times control reached each offset
+ */
+static void findBlocks(Layout* layout, const uint64_t* const counts)
+{
+    uint32_t length = layout->length;
+    uint32_t* blockAt = layout->blockAt;
+    for (uint32_t pc = 0; pc <= length; pc++) {
+        *(blockAt + pc) = NO_BLOCK;
+    }
+    *blockAt = 0;  // marks a leader until the blocks are numbered
+    for (uint32_t pc = 0; pc < length; pc++) {
+        uint8_t instruction = *(layout->code + pc);
+        if (instruction & 0b10000000) {
+            int64_t target = jumpTarget(instruction, pc);
+            if (target >= 0 && target <= length) {
+                *(blockAt + target) = 0;
+            }
+            *(blockAt + pc + 1) = 0;
+        }
+    }
+    uint32_t numBlocks = 0;
+    for (uint32_t pc = 0; pc < length; pc++) {
+        if (*(blockAt + pc) != NO_BLOCK) {
+            (layout->blocks + numBlocks)->start = pc;
+            *(blockAt + pc) = numBlocks++;
+        }
+    }
+    *(blockAt + length) = numBlocks;
+    layout->numBlocks = numBlocks;
+    uint32_t exitBlock = numBlocks + 1;
+    uint32_t startBlock = numBlocks + 2;
+    LayoutBlock* endBlock = layout->blocks + numBlocks;
+    memset(endBlock, 0, sizeof(LayoutBlock));
+    endBlock->start = length;
+    endBlock->end = length;
+    endBlock->target = NO_BLOCK;
+    endBlock->fall = NO_BLOCK;
+    endBlock->jumpEdge = NO_EDGE;
+    endBlock->fallEdge = NO_EDGE;
+
+    layout->numEdges = 0;
+    addEdge(layout, startBlock, 0);
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        LayoutBlock* block = layout->blocks + i;
+        block->end = i + 1 < numBlocks ? (block + 1)->start : length;
+        uint32_t last = block->end - 1;
+        uint8_t instruction = *(layout->code + last);
+        block->target = NO_BLOCK;
+        block->fall = *(blockAt + block->end);
+        block->jumpEdge = NO_EDGE;
+        block->fallEdge = NO_EDGE;
+        block->glued = false;
+        if (instruction & 0b10000000) {
+            int64_t target = jumpTarget(instruction, last);
+            block->target = target >= 0 && target <= length ? *(blockAt + target) : exitBlock;
+            block->jumpEdge = addEdge(layout, i, block->target);
+            if (last == 0 || !isSkip(*(layout->code + last - 1))) {
+                block->fall = NO_BLOCK;  // always taken
+            }
+        } else {
+            block->glued = isSkip(instruction);
+        }
+        if (block->fall != NO_BLOCK) {
+            block->fallEdge = addEdge(layout, i, block->fall);
+        }
+        block->count = *(counts + block->start);
+        block->countKnown = block->count != LAYOUT_UNKNOWN_COUNT;
+    }
+
+    uint32_t numNodes = numBlocks + 3;
+    memset(layout->inStart, 0, (numNodes + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < layout->numEdges; i++) {
+        (*(layout->inStart + (layout->edges + i)->to + 1))++;
+    }
+    for (uint32_t i = 0; i < numNodes; i++) {
+        *(layout->inStart + i + 1) += *(layout->inStart + i);
+    }
+    uint32_t* filled = layout->positions;  // not needed until the program is laid out
+    memcpy(filled, layout->inStart, numNodes * sizeof(uint32_t));
+    for (uint32_t i = 0; i < layout->numEdges; i++) {
+        *(layout->inEdges + (*(filled + (layout->edges + i)->to))++) = i;
+    }
+}
+
+/**
+ * @brief Queue a block to have its counts worked out again
+ *
+ * @param layout The layout
+ * @param block The block, ignored if it is the end of the program or outside it
+ * @param numQueued Number of blocks in the worklist, increased if the block was added
+ */
+static void queueBlock(Layout* layout, uint32_t block, uint32_t* numQueued)
+{
+    if (block < layout->numBlocks && !*(layout->queued + block)) {
+        *(layout->queued + block) = true;
+        *(layout->worklist + (*numQueued)++) = block;
+    }
+}
+
+/**
+ * @brief Set the weight of an edge and queue both its blocks
+ *
+ * @param layout The layout
+ * @param edge The edge
+ * @param weight Times control went this way
+ * @param numQueued Number of blocks in the worklist
+ */
+static void setEdgeWeight(Layout* layout, uint32_t edge, uint64_t weight, uint32_t* numQueued)
+{
+    LayoutEdge* known = layout->edges + edge;
+    known->known = true;
+    known->weight = weight;
+    queueBlock(layout, known->from, numQueued);
+    queueBlock(layout, known->to, numQueued);
+}
+
+/**
+ * @brief Work out one unknown edge of a block from its count, if every other edge on that side is known
+ *
+ * @param layout The layout
+ * @param count Times control reached the block
+ * @param edges The block's edges on one side
+ * @param numEdges Number of edges on that side
+ * @param numQueued Number of blocks in the worklist
+ */
+static void solveEdges(Layout* layout, uint64_t count, const uint32_t* const edges, uint32_t numEdges, uint32_t* numQueued)
+{
+    uint64_t knownWeight = 0;
+    uint32_t unknown = NO_EDGE;
+    for (uint32_t i = 0; i < numEdges; i++) {
+        const LayoutEdge* edge = layout->edges + *(edges + i);
+        if (edge->known) {
+            knownWeight += edge->weight;
+        } else if (unknown == NO_EDGE) {
+            unknown = *(edges + i);
+        } else {
+            return;
+        }
+    }
+    if (unknown != NO_EDGE) {
+        setEdgeWeight(layout, unknown, count > knownWeight ? count - knownWeight : 0, numQueued);
+    }
+}
+
+/**
+ * @brief Sum the edges on one side of a block, if they are all known
+ *
+ * @param layout The layout
+ * @param edges The block's edges on that side
+ * @param numEdges Number of edges on that side
+ * @param sum Receives the sum
+ * @return true if there is at least one edge and every one is known
+ */
+static bool sumEdges(const Layout* const layout, const uint32_t* const edges, uint32_t numEdges, uint64_t* sum)
+{
+    *sum = 0;
+    for (uint32_t i = 0; i < numEdges; i++) {
+        const LayoutEdge* edge = layout->edges + *(edges + i);
+        if (!edge->known) {
+            return false;
+        }
+        *sum += edge->weight;
+    }
+    return numEdges > 0;
+}
+
+/**
+ * @brief Work out every count and edge weight that follows from the known ones, since control leaves a block as often
+ *        as it enters
+ *
+ * @param layout The layout, with every block queued
+ * @param numQueued Number of blocks in the worklist
+ */
+static void propagateCounts(Layout* layout, uint32_t numQueued)
+{
+    while (numQueued > 0) {
+        uint32_t i = *(layout->worklist + --numQueued);
+        *(layout->queued + i) = false;
+        LayoutBlock* block = layout->blocks + i;
+        uint32_t outEdges[2];
+        uint32_t numOut = 0;
+        if (block->jumpEdge != NO_EDGE) {
+            outEdges[numOut++] = block->jumpEdge;
+        }
+        if (block->fallEdge != NO_EDGE) {
+            outEdges[numOut++] = block->fallEdge;
+        }
+        const uint32_t* inEdges = layout->inEdges + *(layout->inStart + i);
+        uint32_t numIn = *(layout->inStart + i + 1) - *(layout->inStart + i);
+        if (!block->countKnown) {
+            if (!sumEdges(layout, outEdges, numOut, &block->count) && !sumEdges(layout, inEdges, numIn, &block->count)) {
+                continue;
+            }
+            block->countKnown = true;
+        }
+        solveEdges(layout, block->count, outEdges, numOut, &numQueued);
+        solveEdges(layout, block->count, inEdges, numIn, &numQueued);
+    }
+}
+
+/**
+ * @brief Estimate how often control went along every edge from the counts of the blocks
+ *
+ * @param layout The layout, with its blocks and edges found
+ */
+static void estimateWeights(Layout* layout)
+{
+    uint32_t numQueued = 0;
+    for (uint32_t i = layout->numBlocks; i-- > 0;) {
+        queueBlock(layout, i, &numQueued);  // popped in program order
+    }
+    propagateCounts(layout, numQueued);
+    // where the counts do not decide, a branch is assumed to go either way equally often
+    numQueued = 0;
+    for (uint32_t i = 0; i < layout->numBlocks; i++) {
+        LayoutBlock* block = layout->blocks + i;
+        if (!block->countKnown || block->jumpEdge == NO_EDGE || block->fallEdge == NO_EDGE) {
+            continue;
+        }
+        LayoutEdge* jump = layout->edges + block->jumpEdge;
+        LayoutEdge* fall = layout->edges + block->fallEdge;
+        if (!jump->known && !fall->known) {
+            setEdgeWeight(layout, block->jumpEdge, block->count / 2, &numQueued);
+            setEdgeWeight(layout, block->fallEdge, block->count - block->count / 2, &numQueued);
+        }
+    }
+    propagateCounts(layout, numQueued);
+    for (uint32_t i = 0; i < layout->numEdges; i++) {
+        if (!(layout->edges + i)->known) {
+            (layout->edges + i)->weight = 0;  // never reached by anything counted
+        }
+    }
+}
+
+/**
+ * @brief Order candidates by whether they are forced, then heaviest first, then falling through before removing a
+ *        JUMP, then in program order
+ *
+ * @param a The first candidate
+ * @param b The second candidate
+ * @return Negative if a comes first, positive if b does
+ */
+static int compareCandidates(const void* a, const void* b)
+{
+    const LayoutCandidate* first = (const LayoutCandidate*)a;
+    const LayoutCandidate* second = (const LayoutCandidate*)b;
+    if (first->forced != second->forced) {
+        return first->forced ? -1 : 1;
+    }
+    if (first->weight != second->weight) {
+        return first->weight > second->weight ? -1 : 1;
+    }
+    if (first->falls != second->falls) {
+        return first->falls ? -1 : 1;
+    }
+    return first->from < second->from ? -1 : first->from > second->from;
+}
+
+/**
+ * @brief List every block that could be placed after another for free, heaviest first
+ *
+ * @param layout The layout, with its weights estimated
+ */
+static void findCandidates(Layout* layout)
+{
+    layout->numCandidates = 0;
+    for (uint32_t i = 0; i < layout->numBlocks; i++) {
+        const LayoutBlock* block = layout->blocks + i;
+        uint32_t to = NO_BLOCK;
+        uint32_t edge = NO_EDGE;
+        if (block->fall != NO_BLOCK) {
+            to = block->fall;
+            edge = block->fallEdge;
+        } else if (block->target <= layout->numBlocks) {
+            to = block->target;
+            edge = block->jumpEdge;
+        }
+        if (to == NO_BLOCK || to == 0 || to == i) {
+            continue;  // the first block stays first
+        }
+        LayoutCandidate* candidate = layout->candidates + layout->numCandidates++;
+        candidate->from = i;
+        candidate->to = to;
+        candidate->weight = (layout->edges + edge)->weight;
+        candidate->falls = block->fall != NO_BLOCK;
+        candidate->forced = block->glued;
+    }
+    qsort(layout->candidates, layout->numCandidates, sizeof(LayoutCandidate), compareCandidates);
+}
+
+/**
+ * @brief Find the chain a block is in
+ *
+ * @param layout The layout
+ * @param block The block
+ * @return The block that stands for its chain
+ */
+static uint32_t findChain(Layout* layout, uint32_t block)
+{
+    while (*(layout->parent + block) != block) {
+        *(layout->parent + block) = *(layout->parent + *(layout->parent + block));  // path halving
+        block = *(layout->parent + block);
+    }
+    return block;
+}
+
+/**
+ * @brief Chain blocks along the first candidates that fit, and order the chains
+ *
+ * The chains keep the order of the blocks they start with, except that the one ending the program goes last.
+ *
+ * @param layout The layout
+ * @param numCandidates Number of candidates to use, skipped ones aside
+ */
+static void buildOrder(Layout* layout, uint32_t numCandidates)
+{
+    uint32_t numBlocks = layout->numBlocks;
+    for (uint32_t i = 0; i <= numBlocks; i++) {
+        *(layout->next + i) = NO_BLOCK;
+        *(layout->prev + i) = NO_BLOCK;
+        *(layout->parent + i) = i;
+        *(layout->chainFlags + i) = 0;
+    }
+    *layout->chainFlags |= CHAIN_ENTRY;
+    *(layout->chainFlags + numBlocks) |= CHAIN_END;
+    for (uint32_t i = 0; i < numCandidates; i++) {
+        const LayoutCandidate* candidate = layout->candidates + i;
+        if (*(layout->skipped + i) || *(layout->next + candidate->from) != NO_BLOCK || *(layout->prev + candidate->to) != NO_BLOCK) {
+            continue;
+        }
+        uint32_t from = findChain(layout, candidate->from);
+        uint32_t to = findChain(layout, candidate->to);
+        uint8_t flags = *(layout->chainFlags + from) | *(layout->chainFlags + to);
+        if (from == to || (flags == (CHAIN_ENTRY | CHAIN_END) && !candidate->forced)) {
+            continue;  // a loop, or nowhere left for the chains in between
+        }
+        *(layout->next + candidate->from) = candidate->to;
+        *(layout->prev + candidate->to) = candidate->from;
+        *(layout->parent + to) = from;
+        *(layout->chainFlags + from) = flags;
+    }
+    uint32_t numOrdered = 0;
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        if (*(layout->prev + i) == NO_BLOCK && !(*(layout->chainFlags + findChain(layout, i)) & CHAIN_END)) {
+            for (uint32_t block = i; block != NO_BLOCK; block = *(layout->next + block)) {
+                *(layout->order + numOrdered++) = block;
+            }
+        }
+    }
+    uint32_t head = numBlocks;
+    while (*(layout->prev + head) != NO_BLOCK) {
+        head = *(layout->prev + head);
+    }
+    for (uint32_t block = head; block != NO_BLOCK; block = *(layout->next + block)) {
+        *(layout->order + numOrdered++) = block;
+    }
+}
+
+/**
+ * @brief Write the blocks in their order, dropping JUMPs to the next block and adding JUMPs to blocks no longer
+ *        fallen through to
+ *
+ * @param layout The layout, with its order built
+ * @return true if every JUMP reaches its target and the program fits in maxLength
+ */
+static bool encodeOrder(Layout* layout)
+{
+    uint32_t numBlocks = layout->numBlocks;
+    uint32_t position = 0;
+    for (uint32_t k = 0; k < numBlocks; k++) {
+        const LayoutBlock* block = layout->blocks + *(layout->order + k);
+        uint32_t next = *(layout->order + k + 1);
+        *(layout->positions + *(layout->order + k)) = position;
+        position += block->end - block->start;
+        position -= block->fall == NO_BLOCK && block->target == next;
+        position += block->fall != NO_BLOCK && block->fall != next;
+        if (position > layout->maxLength) {
+            return false;
+        }
+    }
+    uint32_t length = position;
+    *(layout->positions + numBlocks) = length;
+    layout->cycles = 0;
+    layout->jumpsRemoved = 0;
+    layout->jumpsAdded = 0;
+    position = 0;
+    for (uint32_t k = 0; k < numBlocks; k++) {
+        uint32_t i = *(layout->order + k);
+        const LayoutBlock* block = layout->blocks + i;
+        uint32_t next = *(layout->order + k + 1);
+        uint32_t last = block->end - 1;
+        for (uint32_t pc = block->start; pc <= last; pc++) {
+            *(layout->offsetMap + pc) = position;
+            uint8_t instruction = *(layout->code + pc);
+            if (pc < last || block->target == NO_BLOCK) {
+                *(layout->origins + position) = pc;
+                *(layout->output + position++) = instruction;
+                continue;
+            }
+            if (block->fall == NO_BLOCK && block->target == next) {
+                layout->jumpsRemoved++;
+                continue;  // mapped to the next block, which is where it went
+            }
+            int64_t target;
+            if (block->target <= numBlocks) {
+                target = *(layout->positions + block->target);
+            } else {
+                target = jumpTarget(instruction, position);
+                target = target < 0 || target > length ? target : length;  // still leaves, or goes to the end
+            }
+            int64_t offset = target - position;
+            if (target >= 0 && target <= length && (offset < JUMP_MIN_OFFSET || offset > JUMP_MAX_OFFSET)) {
+                return false;
+            }
+            layout->cycles += (layout->edges + block->jumpEdge)->weight;
+            *(layout->origins + position) = pc;
+            *(layout->output + position) = (uint8_t)(0b10000000 | ((uint8_t)offset & 0b1111111));
+            position++;
+        }
+        if (block->fall != NO_BLOCK && block->fall != next) {
+            int64_t offset = (int64_t)*(layout->positions + block->fall) - position;
+            if (offset < JUMP_MIN_OFFSET || offset > JUMP_MAX_OFFSET) {
+                return false;
+            }
+            layout->cycles += (layout->edges + block->fallEdge)->weight;
+            layout->jumpsAdded++;
+            *(layout->origins + position) = last;
+            *(layout->output + position++) = (uint8_t)(0b10000000 | ((uint8_t)offset & 0b1111111));
+        }
+    }
+    *(layout->offsetMap + layout->length) = length;
+    layout->outputLength = length;
+    return true;
+}
+
+/**
+ * @brief Lay the program out along the first candidates, skipped ones aside
+ *
+ * @param layout The layout
+ * @param numCandidates Number of candidates to use
+ * @return true if the result fits, see encodeOrder
+ */
+static bool tryCandidates(Layout* layout, uint32_t numCandidates)
+{
+    buildOrder(layout, numCandidates);
+    return encodeOrder(layout);
+}
+
+/**
+ * @brief Reorder the basic blocks of an assembled program so the paths it runs most fall through
+ *
+ * Blocks end at every JUMP and before every JUMP target. A JUMP right after a SKIP is a two-way branch: the SKIP can
+ * only skip on equality, so the JUMP stays and runs whenever the SKIP does not skip, and only the block after it can be
+ * placed for free. An unconditional JUMP disappears when its target is placed after it, and a block that used to be
+ * fallen through to gets a JUMP if it is placed elsewhere. How often each branch goes each way is worked out from the
+ * block counts by flow conservation, splitting evenly where the counts do not decide. Blocks are chained along the
+ * heaviest branches first and the chains kept in source order, skipping any branch whose placement would put a JUMP
+ * out of range or the program over maxLength, so the result always assembles. The first block stays first and a SKIP
+ * always stays before the instruction it may skip.
+ *
+ * @param code The program, rewritten in place
+ * @param counts Times control reached each offset, up to and including the program length, LAYOUT_UNKNOWN_COUNT
+ *               where unknown
+ * @param maxLength Longest the program may become, at least its current length
+ * @param offsetMap Receives the new offset of each old offset (a JUMP removed maps to the instruction that replaces
+ *                  it), and the new length after the old length, so needs room for length + 1 entries, may be NULL
+ * @param origins Receives the old offset of the instruction at each new offset, or of the end of the block an added
+ *                JUMP leaves, so needs room for maxLength entries, may be NULL
+ * @param stats Receives what was moved and the estimated cycles, may be NULL
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY and code is unchanged
+ */
+uint8_t layoutCode(CodeBuffer* code, const uint64_t* const counts, uint32_t maxLength, uint32_t* offsetMap, uint32_t* origins, LayoutStats* stats)
+{
+    Layout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.code = code->data;
+    layout.length = (uint32_t)code->length;
+    layout.maxLength = maxLength > layout.length ? maxLength : layout.length;
+    size_t numNodes = (size_t)layout.length + 3;  // at most one block per instruction, the end, out and in
+    size_t numEdges = 2 * (size_t)layout.length + 1;
+    layout.blocks = (LayoutBlock*)allocateLayoutArray(numNodes, sizeof(LayoutBlock));
+    layout.blockAt = (uint32_t*)allocateLayoutArray(numNodes, sizeof(uint32_t));
+    layout.edges = (LayoutEdge*)allocateLayoutArray(numEdges, sizeof(LayoutEdge));
+    layout.inStart = (uint32_t*)allocateLayoutArray(numNodes + 1, sizeof(uint32_t));
+    layout.inEdges = (uint32_t*)allocateLayoutArray(numEdges, sizeof(uint32_t));
+    layout.worklist = (uint32_t*)allocateLayoutArray(numNodes, sizeof(uint32_t));
+    layout.queued = (bool*)allocateLayoutArray(numNodes, sizeof(bool));
+    layout.candidates = (LayoutCandidate*)allocateLayoutArray(numNodes, sizeof(LayoutCandidate));
+    layout.skipped = (bool*)allocateLayoutArray(numNodes, sizeof(bool));
+    layout.next = (uint32_t*)allocateLayoutArray(numNodes, sizeof(uint32_t));
+    layout.prev = (uint32_t*)allocateLayoutArray(numNodes, sizeof(uint32_t));
+    layout.parent = (uint32_t*)allocateLayoutArray(numNodes, sizeof(uint32_t));
+    layout.chainFlags = (uint8_t*)allocateLayoutArray(numNodes, sizeof(uint8_t));
+    layout.order = (uint32_t*)allocateLayoutArray(numNodes, sizeof(uint32_t));
+    layout.positions = (uint32_t*)allocateLayoutArray(numNodes, sizeof(uint32_t));
+    layout.output = (uint8_t*)allocateLayoutArray(layout.maxLength, sizeof(uint8_t));
+    layout.offsetMap = (uint32_t*)allocateLayoutArray((size_t)layout.length + 1, sizeof(uint32_t));
+    layout.origins = (uint32_t*)allocateLayoutArray(layout.maxLength, sizeof(uint32_t));
+    if (layout.blocks == NULL || layout.blockAt == NULL || layout.edges == NULL || layout.inStart == NULL || layout.inEdges == NULL || layout.worklist == NULL || layout.queued == NULL || layout.candidates == NULL || layout.skipped == NULL || layout.next == NULL || layout.prev == NULL || layout.parent == NULL || layout.chainFlags == NULL || layout.order == NULL || layout.positions == NULL || layout.output == NULL || layout.offsetMap == NULL || layout.origins == NULL || !reserveCode(code, layout.maxLength)) {
+        freeLayout(&layout);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    layout.code = code->data;  // reserving may have moved it
+
+    uint64_t cyclesBefore = 0;
+    uint32_t placementsSkipped = 0;
+    if (layout.length > 0) {
+        findBlocks(&layout, counts);
+        estimateWeights(&layout);
+        for (uint32_t i = 0; i < layout.numBlocks; i++) {
+            const LayoutBlock* block = layout.blocks + i;
+            cyclesBefore += block->jumpEdge != NO_EDGE ? (layout.edges + block->jumpEdge)->weight : 0;
+        }
+        findCandidates(&layout);
+        // every prefix of the candidates that fits is kept, and the candidate that first breaks it is skipped. The
+        // program as assembled fits, and so does it with only the SKIPs kept in place, so there is always a fit to
+        // fall back to. Each skip costs a few layouts of the whole program, so past LAYOUT_MAX_SKIPS the rest of the
+        // candidates are skipped at once
+        uint32_t fits = 0;
+        while (!tryCandidates(&layout, layout.numCandidates)) {
+            uint32_t breaks = layout.numCandidates;
+            while (breaks - fits > 1) {
+                uint32_t middle = fits + (breaks - fits) / 2;
+                if (tryCandidates(&layout, middle)) {
+                    fits = middle;
+                } else {
+                    breaks = middle;
+                }
+            }
+            if (placementsSkipped == LAYOUT_MAX_SKIPS) {
+                memset(layout.skipped + fits, true, (layout.numCandidates - fits) * sizeof(bool));
+                placementsSkipped += layout.numCandidates - fits;
+            } else {
+                *(layout.skipped + fits) = true;
+                placementsSkipped++;
+                fits++;
+            }
+        }
+        if (layout.cycles > cyclesBefore) {
+            // the estimates can make a worse order look better, so the source order is kept
+            memset(layout.skipped, true, layout.numCandidates * sizeof(bool));
+            tryCandidates(&layout, layout.numCandidates);
+        }
+        memcpy(code->data, layout.output, layout.outputLength);
+        code->length = layout.outputLength;
+    }
+    if (offsetMap != NULL) {
+        memcpy(offsetMap, layout.offsetMap, ((size_t)layout.length + 1) * sizeof(uint32_t));
+    }
+    if (origins != NULL) {
+        memcpy(origins, layout.origins, (size_t)layout.outputLength * sizeof(uint32_t));
+    }
+    if (stats != NULL) {
+        stats->blocks = layout.numBlocks;
+        stats->jumpsRemoved = layout.jumpsRemoved;
+        stats->jumpsAdded = layout.jumpsAdded;
+        stats->placementsSkipped = placementsSkipped;
+        stats->cyclesBefore = cyclesBefore;
+        stats->cyclesAfter = layout.cycles;
+    }
+    freeLayout(&layout);
+    return 0;
+}
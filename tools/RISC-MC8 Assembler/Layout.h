@@ -0,0 +1,61 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <inttypes.h>
+
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "LineTable.h"
+#include "Source.h"
+
+#define LAYOUT_UNKNOWN_COUNT UINT64_MAX  // no count for this offset, it is worked out from the counts around it
+
+typedef struct _LayoutStats {
+    uint32_t blocks;
+    uint32_t jumpsRemoved;  // JUMPs to the block now after them
+    uint32_t jumpsAdded;    // JUMPs to a block that used to be fallen through to, now placed elsewhere
+    uint32_t placementsSkipped;  // hot paths left as they were, since following them put a JUMP out of range or
+                                 // the program over the ROM
+    uint64_t cyclesBefore;  // estimated cycles spent executing JUMPs, as assembled
+    uint64_t cyclesAfter;   // and as laid out
+} LayoutStats;
+
+/**
+ * @brief Read how often control reached each label, one `label count` pair per line, # starting a comment
+ *
+ * @param file The execution count file, as written by `emulate-risc-mc8 --label-counts`
+ * @param table Line table of the program, for the offset of every label
+ * @param counts Receives the count of each labelled offset, needs room for the table length + 1 entries which should
+ *               start as LAYOUT_UNKNOWN_COUNT
+ * @param unknownLabels Receives the number of labels in the file that are not in the program
+ * @param diagnostic Set to the error and the line of the file it occurred on if one occurs, may be NULL
+ * @return 0 if successful, ERROR_MALFORMED_COUNTS if a line is not a label and a count, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t readLabelCounts(SourceReader* file, const LineTable* const table, uint64_t* counts, uint32_t* unknownLabels, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Reorder the basic blocks of an assembled program so the paths it runs most fall through
+ *
+ * Blocks end at every JUMP and before every JUMP target. A JUMP right after a SKIP is a two-way branch: the SKIP can
+ * only skip on equality, so the JUMP stays and runs whenever the SKIP does not skip, and only the block after it can be
+ * placed for free. An unconditional JUMP disappears when its target is placed after it, and a block that used to be
+ * fallen through to gets a JUMP if it is placed elsewhere. How often each branch goes each way is worked out from the
+ * block counts by flow conservation, splitting evenly where the counts do not decide. Blocks are chained along the
+ * heaviest branches first and the chains kept in source order, skipping any branch whose placement would put a JUMP
+ * out of range or the program over maxLength, so the result always assembles. The first block stays first and a SKIP
+ * always stays before the instruction it may skip.
+ *
+ * @param code The program, rewritten in place
+ * @param counts Times control reached each offset, up to and including the program length, LAYOUT_UNKNOWN_COUNT
+ *               where unknown
+ * @param maxLength Longest the program may become, at least its current length
+ * @param offsetMap Receives the new offset of each old offset (a JUMP removed maps to the instruction that replaces
+ *                  it), and the new length after the old length, so needs room for length + 1 entries, may be NULL
+ * @param origins Receives the old offset of the instruction at each new offset, or of the end of the block an added
+ *                JUMP leaves, so needs room for maxLength entries, may be NULL
+ * @param stats Receives what was moved and the estimated cycles, may be NULL
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY and code is unchanged
+ */
+uint8_t layoutCode(CodeBuffer* code, const uint64_t* const counts, uint32_t maxLength, uint32_t* offsetMap, uint32_t* origins, LayoutStats* stats);
+
+#endif
@@ -0,0 +1,153 @@
+#include "Lexer.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "StatusCodes.h"
+
+/**
+ * @param c Character to test
+ * @return true if c separates tokens, false otherwise
+ */
+static inline bool isSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+/**
+ * @brief Split a line into tokens and classify it, without copying or allocating
+ *
+ * @param result Where to write the lexed line
+ * @param line The line to lex, does not need to be NUL terminated
+ * @param length Number of characters in line
+ */
+void lexLine(SourceLine* result, const char* const line, uint32_t length)
+{
+    result->text = line;
+    result->errorAt = NULL;
+    result->kind = LINE_KIND_EMPTY;
+    result->status = 0;
+    result->tokenCount = 0;
+    result->tooManyTokens = false;
+
+    uint32_t pos = 0;
+    while (pos < length && isSeparator(*(line + pos))) {  // get to potential start of label
+        pos++;
+    }
+
+    // a label runs up to a : that comes before any whitespace or comment
+    uint32_t end = pos;
+    while (end < length && !isSeparator(*(line + end)) && *(line + end) != '#' && *(line + end) != ':') {
+        end++;
+    }
+    if (end < length && *(line + end) == ':') {
+        if (end == pos) {
+            return;  // a lone : has never been a label or an instruction
+        }
+        result->kind = LINE_KIND_LABEL;
+        result->tokens[0].start = line + pos;
+        result->tokens[0].length = end - pos;
+        result->tokenCount = 1;
+        // make sure it's not followed by an instruction - whitespace until # or end of line
+        uint32_t verifyPos = end + 1;
+        if (verifyPos < length && !isSeparator(*(line + verifyPos))) {
+            result->status = ERROR_NO_SPACE_AFTER_LABEL;
+            result->errorAt = line + verifyPos;
+            return;
+        }
+        while (verifyPos < length && isSeparator(*(line + verifyPos))) {
+            verifyPos++;
+        }
+        if (verifyPos < length && *(line + verifyPos) != '#') {
+            result->status = ERROR_INSTRUCTION_FOLLOWS_LABEL;
+            result->errorAt = line + verifyPos;
+        }
+        return;
+    }
+
+    // otherwise it's an instruction, split on whitespace up to any comment
+    uint8_t maxTokens = 2;
+    while (pos < length && *(line + pos) != '#') {
+        uint32_t tokenEnd = pos;
+        while (tokenEnd < length && !isSeparator(*(line + tokenEnd)) && *(line + tokenEnd) != '#') {
+            tokenEnd++;
+        }
+        if (result->tokenCount == 1 && result->tokens[0].length == 2 && tokenEquals(&result->tokens[0], "li")) {
+            maxTokens = 3;  // `li reg value`
+        }
+        if (result->tokenCount == maxTokens) {
+            result->tooManyTokens = true;  // error on `addi 000 000`
+            result->errorAt = line + pos;
+            break;
+        }
+        result->tokens[result->tokenCount].start = line + pos;
+        result->tokens[result->tokenCount].length = tokenEnd - pos;
+        result->tokenCount++;
+        pos = tokenEnd;
+        while (pos < length && isSeparator(*(line + pos))) {
+            pos++;
+        }
+    }
+    if (result->tokenCount > 0) {
+        result->kind = *result->tokens[0].start == '.' ? LINE_KIND_DIRECTIVE : LINE_KIND_INSTRUCTION;
+    }
+}
+
+/**
+ * @brief Find the column an error returned while lexing or parsing a line points at
+ *
+ * @param line The lexed line the error came from
+ * @param status The error that occurred
+ * @return 1-based column of the offending token, or 0 if the error is not tied to a token
+ */
+uint32_t getStatusColumn(const SourceLine* const line, uint8_t status)
+{
+    const char* at = NULL;
+    switch (status) {
+        case ERROR_NO_SPACE_AFTER_LABEL:
+        case ERROR_INSTRUCTION_FOLLOWS_LABEL:
+        case ERROR_TOO_MANY_TOKENS:
+            at = line->errorAt;
+            break;
+        case ERROR_UNKNOWN_MNEMONIC:
+        case ERROR_UNKNOWN_DIRECTIVE:
+        case ERROR_DUPLICATE_LABEL:
+        case ERROR_MISSING_INSTRUCTION_PARAMETER:
+            at = line->tokenCount > 0 ? line->tokens[0].start : NULL;
+            break;
+        case ERROR_VALUE_OUT_OF_RANGE:
+        case ERROR_INVALID_NUMBER:
+        case ERROR_INVALID_BINARY_STRING_CHARACTER:
+        case ERROR_INVALID_BINARY_STRING_LENGTH:
+        case ERROR_JUMP_INTO_LOAD_IMMEDIATE:
+            at = line->tokenCount > 1 ? line->tokens[line->tokenCount - 1].start : NULL;  // the value is always last
+            break;
+        case ERROR_EXPANSION_AFTER_SKIP:
+            at = line->tokenCount > 0 ? line->tokens[0].start : NULL;
+            break;
+        case ERROR_UNKNOWN_REGISTER:
+        case ERROR_UNKNOWN_LABEL:
+        case STATUS_UNRESOLVED_SYMBOL:
+            at = line->tokenCount > 1 ? line->tokens[1].start : NULL;
+            break;
+    }
+    return at == NULL ? 0 : (uint32_t)(at - line->text) + 1;
+}
+
+/**
+ * @brief Compare a token against a lowercase string, ignoring case in the token
+ *
+ * @param token The token to compare
+ * @param lower NUL terminated lowercase string
+ * @return true if they are equal, false otherwise
+ */
+bool tokenEquals(const Token* const token, const char* const lower)
+{
+    for (uint32_t i = 0; i < token->length; i++) {
+        if (*(lower + i) == '\0' || toLowerAscii(*(token->start + i)) != *(lower + i)) {
+            return false;
+        }
+    }
+    return *(lower + token->length) == '\0';
+}
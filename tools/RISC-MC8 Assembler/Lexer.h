@@ -0,0 +1,73 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#define LINE_KIND_EMPTY 0
+#define LINE_KIND_LABEL 1
+#define LINE_KIND_INSTRUCTION 2
+#define LINE_KIND_DIRECTIVE 3
+
+/**
+ * A span of characters inside a source line. Tokens are never copied or NUL terminated.
+ */
+typedef struct _Token {
+    const char* start;
+    uint32_t length;
+} Token;
+
+/**
+ * A lexed source line. For a label, tokens[0] is the label name; for an instruction, tokens[0] is the mnemonic and
+ * tokens[1] (if present) is the operand. A directive is an instruction whose mnemonic starts with a `.`, such as
+ * `.global name`. Only the li pseudo-instruction takes a second operand, in tokens[2].
+ */
+typedef struct _SourceLine {
+    const char* text;     // start of the line, for turning token positions into columns
+    const char* errorAt;  // where the lexing error or the extra token starts, NULL if none
+    uint8_t kind;
+    uint8_t status;  // error found while lexing a label, 0 if none
+    uint8_t tokenCount;
+    bool tooManyTokens;
+    Token tokens[3];
+} SourceLine;
+
+/**
+ * @brief Lowercase an ASCII character, leaving everything else unchanged
+ *
+ * @param c Character to lowercase
+ * @return The lowercase character
+ */
+static inline char toLowerAscii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/**
+ * @brief Split a line into tokens and classify it, without copying or allocating
+ *
+ * @param result Where to write the lexed line
+ * @param line The line to lex, does not need to be NUL terminated
+ * @param length Number of characters in line
+ */
+void lexLine(SourceLine* result, const char* const line, uint32_t length);
+
+/**
+ * @brief Find the column an error returned while lexing or parsing a line points at
+ *
+ * @param line The lexed line the error came from
+ * @param status The error that occurred
+ * @return 1-based column of the offending token, or 0 if the error is not tied to a token
+ */
+uint32_t getStatusColumn(const SourceLine* const line, uint8_t status);
+
+/**
+ * @brief Compare a token against a lowercase string, ignoring case in the token
+ *
+ * @param token The token to compare
+ * @param lower NUL terminated lowercase string
+ * @return true if they are equal, false otherwise
+ */
+bool tokenEquals(const Token* const token, const char* const lower);
+
+#endif
@@ -0,0 +1,421 @@
+#include "LineTable.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AssemblerStats.h"
+#include "CodeBuffer.h"
+#include "Lexer.h"
+#include "LoadImmediate.h"
+#include "StatusCodes.h"
+
+#define LINE_TABLE_HEADER_LENGTH 20
+#define LINE_TABLE_LABEL_HEADER_LENGTH 12
+
+/**
+ * @brief Start an empty table
+ *
+ * @param table The table to initialize
+ */
+void initLineTable(LineTable* table)
+{
+    memset(table, 0, sizeof(LineTable));
+}
+
+void freeLineTable(LineTable* table)
+{
+    for (uint32_t i = 0; i < table->numLabels; i++) {
+        free((table->labels + i)->name);
+    }
+    free(table->labels);
+    free(table->lines);
+    free(table->sourcePath);
+    initLineTable(table);
+}
+
+/**
+ * @brief Copy some characters into a new NUL terminated string
+ *
+ * @param text The characters to copy
+ * @param length Number of characters
+ * @return The copy, or NULL if out of memory
+ */
+static char* copyString(const char* const text, uint32_t length)
+{
+    char* copy = (char*)malloc((size_t)length + 1);
+    if (copy != NULL) {
+        memcpy(copy, text, length);
+        *(copy + length) = '\0';
+        countAllocation((size_t)length + 1);
+    }
+    return copy;
+}
+
+/**
+ * @brief Add the line of the next instruction
+ *
+ * @param table Table to add to
+ * @param line Source line of the instruction
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t addInstructionLine(LineTable* table, uint32_t line)
+{
+    if (table->length == table->capacity) {
+        uint32_t newCapacity = table->capacity == 0 ? 256 : table->capacity * 2;
+        uint32_t* grown = (uint32_t*)realloc(table->lines, newCapacity * sizeof(uint32_t));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        countAllocation(newCapacity * sizeof(uint32_t));
+        table->lines = grown;
+        table->capacity = newCapacity;
+    }
+    *(table->lines + table->length++) = line;
+    return 0;
+}
+
+/**
+ * @brief Add a label, labels must be added in offset order
+ *
+ * @param table Table to add to
+ * @param name Name of the label, copied by the table
+ * @param length Number of characters in name
+ * @param offset Offset the label points at
+ * @param line Line the label is defined on
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t addLineTableLabel(LineTable* table, const char* const name, uint32_t length, uint32_t offset, uint32_t line)
+{
+    if (table->numLabels == table->labelCapacity) {
+        uint32_t newCapacity = table->labelCapacity == 0 ? 16 : table->labelCapacity * 2;
+        LineTableLabel* grown = (LineTableLabel*)realloc(table->labels, newCapacity * sizeof(LineTableLabel));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        countAllocation(newCapacity * sizeof(LineTableLabel));
+        table->labels = grown;
+        table->labelCapacity = newCapacity;
+    }
+    LineTableLabel* added = table->labels + table->numLabels;
+    added->name = copyString(name, length);
+    if (added->name == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    added->offset = offset;
+    added->line = line;
+    table->numLabels++;
+    return 0;
+}
+
+/**
+ * @brief Add every line of a source to a table
+ *
+ * @param source The source, read from its current position
+ * @param table The table, without lines or labels yet
+ * @param landings Where JUMPs by a number land, added to as they are found
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t addSourceLines(SourceReader* source, LineTable* table, JumpLandings* landings)
+{
+    LineSizer sizer;
+    initLineSizer(&sizer, NULL, source->data == NULL, landings);
+    uint8_t status = 0;
+    const char* text;
+    uint32_t length;
+    SourceLine line;
+    while (status == 0 && readSourceLine(source, &text, &length)) {
+        lexLine(&line, text, length);
+        uint32_t count = sizeSourceLine(&sizer, &line);
+        for (uint32_t i = 0; status == 0 && i < count; i++) {
+            status = addInstructionLine(table, source->lineNumber);
+        }
+        if (line.kind == LINE_KIND_LABEL) {
+            status = addLineTableLabel(table, line.tokens[0].start, line.tokens[0].length, table->length, source->lineNumber);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Build the table of a source that assembled successfully
+ *
+ * Every instruction line assembles to one byte, or a few for li, so the table only needs the lexer and a LineSizer and
+ * is the same whichever mode assembled the source. Like the two-pass path it sizes again if a JUMP by a number lands
+ * behind an li that relied on known values.
+ *
+ * @param source The source, read from its current position, which must be the beginning if it is rewindable
+ * @param sourcePath Path to record for annotating the source later, may be NULL
+ * @param table Empty table to fill in
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t buildLineTable(SourceReader* source, const char* const sourcePath, LineTable* table)
+{
+    if (sourcePath != NULL) {
+        table->sourcePath = copyString(sourcePath, (uint32_t)strlen(sourcePath));
+        if (table->sourcePath == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+    }
+    JumpLandings landings = {NULL, 0, 0, 0, 0, false, false};
+    uint8_t status = addSourceLines(source, table, &landings);
+    if (status == 0 && landings.unsettled && rewindSource(source)) {
+        settleJumpLandings(source, &landings);
+        for (uint32_t i = 0; i < table->numLabels; i++) {
+            free((table->labels + i)->name);
+        }
+        table->numLabels = 0;
+        table->length = 0;
+        status = addSourceLines(source, table, &landings);
+    }
+    freeJumpLandings(&landings);
+    return status;
+}
+
+/**
+ * @brief Move every entry to where an optimizer put its instruction, dropping the lines of instructions it removed
+ *
+ * @param table The table of the source as written
+ * @param offsetMap New offset of each old offset, up to and including the old length, see optimizeCode
+ */
+void remapLineTable(LineTable* table, const uint32_t* const offsetMap)
+{
+    for (uint32_t i = 0; i < table->length; i++) {
+        if (*(offsetMap + i) != *(offsetMap + i + 1)) {
+            *(table->lines + *(offsetMap + i)) = *(table->lines + i);  // never ahead of i, so nothing is overwritten early
+        }
+    }
+    for (uint32_t i = 0; i < table->numLabels; i++) {
+        (table->labels + i)->offset = *(offsetMap + (table->labels + i)->offset);
+    }
+    table->length = *(offsetMap + table->length);
+}
+
+/**
+ * @brief Order labels by offset, then by line
+ *
+ * @param a The first label
+ * @param b The second label
+ * @return Negative if a comes first, positive if b does
+ */
+static int compareLabelOffsets(const void* a, const void* b)
+{
+    const LineTableLabel* first = (const LineTableLabel*)a;
+    const LineTableLabel* second = (const LineTableLabel*)b;
+    if (first->offset != second->offset) {
+        return first->offset < second->offset ? -1 : 1;
+    }
+    return first->line < second->line ? -1 : first->line > second->line;
+}
+
+/**
+ * @brief Move every entry to where a pass that reorders or inserts code put its instruction
+ *
+ * @param table The table of the program before the pass
+ * @param offsetMap New offset of each old offset, up to and including the old length
+ * @param origins Old offset of the instruction at each new offset, inserted code taking the line of what it was
+ *                inserted for
+ * @param length Length of the program after the pass
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY (the table is unchanged)
+ */
+uint8_t reorderLineTable(LineTable* table, const uint32_t* const offsetMap, const uint32_t* const origins, uint32_t length)
+{
+    uint32_t capacity = length > 0 ? length : 1;
+    uint32_t* lines = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    if (lines == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    countAllocation(capacity * sizeof(uint32_t));
+    for (uint32_t i = 0; i < length; i++) {
+        *(lines + i) = *(table->lines + *(origins + i));
+    }
+    for (uint32_t i = 0; i < table->numLabels; i++) {
+        (table->labels + i)->offset = *(offsetMap + (table->labels + i)->offset);
+    }
+    qsort(table->labels, table->numLabels, sizeof(LineTableLabel), compareLabelOffsets);  // blocks may have moved
+    free(table->lines);
+    table->lines = lines;
+    table->length = length;
+    table->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Move every entry to where relaxation put its instruction, giving each inserted JUMP the line of the JUMP it
+ *        was added for
+ *
+ * @param table The table of the source as written
+ * @param report The report of relaxJumps, with its offset maps
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY (the table is unchanged)
+ */
+uint8_t relaxLineTable(LineTable* table, const RelaxationReport* const report)
+{
+    if (report->offsetMap == NULL || report->oldLength != table->length) {
+        return 0;  // nothing was inserted, or the table is not of this program
+    }
+    return reorderLineTable(table, report->offsetMap, report->origins, report->length);
+}
+
+/**
+ * @brief Write a 32-bit value in little-endian order
+ *
+ * @param dest Where to write the 4 bytes
+ * @param value The value to write
+ */
+static void putTableUint32(uint8_t* dest, uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; i++) {
+        *(dest + i) = (uint8_t)(value >> (i * 8));
+    }
+}
+
+/**
+ * @brief Read a 32-bit value in little-endian order
+ *
+ * @param src The 4 bytes to read
+ * @return The value
+ */
+static uint32_t getTableUint32(const uint8_t* const src)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        value |= (uint32_t)*(src + i) << (i * 8);
+    }
+    return value;
+}
+
+/**
+ * @brief Write a table in the line table format
+ *
+ * @param outputFile Where to write the table
+ * @param table The table to write
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the file could not be written
+ */
+uint8_t writeLineTable(FILE* outputFile, const LineTable* const table)
+{
+    uint32_t pathLength = table->sourcePath == NULL ? 0 : (uint32_t)strlen(table->sourcePath);
+    uint8_t header[LINE_TABLE_HEADER_LENGTH];
+    memcpy(header, LINE_TABLE_MAGIC, 7);
+    header[7] = LINE_TABLE_FORMAT_VERSION;
+    putTableUint32(header + 8, table->length);
+    putTableUint32(header + 12, table->numLabels);
+    putTableUint32(header + 16, pathLength);
+    bool written = fwrite(header, 1, LINE_TABLE_HEADER_LENGTH, outputFile) == LINE_TABLE_HEADER_LENGTH;
+    written = written && fwrite(table->sourcePath, 1, pathLength, outputFile) == pathLength;
+
+    // the deltas go through a buffer, one fwrite per byte would dominate on large programs
+    CodeBuffer deltas;
+    initGrowableCodeBuffer(&deltas);
+    uint32_t previous = 0;
+    for (uint32_t i = 0; i < table->length && written; i++) {
+        uint32_t delta = *(table->lines + i) - previous;
+        previous = *(table->lines + i);
+        while (delta >= 0b10000000 && written) {
+            written = appendCode(&deltas, (uint8_t)(delta | 0b10000000));
+            delta >>= 7;
+        }
+        written = written && appendCode(&deltas, (uint8_t)delta);
+    }
+    written = written && fwrite(deltas.data, 1, deltas.length, outputFile) == deltas.length;
+    freeCodeBuffer(&deltas);
+
+    for (uint32_t i = 0; i < table->numLabels && written; i++) {
+        const LineTableLabel* label = table->labels + i;
+        uint32_t nameLength = (uint32_t)strlen(label->name);
+        uint8_t record[LINE_TABLE_LABEL_HEADER_LENGTH];
+        putTableUint32(record, label->offset);
+        putTableUint32(record + 4, label->line);
+        putTableUint32(record + 8, nameLength);
+        written = fwrite(record, 1, LINE_TABLE_LABEL_HEADER_LENGTH, outputFile) == LINE_TABLE_LABEL_HEADER_LENGTH;
+        written = written && fwrite(label->name, 1, nameLength, outputFile) == nameLength;
+    }
+    return written ? 0 : ERROR_INVALID_ARGUMENTS;
+}
+
+/**
+ * @brief Read a table in the line table format
+ *
+ * @param data The whole line table file
+ * @param length Number of bytes in data
+ * @param table Empty table to fill in
+ * @return 0 if successful, ERROR_MALFORMED_LINE_TABLE if data is not a valid table, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t readLineTable(const uint8_t* const data, size_t length, LineTable* table)
+{
+    if (length < LINE_TABLE_HEADER_LENGTH || memcmp(data, LINE_TABLE_MAGIC, 7) != 0 || data[7] != LINE_TABLE_FORMAT_VERSION) {
+        return ERROR_MALFORMED_LINE_TABLE;
+    }
+    uint32_t numInstructions = getTableUint32(data + 8);
+    uint32_t numLabels = getTableUint32(data + 12);
+    uint32_t pathLength = getTableUint32(data + 16);
+    size_t position = LINE_TABLE_HEADER_LENGTH;
+    if (length - position < pathLength) {
+        return ERROR_MALFORMED_LINE_TABLE;
+    }
+    if (pathLength > 0) {
+        table->sourcePath = copyString((const char*)(data + position), pathLength);
+        if (table->sourcePath == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+    }
+    position += pathLength;
+
+    uint8_t status = 0;
+    uint32_t line = 0;
+    for (uint32_t i = 0; i < numInstructions && status == 0; i++) {
+        uint32_t delta = 0;
+        uint8_t shift = 0;
+        uint8_t byte;
+        do {
+            if (position == length || shift > 28) {
+                return ERROR_MALFORMED_LINE_TABLE;
+            }
+            byte = *(data + position++);
+            delta |= (uint32_t)(byte & 0b1111111) << shift;
+            shift += 7;
+        } while (byte & 0b10000000);
+        line += delta;
+        status = addInstructionLine(table, line);
+    }
+    for (uint32_t i = 0; i < numLabels && status == 0; i++) {
+        if (length - position < LINE_TABLE_LABEL_HEADER_LENGTH) {
+            return ERROR_MALFORMED_LINE_TABLE;
+        }
+        const uint8_t* record = data + position;
+        uint32_t offset = getTableUint32(record);
+        uint32_t nameLength = getTableUint32(record + 8);
+        position += LINE_TABLE_LABEL_HEADER_LENGTH;
+        bool ordered = table->numLabels == 0 || (table->labels + table->numLabels - 1)->offset <= offset;
+        if (offset > numInstructions || !ordered || length - position < nameLength) {
+            return ERROR_MALFORMED_LINE_TABLE;
+        }
+        status = addLineTableLabel(table, (const char*)(data + position), nameLength, offset, getTableUint32(record + 4));
+        position += nameLength;
+    }
+    return status;
+}
+
+/**
+ * @brief Find the label an instruction follows
+ *
+ * @param table The table to search
+ * @param offset Offset of the instruction
+ * @return Index of the last label at or before offset, or -1 if none is
+ */
+int64_t findEnclosingLabel(const LineTable* const table, uint32_t offset)
+{
+    // binary search for the first label after offset
+    uint32_t low = 0;
+    uint32_t high = table->numLabels;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if ((table->labels + middle)->offset <= offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return (int64_t)low - 1;
+}
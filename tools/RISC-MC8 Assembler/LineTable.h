@@ -0,0 +1,124 @@
+#ifndef LINETABLE_H
+#define LINETABLE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "Relaxation.h"
+#include "Source.h"
+
+#define LINE_TABLE_MAGIC "RMC8LIN"
+#define LINE_TABLE_FORMAT_VERSION 1
+#define LINE_TABLE_EXTENSION ".lines"  // appended to the output path, so output.o gets output.o.lines
+
+/*
+ * Line table layout, all fixed-size integers little-endian:
+ *   "RMC8LIN", u8 format version
+ *   u32 instruction count, u32 label count, u32 source path length, source path bytes
+ *   per instruction: unsigned LEB128 of its line minus the previous instruction's line (the first minus 0), modulo 2^32
+ *   per label, in offset order: u32 offset, u32 line, u32 name length, name bytes
+ * Lines only decrease where blocks were reordered, so the deltas are almost always a single byte.
+ */
+
+typedef struct _LineTableLabel {
+    char* name;  // as written in the source, NUL terminated
+    uint32_t offset;
+    uint32_t line;
+} LineTableLabel;
+
+/**
+ * Maps every ROM offset of an assembled program back to its source line and the label it follows.
+ */
+typedef struct _LineTable {
+    uint32_t* lines;  // 1-based source line of each instruction
+    uint32_t length;
+    uint32_t capacity;
+    LineTableLabel* labels;  // sorted by offset
+    uint32_t numLabels;
+    uint32_t labelCapacity;
+    char* sourcePath;  // NULL if unknown
+} LineTable;
+
+/**
+ * @brief Start an empty table
+ *
+ * @param table The table to initialize
+ */
+void initLineTable(LineTable* table);
+
+void freeLineTable(LineTable* table);
+
+/**
+ * @brief Build the table of a source that assembled successfully
+ *
+ * Every instruction line assembles to one byte, or a few for li, so the table only needs the lexer and a LineSizer and
+ * is the same whichever mode assembled the source. Like the two-pass path it sizes again if a JUMP by a number lands
+ * behind an li that relied on known values.
+ *
+ * @param source The source, read from its current position, which must be the beginning if it is rewindable
+ * @param sourcePath Path to record for annotating the source later, may be NULL
+ * @param table Empty table to fill in
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t buildLineTable(SourceReader* source, const char* const sourcePath, LineTable* table);
+
+/**
+ * @brief Move every entry to where an optimizer put its instruction, dropping the lines of instructions it removed
+ *
+ * @param table The table of the source as written
+ * @param offsetMap New offset of each old offset, up to and including the old length, see optimizeCode
+ */
+void remapLineTable(LineTable* table, const uint32_t* const offsetMap);
+
+/**
+ * @brief Move every entry to where a pass that reorders or inserts code put its instruction
+ *
+ * @param table The table of the program before the pass
+ * @param offsetMap New offset of each old offset, up to and including the old length
+ * @param origins Old offset of the instruction at each new offset, inserted code taking the line of what it was
+ *                inserted for
+ * @param length Length of the program after the pass
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY (the table is unchanged)
+ */
+uint8_t reorderLineTable(LineTable* table, const uint32_t* const offsetMap, const uint32_t* const origins, uint32_t length);
+
+/**
+ * @brief Move every entry to where relaxation put its instruction, giving each inserted JUMP the line of the JUMP it
+ *        was added for
+ *
+ * @param table The table of the source as written
+ * @param report The report of relaxJumps, with its offset maps
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY (the table is unchanged)
+ */
+uint8_t relaxLineTable(LineTable* table, const RelaxationReport* const report);
+
+/**
+ * @brief Write a table in the line table format
+ *
+ * @param outputFile Where to write the table
+ * @param table The table to write
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the file could not be written
+ */
+uint8_t writeLineTable(FILE* outputFile, const LineTable* const table);
+
+/**
+ * @brief Read a table in the line table format
+ *
+ * @param data The whole line table file
+ * @param length Number of bytes in data
+ * @param table Empty table to fill in
+ * @return 0 if successful, ERROR_MALFORMED_LINE_TABLE if data is not a valid table, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t readLineTable(const uint8_t* const data, size_t length, LineTable* table);
+
+/**
+ * @brief Find the label an instruction follows
+ *
+ * @param table The table to search
+ * @param offset Offset of the instruction
+ * @return Index of the last label at or before offset, or -1 if none is
+ */
+int64_t findEnclosingLabel(const LineTable* const table, uint32_t offset);
+
+#endif
@@ -0,0 +1,84 @@
+#include "Linker.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StatusCodes.h"
+#include "Symbols.h"
+
+/**
+ * @brief Link relocatable modules into one flat binary
+ *
+ * @param modules The modules to link
+ * @param numModules Number of modules
+ * @param output Buffer to append the linked binary to
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @param failedModule Set to the index of the module the error occurred in, may be NULL
+ * @return 0 if successful, ERROR_DUPLICATE_LABEL if two modules export the same label, ERROR_UNKNOWN_LABEL if an import
+ *         is not exported by any module, ERROR_VALUE_OUT_OF_RANGE if a JUMP cannot reach its target
+ */
+uint8_t linkModules(const ObjectModule* const modules, uint32_t numModules, CodeBuffer* output, AssemblerDiagnostic* diagnostic, uint32_t* failedModule)
+{
+    setDiagnostic(diagnostic, 0, 0, 0);
+    SymbolsList* globals = (SymbolsList*)calloc(1, sizeof(SymbolsList));
+    uint32_t* bases = (uint32_t*)calloc(numModules > 0 ? numModules : 1, sizeof(uint32_t));
+    uint8_t status = globals == NULL || bases == NULL ? ERROR_OUT_OF_MEMORY : 0;
+    uint32_t errorModule = 0;
+    uint32_t errorLine = 0;
+
+    // lay the modules out back to back and give every export its address
+    size_t start = output->length;
+    for (uint32_t i = 0; i < numModules && status == 0; i++) {
+        const ObjectModule* module = modules + i;
+        *(bases + i) = (uint32_t)(output->length - start);
+        for (uint32_t j = 0; j < module->numSymbols && status == 0; j++) {
+            const ObjectSymbol* symbol = module->symbols + j;
+            if (symbol->kind == OBJECT_SYMBOL_EXPORT) {
+                status = addSymbolToList(globals, symbol->name, *(bases + i) + symbol->value);
+                errorModule = i;
+                errorLine = symbol->line;
+            }
+        }
+        for (size_t j = 0; j < module->code.length && status == 0; j++) {
+            if (!appendCode(output, *(module->code.data + j))) {
+                status = ERROR_OUT_OF_MEMORY;
+            }
+        }
+    }
+
+    // patch every JUMP to an import with the distance to its export
+    for (uint32_t i = 0; i < numModules && status == 0; i++) {
+        const ObjectModule* module = modules + i;
+        for (uint32_t j = 0; j < module->numRelocations && status == 0; j++) {
+            const Relocation* relocation = module->relocations + j;
+            const Symbol* target = findSymbol(globals, (module->symbols + relocation->symbol)->name);
+            uint32_t offset = *(bases + i) + relocation->offset;
+            errorModule = i;
+            errorLine = relocation->line;
+            if (target == NULL) {
+                status = ERROR_UNKNOWN_LABEL;
+                continue;
+            }
+            // same arithmetic as load7BitSImm, so linked jumps match a monolithic build
+            int32_t distance = (int32_t)target->value - (int32_t)offset;
+            if (distance < -64 || distance > 63) {
+                status = ERROR_VALUE_OUT_OF_RANGE;
+                continue;
+            }
+            patchCode(output, (uint32_t)(start + offset), distance & 0b1111111);  // drop high bits
+        }
+    }
+
+    if (status != 0) {
+        setDiagnostic(diagnostic, status, status == ERROR_OUT_OF_MEMORY ? 0 : errorLine, 0);
+        if (failedModule != NULL) {
+            *failedModule = errorModule;
+        }
+    }
+    free(bases);
+    if (globals != NULL) {
+        freeSymbolsList(&globals);
+    }
+    return status;
+}
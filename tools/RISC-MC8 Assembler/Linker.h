@@ -0,0 +1,26 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <inttypes.h>
+
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "ObjectModule.h"
+
+/**
+ * @brief Link relocatable modules into one flat binary
+ *
+ * Modules are laid out back to back in the order given, every export is given its address, and each JUMP to an
+ * import is patched with the distance to the matching export.
+ *
+ * @param modules The modules to link
+ * @param numModules Number of modules
+ * @param output Buffer to append the linked binary to
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @param failedModule Set to the index of the module the error occurred in, may be NULL
+ * @return 0 if successful, ERROR_DUPLICATE_LABEL if two modules export the same label, ERROR_UNKNOWN_LABEL if an import
+ *         is not exported by any module, ERROR_VALUE_OUT_OF_RANGE if a JUMP cannot reach its target
+ */
+uint8_t linkModules(const ObjectModule* const modules, uint32_t numModules, CodeBuffer* output, AssemblerDiagnostic* diagnostic, uint32_t* failedModule);
+
+#endif
@@ -0,0 +1,554 @@
+#include "LoadImmediate.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AssemblerStats.h"
+#include "InstructionParser.h"
+#include "Instructions.h"
+#include "Lexer.h"
+#include "Registers.h"
+#include "Source.h"
+#include "StatusCodes.h"
+#include "Symbols.h"
+
+// instruction bases, as in InstructionLoaderLUT
+#define ANDI 0b00000000
+#define NAND 0b00001000
+#define ADDI 0b00010000
+#define SUBI 0b00011000
+#define IORI 0b00100000
+#define XORI 0b00101000
+#define DUPI 0b00110000
+#define DUPR 0b00111000
+#define LOAD 0b01000000
+#define STOR 0b01001000
+#define SHIF 0b01010000
+#define SKIP 0b01011000
+#define STLO 0b01100000
+#define STHI 0b01110000
+
+#define IREG 0
+#define ALL_BITS 0xFF
+#define LOW_NIBBLE 0x0F
+#define HIGH_NIBBLE 0xF0
+
+/**
+ * @brief Forget everything about the registers, as at the start of a program
+ *
+ * @param tracker The tracker
+ */
+void resetValueTracker(ValueTracker* tracker)
+{
+    memset(tracker, 0, sizeof(ValueTracker));
+}
+
+/**
+ * @brief Forget the registers at a label, where code may arrive from anywhere
+ *
+ * @param tracker The tracker
+ */
+void forgetValues(ValueTracker* tracker)
+{
+    memset(tracker->known, 0, sizeof(tracker->known));
+    memset(tracker->values, 0, sizeof(tracker->values));
+}
+
+/**
+ * @param tracker The tracker
+ * @return true if anything is known, so code sized without the tracker may assemble differently
+ */
+bool valuesKnown(const ValueTracker* const tracker)
+{
+    uint8_t any = tracker->skipArmed;
+    for (uint32_t i = 0; i < NUM_REGISTERS; i++) {
+        any |= tracker->known[i];
+    }
+    return any != 0;
+}
+
+/**
+ * @param tracker The tracker
+ * @param reg Index of the register
+ * @param value The value
+ * @return true if the register is known to hold the value
+ */
+static inline bool registerHolds(const ValueTracker* const tracker, uint8_t reg, uint8_t value)
+{
+    return tracker->known[reg] == ALL_BITS && tracker->values[reg] == value;
+}
+
+/**
+ * @brief Set what is known about a register
+ *
+ * @param tracker The tracker
+ * @param reg Index of the register
+ * @param known Bits whose value is known
+ * @param value Those bits
+ */
+static inline void setKnown(ValueTracker* tracker, uint8_t reg, uint8_t known, uint8_t value)
+{
+    tracker->known[reg] = known;
+    tracker->values[reg] = value & known;
+}
+
+/**
+ * @brief Update what is known about the registers after an instruction
+ *
+ * @param tracker The tracker
+ * @param instruction The instruction, a JUMP's offset does not matter
+ */
+void trackInstruction(ValueTracker* tracker, uint8_t instruction)
+{
+    // the instruction after a SKIP may not run, so afterwards only what holds either way is known
+    ValueTracker before;
+    bool skippable = tracker->skipArmed;
+    if (skippable) {
+        before = *tracker;
+        tracker->skipArmed = false;
+    }
+
+    uint8_t reg = instruction & 0b111;
+    uint8_t irKnown = tracker->known[IREG];
+    uint8_t irValue = tracker->values[IREG];
+    uint8_t regKnown = tracker->known[reg];
+    uint8_t regValue = tracker->values[reg];
+    bool bothKnown = irKnown == ALL_BITS && regKnown == ALL_BITS;
+    if (instruction & 0b10000000) {
+        forgetValues(tracker);  // JUMP, whatever comes next is reached from elsewhere
+    } else if ((instruction & 0b11110000) == STLO) {
+        setKnown(tracker, IREG, irKnown | LOW_NIBBLE, (irValue & HIGH_NIBBLE) | (instruction & LOW_NIBBLE));
+    } else if ((instruction & 0b11110000) == STHI) {
+        setKnown(tracker, IREG, irKnown | HIGH_NIBBLE, (irValue & LOW_NIBBLE) | (uint8_t)(instruction << 4));
+    } else {
+        switch (instruction & 0b11111000) {
+            case ANDI:
+            case NAND: {
+                // a known 0 on either side decides the bit
+                uint8_t known = (irKnown & regKnown) | (irKnown & ~irValue) | (regKnown & ~regValue);
+                uint8_t value = irValue & regValue;
+                setKnown(tracker, reg, known, (instruction & 0b11111000) == ANDI ? value : ~value);
+                break;
+            }
+            case IORI:
+                setKnown(tracker, reg, (irKnown & regKnown) | (irKnown & irValue) | (regKnown & regValue), irValue | regValue);
+                break;
+            case XORI:
+                setKnown(tracker, reg, reg == IREG ? ALL_BITS : irKnown & regKnown, irValue ^ regValue);
+                break;
+            case ADDI:
+                setKnown(tracker, reg, bothKnown ? ALL_BITS : 0, (uint8_t)(regValue + irValue));
+                break;
+            case SUBI:
+                setKnown(tracker, reg, bothKnown || reg == IREG ? ALL_BITS : 0, (uint8_t)(regValue - irValue));
+                break;
+            case DUPI:
+                setKnown(tracker, reg, irKnown, irValue);
+                break;
+            case DUPR:
+                setKnown(tracker, IREG, regKnown, regValue);
+                break;
+            case LOAD:
+            case SHIF:
+                setKnown(tracker, reg, 0, 0);
+                break;
+            case SKIP:
+                tracker->skipArmed = true;
+                break;
+            default:  // STOR changes no register
+                break;
+        }
+    }
+
+    if (skippable) {
+        for (uint32_t i = 0; i < NUM_REGISTERS; i++) {
+            uint8_t same = before.known[i] & tracker->known[i] & ~(before.values[i] ^ tracker->values[i]);
+            setKnown(tracker, (uint8_t)i, same, before.values[i]);
+        }
+    }
+}
+
+/**
+ * @brief Write the fewest instructions that put a value in ireg
+ *
+ * @param tracker What the registers hold
+ * @param value The value
+ * @param dest Where to write the instructions, room for 2
+ * @return Number of instructions written
+ */
+static uint32_t materializeValue(const ValueTracker* const tracker, uint8_t value, uint8_t* dest)
+{
+    uint8_t irKnown = tracker->known[IREG];
+    uint8_t irValue = tracker->values[IREG];
+    bool lowHeld = (irKnown & LOW_NIBBLE) == LOW_NIBBLE && (irValue & LOW_NIBBLE) == (value & LOW_NIBBLE);
+    bool highHeld = (irKnown & HIGH_NIBBLE) == HIGH_NIBBLE && (irValue & HIGH_NIBBLE) == (value & HIGH_NIBBLE);
+    if (lowHeld && highHeld) {
+        return 0;
+    } else if (highHeld) {
+        *dest = STLO | (value & LOW_NIBBLE);
+        return 1;
+    } else if (lowHeld) {
+        *dest = STHI | (value >> 4);
+        return 1;
+    } else if (value == 0) {
+        *dest = XORI | IREG;
+        return 1;
+    }
+    for (uint8_t reg = 1; reg < NUM_REGISTERS; reg++) {
+        if (registerHolds(tracker, reg, value)) {
+            *dest = DUPR | reg;
+            return 1;
+        }
+    }
+    *dest = STLO | (value & LOW_NIBBLE);
+    *(dest + 1) = STHI | (value >> 4);
+    return 2;
+}
+
+/**
+ * @brief Expand `li value` or `li reg value` into the fewest instructions that load the value, given what the
+ * registers are known to hold, and track them
+ *
+ * @param tracker What the registers hold before the line, updated to after it
+ * @param line The lexed li line
+ * @param dest Where to write the instructions, room for LOAD_IMMEDIATE_MAX_LENGTH
+ * @param count Set to the number of instructions written
+ * @return 0 if successful, otherwise the error in the line, or ERROR_EXPANSION_AFTER_SKIP
+ */
+uint8_t expandLoadImmediate(ValueTracker* tracker, const SourceLine* const line, uint8_t* dest, uint32_t* count)
+{
+    *count = 0;
+    if (line->tokenCount < 2) {
+        return ERROR_MISSING_INSTRUCTION_PARAMETER;
+    } else if (line->tooManyTokens) {
+        return ERROR_TOO_MANY_TOKENS;
+    }
+    uint8_t reg = IREG;
+    const Token* operand = &line->tokens[1];
+    if (line->tokenCount == 3) {
+        const RegisterDefinition* rDef = getRegisterDefinitionN(operand->start, operand->length);
+        if (rDef == NULL) {
+            return ERROR_UNKNOWN_REGISTER;
+        }
+        reg = rDef->value;
+        operand = &line->tokens[2];
+    }
+    uint8_t value;
+    uint8_t status = parse8BitImm(&value, operand->start, operand->length);
+    if (status != 0) {
+        return status;
+    }
+
+    uint32_t length = 0;
+    if (reg == IREG || !registerHolds(tracker, reg, value)) {
+        length = materializeValue(tracker, value, dest);
+        if (reg != IREG) {
+            *(dest + length++) = DUPI | reg;
+        }
+    }
+    // a SKIP skips exactly one instruction, so nothing becomes a copy of ireg into itself and more is an error
+    if (tracker->skipArmed && length != 1) {
+        if (length > 1) {
+            return ERROR_EXPANSION_AFTER_SKIP;
+        }
+        *dest = DUPI | IREG;
+        length = 1;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        trackInstruction(tracker, *(dest + i));
+    }
+    *count = length;
+    return 0;
+}
+
+/**
+ * @brief Start the next pass over the same source, keeping the landings found so far
+ *
+ * @param landings The landings
+ */
+void rewindJumpLandings(JumpLandings* landings)
+{
+    landings->next = 0;
+    landings->dependentEnd = 0;
+    landings->unsettled = false;
+}
+
+void freeJumpLandings(JumpLandings* landings)
+{
+    free(landings->offsets);
+    memset(landings, 0, sizeof(JumpLandings));
+}
+
+/**
+ * @brief Find the distance of a JUMP by a number, rather than to a label
+ *
+ * @param line A lexed line
+ * @param distance Set to the distance
+ * @return true if the line is such a JUMP and goes neither to itself (a halt) nor to the next instruction, where
+ *         nothing is known anyway
+ */
+bool jumpsByNumber(const SourceLine* const line, int32_t* distance)
+{
+    // length first, since every instruction line of every pass asks
+    if (line->kind != LINE_KIND_INSTRUCTION || line->tokenCount < 2 || line->tokens[0].length != 4 || !tokenEquals(&line->tokens[0], "jump")) {
+        return false;
+    }
+    // without symbols only a number loads, the same way whichever pass asks
+    SymbolsList noSymbols;
+    memset(&noSymbols, 0, sizeof(SymbolsList));
+    uint8_t instruction = 0;
+    if (load7BitSImm(&instruction, 0, line->tokens[1].start, line->tokens[1].length, &noSymbols) != 0) {
+        return false;
+    }
+    *distance = (instruction & 0b1000000) ? (int32_t)instruction - 0b10000000 : (int32_t)instruction;
+    return *distance != 0 && *distance != 1;
+}
+
+/**
+ * @brief Record where a line lands if it is a JUMP by a number
+ *
+ * @param landings The landings, unsettled if this one is behind an li that relied on known values, or if out of
+ *                 memory (which also leaves them untracked)
+ * @param line A lexed instruction line
+ * @param offset The offset of the line's instruction
+ */
+void addJumpLanding(JumpLandings* landings, const SourceLine* const line, uint32_t offset)
+{
+    int32_t distance;
+    if (landings->untracked || !jumpsByNumber(line, &distance) || (distance < 0 && offset < (uint32_t)-distance)) {
+        return;  // nothing relies on known values, or it leaves the program
+    }
+    uint32_t landing = offset + distance;
+    uint32_t low = 0;
+    uint32_t high = landings->length;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (*(landings->offsets + middle) < landing) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < landings->length && *(landings->offsets + low) == landing) {
+        return;
+    }
+    if (landing < offset) {
+        if (landing >= landings->dependentEnd) {
+            return;  // no li behind it relied on anything, so this pass is still right and later ones need not know
+        }
+        landings->unsettled = true;
+    }
+
+    if (landings->length == landings->capacity) {
+        uint32_t newCapacity = landings->capacity == 0 ? 16 : landings->capacity * 2;
+        uint32_t* grown = (uint32_t*)realloc(landings->offsets, newCapacity * sizeof(uint32_t));
+        if (grown == NULL) {
+            // without the landings nothing known can be trusted, and this pass already relied on it
+            landings->untracked = true;
+            landings->unsettled = true;
+            return;
+        }
+        countAllocation(newCapacity * sizeof(uint32_t));
+        landings->offsets = grown;
+        landings->capacity = newCapacity;
+    }
+    memmove(landings->offsets + low + 1, landings->offsets + low, (landings->length - low) * sizeof(uint32_t));
+    *(landings->offsets + low) = landing;
+    landings->length++;
+    if (low < landings->next) {
+        landings->next++;  // behind the pass, so only the next one reaches it
+    }
+}
+
+/**
+ * @brief Record that an li was expanded, so a landing found behind it later can tell whether it was sized wrongly
+ *
+ * @param landings The landings
+ * @param relied Whether anything was known before the li, see valuesKnown
+ * @param offset The offset of the li
+ * @param count Number of instructions it expanded to
+ */
+void noteLoadImmediate(JumpLandings* landings, bool relied, uint32_t offset, uint32_t count)
+{
+    if (relied) {
+        landings->dependentEnd = offset + (count > 0 ? count : 1);  // one that emitted nothing relied on the next
+    }
+}
+
+/**
+ * @brief Update the tracker with one source line
+ *
+ * @param tracker The tracker
+ * @param line The lexed line
+ */
+static void trackSourceLine(ValueTracker* tracker, const SourceLine* const line)
+{
+    if (line->kind == LINE_KIND_LABEL) {
+        forgetValues(tracker);
+    } else if (isLoadImmediate(line)) {
+        uint8_t code[LOAD_IMMEDIATE_MAX_LENGTH];
+        uint32_t count;
+        expandLoadImmediate(tracker, line, code, &count);
+    } else if (line->kind == LINE_KIND_INSTRUCTION) {
+        // the assembler reports errors, only what a line does matters here, and JUMPs need no label
+        SymbolsList noSymbols;
+        memset(&noSymbols, 0, sizeof(SymbolsList));
+        uint8_t instruction = 0;
+        uint8_t status = parseInstruction(&instruction, line, 0, &noSymbols);
+        if (status == 0 || status == STATUS_UNRESOLVED_SYMBOL) {
+            trackInstruction(tracker, instruction);
+        }
+    }
+}
+
+/**
+ * @brief Start sizing lines
+ *
+ * @param sizer The sizer
+ * @param entry What the registers hold before the first line, NULL if nothing is known
+ * @param eager true if the lines passed to sizeSourceLine do not stay in memory
+ */
+void initLineSizer(LineSizer* sizer, const ValueTracker* const entry, bool eager, JumpLandings* landings)
+{
+    if (entry != NULL) {
+        sizer->tracker = *entry;
+    } else {
+        resetValueTracker(&sizer->tracker);
+    }
+    sizer->pending = NULL;
+    sizer->lastMnemonic.start = NULL;
+    sizer->lastMnemonic.length = 0;
+    sizer->eager = eager;
+    sizer->offset = 0;
+    sizer->landings = landings;
+}
+
+/**
+ * @brief Forget the registers at a label or landing
+ *
+ * @param sizer The sizer
+ */
+static void forgetSizedLines(LineSizer* sizer)
+{
+    // nothing before needs tracking any more, only whether it ended in a SKIP, checked only now since nearly every
+    // other line would pay for it
+    forgetValues(&sizer->tracker);
+    if (sizer->lastMnemonic.length > 0) {
+        sizer->tracker.skipArmed = tokenEquals(&sizer->lastMnemonic, "skip");
+    }
+    sizer->lastMnemonic.length = 0;
+    sizer->pending = NULL;
+}
+
+/**
+ * @brief Find how many instructions a line assembles to
+ *
+ * @param sizer The sizer, lines must be given in order and, unless eager, from one block of memory
+ * @param line The lexed line
+ * @return Number of instructions, 0 for labels, directives, empty lines and li lines with errors
+ */
+uint32_t sizeSourceLine(LineSizer* sizer, const SourceLine* const line)
+{
+    if (line->kind == LINE_KIND_LABEL) {
+        forgetSizedLines(sizer);
+        return 0;
+    } else if (line->kind != LINE_KIND_INSTRUCTION) {
+        return 0;
+    }
+    JumpLandings* landings = sizer->landings;
+    if (landings != NULL && reachJumpLandings(landings, sizer->offset, sizer->offset + 1)) {
+        forgetSizedLines(sizer);
+    }
+    if (isLoadImmediate(line)) {
+        catchUpLineSizer(sizer, line->text);
+        bool relied = valuesKnown(&sizer->tracker);
+        uint8_t code[LOAD_IMMEDIATE_MAX_LENGTH];
+        uint32_t count;
+        uint8_t status = expandLoadImmediate(&sizer->tracker, line, code, &count);
+        if (landings != NULL && status == 0) {
+            noteLoadImmediate(landings, relied, sizer->offset, count);
+            if (count > 1 && reachJumpLandings(landings, sizer->offset + 1, sizer->offset + count)) {
+                forgetValues(&sizer->tracker);  // landing inside the li
+            }
+        }
+        sizer->lastMnemonic = line->tokens[0];
+        sizer->offset += count;
+        return count;
+    }
+    if (sizer->eager) {
+        trackSourceLine(&sizer->tracker, line);
+    } else if (sizer->pending == NULL) {
+        sizer->pending = line->text;
+    }
+    if (landings != NULL) {
+        addJumpLanding(landings, line, sizer->offset);
+    }
+    sizer->lastMnemonic = line->tokens[0];
+    sizer->offset++;
+    return 1;
+}
+
+/**
+ * @brief Give the tracker every line up to a point, so it holds what the registers hold there
+ *
+ * @param sizer The sizer
+ * @param end Where the lines given so far end
+ */
+void catchUpLineSizer(LineSizer* sizer, const char* const end)
+{
+    if (sizer->pending != NULL) {
+        trackSourceText(&sizer->tracker, sizer->pending, (size_t)(end - sizer->pending));
+        sizer->pending = NULL;
+    }
+}
+
+/**
+ * @brief Update the tracker with every line of some source text
+ *
+ * @param tracker What the registers hold before the text, updated to after it
+ * @param text The source text, starting at the beginning of a line
+ * @param length Number of bytes in text
+ */
+void trackSourceText(ValueTracker* tracker, const char* const text, size_t length)
+{
+    SourceReader source;
+    openSourceBuffer(&source, text, length);
+    const char* lineText;
+    uint32_t lineLength;
+    SourceLine line;
+    while (readSourceLine(&source, &lineText, &lineLength)) {
+        lexLine(&line, lineText, lineLength);
+        trackSourceLine(tracker, &line);
+    }
+    closeSource(&source);
+}
+
+/**
+ * @brief Size a source again until no JUMP by a number lands behind an li sized with what the registers held
+ *
+ * @param source The source, must be rewindable, left rewound
+ * @param landings Unsettled landings of an earlier pass, left settled and rewound
+ */
+void settleJumpLandings(SourceReader* source, JumpLandings* landings)
+{
+    for (uint32_t pass = 0; landings->unsettled; pass++) {
+        rewindSource(source);
+        rewindJumpLandings(landings);
+        if (pass == MAX_LANDING_PASSES) {
+            landings->untracked = true;  // nothing can land wrongly then
+        }
+        LineSizer sizer;
+        initLineSizer(&sizer, NULL, false, landings);
+        const char* text;
+        uint32_t length;
+        SourceLine line;
+        while (readSourceLine(source, &text, &length)) {
+            lexLine(&line, text, length);
+            sizeSourceLine(&sizer, &line);
+        }
+    }
+    rewindSource(source);
+    rewindJumpLandings(landings);
+}
@@ -0,0 +1,216 @@
+#ifndef LOADIMMEDIATE_H
+#define LOADIMMEDIATE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Lexer.h"
+#include "Source.h"
+
+#define LOAD_IMMEDIATE_MNEMONIC "li"
+#define LOAD_IMMEDIATE_MAX_LENGTH 3  // STLO, STHI and a DUPI into the destination register
+#define MAX_LANDING_PASSES 3         // sizings settleJumpLandings tries before li stops relying on known values
+
+/**
+ * What is known about the registers at a point in straight-line code, bit by bit. Nothing is known at a label, after a
+ * JUMP or where a JUMP by a number lands, since the code there may be reached from anywhere.
+ */
+typedef struct _ValueTracker {
+    uint8_t known[8];   // bits of each register whose value is known, [0] is ireg
+    uint8_t values[8];  // those bits, the rest are 0
+    bool skipArmed;     // the last instruction was a SKIP, so the next one may not run
+} ValueTracker;
+
+/**
+ * Offsets where JUMPs by a number land, which the tracker forgets the registers at just like a label. A pass only
+ * finds a landing at its JUMP, so one behind the JUMP is only forgotten from the next pass on; if an li there relied on
+ * known values it was sized wrongly and the landings are unsettled.
+ */
+typedef struct _JumpLandings {
+    uint32_t* offsets;      // in order
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t next;          // index of the first landing the pass has not reached
+    uint32_t dependentEnd;  // offset after the last li that relied on known values, 0 if none yet
+    bool unsettled;         // a landing was found behind such an li, so this pass sized it wrongly
+    bool untracked;         // li relies on nothing, for when the landings do not settle
+} JumpLandings;
+
+/**
+ * Sizes lines for passes that do not otherwise encode instructions, such as symbol extraction. Lines are only parsed
+ * for the tracker once an li needs to know what the registers hold, so sources without li pay nothing.
+ */
+typedef struct _LineSizer {
+    ValueTracker tracker;
+    const char* pending;  // start of the lines not yet given to the tracker, NULL if there are none
+    Token lastMnemonic;   // of the last instruction line since the last label, length 0 if there is none
+    bool eager;           // track each line as it is read, for sources whose lines do not stay in memory
+    uint32_t offset;      // of the next instruction
+    JumpLandings* landings;  // NULL if the source is known to have no JUMPs by a number that matter
+} LineSizer;
+
+/**
+ * @brief Forget everything about the registers, as at the start of a program
+ *
+ * @param tracker The tracker
+ */
+void resetValueTracker(ValueTracker* tracker);
+
+/**
+ * @brief Forget the registers at a label, where code may arrive from anywhere
+ *
+ * A SKIP just before the label still skips the instruction after it, so that is kept.
+ *
+ * @param tracker The tracker
+ */
+void forgetValues(ValueTracker* tracker);
+
+/**
+ * @param tracker The tracker
+ * @return true if anything is known, so code sized without the tracker may assemble differently
+ */
+bool valuesKnown(const ValueTracker* const tracker);
+
+/**
+ * @brief Update what is known about the registers after an instruction
+ *
+ * @param tracker The tracker
+ * @param instruction The instruction, a JUMP's offset does not matter
+ */
+void trackInstruction(ValueTracker* tracker, uint8_t instruction);
+
+/**
+ * @brief Start the next pass over the same source, keeping the landings found so far
+ *
+ * @param landings The landings
+ */
+void rewindJumpLandings(JumpLandings* landings);
+
+void freeJumpLandings(JumpLandings* landings);
+
+/**
+ * @brief Find the distance of a JUMP by a number, rather than to a label
+ *
+ * @param line A lexed line
+ * @param distance Set to the distance
+ * @return true if the line is such a JUMP and goes neither to itself (a halt) nor to the next instruction, where
+ *         nothing is known anyway
+ */
+bool jumpsByNumber(const SourceLine* const line, int32_t* distance);
+
+/**
+ * @brief Record where a line lands if it is a JUMP by a number
+ *
+ * @param landings The landings, unsettled if this one is behind an li that relied on known values, or if out of
+ *                 memory (which also leaves them untracked)
+ * @param line A lexed instruction line
+ * @param offset The offset of the line's instruction
+ */
+void addJumpLanding(JumpLandings* landings, const SourceLine* const line, uint32_t offset);
+
+/**
+ * @brief Move past the landings before an offset
+ *
+ * @param landings The landings
+ * @param from The offset of the first instruction being assembled
+ * @param to The offset after the last one
+ * @return true if one of them is landed at (or li relies on nothing), so the registers must be forgotten
+ */
+static inline bool reachJumpLandings(JumpLandings* landings, uint32_t from, uint32_t to)
+{
+    // inline, since every instruction line of every pass asks and there are usually no landings at all
+    bool landed = landings->untracked;
+    while (landings->next < landings->length && *(landings->offsets + landings->next) < to) {
+        landed |= *(landings->offsets + landings->next) >= from;
+        landings->next++;
+    }
+    return landed;
+}
+
+/**
+ * @brief Record that an li was expanded, so a landing found behind it later can tell whether it was sized wrongly
+ *
+ * @param landings The landings
+ * @param relied Whether anything was known before the li, see valuesKnown
+ * @param offset The offset of the li
+ * @param count Number of instructions it expanded to
+ */
+void noteLoadImmediate(JumpLandings* landings, bool relied, uint32_t offset, uint32_t count);
+
+/**
+ * @brief Size a source again until no JUMP by a number lands behind an li sized with what the registers held
+ *
+ * Each pass forgets the registers at the landings found so far, which can grow the li after them and move the JUMPs,
+ * so after MAX_LANDING_PASSES passes li stops relying on known values altogether.
+ *
+ * @param source The source, must be rewindable, left rewound
+ * @param landings Unsettled landings of an earlier pass, left settled and rewound
+ */
+void settleJumpLandings(SourceReader* source, JumpLandings* landings);
+
+/**
+ * @param line A lexed line
+ * @return true if it is an li pseudo-instruction
+ */
+static inline bool isLoadImmediate(const SourceLine* const line)
+{
+    // inline and length first, since every line of every pass asks
+    return line->kind == LINE_KIND_INSTRUCTION && line->tokens[0].length == sizeof(LOAD_IMMEDIATE_MNEMONIC) - 1 &&
+           tokenEquals(&line->tokens[0], LOAD_IMMEDIATE_MNEMONIC);
+}
+
+/**
+ * @brief Expand `li value` or `li reg value` into the fewest instructions that load the value, given what the
+ * registers are known to hold, and track them
+ *
+ * `li value` sets ireg with STLO and/or STHI, XORI ireg for 0, or a DUPR of a register known to hold the value,
+ * and emits nothing if ireg already holds it. `li reg value` sets ireg the same way then copies it with DUPI, unless
+ * the register already holds the value. Values are 8-bit, either -128 to 255 or "0b10101010"-style. After a SKIP the
+ * expansion is always exactly one instruction, `dupi ireg` if nothing needs to change.
+ *
+ * @param tracker What the registers hold before the line, updated to after it
+ * @param line The lexed li line
+ * @param dest Where to write the instructions, room for LOAD_IMMEDIATE_MAX_LENGTH
+ * @param count Set to the number of instructions written
+ * @return 0 if successful, otherwise the error in the line, or ERROR_EXPANSION_AFTER_SKIP
+ */
+uint8_t expandLoadImmediate(ValueTracker* tracker, const SourceLine* const line, uint8_t* dest, uint32_t* count);
+
+/**
+ * @brief Start sizing lines
+ *
+ * @param sizer The sizer
+ * @param entry What the registers hold before the first line, NULL if nothing is known
+ * @param eager true if the lines passed to sizeSourceLine do not stay in memory
+ * @param landings Where JUMPs by a number land, added to as they are found, NULL to not look for them
+ */
+void initLineSizer(LineSizer* sizer, const ValueTracker* const entry, bool eager, JumpLandings* landings);
+
+/**
+ * @brief Find how many instructions a line assembles to
+ *
+ * @param sizer The sizer, lines must be given in order and, unless eager, from one block of memory
+ * @param line The lexed line
+ * @return Number of instructions, 0 for labels, directives, empty lines and li lines with errors
+ */
+uint32_t sizeSourceLine(LineSizer* sizer, const SourceLine* const line);
+
+/**
+ * @brief Give the tracker every line up to a point, so it holds what the registers hold there
+ *
+ * @param sizer The sizer
+ * @param end Where the lines given so far end
+ */
+void catchUpLineSizer(LineSizer* sizer, const char* const end);
+
+/**
+ * @brief Update the tracker with every line of some source text
+ *
+ * @param tracker What the registers hold before the text, updated to after it
+ * @param text The source text, starting at the beginning of a line
+ * @param length Number of bytes in text
+ */
+void trackSourceText(ValueTracker* tracker, const char* const text, size_t length);
+
+#endif
@@ -0,0 +1,496 @@
+#include "LockstepEmulator.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StatusCodes.h"
+#include "WorkerPool.h"
+
+#if !defined(__GNUC__)
+#error "The lockstep emulator needs GCC or Clang vector extensions"
+#endif
+
+// one byte per lane; GCC lowers operations on it to whatever vector instructions the target has
+typedef uint8_t Lanes __attribute__((vector_size(LOCKSTEP_LANES)));
+
+// instructions the lanes at the lowest program counter may get ahead of the furthest behind lane while split
+#define LOCKSTEP_MAX_LAG 1024
+
+// lanes of a where mask is set, lanes of b elsewhere (mask lanes are all ones or all zeros)
+#define BLEND(mask, a, b) (((a) & (mask)) | ((b) & ~(mask)))
+
+// build the function once per instruction set, picking the best one the processor has when the program starts
+#if defined(__x86_64__) && !defined(_WIN32)
+#define LANE_TARGETS __attribute__((target_clones("arch=x86-64-v4", "avx2", "default")))
+#else
+#define LANE_TARGETS
+#endif
+
+/**
+ * LOCKSTEP_LANES machine states in structure-of-arrays layout, so each register or RAM cell of every lane is one
+ * vector.
+ */
+typedef struct _LaneGroup {
+    Lanes registers[EMULATOR_NUM_REGISTERS];
+    Lanes ram[EMULATOR_RAM_SIZE];
+    Lanes active;  // lanes still running
+    uint32_t pc[LOCKSTEP_LANES];  // only kept up to date while the lanes are split
+    uint64_t executed[LOCKSTEP_LANES];
+    uint8_t reason[LOCKSTEP_LANES];
+} LaneGroup;
+
+typedef struct _LockstepRun {
+    const Emulator* emulator;
+    uint64_t firstInstance;
+    uint64_t numInstances;
+    InitialStateGenerator generate;
+    void* context;
+    uint64_t maxSteps;
+    LockstepResult* results;
+} LockstepRun;
+
+/**
+ * @return true if any lane is non-zero
+ */
+static inline bool anyLane(const Lanes* const lanes)
+{
+    uint64_t words[LOCKSTEP_LANES / 8];
+    memcpy(words, lanes, sizeof(words));
+    uint64_t combined = 0;
+    for (uint32_t i = 0; i < LOCKSTEP_LANES / 8; i++) {
+        combined |= words[i];
+    }
+    return combined != 0;
+}
+
+/**
+ * @brief Execute one instruction on the lanes in mask, apart from its effect on the program counter
+ *
+ * @param group The lanes
+ * @param instruction The instruction to execute
+ * @param mask Lanes to execute it on
+ */
+__attribute__((always_inline)) static inline void executeLanes(LaneGroup* group, const DecodedInstruction* const instruction, const Lanes* const lanes)
+{
+    Lanes mask = *lanes;
+    Lanes* reg = group->registers + instruction->operand;
+    Lanes* ireg = group->registers;
+    switch (instruction->op) {
+        case EMULATOR_OP_ANDI:
+            *reg = BLEND(mask, *reg & *ireg, *reg);
+            break;
+        case EMULATOR_OP_NAND:
+            *reg = BLEND(mask, ~(*reg & *ireg), *reg);
+            break;
+        case EMULATOR_OP_ADDI:
+            *reg = BLEND(mask, *reg + *ireg, *reg);
+            break;
+        case EMULATOR_OP_SUBI:
+            *reg = BLEND(mask, *reg - *ireg, *reg);
+            break;
+        case EMULATOR_OP_IORI:
+            *reg = BLEND(mask, *reg | *ireg, *reg);
+            break;
+        case EMULATOR_OP_XORI:
+            *reg = BLEND(mask, *reg ^ *ireg, *reg);
+            break;
+        case EMULATOR_OP_DUPI:
+            *reg = BLEND(mask, *ireg, *reg);
+            break;
+        case EMULATOR_OP_DUPR:
+            *ireg = BLEND(mask, *reg, *ireg);
+            break;
+        case EMULATOR_OP_LOAD:
+        case EMULATOR_OP_LOAD_IO:  // lanes have no host channels, the ports are plain RAM
+            // a gather, each lane reads its own RAM at its own address
+            for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                if (mask[lane]) {
+                    (*reg)[lane] = group->ram[(*ireg)[lane]][lane];
+                }
+            }
+            break;
+        case EMULATOR_OP_STOR:
+        case EMULATOR_OP_STOR_IO:
+            for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                if (mask[lane]) {
+                    group->ram[(*ireg)[lane]][lane] = (*reg)[lane];
+                }
+            }
+            break;
+        case EMULATOR_OP_SHIF: {
+            // every lane may shift by a different amount, so try each amount on the lanes that want it
+            Lanes amount = *ireg & 0b1111;
+            Lanes value = *reg;
+            Lanes shifted = value;
+            for (uint8_t bits = 1; bits < 8; bits++) {
+                shifted = BLEND((Lanes)(amount == bits), value << bits, shifted);
+                shifted = BLEND((Lanes)(amount == (uint8_t)(16 - bits)), value >> bits, shifted);
+            }
+            *reg = BLEND(mask, shifted, value);
+            break;
+        }
+        case EMULATOR_OP_STLO:
+        case EMULATOR_OP_STHI: {
+            uint8_t kept = instruction->op == EMULATOR_OP_STLO ? 0b11110000 : 0b00001111;
+            *ireg = BLEND(mask, (*ireg & kept) | instruction->operand, *ireg);
+            break;
+        }
+        default:
+            break;  // SKIP, JUMP, HALT and END only affect the program counter
+    }
+}
+
+/**
+ * @brief Stop the lanes in mask
+ *
+ * @param group The lanes
+ * @param mask Lanes to stop
+ * @param reason The EMULATOR_HALT_* reason they stopped
+ * @param pc Program counter to record for them
+ */
+static void haltLanes(LaneGroup* group, const Lanes* const mask, uint8_t reason, uint32_t pc)
+{
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        if ((*mask)[lane]) {
+            group->reason[lane] = reason;
+            group->pc[lane] = pc;
+        }
+    }
+    group->active &= ~*mask;
+}
+
+/**
+ * @brief Add steps taken while the lanes agreed to every active lane
+ *
+ * @param group The lanes
+ * @param steps Steps taken since the last flush, reset to 0
+ */
+static void flushSharedSteps(LaneGroup* group, uint64_t* steps)
+{
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        group->executed[lane] += group->active[lane] ? *steps : 0;
+    }
+    *steps = 0;
+}
+
+/**
+ * @brief Run a group of lanes until every lane halts or the step limit is reached
+ *
+ * @param group The lanes, with active lanes and their program counters set
+ * @param program The predecoded program, with its END sentinels
+ * @param length Number of instructions in the program, where lanes that run off the end stop
+ * @param maxSteps Most steps to take
+ */
+LANE_TARGETS static void runLaneGroup(LaneGroup* group, const DecodedInstruction* const program, uint32_t length, uint64_t maxSteps)
+{
+    uint64_t shared = 0;  // steps every active lane took while they agreed, not yet added to executed
+    bool together = false;
+    uint32_t pc = 0;
+    for (uint64_t step = 0; anyLane(&group->active); step++) {
+        if (step == maxSteps) {
+            flushSharedSteps(group, &shared);
+            for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                if (group->active[lane]) {
+                    group->reason[lane] = EMULATOR_HALT_STEP_LIMIT;
+                    group->pc[lane] = together ? pc : group->pc[lane];
+                }
+            }
+            group->active = (Lanes){0};
+            break;
+        }
+
+        if (!together) {
+            // run the lowest program counter first, so lanes that skipped ahead wait for the rest to catch up, unless
+            // the lanes there are looping while another lane falls too far behind
+            uint32_t lowest = UINT32_MAX;
+            uint32_t highest = 0;
+            uint64_t lowestExecuted = 0;
+            uint32_t behindPc = 0;
+            uint64_t behindExecuted = UINT64_MAX;
+            for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                if (group->active[lane]) {
+                    if (group->pc[lane] < lowest) {
+                        lowest = group->pc[lane];
+                        lowestExecuted = group->executed[lane];
+                    }
+                    highest = group->pc[lane] > highest ? group->pc[lane] : highest;
+                    if (group->executed[lane] < behindExecuted) {
+                        behindExecuted = group->executed[lane];
+                        behindPc = group->pc[lane];
+                    }
+                }
+            }
+            if (lowest == highest) {
+                together = true;
+                pc = lowest;
+            } else {
+                if (lowestExecuted - behindExecuted > LOCKSTEP_MAX_LAG) {
+                    lowest = behindPc;
+                }
+                Lanes mask;
+                for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    mask[lane] = group->active[lane] && group->pc[lane] == lowest ? 0xFF : 0;
+                }
+                const DecodedInstruction* instruction = program + lowest;
+                if (instruction->op == EMULATOR_OP_HALT) {
+                    haltLanes(group, &mask, EMULATOR_HALT_SELF_JUMP, lowest);
+                    continue;
+                } else if (instruction->op == EMULATOR_OP_END) {
+                    haltLanes(group, &mask, EMULATOR_HALT_END, length);
+                    continue;
+                }
+                executeLanes(group, instruction, &mask);
+                Lanes taken = mask;
+                if (instruction->op == EMULATOR_OP_SKIP) {
+                    taken &= (Lanes)(group->registers[0] == group->registers[instruction->operand]);
+                }
+                uint32_t next = instruction->op == EMULATOR_OP_JUMP ? instruction->target : lowest + 1;
+                for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    if (mask[lane]) {
+                        group->pc[lane] = taken[lane] && instruction->op == EMULATOR_OP_SKIP ? instruction->target : next;
+                        group->executed[lane]++;
+                    }
+                }
+                continue;
+            }
+        }
+
+        // every active lane is at pc, run it on all of them at once
+        const DecodedInstruction* instruction = program + pc;
+        if (instruction->op == EMULATOR_OP_HALT || instruction->op == EMULATOR_OP_END) {
+            flushSharedSteps(group, &shared);
+            if (instruction->op == EMULATOR_OP_HALT) {
+                haltLanes(group, &group->active, EMULATOR_HALT_SELF_JUMP, pc);
+            } else {
+                haltLanes(group, &group->active, EMULATOR_HALT_END, length);  // a SKIP may have landed on the second sentinel
+            }
+            continue;
+        }
+        executeLanes(group, instruction, &group->active);
+        shared++;
+        if (instruction->op == EMULATOR_OP_JUMP) {
+            pc = instruction->target;
+        } else if (instruction->op == EMULATOR_OP_SKIP) {
+            Lanes taken = group->active & (Lanes)(group->registers[0] == group->registers[instruction->operand]);
+            Lanes notTaken = group->active & ~taken;
+            if (!anyLane(&taken)) {
+                pc++;
+            } else if (!anyLane(&notTaken)) {
+                pc = instruction->target;
+            } else {
+                // the lanes split up
+                flushSharedSteps(group, &shared);
+                for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++) {
+                    group->pc[lane] = group->active[lane] ? (taken[lane] ? instruction->target : pc + 1) : group->pc[lane];
+                }
+                together = false;
+            }
+        } else {
+            pc++;
+        }
+    }
+    flushSharedSteps(group, &shared);
+}
+
+/**
+ * @brief Run one group of instances
+ *
+ * @param context The LockstepRun
+ * @param index Index of the group to run
+ */
+static void runGroupTask(void* context, uint32_t index)
+{
+    const LockstepRun* run = (const LockstepRun*)context;
+    LaneGroup group;
+    memset(&group, 0, sizeof(group));
+    uint64_t first = (uint64_t)index * LOCKSTEP_LANES;
+    uint32_t numLanes = run->numInstances - first < LOCKSTEP_LANES ? (uint32_t)(run->numInstances - first) : LOCKSTEP_LANES;
+
+    // transpose each instance's state into its lane
+    EmulatorState state;
+    for (uint32_t lane = 0; lane < numLanes; lane++) {
+        memset(&state, 0, sizeof(state));
+        run->generate(run->context, run->firstInstance + first + lane, &state);
+        for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+            group.registers[i][lane] = state.registers[i];
+        }
+        for (uint32_t i = 0; i < EMULATOR_RAM_SIZE; i++) {
+            group.ram[i][lane] = state.ram[i];
+        }
+        group.pc[lane] = state.pc < run->emulator->length ? state.pc : run->emulator->length;
+        group.active[lane] = 0xFF;
+    }
+
+    runLaneGroup(&group, run->emulator->program, run->emulator->length, run->maxSteps);
+
+    for (uint32_t lane = 0; lane < numLanes; lane++) {
+        LockstepResult* result = run->results + first + lane;
+        for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+            result->registers[i] = group.registers[i][lane];
+        }
+        result->reason = group.reason[lane];
+        result->pc = group.pc[lane];
+        result->executed = group.executed[lane];
+    }
+}
+
+/**
+ * @brief Run many instances of one program from different initial states, LOCKSTEP_LANES at a time in SIMD lanes
+ *
+ * @param emulator Holds the predecoded program, its state is not used
+ * @param firstInstance Number passed to generate for the first instance
+ * @param numInstances Number of instances to run
+ * @param generate Fills in each instance's initial state
+ * @param context Passed to generate
+ * @param maxSteps Most lockstep steps per group, which bounds the instructions of every instance, 0 for
+ *                 LOCKSTEP_DEFAULT_MAX_STEPS
+ * @param numThreads Number of threads to use, 0 for one per processor
+ * @param results Receives how each instance finished, numInstances entries
+ * @return 0 if successful, ERROR_VALUE_OUT_OF_RANGE if there are too many instances
+ */
+uint8_t runLockstep(const Emulator* const emulator, uint64_t firstInstance, uint64_t numInstances, InitialStateGenerator generate, void* context, uint64_t maxSteps, uint32_t numThreads, LockstepResult* results)
+{
+    uint64_t numGroups = (numInstances + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES;
+    if (numGroups > UINT32_MAX) {
+        return ERROR_VALUE_OUT_OF_RANGE;
+    }
+    LockstepRun run = {emulator, firstInstance, numInstances, generate, context, maxSteps == 0 ? LOCKSTEP_DEFAULT_MAX_STEPS : maxSteps, results};
+    runWorkerPool(&runGroupTask, &run, (uint32_t)numGroups, numThreads);
+    return 0;
+}
+
+/**
+ * @brief Hash an outcome
+ *
+ * @param registers The final registers
+ * @param reason The halt reason
+ * @return FNV-1a hash of both
+ */
+static uint32_t hashOutcome(const uint8_t* const registers, uint8_t reason)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < EMULATOR_NUM_REGISTERS; i++) {
+        hash ^= *(registers + i);
+        hash *= 16777619u;
+    }
+    hash ^= reason;
+    hash *= 16777619u;
+    return hash;
+}
+
+/**
+ * @brief Double the bucket array (or create it) and reinsert every outcome
+ *
+ * @param histogram Histogram to grow
+ * @return 0 if successful, ERROR_OUT_OF_MEMORY otherwise (histogram is unchanged)
+ */
+static uint8_t growOutcomeBuckets(OutcomeHistogram* histogram)
+{
+    uint32_t newCount = histogram->bucketCount == 0 ? 64 : histogram->bucketCount * 2;
+    while ((histogram->length + 1) * 2 > newCount) {
+        newCount *= 2;
+    }
+    uint32_t* newBuckets = (uint32_t*)calloc(newCount, sizeof(uint32_t));
+    if (newBuckets == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    for (uint32_t i = 0; i < histogram->length; i++) {
+        const OutcomeCount* outcome = histogram->outcomes + i;
+        uint32_t bucket = hashOutcome(outcome->registers, outcome->reason) & (newCount - 1);
+        while (*(newBuckets + bucket) != 0) {
+            bucket = (bucket + 1) & (newCount - 1);
+        }
+        *(newBuckets + bucket) = i + 1;
+    }
+    free(histogram->buckets);
+    histogram->buckets = newBuckets;
+    histogram->bucketCount = newCount;
+    return 0;
+}
+
+/**
+ * @brief Count results into a histogram
+ *
+ * @param histogram The histogram to add to
+ * @param results The results to count
+ * @param numResults Number of results
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY (the histogram holds the results counted so far)
+ */
+uint8_t addOutcomes(OutcomeHistogram* histogram, const LockstepResult* const results, uint64_t numResults)
+{
+    for (uint64_t i = 0; i < numResults; i++) {
+        const LockstepResult* result = results + i;
+        if ((histogram->length + 1) * 2 > histogram->bucketCount && growOutcomeBuckets(histogram) != 0) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        uint32_t mask = histogram->bucketCount - 1;
+        uint32_t bucket = hashOutcome(result->registers, result->reason) & mask;
+        while (*(histogram->buckets + bucket) != 0) {
+            OutcomeCount* outcome = histogram->outcomes + *(histogram->buckets + bucket) - 1;
+            if (outcome->reason == result->reason && memcmp(outcome->registers, result->registers, EMULATOR_NUM_REGISTERS) == 0) {
+                break;
+            }
+            bucket = (bucket + 1) & mask;  // linear probing
+        }
+        if (*(histogram->buckets + bucket) == 0) {
+            if (histogram->length == histogram->capacity) {
+                uint32_t newCapacity = histogram->capacity == 0 ? 32 : histogram->capacity * 2;
+                OutcomeCount* grown = (OutcomeCount*)realloc(histogram->outcomes, newCapacity * sizeof(OutcomeCount));
+                if (grown == NULL) {
+                    return ERROR_OUT_OF_MEMORY;
+                }
+                histogram->outcomes = grown;
+                histogram->capacity = newCapacity;
+            }
+            OutcomeCount* added = histogram->outcomes + histogram->length;
+            memcpy(added->registers, result->registers, EMULATOR_NUM_REGISTERS);
+            added->reason = result->reason;
+            added->count = 0;
+            histogram->length++;
+            *(histogram->buckets + bucket) = histogram->length;
+        }
+        (histogram->outcomes + *(histogram->buckets + bucket) - 1)->count++;
+        histogram->total++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Order outcomes by descending count, then by reason and registers so the order is stable
+ */
+static int compareOutcomes(const void* a, const void* b)
+{
+    const OutcomeCount* first = (const OutcomeCount*)a;
+    const OutcomeCount* second = (const OutcomeCount*)b;
+    if (first->count != second->count) {
+        return first->count > second->count ? -1 : 1;
+    } else if (first->reason != second->reason) {
+        return first->reason < second->reason ? -1 : 1;
+    }
+    return memcmp(first->registers, second->registers, EMULATOR_NUM_REGISTERS);
+}
+
+/**
+ * @brief Sort a histogram's outcomes from most to least common
+ *
+ * @param histogram The histogram to sort
+ */
+void sortOutcomes(OutcomeHistogram* histogram)
+{
+    if (histogram->length > 1) {
+        qsort(histogram->outcomes, histogram->length, sizeof(OutcomeCount), &compareOutcomes);
+    }
+    // the buckets point at the old order, they are rebuilt if more outcomes are added
+    free(histogram->buckets);
+    histogram->buckets = NULL;
+    histogram->bucketCount = 0;
+}
+
+void freeOutcomeHistogram(OutcomeHistogram* histogram)
+{
+    free(histogram->outcomes);
+    free(histogram->buckets);
+    memset(histogram, 0, sizeof(OutcomeHistogram));
+}
@@ -0,0 +1,88 @@
+#ifndef LOCKSTEPEMULATOR_H
+#define LOCKSTEPEMULATOR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "Emulator.h"
+
+#define LOCKSTEP_LANES 64  // instances stepped together, one byte lane each (one AVX-512, two AVX2 or four SSE2 registers)
+#define LOCKSTEP_DEFAULT_MAX_STEPS (1u << 20)
+
+/**
+ * Fill in the initial state of one instance. Called from several threads at once, so it must only depend on its
+ * arguments.
+ */
+typedef void (*InitialStateGenerator)(void* context, uint64_t instance, EmulatorState* state);
+
+/**
+ * How one instance finished. RAM is not kept, so a run of millions of instances stays small.
+ */
+typedef struct _LockstepResult {
+    uint8_t registers[EMULATOR_NUM_REGISTERS];
+    uint8_t reason;  // EMULATOR_HALT_*, never EMULATOR_HALT_CYCLE
+    uint32_t pc;
+    uint64_t executed;
+} LockstepResult;
+
+typedef struct _OutcomeCount {
+    uint8_t registers[EMULATOR_NUM_REGISTERS];
+    uint8_t reason;
+    uint64_t count;
+} OutcomeCount;
+
+/**
+ * Distinct final register files and halt reasons with how many instances ended in each. Open-addressing hash table
+ * like SymbolsList, buckets hold (index + 1) into outcomes. A zeroed OutcomeHistogram is a valid empty histogram.
+ */
+typedef struct _OutcomeHistogram {
+    OutcomeCount* outcomes;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t* buckets;
+    uint32_t bucketCount;
+    uint64_t total;
+} OutcomeHistogram;
+
+/**
+ * @brief Run many instances of one program from different initial states, LOCKSTEP_LANES at a time in SIMD lanes
+ *
+ * The lanes of a group share one program counter while they agree, so each step is one vector operation over every
+ * lane. A SKIP that goes different ways splits them, and from then on each step runs the instruction at the lowest
+ * program counter for just the lanes that are at it (a lane mask) until they meet again. LOAD and STOR gather and
+ * scatter one lane at a time. Groups run in parallel on a worker pool. There is no cycle detection, so instances
+ * that never halt stop at the step limit.
+ *
+ * @param emulator Holds the predecoded program without branch counts attached, its state is not used
+ * @param firstInstance Number passed to generate for the first instance
+ * @param numInstances Number of instances to run
+ * @param generate Fills in each instance's initial state
+ * @param context Passed to generate
+ * @param maxSteps Most lockstep steps per group, which bounds the instructions of every instance, 0 for
+ *                 LOCKSTEP_DEFAULT_MAX_STEPS
+ * @param numThreads Number of threads to use, 0 for one per processor
+ * @param results Receives how each instance finished, numInstances entries
+ * @return 0 if successful, ERROR_VALUE_OUT_OF_RANGE if there are too many instances
+ */
+uint8_t runLockstep(const Emulator* const emulator, uint64_t firstInstance, uint64_t numInstances, InitialStateGenerator generate, void* context, uint64_t maxSteps, uint32_t numThreads, LockstepResult* results);
+
+/**
+ * @brief Count results into a histogram
+ *
+ * @param histogram The histogram to add to
+ * @param results The results to count
+ * @param numResults Number of results
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY (the histogram holds the results counted so far)
+ */
+uint8_t addOutcomes(OutcomeHistogram* histogram, const LockstepResult* const results, uint64_t numResults);
+
+/**
+ * @brief Sort a histogram's outcomes from most to least common
+ *
+ * @param histogram The histogram to sort
+ */
+void sortOutcomes(OutcomeHistogram* histogram);
+
+void freeOutcomeHistogram(OutcomeHistogram* histogram);
+
+#endif
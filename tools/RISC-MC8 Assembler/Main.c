@@ -2,49 +2,736 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "InstructionParser.h"
+#include "Assembler.h"
+#include "AssemblerStats.h"
+#include "AssemblerServer.h"
+#include "BatchAssembler.h"
+#include "BuildCache.h"
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Layout.h"
+#include "LineTable.h"
+#include "Linker.h"
+#include "ObjectModule.h"
+#include "Optimizer.h"
+#include "Schematic.h"
+#include "Source.h"
 #include "StatusCodes.h"
-#include "Symbols.h"
+
+#define USAGE \
+    "Expected arguments: [--single-pass | --threads N] [--cache dir] [--stats fd] [--line-table] [--layout counts.txt]\n" \
+    "                    [--optimize] [--schematic] source.asm output.o\n" \
+    "                or: --batch [--threads N] [--cache dir] [--schematic] [--manifest file] [source.asm output.o]...\n" \
+    "                or: --relocatable source.asm output.o\n" \
+    "                or: --link output.bin module.o...\n" \
+    "                or: --serve socket [--threads N]\n" \
+    "                or: --connect socket source.asm output.o\n" \
+    "                or: --cache dir (--cache-stats | --cache-evict [--max-size bytes[K|M|G]] [--max-age seconds])\n"
+
+/**
+ * @brief Assemble a source on a running server, sending it the whole source at once
+ *
+ * @param socketPath Path the server is listening on
+ * @param source Source to assemble, streams are read to the end first
+ * @param code Buffer to append the assembled code to
+ * @param relaxation Empty report to fill in with the summary of what relaxation did to the code
+ * @param diagnostic Set to the error and where it occurred if one occurs
+ * @return 0 if successful, ERROR_SERVER_UNAVAILABLE if the server could not be reached, otherwise the error
+ */
+static uint8_t assembleThroughServer(const char* const socketPath, SourceReader* source, CodeBuffer* code, RelaxationReport* relaxation, AssemblerDiagnostic* diagnostic)
+{
+    if (source->data != NULL) {
+        return assembleRemote(socketPath, source->data, source->length, code, relaxation, diagnostic);
+    }
+    CodeBuffer text;  // raw bytes, so a code buffer holds the source just as well
+    initGrowableCodeBuffer(&text);
+    const char* line;
+    uint32_t length;
+    bool collected = true;
+    while (collected && readSourceLine(source, &line, &length)) {
+        collected = reserveCode(&text, text.length + length + 1);
+        if (collected) {
+            memcpy(text.data + text.length, line, length);
+            *(text.data + text.length + length) = '\n';
+            text.length += length + 1;
+        }
+    }
+    uint8_t status = ERROR_OUT_OF_MEMORY;
+    if (collected && source->status == 0) {
+        status = assembleRemote(socketPath, (const char*)text.data, text.length, code, relaxation, diagnostic);
+    } else {
+        setDiagnostic(diagnostic, status, 0, 0);
+    }
+    freeCodeBuffer(&text);
+    return status;
+}
+
+/**
+ * @brief Parse a non-negative count, optionally followed by a K, M or G multiplier
+ *
+ * @param text The text to parse
+ * @param allowSuffix Whether a K, M or G multiplier is allowed
+ * @param value Set to the count
+ * @return true if successful, false if text is not a count
+ */
+static bool parseCount(const char* const text, bool allowSuffix, uint64_t* value)
+{
+    char* end;
+    *value = strtoull(text, &end, 10);
+    if (end == text || *text == '-') {
+        return false;
+    }
+    uint32_t shift = 0;
+    if (allowSuffix && (*end == 'K' || *end == 'k')) {
+        shift = 10;
+    } else if (allowSuffix && (*end == 'M' || *end == 'm')) {
+        shift = 20;
+    } else if (allowSuffix && (*end == 'G' || *end == 'g')) {
+        shift = 30;
+    }
+    *value <<= shift;
+    return *(end + (shift != 0)) == '\0';
+}
+
+/**
+ * @brief Report on or trim a build cache
+ *
+ * @param cacheDirectory The cache directory
+ * @param evict true to evict entries, false to print statistics
+ * @param maxBytes Largest total size to keep when evicting, 0 for no limit
+ * @param maxAge Age in seconds after which entries are evicted, 0 for no limit
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t manageCache(const char* const cacheDirectory, bool evict, uint64_t maxBytes, uint64_t maxAge)
+{
+    uint8_t status;
+    if (evict) {
+        uint32_t removed = 0;
+        status = evictCache(cacheDirectory, maxBytes, maxAge, &removed);
+        if (status == 0) {
+            printf("Removed %" PRIu32 " cache entries.\n", removed);
+        }
+    } else {
+        CacheStats stats;
+        status = readCacheStats(cacheDirectory, &stats);
+        if (status == 0) {
+            uint64_t lookups = stats.hits + stats.misses;
+            printf("Hits: %" PRIu64 "\n", stats.hits);
+            printf("Misses: %" PRIu64 "\n", stats.misses);
+            printf("Hit ratio: %.1f%%\n", lookups == 0 ? 0.0 : 100.0 * (double)stats.hits / (double)lookups);
+            printf("Entries: %" PRIu64 " (%" PRIu64 " bytes)\n", stats.entries, stats.bytes);
+        }
+    }
+    if (status == ERROR_INVALID_ARGUMENTS) {
+        fprintf(stderr, "Error: Cache directory does not exist.\n");
+    }
+    return status;
+}
+
+/**
+ * @brief Assemble a source into a relocatable module, exporting its .global labels and importing undefined ones
+ *
+ * @param source Source to assemble
+ * @param outputFile File to write the module to
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t assembleRelocatable(SourceReader* source, FILE* outputFile)
+{
+    ObjectModule module;
+    initObjectModule(&module);
+    AssemblerDiagnostic diagnostic;
+    uint8_t status = assembleObject(source, &module, &diagnostic);
+    if (status == 0) {
+        status = writeObjectModule(outputFile, &module);
+        if (status != 0) {
+            fprintf(stderr, "Error: Could not write output file.\n");
+        }
+    } else {
+        printDiagnostic(stderr, &diagnostic);
+    }
+    freeObjectModule(&module);
+    return status;
+}
+
+/**
+ * @brief Link relocatable modules into a flat binary, laid out in the order given
+ *
+ * @param outputPath Path to write the binary to, removed if an error occurs
+ * @param paths Paths of the modules
+ * @param numPaths Number of modules
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t linkObjects(const char* const outputPath, char** paths, int numPaths)
+{
+    ObjectModule* modules = (ObjectModule*)calloc(numPaths, sizeof(ObjectModule));
+    if (modules == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    printf("Linking %d modules...\n", numPaths);
+
+    uint8_t status = 0;
+    int numRead = 0;
+    for (; numRead < numPaths && status == 0; numRead++) {
+        SourceReader object;
+        initObjectModule(modules + numRead);
+        if (openSourceFile(&object, paths[numRead]) != 0 || object.data == NULL) {
+            fprintf(stderr, "%s: Error: Input file does not exist.\n", paths[numRead]);
+            status = ERROR_INVALID_ARGUMENTS;
+        } else {
+            status = readObjectModule((const uint8_t*)object.data, object.length, modules + numRead);
+            if (status != 0) {
+                AssemblerDiagnostic diagnostic = {status, 0, 0};
+                fprintf(stderr, "%s: ", paths[numRead]);
+                printDiagnostic(stderr, &diagnostic);
+            }
+        }
+        closeSource(&object);
+    }
+
+    CodeBuffer code;
+    initGrowableCodeBuffer(&code);
+    if (status == 0) {
+        AssemblerDiagnostic diagnostic;
+        uint32_t failedModule = 0;
+        status = linkModules(modules, numPaths, &code, &diagnostic, &failedModule);
+        if (status != 0) {
+            fprintf(stderr, "%s: ", paths[failedModule]);
+            printDiagnostic(stderr, &diagnostic);
+        }
+    }
+    if (status == 0) {
+        FILE* outputFile = fopen(outputPath, "wb");
+        if (outputFile == NULL || fwrite(code.data, sizeof(uint8_t), code.length, outputFile) != code.length) {
+            fprintf(stderr, "Error: Could not open output file.\n");
+            status = ERROR_INVALID_ARGUMENTS;
+        }
+        if (outputFile != NULL) {
+            fclose(outputFile);
+        }
+        if (status != 0) {
+            remove(outputPath);
+        }
+    }
+    freeCodeBuffer(&code);
+    for (int i = 0; i < numRead; i++) {
+        freeObjectModule(modules + i);
+    }
+    free(modules);
+    return status;
+}
+
+/**
+ * @brief Report the JUMPs that relaxation gave a route through trampolines and what each costs
+ *
+ * @param report The report of the assembly, nothing is printed if no JUMP was out of range
+ */
+static void printRelaxationReport(const RelaxationReport* const report)
+{
+    if (report->numJumps == 0) {
+        return;
+    }
+    printf("Relaxed %" PRIu32 " out of range jumps from %" PRIu32 " to %" PRIu32 " bytes:", report->numJumps, report->oldLength, report->length);
+    printf(" %" PRIu32 " trampolines,", report->trampolines);
+    printf(" %" PRIu32 " jumps reused,", report->reused);
+    printf(" %" PRIu32 " jumps over trampolines.\n", report->skipJumps);
+    for (uint32_t i = 0; i < report->numJumps; i++) {
+        const RelaxedJump* jump = report->jumps + i;
+        if (jump->line != 0) {
+            printf("  line %" PRIu32 ":", jump->line);
+        } else {
+            printf("  offset %" PRIu32 ":", jump->offset);
+        }
+        printf(" +%" PRIu32 " cycles when taken, +%" PRIu32 " cycles when falling through.\n", jump->hops, jump->skipJumps);
+    }
+}
+
+/**
+ * @brief Optimize an assembled program and report what was saved
+ *
+ * @param code The program, shortened in place
+ * @param offsetMap Set to a new array of where each instruction went, see optimizeCode, or NULL if not needed
+ * @param diagnostic Set to the error if one occurs
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t optimizeProgram(CodeBuffer* code, uint32_t** offsetMap, AssemblerDiagnostic* diagnostic)
+{
+    uint32_t* map = NULL;
+    if (offsetMap != NULL) {
+        map = (uint32_t*)malloc((code->length + 1) * sizeof(uint32_t));
+        *offsetMap = map;
+    }
+    uint32_t length = (uint32_t)code->length;
+    OptimizerStats stats;
+    uint8_t status = offsetMap != NULL && map == NULL ? ERROR_OUT_OF_MEMORY : optimizeCode(code, map, &stats);
+    setDiagnostic(diagnostic, status, 0, 0);
+    if (status == 0) {
+        printf("Optimized away %" PRIu32 " of %" PRIu32 " bytes and %" PRIu32 " cycles:", stats.bytesSaved, length, stats.cyclesSaved);
+        printf(" %" PRIu32 " redundant copies,", stats.rewrites[OPTIMIZER_REDUNDANT_COPY]);
+        printf(" %" PRIu32 " redundant nibble stores,", stats.rewrites[OPTIMIZER_REDUNDANT_NIBBLE]);
+        printf(" %" PRIu32 " dead writes to ireg,", stats.rewrites[OPTIMIZER_DEAD_WRITE]);
+        printf(" %" PRIu32 " jumps to the next instruction,", stats.rewrites[OPTIMIZER_JUMP_TO_NEXT]);
+        printf(" %" PRIu32 " threaded jumps.\n", stats.rewrites[OPTIMIZER_THREADED_JUMP]);
+    }
+    return status;
+}
+
+/**
+ * @brief Build the line table of an assembled source, for the program as relaxation left it
+ *
+ * @param source The source that was assembled, rewound and read again
+ * @param sourcePath Path of the source, recorded for annotating it later
+ * @param relaxation Where relaxation moved each instruction and what it inserted
+ * @param table Empty table to fill in
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t buildProgramLineTable(SourceReader* source, const char* const sourcePath, const RelaxationReport* const relaxation, LineTable* table)
+{
+    uint8_t status = !rewindSource(source) ? ERROR_OUT_OF_MEMORY : buildLineTable(source, sourcePath, table);
+    return status != 0 ? status : relaxLineTable(table, relaxation);
+}
+
+/**
+ * @brief Write the line table of an assembled source next to its output, as output.o.lines
+ *
+ * @param table The table, moved along with every pass over the program
+ * @param outputPath Path of the assembled output
+ * @return 0 if successful, otherwise the error that occurred (already printed)
+ */
+static uint8_t writeLineTableFile(const LineTable* const table, const char* const outputPath)
+{
+    size_t outputLength = strlen(outputPath);
+    char* tablePath = (char*)malloc(outputLength + sizeof(LINE_TABLE_EXTENSION));
+    if (tablePath == NULL) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        return ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(tablePath, outputPath, outputLength);
+    memcpy(tablePath + outputLength, LINE_TABLE_EXTENSION, sizeof(LINE_TABLE_EXTENSION));
+    FILE* tableFile = fopen(tablePath, "wb");
+    uint8_t status = tableFile == NULL ? ERROR_INVALID_ARGUMENTS : writeLineTable(tableFile, table);
+    if (tableFile != NULL && fclose(tableFile) != 0) {
+        status = ERROR_INVALID_ARGUMENTS;
+    }
+    if (status != 0) {
+        fprintf(stderr, "Error: Could not write line table.\n");
+        remove(tablePath);
+    }
+    free(tablePath);
+    return status;
+}
+
+/**
+ * @brief Lay out an assembled program by how often its labels were reached and report the cycles saved
+ *
+ * @param code The program, rewritten in place
+ * @param countsFile The execution count file, see readLabelCounts
+ * @param table Line table of the program, moved along with its instructions
+ * @param diagnostic Set to the error if one occurs
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t layoutProgram(CodeBuffer* code, SourceReader* countsFile, LineTable* table, AssemblerDiagnostic* diagnostic)
+{
+    uint32_t length = (uint32_t)code->length;
+    uint32_t maxLength = length > SCHEMATIC_MAX_BYTES ? length : SCHEMATIC_MAX_BYTES;  // never grow past the ROM
+    uint64_t* counts = (uint64_t*)malloc(((size_t)length + 1) * sizeof(uint64_t));
+    uint32_t* offsetMap = (uint32_t*)malloc(((size_t)length + 1) * sizeof(uint32_t));
+    uint32_t* origins = (uint32_t*)malloc((size_t)maxLength * sizeof(uint32_t));
+    uint8_t status = counts == NULL || offsetMap == NULL || origins == NULL ? ERROR_OUT_OF_MEMORY : 0;
+    setDiagnostic(diagnostic, status, 0, 0);
+    uint32_t unknownLabels = 0;
+    if (status == 0) {
+        for (uint32_t i = 0; i <= length; i++) {
+            *(counts + i) = LAYOUT_UNKNOWN_COUNT;
+        }
+        status = table->length == length ? readLabelCounts(countsFile, table, counts, &unknownLabels, diagnostic) : 0;
+    }
+    LayoutStats stats;
+    if (status == 0) {
+        status = layoutCode(code, counts, maxLength, offsetMap, origins, &stats);
+        if (status == 0 && table->length == length) {
+            status = reorderLineTable(table, offsetMap, origins, (uint32_t)code->length);
+        }
+        setDiagnostic(diagnostic, status, 0, 0);
+    }
+    if (status == 0) {
+        printf("Laid out %" PRIu32 " blocks by execution count, saving an estimated %" PRIu64 " of %" PRIu64 " cycles spent in jumps:", stats.blocks, stats.cyclesBefore - stats.cyclesAfter, stats.cyclesBefore);
+        printf(" %" PRIu32 " jumps removed,", stats.jumpsRemoved);
+        printf(" %" PRIu32 " jumps added,", stats.jumpsAdded);
+        printf(" %" PRIu32 " hot paths kept in place to keep jumps in range.\n", stats.placementsSkipped);
+        if (unknownLabels > 0) {
+            printf("Note: %" PRIu32 " labels in the execution counts are not in the program.\n", unknownLabels);
+        }
+    }
+    free(counts);
+    free(offsetMap);
+    free(origins);
+    return status;
+}
+
+/**
+ * @brief Assemble many files in one process, from pairs on the command line and/or a manifest
+ *
+ * @param paths Alternating source and output paths
+ * @param numPaths Number of entries in paths, must be even
+ * @param manifestPath Path of a manifest of more pairs, `-` for stdin, or NULL for none
+ * @param numThreads Size of the thread pool, 0 for one thread per processor
+ * @param cacheDirectory Build cache to reuse earlier results from, or NULL for none
+ * @param schematic true to write Minecraft ROM schematics instead of the raw code
+ * @return 0 if every file assembled, otherwise the error of the first file that failed
+ */
+static uint8_t assembleBatch(char** paths, int numPaths, const char* manifestPath, uint32_t numThreads, const char* cacheDirectory, bool schematic)
+{
+    BatchList* batch = (BatchList*)calloc(1, sizeof(BatchList));
+    if (batch == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    uint8_t status = 0;
+    for (int i = 0; i + 1 < numPaths && status == 0; i += 2) {
+        status = addBatchJob(batch, paths[i], strlen(paths[i]), paths[i + 1], strlen(paths[i + 1]));
+    }
+    if (status == 0 && manifestPath != NULL) {
+        SourceReader manifest;
+        if (strcmp(manifestPath, "-") == 0) {
+            openSourceStream(&manifest, stdin);
+        } else if (openSourceFile(&manifest, manifestPath) != 0) {
+            fprintf(stderr, "Error: Manifest file does not exist.\n");
+            freeBatchList(&batch);
+            return ERROR_INVALID_ARGUMENTS;
+        }
+        status = readBatchManifest(batch, &manifest, stderr);
+        closeSource(&manifest);
+    }
+    if (status != 0) {
+        freeBatchList(&batch);
+        return status;
+    }
+
+    printf("Assembling %d files...\n", batch->length);
+
+    status = runBatch(batch, numThreads, cacheDirectory, schematic, stderr);
+    uint32_t succeeded = 0;
+    for (uint32_t i = 0; i < batch->length; i++) {
+        succeeded += (batch->jobs + i)->status == 0;
+    }
+    printf("Assembled %d of %d files.\n", succeeded, batch->length);
+    freeBatchList(&batch);
+    return status;
+}
 
 /**
  * @brief Assemble the indicated file to the indicated output file, using the RISC-MC8 instruction set
  *
  * @param argc Argument count
- * @param argv Arguments, should be `source.asm, output.o`
+ * @param argv Arguments, should be `[--single-pass | --threads N] source.asm output.o`, a source of `-` reads stdin
+ *             in a single pass, and --threads 0 uses one thread per processor. With `--batch`, any number of
+ *             `source.asm output.o` pairs may be given, and `--manifest file` reads more pairs from a file.
+ *             `--serve socket` runs a server on a Unix socket and `--connect socket` assembles through one, as do
+ *             plain invocations when RISC_MC8_ASSEMBLER_SOCKET names a running server. `--cache dir` (or
+ *             RISC_MC8_ASSEMBLER_CACHE) reuses earlier results for identical sources, and `--cache-stats` or
+ *             `--cache-evict [--max-size bytes] [--max-age seconds]` manage that cache. `--relocatable` writes a
+ *             module for `--link output.bin module.o...` to combine. `--stats fd` writes phase timings and counts as
+ *             JSON to file descriptor fd. `--schematic` writes each output as a Minecraft ROM schematic.
+ *             `--optimize` removes redundant instructions and threads JUMPs before writing a single output, and
+ *             `--layout counts.txt` first reorders its blocks so the labels reached most often fall through.
  * @return 0 if successful, otherwise a non-zero error code accompanied with a message on stout
  */
 int main(int argc, char** argv)
 {
-    if (argc != 3) {
+    bool singlePass = false;
+    bool parallel = false;
+    bool batch = false;
+    bool relocatable = false;
+    const char* linkPath = NULL;
+    const char* manifestPath = NULL;
+    const char* servePath = NULL;
+    const char* connectPath = NULL;
+    const char* cacheDirectory = getenv(CACHE_DIRECTORY_ENVIRONMENT);
+    bool cacheStats = false;
+    bool cacheEvict = false;
+    uint64_t maxBytes = 0;
+    uint64_t maxAge = 0;
+    uint32_t numThreads = 0;
+    int statsFd = -1;
+    bool lineTable = false;
+    bool schematic = false;
+    bool optimize = false;
+    const char* countsPath = NULL;
+    char** paths = (char**)calloc(argc, sizeof(char*));
+    if (paths == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    int numPaths = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--single-pass") == 0) {
+            singlePass = true;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            batch = true;
+            manifestPath = argv[++i];
+        } else if (strcmp(argv[i], "--relocatable") == 0) {
+            relocatable = true;
+        } else if (strcmp(argv[i], "--link") == 0 && i + 1 < argc) {
+            linkPath = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            servePath = argv[++i];
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connectPath = argv[++i];
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cacheDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--cache-stats") == 0) {
+            cacheStats = true;
+        } else if (strcmp(argv[i], "--cache-evict") == 0) {
+            cacheEvict = true;
+        } else if ((strcmp(argv[i], "--max-size") == 0 || strcmp(argv[i], "--max-age") == 0) && i + 1 < argc) {
+            bool size = strcmp(argv[i], "--max-size") == 0;
+            if (!parseCount(argv[i + 1], size, size ? &maxBytes : &maxAge)) {
+                fprintf(stderr, "Error: Invalid %s.\n", size ? "cache size" : "cache age");
+                fprintf(stderr, USAGE);
+                free(paths);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            uint64_t fd;
+            if (!parseCount(argv[++i], false, &fd) || fd > INT32_MAX) {
+                fprintf(stderr, "Error: Invalid file descriptor.\n");
+                fprintf(stderr, USAGE);
+                free(paths);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+            statsFd = (int)fd;
+        } else if (strcmp(argv[i], "--line-table") == 0) {
+            lineTable = true;
+        } else if (strcmp(argv[i], "--schematic") == 0) {
+            schematic = true;
+        } else if (strcmp(argv[i], "--optimize") == 0) {
+            optimize = true;
+        } else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+            countsPath = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            char* end;
+            numThreads = strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || *argv[i] == '\0' || *argv[i] == '-') {
+                fprintf(stderr, "Error: Invalid thread count.\n");
+                fprintf(stderr, USAGE);
+                free(paths);
+                return ERROR_INVALID_ARGUMENTS;
+            }
+            parallel = true;
+        } else {
+            paths[numPaths++] = argv[i];
+        }
+    }
+    bool otherMode = batch || relocatable || linkPath != NULL || servePath != NULL || connectPath != NULL;
+    if (statsFd >= 0 && (otherMode || cacheStats || cacheEvict)) {
+        fprintf(stderr, "Error: --stats only applies to assembling a single file.\n");
+        fprintf(stderr, USAGE);
+        free(paths);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    if (lineTable && (otherMode || cacheStats || cacheEvict || (numPaths > 0 && strcmp(paths[0], "-") == 0))) {
+        fprintf(stderr, "Error: --line-table only applies to assembling a single source file.\n");
+        fprintf(stderr, USAGE);
+        free(paths);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    if (countsPath != NULL && (otherMode || cacheStats || cacheEvict || (numPaths > 0 && strcmp(paths[0], "-") == 0))) {
+        fprintf(stderr, "Error: --layout only applies to assembling a single source file.\n");
+        fprintf(stderr, USAGE);
+        free(paths);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    if (optimize && (otherMode || cacheStats || cacheEvict)) {
+        fprintf(stderr, "Error: --optimize only applies to assembling a single file.\n");
+        fprintf(stderr, USAGE);
+        free(paths);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    if (schematic && (relocatable || linkPath != NULL || servePath != NULL || cacheStats || cacheEvict)) {
+        fprintf(stderr, "Error: --schematic only applies to assembling source files.\n");
+        fprintf(stderr, USAGE);
+        free(paths);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    if (cacheStats || cacheEvict) {
+        free(paths);
+        if (numPaths != 0 || cacheDirectory == NULL || (cacheStats && cacheEvict)) {
+            fprintf(stderr, "Error: Wrong number of arguments.\n");
+            fprintf(stderr, USAGE);
+            return ERROR_INVALID_ARGUMENTS;
+        }
+        return manageCache(cacheDirectory, cacheEvict, maxBytes, maxAge);
+    }
+    if (linkPath != NULL) {
+        uint8_t linkStatus = ERROR_INVALID_ARGUMENTS;
+        if (numPaths == 0 || batch || relocatable) {
+            fprintf(stderr, "Error: Wrong number of arguments.\n");
+            fprintf(stderr, USAGE);
+        } else {
+            linkStatus = linkObjects(linkPath, paths, numPaths);
+            if (linkStatus == 0) {
+                printf("Finished successfully.\n");
+            }
+        }
+        free(paths);
+        return linkStatus;
+    }
+    if (servePath != NULL) {
+        free(paths);
+        if (numPaths != 0 || batch || singlePass || connectPath != NULL) {
+            fprintf(stderr, "Error: Wrong number of arguments.\n");
+            fprintf(stderr, USAGE);
+            return ERROR_INVALID_ARGUMENTS;
+        }
+        printf("Serving on %s...\n", servePath);
+        fflush(stdout);
+        return runAssemblerServer(servePath, numThreads, stderr);
+    }
+    bool validBatch = batch && !singlePass && numPaths % 2 == 0 && (numPaths > 0 || manifestPath != NULL);
+    bool validRemote = connectPath == NULL || (!batch && !singlePass && !parallel);
+    bool validRelocatable = !relocatable || (!batch && !parallel && connectPath == NULL);
+    if (batch ? !validBatch : (numPaths != 2 || (singlePass && parallel) || !validRemote || !validRelocatable)) {
         fprintf(stderr, "Error: Wrong number of arguments.\n");
-        fprintf(stderr, "Expected arguments: source.asm output.o\n");
+        fprintf(stderr, USAGE);
+        free(paths);
         return ERROR_INVALID_ARGUMENTS;
     }
-    FILE* inputFile = fopen(argv[1], "r");
-    if (inputFile == NULL) {
+    if (batch) {
+        uint8_t batchStatus = assembleBatch(paths, numPaths, manifestPath, numThreads, cacheDirectory, schematic);
+        free(paths);
+        return batchStatus;
+    }
+    const char* sourcePath = paths[0];
+    const char* outputPath = paths[1];
+    free(paths);
+
+    SourceReader source;
+    if (strcmp(sourcePath, "-") == 0) {
+        openSourceStream(&source, stdin);
+    } else if (openSourceFile(&source, sourcePath) != 0) {
         fprintf(stderr, "Error: Input file does not exist.\n");
         return ERROR_INVALID_ARGUMENTS;
     }
-
-    printf("Extracting symbols...\n");
-
-    SymbolsList* symbols = extractSymbols(inputFile, true);
-    if (symbols == NULL) {
-        fclose(inputFile);
-        return ERROR_SYMBOLS_LIST_NULL;
+    SourceReader countsFile;  // read as text, like a source
+    if (countsPath != NULL && openSourceFile(&countsFile, countsPath) != 0) {
+        fprintf(stderr, "Error: Execution count file does not exist.\n");
+        closeSource(&source);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    FILE* outputFile = fopen(outputPath, "wb");
+    if (outputFile == NULL) {
+        fprintf(stderr, "Error: Could not open output file.\n");
+        closeSource(&source);
+        if (countsPath != NULL) {
+            closeSource(&countsFile);
+        }
+        return ERROR_INVALID_ARGUMENTS;
     }
-    rewind(inputFile);
 
-    printf("Assembling instructions...\n");
+    if (relocatable) {
+        printf("Assembling module...\n");
+        uint8_t moduleStatus = assembleRelocatable(&source, outputFile);
+        closeSource(&source);
+        if (countsPath != NULL) {
+            closeSource(&countsFile);
+        }
+        fclose(outputFile);
+        if (moduleStatus != 0) {
+            remove(outputPath);  // nuke output file if there was an error
+        } else {
+            printf("Finished successfully.\n");
+        }
+        return moduleStatus;
+    }
 
-    FILE* outputFile = fopen(argv[2], "wb");
-    uint8_t parseStatus = parseInstructionsFile(inputFile, outputFile, symbols, true);
-    fclose(inputFile);
+    AssemblerStats stats;
+    memset(&stats, 0, sizeof(stats));
+    RelaxationReport relaxation;
+    memset(&relaxation, 0, sizeof(relaxation));
+    AssemblerOptions options = {ASSEMBLER_MODE_TWO_PASS, numThreads, statsFd >= 0 ? &stats : NULL, &relaxation};
+    if (parallel && source.data != NULL) {
+        options.mode = ASSEMBLER_MODE_PARALLEL;
+        printf("Assembling instructions in parallel...\n");
+    } else {
+        options.mode = singlePass ? ASSEMBLER_MODE_SINGLE_PASS : ASSEMBLER_MODE_TWO_PASS;
+        printf("Assembling instructions...\n");
+    }
+    // plain invocations go through a server named in the environment when one is running, so existing scripts
+    // get its speed without changes; an explicit --connect must reach its server, and --stats measures this process.
+    // A line table needs to know where relaxation moved each instruction, which only a local assembly reports
+    bool needsLineTable = lineTable || countsPath != NULL;
+    bool localFallback = connectPath == NULL;
+    if (connectPath == NULL && !singlePass && !parallel && source.data != NULL && statsFd < 0 && !needsLineTable) {
+        connectPath = getenv(SERVER_SOCKET_ENVIRONMENT);
+    }
+    CodeBuffer code;
+    initGrowableCodeBuffer(&code);
+    AssemblerDiagnostic diagnostic;
+    if (statsFd >= 0) {
+        startStatsCounting();
+    }
+    uint8_t parseStatus = ERROR_SERVER_UNAVAILABLE;
+    if (connectPath != NULL && *connectPath != '\0') {
+        parseStatus = assembleThroughServer(connectPath, &source, &code, &relaxation, &diagnostic);
+    }
+    if (parseStatus == ERROR_SERVER_UNAVAILABLE && localFallback) {
+        parseStatus = assembleWithCache(needsLineTable ? NULL : cacheDirectory, &source, &code, &options, &diagnostic);
+    }
+    if (parseStatus == 0) {
+        printRelaxationReport(&relaxation);
+    }
+    PhaseTimer timer;
+    startPhase(&timer);
+    LineTable table;
+    initLineTable(&table);
+    if (parseStatus == 0 && needsLineTable) {
+        parseStatus = buildProgramLineTable(&source, sourcePath, &relaxation, &table);
+        setDiagnostic(&diagnostic, parseStatus, 0, 0);
+    }
+    if (parseStatus == 0 && countsPath != NULL) {
+        parseStatus = layoutProgram(&code, &countsFile, &table, &diagnostic);
+    }
+    uint32_t* offsetMap = NULL;
+    if (parseStatus == 0 && optimize) {
+        parseStatus = optimizeProgram(&code, lineTable ? &offsetMap : NULL, &diagnostic);
+    }
+    if (parseStatus == 0 && offsetMap != NULL) {
+        remapLineTable(&table, offsetMap);
+    }
+    if (parseStatus == 0 && schematic) {
+        parseStatus = writeRomSchematic(outputFile, code.data, code.length);
+        setDiagnostic(&diagnostic, parseStatus, 0, 0);
+    } else if (parseStatus == 0) {
+        fwrite(code.data, sizeof(uint8_t), code.length, outputFile);
+    }
+    if (parseStatus != 0) {
+        printDiagnostic(stderr, &diagnostic);
+    }
+    if (parseStatus == 0 && lineTable) {
+        parseStatus = writeLineTableFile(&table, outputPath);
+    }
+    freeLineTable(&table);
+    free(offsetMap);
+    freeRelaxationReport(&relaxation);
+    freeCodeBuffer(&code);
+    closeSource(&source);
+    if (countsPath != NULL) {
+        closeSource(&countsFile);
+    }
     fclose(outputFile);
-    freeSymbolsList(&symbols);
+    stopPhase(&timer, &stats.output);
+    if (statsFd >= 0) {
+        readStatsCounters(&stats);
+        fflush(stdout);  // keep the report after the progress messages when both go to the same place
+        if (!writeStatsJson(statsFd, &stats, parseStatus)) {
+            fprintf(stderr, "Error: Could not write statistics.\n");
+        }
+    }
     if (parseStatus != 0) {
-        remove(argv[2]);  // nuke output file if there was an error
+        remove(outputPath);  // nuke output file if there was an error
     } else {
         printf("Finished successfully.\n");
     }
@@ -0,0 +1,318 @@
+#include "ObjectModule.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Fixups.h"
+#include "InstructionParser.h"
+#include "StatusCodes.h"
+#include "Symbols.h"
+
+#define OBJECT_HEADER_LENGTH 20
+#define OBJECT_SYMBOL_HEADER_LENGTH 13
+#define OBJECT_RELOCATION_LENGTH 12
+
+/**
+ * @brief Start an empty module
+ *
+ * @param module The module to initialize
+ */
+void initObjectModule(ObjectModule* module)
+{
+    memset(module, 0, sizeof(ObjectModule));
+    initGrowableCodeBuffer(&module->code);
+}
+
+void freeObjectModule(ObjectModule* module)
+{
+    for (uint32_t i = 0; i < module->numSymbols; i++) {
+        free((module->symbols + i)->name);
+    }
+    free(module->symbols);
+    free(module->relocations);
+    freeCodeBuffer(&module->code);
+    initObjectModule(module);
+}
+
+/**
+ * @brief Add a symbol to a module
+ *
+ * @param module Module to add to
+ * @param name Name of the symbol, copied by the module
+ * @param length Number of characters in name
+ * @param kind OBJECT_SYMBOL_EXPORT or OBJECT_SYMBOL_IMPORT
+ * @param value Offset of an export, 0 for an import
+ * @param line Line the symbol was exported or first used on
+ * @return 0 if successful, otherwise an error code
+ */
+static uint8_t addObjectSymbol(ObjectModule* module, const char* const name, uint32_t length, uint8_t kind, uint32_t value, uint32_t line)
+{
+    if (module->numSymbols == module->symbolCapacity) {
+        uint32_t newCapacity = module->symbolCapacity == 0 ? 16 : module->symbolCapacity * 2;
+        ObjectSymbol* grown = (ObjectSymbol*)realloc(module->symbols, newCapacity * sizeof(ObjectSymbol));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        module->symbols = grown;
+        module->symbolCapacity = newCapacity;
+    }
+    ObjectSymbol* added = module->symbols + module->numSymbols;
+    added->name = (char*)malloc(length + 1);
+    if (added->name == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        *(added->name + i) = toLowerAscii(*(name + i));
+    }
+    *(added->name + length) = '\0';
+    added->kind = kind;
+    added->value = value;
+    added->line = line;
+    module->numSymbols++;
+    return 0;
+}
+
+/**
+ * @brief Add a relocation to a module
+ *
+ * @param module Module to add to
+ * @param offset Offset of the JUMP to patch
+ * @param symbol Index of the symbol it jumps to
+ * @param line Source line of the JUMP
+ * @return 0 if successful, otherwise an error code
+ */
+static uint8_t addRelocation(ObjectModule* module, uint32_t offset, uint32_t symbol, uint32_t line)
+{
+    if (module->numRelocations == module->relocationCapacity) {
+        uint32_t newCapacity = module->relocationCapacity == 0 ? 16 : module->relocationCapacity * 2;
+        Relocation* grown = (Relocation*)realloc(module->relocations, newCapacity * sizeof(Relocation));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        module->relocations = grown;
+        module->relocationCapacity = newCapacity;
+    }
+    Relocation* added = module->relocations + module->numRelocations;
+    added->offset = offset;
+    added->symbol = symbol;
+    added->line = line;
+    module->numRelocations++;
+    return 0;
+}
+
+/**
+ * @brief Record the exports and imports of an assembled module
+ *
+ * @param module Module to add the symbols and relocations to
+ * @param symbols Labels defined in the source
+ * @param fixups JUMPs whose labels were not defined in the source are still pending
+ * @param exports Names given to `.global`, with the line of the directive as the value
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise the error that occurred
+ */
+static uint8_t collectObjectSymbols(ObjectModule* module, SymbolsList* symbols, FixupsList* fixups, SymbolsList* exports, AssemblerDiagnostic* diagnostic)
+{
+    uint8_t status = 0;
+    for (uint32_t i = 0; i < exports->length && status == 0; i++) {
+        const Symbol* exported = exports->symbols + i;
+        const char* name = getSymbolName(exports, exported);
+        const Symbol* defined = findSymbol(symbols, name);
+        if (defined == NULL) {
+            status = ERROR_UNKNOWN_LABEL;
+            setDiagnostic(diagnostic, status, exported->value, 0);
+        } else {
+            status = addObjectSymbol(module, name, strlen(name), OBJECT_SYMBOL_EXPORT, defined->value, exported->value);
+        }
+    }
+
+    // every label still waiting on fixups is an import, its chain lists the JUMPs to relocate
+    for (uint32_t i = 0; i < fixups->labels.length && status == 0; i++) {
+        const Symbol* referenced = fixups->labels.symbols + i;
+        const char* name = getSymbolName(&fixups->labels, referenced);
+        if (findSymbol(symbols, name) != NULL) {
+            continue;  // defined later in the source, already patched
+        }
+        uint32_t index = module->numSymbols;
+        const Fixup* first = NULL;
+        for (uint32_t next = referenced->value; next != 0 && status == 0; next = (fixups->fixups + next - 1)->previous) {
+            first = fixups->fixups + next - 1;
+            status = addRelocation(module, first->offset, index, first->line);
+        }
+        if (status == 0) {
+            status = addObjectSymbol(module, name, strlen(name), OBJECT_SYMBOL_IMPORT, 0, first->line);
+        }
+    }
+    if (status == ERROR_OUT_OF_MEMORY) {
+        setDiagnostic(diagnostic, status, 0, 0);
+    }
+    return status;
+}
+
+/**
+ * @brief Assemble a source into a relocatable module
+ *
+ * @param source Source to assemble, may be a pipe
+ * @param module Empty module to fill in
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise the error that occurred
+ */
+uint8_t assembleObject(SourceReader* source, ObjectModule* module, AssemblerDiagnostic* diagnostic)
+{
+    setDiagnostic(diagnostic, 0, 0, 0);
+    SymbolsList* symbols = (SymbolsList*)calloc(1, sizeof(SymbolsList));
+    SymbolsList* exports = (SymbolsList*)calloc(1, sizeof(SymbolsList));
+    FixupsList* fixups = (FixupsList*)calloc(1, sizeof(FixupsList));
+    uint8_t status = symbols == NULL || exports == NULL || fixups == NULL ? ERROR_OUT_OF_MEMORY : 0;
+    if (status == 0) {
+        status = parseInstructionsDeferred(source, &module->code, symbols, fixups, exports, NULL, diagnostic);
+        if (source->status != 0) {
+            status = source->status;
+            setDiagnostic(diagnostic, status, source->lineNumber + 1, 0);
+        }
+    } else {
+        setDiagnostic(diagnostic, status, 0, 0);
+    }
+    if (status == 0) {
+        status = collectObjectSymbols(module, symbols, fixups, exports, diagnostic);
+    }
+    if (fixups != NULL) {
+        freeFixupsList(&fixups);
+    }
+    if (exports != NULL) {
+        freeSymbolsList(&exports);
+    }
+    if (symbols != NULL) {
+        freeSymbolsList(&symbols);
+    }
+    return status;
+}
+
+/**
+ * @brief Write a 32-bit value in little-endian order
+ *
+ * @param dest Where to write the 4 bytes
+ * @param value The value to write
+ */
+static void putObjectUint32(uint8_t* dest, uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; i++) {
+        *(dest + i) = (uint8_t)(value >> (i * 8));
+    }
+}
+
+/**
+ * @brief Read a 32-bit value in little-endian order
+ *
+ * @param src The 4 bytes to read
+ * @return The value
+ */
+static uint32_t getObjectUint32(const uint8_t* const src)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        value |= (uint32_t)*(src + i) << (i * 8);
+    }
+    return value;
+}
+
+/**
+ * @brief Write a module in the relocatable object format
+ *
+ * @param outputFile Where to write the module
+ * @param module The module to write
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the file could not be written
+ */
+uint8_t writeObjectModule(FILE* outputFile, const ObjectModule* const module)
+{
+    uint8_t header[OBJECT_HEADER_LENGTH];
+    memcpy(header, OBJECT_MAGIC, 7);
+    header[7] = OBJECT_FORMAT_VERSION;
+    putObjectUint32(header + 8, (uint32_t)module->code.length);
+    putObjectUint32(header + 12, module->numSymbols);
+    putObjectUint32(header + 16, module->numRelocations);
+    bool written = fwrite(header, 1, OBJECT_HEADER_LENGTH, outputFile) == OBJECT_HEADER_LENGTH;
+    written = written && fwrite(module->code.data, 1, module->code.length, outputFile) == module->code.length;
+
+    for (uint32_t i = 0; i < module->numSymbols && written; i++) {
+        const ObjectSymbol* symbol = module->symbols + i;
+        uint32_t nameLength = (uint32_t)strlen(symbol->name);
+        uint8_t record[OBJECT_SYMBOL_HEADER_LENGTH];
+        record[0] = symbol->kind;
+        putObjectUint32(record + 1, symbol->value);
+        putObjectUint32(record + 5, symbol->line);
+        putObjectUint32(record + 9, nameLength);
+        written = fwrite(record, 1, OBJECT_SYMBOL_HEADER_LENGTH, outputFile) == OBJECT_SYMBOL_HEADER_LENGTH;
+        written = written && fwrite(symbol->name, 1, nameLength, outputFile) == nameLength;
+    }
+    for (uint32_t i = 0; i < module->numRelocations && written; i++) {
+        const Relocation* relocation = module->relocations + i;
+        uint8_t record[OBJECT_RELOCATION_LENGTH];
+        putObjectUint32(record, relocation->offset);
+        putObjectUint32(record + 4, relocation->symbol);
+        putObjectUint32(record + 8, relocation->line);
+        written = fwrite(record, 1, OBJECT_RELOCATION_LENGTH, outputFile) == OBJECT_RELOCATION_LENGTH;
+    }
+    return written ? 0 : ERROR_INVALID_ARGUMENTS;
+}
+
+/**
+ * @brief Read a module in the relocatable object format
+ *
+ * Exports must be within the code or at its end, and relocations must be to JUMPs in the code and name imports.
+ *
+ * @param data The whole object file, such as a memory-mapped file
+ * @param length Number of bytes in data
+ * @param module Empty module to fill in
+ * @return 0 if successful, ERROR_MALFORMED_OBJECT if data is not a valid object, otherwise the error that occurred
+ */
+uint8_t readObjectModule(const uint8_t* const data, size_t length, ObjectModule* module)
+{
+    if (length < OBJECT_HEADER_LENGTH || memcmp(data, OBJECT_MAGIC, 7) != 0 || data[7] != OBJECT_FORMAT_VERSION) {
+        return ERROR_MALFORMED_OBJECT;
+    }
+    uint32_t codeLength = getObjectUint32(data + 8);
+    uint32_t numSymbols = getObjectUint32(data + 12);
+    uint32_t numRelocations = getObjectUint32(data + 16);
+    size_t position = OBJECT_HEADER_LENGTH;
+    if (length - position < codeLength || !reserveCode(&module->code, codeLength)) {
+        return length - position < codeLength ? ERROR_MALFORMED_OBJECT : ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(module->code.data, data + position, codeLength);
+    module->code.length = codeLength;
+    position += codeLength;
+
+    uint8_t status = 0;
+    for (uint32_t i = 0; i < numSymbols && status == 0; i++) {
+        if (length - position < OBJECT_SYMBOL_HEADER_LENGTH) {
+            return ERROR_MALFORMED_OBJECT;
+        }
+        const uint8_t* record = data + position;
+        uint32_t nameLength = getObjectUint32(record + 9);
+        position += OBJECT_SYMBOL_HEADER_LENGTH;
+        uint32_t value = getObjectUint32(record + 1);
+        // an export may mark the end of the code, like a label after the last instruction
+        bool outside = record[0] == OBJECT_SYMBOL_EXPORT && value > codeLength;
+        if (record[0] > OBJECT_SYMBOL_IMPORT || outside || length - position < nameLength) {
+            return ERROR_MALFORMED_OBJECT;
+        }
+        status = addObjectSymbol(module, (const char*)(data + position), nameLength, record[0], value, getObjectUint32(record + 5));
+        position += nameLength;
+    }
+    for (uint32_t i = 0; i < numRelocations && status == 0; i++) {
+        if (length - position < OBJECT_RELOCATION_LENGTH) {
+            return ERROR_MALFORMED_OBJECT;
+        }
+        const uint8_t* record = data + position;
+        uint32_t offset = getObjectUint32(record);
+        uint32_t symbol = getObjectUint32(record + 4);
+        if (offset >= codeLength || symbol >= numSymbols || (module->symbols + symbol)->kind != OBJECT_SYMBOL_IMPORT) {
+            return ERROR_MALFORMED_OBJECT;
+        }
+        status = addRelocation(module, offset, symbol, getObjectUint32(record + 8));
+        position += OBJECT_RELOCATION_LENGTH;
+    }
+    return status;
+}
@@ -0,0 +1,94 @@
+#ifndef OBJECTMODULE_H
+#define OBJECTMODULE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Source.h"
+
+#define OBJECT_MAGIC "RMC8OBJ"
+#define OBJECT_FORMAT_VERSION 1
+
+#define OBJECT_SYMBOL_EXPORT 0
+#define OBJECT_SYMBOL_IMPORT 1
+
+/*
+ * Relocatable object layout, all integers little-endian:
+ *   "RMC8OBJ", u8 format version
+ *   u32 code length, u32 symbol count, u32 relocation count
+ *   code bytes
+ *   per symbol: u8 kind, u32 value (offset of an export, 0 for an import), u32 line, u32 name length, name bytes
+ *   per relocation: u32 offset of the JUMP, u32 index of the imported symbol, u32 line
+ * JUMPs are relative, so only those to imported labels need relocating; everything else is final.
+ */
+
+typedef struct _ObjectSymbol {
+    char* name;  // lowercase, NUL terminated
+    uint8_t kind;
+    uint32_t value;
+    uint32_t line;  // where it was exported or first used, for error reporting
+} ObjectSymbol;
+
+typedef struct _Relocation {
+    uint32_t offset;
+    uint32_t symbol;
+    uint32_t line;
+} Relocation;
+
+typedef struct _ObjectModule {
+    CodeBuffer code;
+    ObjectSymbol* symbols;
+    uint32_t numSymbols;
+    uint32_t symbolCapacity;
+    Relocation* relocations;
+    uint32_t numRelocations;
+    uint32_t relocationCapacity;
+} ObjectModule;
+
+/**
+ * @brief Start an empty module
+ *
+ * @param module The module to initialize
+ */
+void initObjectModule(ObjectModule* module);
+
+void freeObjectModule(ObjectModule* module);
+
+/**
+ * @brief Assemble a source into a relocatable module
+ *
+ * Labels named by `.global` directives are exported, and JUMPs to labels that are not defined in the source become
+ * imports to be resolved by the linker.
+ *
+ * @param source Source to assemble, may be a pipe
+ * @param module Empty module to fill in
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, otherwise the error that occurred
+ */
+uint8_t assembleObject(SourceReader* source, ObjectModule* module, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Write a module in the relocatable object format
+ *
+ * @param outputFile Where to write the module
+ * @param module The module to write
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the file could not be written
+ */
+uint8_t writeObjectModule(FILE* outputFile, const ObjectModule* const module);
+
+/**
+ * @brief Read a module in the relocatable object format
+ *
+ * Exports must be within the code or at its end, and relocations must be to JUMPs in the code and name imports.
+ *
+ * @param data The whole object file, such as a memory-mapped file
+ * @param length Number of bytes in data
+ * @param module Empty module to fill in
+ * @return 0 if successful, ERROR_MALFORMED_OBJECT if data is not a valid object, otherwise the error that occurred
+ */
+uint8_t readObjectModule(const uint8_t* const data, size_t length, ObjectModule* module);
+
+#endif
@@ -0,0 +1,395 @@
+#include "Optimizer.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AssemblerStats.h"
+#include "CodeBuffer.h"
+#include "StatusCodes.h"
+
+// operations, numbered like InstructionLoaderLUT
+#define OP_ANDI 0
+#define OP_NAND 1
+#define OP_ADDI 2
+#define OP_SUBI 3
+#define OP_IORI 4
+#define OP_XORI 5
+#define OP_DUPI 6
+#define OP_DUPR 7
+#define OP_LOAD 8
+#define OP_STOR 9
+#define OP_SHIF 10
+#define OP_SKIP 11
+#define OP_STLO 12
+#define OP_STHI 13
+#define OP_JUMP 14
+
+#define IREG 0
+#define IREG_LOW 0b00001111
+#define IREG_HIGH 0b11110000
+#define IREG_ALL 0b11111111
+
+#define FLAG_LEADER 1   // starts a basic block, nothing is known about ireg here
+#define FLAG_SKIPPED 2  // follows a SKIP, so must stay exactly one instruction
+#define FLAG_REMOVED 4
+
+#define JUMP_MIN_OFFSET -64
+#define JUMP_MAX_OFFSET 63
+#define MAX_JUMP_HOPS 16  // longer chains are loops of JUMPs, which gain nothing from threading
+
+/**
+ * One instruction of the program being optimized.
+ */
+typedef struct _IrInstruction {
+    uint8_t op;       // OP_*
+    uint8_t operand;  // register, or the STLO/STHI nibble in place
+    uint8_t flags;    // FLAG_*
+    bool inProgram;   // a JUMP whose target is in the program or just past its end
+    int64_t target;   // offset a JUMP goes to
+} IrInstruction;
+
+/**
+ * @brief Decode one instruction and find where it can be entered from
+ *
+ * @param ir The program, the leader flags of later instructions are set here
+ * @param code The instruction
+ * @param pc Offset of the instruction
+ * @param length Number of instructions, ir has room for length + 1 flags
+ */
+static void decodeIrInstruction(IrInstruction* ir, uint8_t code, uint32_t pc, uint32_t length)
+{
+    IrInstruction* instruction = ir + pc;
+    instruction->operand = code & 0b111;
+    instruction->inProgram = false;
+    if (code & 0b10000000) {
+        instruction->op = OP_JUMP;
+        instruction->target = (int64_t)pc + (int32_t)(code & 0b1111111) - ((code & 0b1000000) << 1);  // sign extend
+        instruction->inProgram = instruction->target >= 0 && instruction->target <= length;
+        if (instruction->inProgram) {
+            (ir + instruction->target)->flags |= FLAG_LEADER;
+        }
+        (ir + pc + 1)->flags |= FLAG_LEADER;
+    } else if ((code & 0b11110000) == 0b01100000) {
+        instruction->op = OP_STLO;
+        instruction->operand = code & 0b1111;
+    } else if ((code & 0b11110000) == 0b01110000) {
+        instruction->op = OP_STHI;
+        instruction->operand = (code & 0b1111) << 4;
+    } else {
+        instruction->op = code >> 3;
+        if (instruction->op == OP_SKIP) {
+            (ir + pc + 1)->flags |= FLAG_LEADER | FLAG_SKIPPED;
+            if (pc + 2 <= length) {
+                (ir + pc + 2)->flags |= FLAG_LEADER;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Remove an instruction, if it is not the one a SKIP skips
+ *
+ * @param instruction The instruction
+ * @param rewrite The OPTIMIZER_* kind of rewrite
+ * @param stats Receives the rewrite
+ * @return true if it was removed
+ */
+static bool removeInstruction(IrInstruction* instruction, uint8_t rewrite, OptimizerStats* stats)
+{
+    if (instruction->flags & FLAG_SKIPPED) {
+        return false;
+    }
+    instruction->flags |= FLAG_REMOVED;
+    stats->rewrites[rewrite]++;
+    stats->cyclesSaved++;
+    return true;
+}
+
+/**
+ * @brief Walk each block forwards tracking the bits of ireg and the registers equal to it, removing instructions
+ * that would not change anything
+ *
+ * @param ir The program
+ * @param length Number of instructions
+ * @param stats Receives the rewrites
+ * @return true if anything was removed
+ */
+static bool removeRedundantWrites(IrInstruction* ir, uint32_t length, OptimizerStats* stats)
+{
+    bool changed = false;
+    uint8_t known = 0;   // bits of ireg whose value is known
+    uint8_t value = 0;   // those bits
+    uint8_t equal = 1;   // registers holding the same value as ireg, bit 0 being ireg itself
+    for (uint32_t pc = 0; pc < length; pc++) {
+        IrInstruction* instruction = ir + pc;
+        if (instruction->flags & FLAG_LEADER) {
+            known = 0;
+            equal = 1;
+        }
+        uint8_t reg = instruction->operand;
+        uint8_t regBit = (uint8_t)(1 << (reg & 0b111));  // only used by register ops, others hold a nibble or offset
+        switch (instruction->op) {
+            case OP_ANDI:
+            case OP_IORI:
+            case OP_DUPI:
+                if (reg == IREG) {
+                    changed |= removeInstruction(instruction, OPTIMIZER_REDUNDANT_COPY, stats);
+                } else if (instruction->op == OP_DUPI) {
+                    equal |= regBit;
+                } else {
+                    equal &= ~regBit;
+                }
+                break;
+            case OP_DUPR:
+                if (equal & regBit) {
+                    changed |= removeInstruction(instruction, OPTIMIZER_REDUNDANT_COPY, stats);
+                } else {
+                    known = 0;
+                    equal = 1 | regBit;
+                }
+                break;
+            case OP_SUBI:
+            case OP_XORI:
+                if (reg != IREG) {
+                    equal &= ~regBit;
+                } else if (known == IREG_ALL && value == 0) {
+                    changed |= removeInstruction(instruction, OPTIMIZER_REDUNDANT_NIBBLE, stats);
+                } else {
+                    known = IREG_ALL;
+                    value = 0;
+                    equal = 1;
+                }
+                break;
+            case OP_NAND:
+            case OP_ADDI:
+            case OP_LOAD:
+            case OP_SHIF:
+                if (reg != IREG) {
+                    equal &= ~regBit;
+                } else {
+                    known = 0;
+                    equal = 1;
+                }
+                break;
+            case OP_STLO:
+            case OP_STHI: {
+                uint8_t nibble = instruction->op == OP_STLO ? IREG_LOW : IREG_HIGH;
+                if ((known & nibble) == nibble && (value & nibble) == instruction->operand) {
+                    changed |= removeInstruction(instruction, OPTIMIZER_REDUNDANT_NIBBLE, stats);
+                } else {
+                    known |= nibble;
+                    value = (value & ~nibble) | instruction->operand;
+                    equal = 1;
+                }
+                break;
+            }
+            default:  // STOR, SKIP and JUMP write no register
+                break;
+        }
+    }
+    return changed;
+}
+
+/**
+ * @brief Send JUMPs to JUMPs straight to where the chain ends, and remove JUMPs to the next instruction
+ *
+ * @param ir The program
+ * @param length Number of instructions
+ * @param stats Receives the rewrites
+ * @return true if anything was rewritten
+ */
+static bool threadJumps(IrInstruction* ir, uint32_t length, OptimizerStats* stats)
+{
+    bool changed = false;
+    for (uint32_t pc = 0; pc < length; pc++) {
+        IrInstruction* instruction = ir + pc;
+        if (instruction->op != OP_JUMP || !instruction->inProgram || (instruction->flags & FLAG_REMOVED)) {
+            continue;
+        }
+        // a chain ending back here is an infinite loop, which must not become a halting jump to itself
+        uint32_t hops = 0;
+        int64_t target = instruction->target;
+        while (target != pc && target < length && hops < MAX_JUMP_HOPS) {
+            const IrInstruction* next = ir + target;
+            int64_t distance = next->target - (int64_t)pc;
+            if (next->op != OP_JUMP || !next->inProgram || next->target == target || next->target == pc ||
+                distance < JUMP_MIN_OFFSET || distance > JUMP_MAX_OFFSET) {
+                break;
+            }
+            target = next->target;
+            hops++;
+        }
+        if (hops > 0) {
+            instruction->target = target;
+            stats->rewrites[OPTIMIZER_THREADED_JUMP]++;
+            stats->cyclesSaved += hops;
+            changed = true;
+        }
+        if (target == (int64_t)pc + 1) {
+            changed |= removeInstruction(instruction, OPTIMIZER_JUMP_TO_NEXT, stats);
+        }
+    }
+    return changed;
+}
+
+/**
+ * @brief Walk each block backwards tracking which bits of ireg are read before being written, removing writes to
+ * ireg that nothing reads
+ *
+ * @param ir The program, with the instructions already removed taken as absent
+ * @param length Number of instructions
+ * @param stats Receives the rewrites
+ * @return true if anything was removed
+ */
+static bool removeDeadWrites(IrInstruction* ir, uint32_t length, OptimizerStats* stats)
+{
+    bool changed = false;
+    uint8_t live = IREG_ALL;  // bits of ireg that may be read later, everything is at the end of a block
+    for (uint32_t pc = length; pc-- > 0;) {
+        IrInstruction* instruction = ir + pc;
+        if ((ir + pc + 1)->flags & FLAG_LEADER) {
+            live = IREG_ALL;
+        }
+        if (instruction->flags & FLAG_REMOVED) {
+            continue;
+        }
+        uint8_t reg = instruction->operand;
+        switch (instruction->op) {
+            case OP_STLO:
+            case OP_STHI: {
+                uint8_t nibble = instruction->op == OP_STLO ? IREG_LOW : IREG_HIGH;
+                if ((live & nibble) == 0 && removeInstruction(instruction, OPTIMIZER_DEAD_WRITE, stats)) {
+                    changed = true;
+                } else {
+                    live &= ~nibble;
+                }
+                break;
+            }
+            case OP_DUPR:
+                if (reg == IREG) {
+                    break;  // a copy of ireg into itself, only left where a SKIP skips it
+                } else if (live == 0 && removeInstruction(instruction, OPTIMIZER_DEAD_WRITE, stats)) {
+                    changed = true;
+                } else {
+                    live = 0;
+                }
+                break;
+            case OP_SUBI:
+            case OP_XORI:
+            case OP_NAND:
+            case OP_ADDI:
+            case OP_SHIF:
+                if (reg != IREG) {
+                    live = instruction->op == OP_SHIF ? live | IREG_LOW : IREG_ALL;  // SHIF only reads the amount
+                } else if (live == 0 && removeInstruction(instruction, OPTIMIZER_DEAD_WRITE, stats)) {
+                    changed = true;
+                } else {
+                    // zeroing does not depend on what ireg held, the rest read all of it
+                    live = instruction->op == OP_SUBI || instruction->op == OP_XORI ? 0 : IREG_ALL;
+                }
+                break;
+            case OP_ANDI:
+            case OP_IORI:
+            case OP_DUPI:
+                if (reg != IREG) {
+                    live = IREG_ALL;
+                }
+                break;
+            default:  // LOAD, STOR, SKIP and JUMP read all of ireg, a LOAD of ireg may also read an I/O port
+                live = IREG_ALL;
+                break;
+        }
+    }
+    return changed;
+}
+
+/**
+ * @brief Drop the removed instructions and point every JUMP at where its target ended up
+ *
+ * @param ir The program
+ * @param code The program's code, rewritten in place
+ * @param length Number of instructions
+ * @param roundMap Receives the new offset of each offset up to and including length
+ * @return The new number of instructions
+ */
+static uint32_t compactCode(const IrInstruction* const ir, uint8_t* code, uint32_t length, uint32_t* roundMap)
+{
+    uint32_t kept = 0;
+    for (uint32_t pc = 0; pc <= length; pc++) {
+        *(roundMap + pc) = kept;
+        kept += pc < length && !((ir + pc)->flags & FLAG_REMOVED);
+    }
+    for (uint32_t pc = 0; pc < length; pc++) {
+        const IrInstruction* instruction = ir + pc;
+        if (instruction->flags & FLAG_REMOVED) {
+            continue;
+        }
+        uint8_t encoded = *(code + pc);
+        // a JUMP out of the program keeps its offset, which still leaves the program however much is removed
+        if (instruction->op == OP_JUMP && instruction->inProgram && instruction->target != pc) {
+            int32_t offset = (int32_t)*(roundMap + instruction->target) - (int32_t)*(roundMap + pc);
+            encoded = 0b10000000 | (offset & 0b1111111);
+        }
+        *(code + *(roundMap + pc)) = encoded;
+    }
+    return kept;
+}
+
+/**
+ * @brief Remove redundant instructions from an assembled program and shorten chains of JUMPs
+ *
+ * @param code The program, shortened in place
+ * @param offsetMap Receives the new offset of each old offset (an instruction removed maps to the one after it), and
+ *                  the new length after the old length, so needs room for length + 1 entries, may be NULL
+ * @param stats Receives what was rewritten, may be NULL
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY and code is unchanged
+ */
+uint8_t optimizeCode(CodeBuffer* code, uint32_t* offsetMap, OptimizerStats* stats)
+{
+    OptimizerStats counts;
+    memset(&counts, 0, sizeof(OptimizerStats));
+    uint32_t length = (uint32_t)code->length;
+    IrInstruction* ir = (IrInstruction*)malloc(((size_t)length + 2) * sizeof(IrInstruction));
+    uint32_t* roundMap = (uint32_t*)malloc(((size_t)length + 1) * sizeof(uint32_t));
+    if (ir == NULL || roundMap == NULL) {
+        free(ir);
+        free(roundMap);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    countAllocation(((size_t)length + 2) * sizeof(IrInstruction) + ((size_t)length + 1) * sizeof(uint32_t));
+    for (uint32_t pc = 0; offsetMap != NULL && pc <= length; pc++) {
+        *(offsetMap + pc) = pc;
+    }
+
+    uint32_t originalLength = length;
+    bool changed = true;
+    for (uint32_t round = 0; changed && round < OPTIMIZER_MAX_ROUNDS; round++) {
+        memset(ir, 0, ((size_t)length + 2) * sizeof(IrInstruction));
+        ir->flags = FLAG_LEADER;
+        (ir + length)->flags = FLAG_LEADER;
+        for (uint32_t pc = 0; pc < length; pc++) {
+            decodeIrInstruction(ir, *(code->data + pc), pc, length);
+        }
+        // redundant writes go first, so a write is only dead if no instruction kept for its value reads it
+        changed = removeRedundantWrites(ir, length, &counts);
+        changed |= threadJumps(ir, length, &counts);
+        changed |= removeDeadWrites(ir, length, &counts);
+        if (!changed) {
+            break;
+        }
+        length = compactCode(ir, code->data, length, roundMap);
+        for (uint32_t pc = 0; offsetMap != NULL && pc <= originalLength; pc++) {
+            *(offsetMap + pc) = *(roundMap + *(offsetMap + pc));
+        }
+    }
+    code->length = length;
+    counts.bytesSaved = originalLength - length;
+    if (stats != NULL) {
+        *stats = counts;
+    }
+    free(roundMap);
+    free(ir);
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <inttypes.h>
+
+#include "CodeBuffer.h"
+
+// kinds of rewrite, counted separately in OptimizerStats
+#define OPTIMIZER_REDUNDANT_COPY 0    // a DUPR of a register already equal to ireg, or a copy of ireg into itself
+#define OPTIMIZER_REDUNDANT_NIBBLE 1  // a STLO, STHI or zeroing of ireg that leaves it as it already was
+#define OPTIMIZER_DEAD_WRITE 2        // a write to ireg that is overwritten before anything reads it
+#define OPTIMIZER_JUMP_TO_NEXT 3      // a JUMP to the instruction after it
+#define OPTIMIZER_THREADED_JUMP 4     // a JUMP to a JUMP, sent straight to the final target
+#define OPTIMIZER_NUM_REWRITES 5
+
+#define OPTIMIZER_MAX_ROUNDS 16  // rewrites expose more rewrites, but a few rounds reach nearly every one
+
+typedef struct _OptimizerStats {
+    uint32_t bytesSaved;
+    uint32_t cyclesSaved;  // one per instruction removed or JUMP skipped, each time that code runs
+    uint32_t rewrites[OPTIMIZER_NUM_REWRITES];
+} OptimizerStats;
+
+/**
+ * @brief Remove redundant instructions from an assembled program and shorten chains of JUMPs
+ *
+ * The program is split into basic blocks at the target of every JUMP, after every JUMP, and after a SKIP and the
+ * instruction it may skip, which is never removed so every SKIP still skips exactly one instruction. What ireg holds
+ * is only tracked within a block. Removing instructions only ever brings a JUMP closer to its target, so every JUMP
+ * offset still fits once they are recomputed.
+ *
+ * @param code The program, shortened in place
+ * @param offsetMap Receives the new offset of each old offset (an instruction removed maps to the one after it), and
+ *                  the new length after the old length, so needs room for length + 1 entries, may be NULL
+ * @param stats Receives what was rewritten, may be NULL
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY and code is unchanged
+ */
+uint8_t optimizeCode(CodeBuffer* code, uint32_t* offsetMap, OptimizerStats* stats);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PACKEDKEYS_H
+#define PACKEDKEYS_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "Lexer.h"
+
+/**
+ * Mnemonics and register names are at most 4 characters, so they are decoded by packing them (lowercased) into one
+ * 32-bit integer and hashing that with a multiplier chosen by GenerateDecoders.c so every name lands in its own slot.
+ */
+#define PACKED_KEY_MAX_LENGTH 4
+#define PACKED_KEY_HASH_BITS 5
+#define PACKED_KEY_HASH_SLOTS (1 << PACKED_KEY_HASH_BITS)
+#define PACKED_KEY_HASH(key, multiplier) ((uint32_t)((key) * (multiplier)) >> (32 - PACKED_KEY_HASH_BITS))
+
+/**
+ * @brief Pack a name into an integer key, lowercasing it
+ *
+ * @param key Where to write the key
+ * @param name The name to pack
+ * @param length Number of characters in name, which need not be NUL terminated
+ * @return true if successful, false if the name is too long to be a mnemonic or register
+ */
+static inline bool packKey(uint32_t* const key, const char* const name, uint32_t length)
+{
+    if (length == 0 || length > PACKED_KEY_MAX_LENGTH) {
+        return false;
+    }
+    uint32_t packed = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        packed |= (uint32_t)(uint8_t)toLowerAscii(*(name + i)) << (8 * i);
+    }
+    *key = packed;
+    return true;
+}
+
+#endif
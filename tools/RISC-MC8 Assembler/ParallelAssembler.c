@@ -0,0 +1,384 @@
+#include "ParallelAssembler.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AssemblerStats.h"
+#include "InstructionParser.h"
+#include "Lexer.h"
+#include "LoadImmediate.h"
+#include "Source.h"
+#include "StatusCodes.h"
+#include "Symbols.h"
+#include "WorkerPool.h"
+
+#define MIN_CHUNK_SIZE (64 * 1024)
+#define CHUNKS_PER_THREAD 4
+
+typedef struct _ChunkLabel {
+    Token name;
+    uint32_t line;    // line within the chunk, 1-based
+    uint32_t column;  // column of the name, or of the lexing error
+    uint32_t offset;  // instructions before it within the chunk
+    uint8_t status;   // error found while lexing the label, 0 if none
+} ChunkLabel;
+
+typedef struct _Chunk {
+    const char* start;
+    size_t length;
+    uint32_t numLines;
+    uint32_t numInstructions;
+    ChunkLabel* labels;
+    uint32_t numLabels;
+    uint32_t labelCapacity;
+    uint32_t firstLine;
+    uint32_t baseOffset;
+    uint8_t status;
+    AssemblerDiagnostic diagnostic;  // line is within the chunk while scanning, global once encoding
+    FarJumpsList farJumps;           // JUMPs to labels out of range, found while encoding
+
+    // an li's length depends on what the registers hold, which is only known from the previous chunk until a label
+    // that follows an instruction of this chunk, so the lines up to there (the head) are sized again if that matters
+    bool hasLoadImmediate;
+    bool jumpsByNumber;         // a JUMP by a number may land in another chunk, which only the two-pass path handles
+    bool liNeedsEntry;          // an li is in the head
+    const char* headEnd;        // where the head ends
+    uint32_t headInstructions;  // instructions in the head
+    uint32_t headLabels;        // labels in the head
+    const char* tail;           // the last label that follows an instruction, NULL if none
+    bool tailAfterSkip;         // tail comes right after a SKIP
+    ValueTracker entry;         // what the registers hold at the start, only set if the chunk's code depends on it
+} Chunk;
+
+typedef struct _ParallelAssembly {
+    Chunk* chunks;
+    SymbolsList* symbols;
+    uint8_t* output;   // where the first chunk is encoded
+    uint8_t* scratch;  // owned space for the output when the caller's buffer is too small, NULL if unused
+    FarJumpsList* farJumps;  // the caller's list, chunks collect their own and are merged in order
+} ParallelAssembly;
+
+/**
+ * @brief Count the lines and instructions of a chunk and collect its labels, without resolving anything
+ *
+ * @param context The ParallelAssembly
+ * @param index Index of the chunk to scan
+ */
+static void scanChunk(void* context, uint32_t index)
+{
+    Chunk* chunk = ((ParallelAssembly*)context)->chunks + index;
+    SourceReader source;
+    openSourceBuffer(&source, chunk->start, chunk->length);
+    LineSizer sizer;
+    initLineSizer(&sizer, NULL, false, NULL);
+    bool sawInstruction = false;
+    bool inHead = true;
+    const char* text;
+    uint32_t length;
+    SourceLine line;
+    while (readSourceLine(&source, &text, &length)) {
+        lexLine(&line, text, length);
+        if (!inHead && chunk->headEnd == NULL) {
+            chunk->headEnd = text;
+            chunk->headInstructions = chunk->numInstructions;
+            chunk->headLabels = chunk->numLabels;
+        }
+        if (line.kind == LINE_KIND_INSTRUCTION) {
+            sawInstruction = true;
+            int32_t distance;
+            if (isLoadImmediate(&line)) {
+                chunk->hasLoadImmediate = true;
+                chunk->liNeedsEntry |= inHead;
+            } else if (jumpsByNumber(&line, &distance)) {
+                chunk->jumpsByNumber = true;
+            }
+        } else if (line.kind == LINE_KIND_LABEL) {
+            if (chunk->numLabels == chunk->labelCapacity) {
+                uint32_t newCapacity = chunk->labelCapacity == 0 ? 64 : chunk->labelCapacity * 2;
+                ChunkLabel* grown = (ChunkLabel*)realloc(chunk->labels, newCapacity * sizeof(ChunkLabel));
+                if (grown == NULL) {
+                    chunk->status = ERROR_OUT_OF_MEMORY;
+                    setDiagnostic(&chunk->diagnostic, ERROR_OUT_OF_MEMORY, source.lineNumber, 0);
+                    return;
+                }
+                countAllocation(newCapacity * sizeof(ChunkLabel));
+                chunk->labels = grown;
+                chunk->labelCapacity = newCapacity;
+            }
+            ChunkLabel* label = chunk->labels + chunk->numLabels;
+            label->name = line.tokens[0];
+            label->line = source.lineNumber;
+            label->column = getStatusColumn(&line, line.status != 0 ? line.status : ERROR_DUPLICATE_LABEL);
+            label->offset = chunk->numInstructions;
+            label->status = line.status;
+            chunk->numLabels++;
+        }
+        chunk->numInstructions += sizeSourceLine(&sizer, &line);
+        if (line.kind == LINE_KIND_LABEL && sawInstruction) {
+            inHead = false;
+            chunk->tail = text;
+            chunk->tailAfterSkip = sizer.tracker.skipArmed;  // all a label keeps
+        }
+    }
+    if (chunk->headEnd == NULL) {
+        chunk->headEnd = chunk->start + chunk->length;
+        chunk->headInstructions = chunk->numInstructions;
+        chunk->headLabels = chunk->numLabels;
+    }
+    chunk->numLines = source.lineNumber;
+}
+
+/**
+ * @brief Find what the registers hold at the end of a chunk
+ *
+ * @param chunk The chunk, with its entry set unless it has a tail
+ * @param exit Receives what the registers hold
+ */
+static void findExitState(const Chunk* const chunk, ValueTracker* exit)
+{
+    const char* from = chunk->start;
+    if (chunk->tail != NULL) {
+        resetValueTracker(exit);
+        exit->skipArmed = chunk->tailAfterSkip;
+        from = chunk->tail;
+    } else {
+        *exit = chunk->entry;
+    }
+    trackSourceText(exit, from, (size_t)(chunk->start + chunk->length - from));
+}
+
+/**
+ * @brief Size the head of a chunk again now its entry is known, moving its labels and every later one to match
+ *
+ * @param chunk The scanned chunk, with its entry set
+ */
+static void rescanChunkHead(Chunk* chunk)
+{
+    SourceReader source;
+    openSourceBuffer(&source, chunk->start, (size_t)(chunk->headEnd - chunk->start));
+    LineSizer sizer;
+    initLineSizer(&sizer, &chunk->entry, false, NULL);
+    uint32_t numInstructions = 0;
+    uint32_t numLabels = 0;
+    const char* text;
+    uint32_t length;
+    SourceLine line;
+    while (readSourceLine(&source, &text, &length)) {
+        lexLine(&line, text, length);
+        if (line.kind == LINE_KIND_LABEL) {
+            (chunk->labels + numLabels)->offset = numInstructions;
+            numLabels++;
+        }
+        numInstructions += sizeSourceLine(&sizer, &line);
+    }
+    closeSource(&source);
+
+    // nothing after the head depends on the entry, so the rest only moves by the difference
+    for (uint32_t i = chunk->headLabels; i < chunk->numLabels; i++) {
+        (chunk->labels + i)->offset = (chunk->labels + i)->offset - chunk->headInstructions + numInstructions;
+    }
+    chunk->numInstructions = chunk->numInstructions - chunk->headInstructions + numInstructions;
+    chunk->headInstructions = numInstructions;
+}
+
+/**
+ * @brief Encode a chunk into its slice of the output
+ *
+ * @param context The ParallelAssembly
+ * @param index Index of the chunk to encode
+ */
+static void encodeChunk(void* context, uint32_t index)
+{
+    ParallelAssembly* assembly = (ParallelAssembly*)context;
+    Chunk* chunk = assembly->chunks + index;
+    SourceReader source;
+    openSourceBuffer(&source, chunk->start, chunk->length);
+    source.lineNumber = chunk->firstLine - 1;  // report global line numbers
+    chunk->status = encodeInstructions(&source, assembly->output + chunk->baseOffset, chunk->baseOffset, &chunk->entry, assembly->symbols, assembly->farJumps == NULL ? NULL : &chunk->farJumps, &chunk->diagnostic);
+}
+
+/**
+ * @brief Split data into chunks that each start at the beginning of a line
+ *
+ * @param data The whole source
+ * @param length Number of bytes in data
+ * @param numThreads Number of threads that will process the chunks
+ * @param numChunks Set to the number of chunks
+ * @return Zeroed chunks with start and length set, or NULL if out of memory
+ */
+static Chunk* splitIntoChunks(const char* const data, size_t length, uint32_t numThreads, uint32_t* numChunks)
+{
+    size_t wanted = length / MIN_CHUNK_SIZE;
+    if (wanted > (size_t)numThreads * CHUNKS_PER_THREAD) {
+        wanted = (size_t)numThreads * CHUNKS_PER_THREAD;
+    }
+    if (wanted == 0) {
+        wanted = 1;
+    }
+    Chunk* chunks = (Chunk*)calloc(wanted, sizeof(Chunk));
+    if (chunks == NULL) {
+        return NULL;
+    }
+    countAllocation(wanted * sizeof(Chunk));
+    uint32_t count = 0;
+    size_t start = 0;
+    for (size_t i = 1; i <= wanted && start < length; i++) {
+        size_t end = length;
+        if (i < wanted) {
+            // move the split point forward to just after the next newline
+            end = length * i / wanted;
+            if (end < start) {
+                end = start;
+            }
+            const char* newline = (const char*)memchr(data + end, '\n', length - end);
+            end = newline == NULL ? length : (size_t)(newline - data) + 1;
+        }
+        (chunks + count)->start = data + start;
+        (chunks + count)->length = end - start;
+        count++;
+        start = end;
+    }
+    *numChunks = count;
+    return chunks;
+}
+
+/**
+ * @brief Assemble a source held in memory on several threads, producing the same output as the two-pass path
+ *
+ * @param data The whole source, such as a memory-mapped file
+ * @param length Number of bytes in data
+ * @param code Buffer to append assembled code to, only written if assembly succeeds
+ * @param numThreads Number of threads to use, 0 for one per processor
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param stats Receives the time spent scanning (as symbol extraction) and encoding (as parsing) and the line count,
+ *              may be NULL
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, STATUS_NEEDS_TWO_PASS (with nothing written) if the source has both li and JUMPs by a
+ *         number, otherwise returns the error that occurred
+ */
+uint8_t parseInstructionsParallel(const char* const data, size_t length, CodeBuffer* code, uint32_t numThreads, FarJumpsList* farJumps, AssemblerStats* stats, AssemblerDiagnostic* diagnostic)
+{
+    if (numThreads == 0) {
+        numThreads = getProcessorCount();
+    }
+    uint32_t numChunks = 0;
+    ParallelAssembly assembly = {NULL, NULL, NULL, NULL, farJumps};
+    assembly.chunks = splitIntoChunks(data, length, numThreads, &numChunks);
+    assembly.symbols = (SymbolsList*)calloc(1, sizeof(SymbolsList));
+    uint8_t status = assembly.chunks == NULL || assembly.symbols == NULL ? ERROR_OUT_OF_MEMORY : 0;
+    if (status != 0) {
+        setDiagnostic(diagnostic, status, 0, 0);
+    } else {
+        countAllocation(sizeof(SymbolsList));
+    }
+
+    // phase 1, count and collect labels per chunk
+    PhaseTimer timer;
+    startPhase(&timer);
+    if (status == 0) {
+        runWorkerPool(&scanChunk, &assembly, numChunks, numThreads);
+    }
+
+    // prefix sum to find where each chunk starts, then merge labels in source order so duplicates report the same line
+    bool hasLoadImmediate = false;
+    bool anyJumpsByNumber = false;
+    for (uint32_t i = 0; i < numChunks && status == 0; i++) {
+        hasLoadImmediate |= (assembly.chunks + i)->hasLoadImmediate;
+        anyJumpsByNumber |= (assembly.chunks + i)->jumpsByNumber;
+    }
+    if (hasLoadImmediate && anyJumpsByNumber) {
+        status = STATUS_NEEDS_TWO_PASS;  // where they land moves li sizes, which chunks sized on their own cannot follow
+    }
+    uint32_t totalInstructions = 0;
+    uint32_t totalLines = 0;
+    for (uint32_t i = 0; i < numChunks && status == 0; i++) {
+        Chunk* chunk = assembly.chunks + i;
+        chunk->firstLine = totalLines + 1;
+        chunk->baseOffset = totalInstructions;
+        if (chunk->status != 0) {
+            status = chunk->status;
+            setDiagnostic(diagnostic, status, chunk->firstLine + chunk->diagnostic.line - 1, chunk->diagnostic.column);
+            break;
+        }
+        // a chunk without a tail passes its entry on, so the next one may need it even if this one does not
+        if (hasLoadImmediate && i > 0 && (chunk->liNeedsEntry || chunk->tail == NULL)) {
+            findExitState(chunk - 1, &chunk->entry);
+            if (chunk->liNeedsEntry && valuesKnown(&chunk->entry)) {
+                rescanChunkHead(chunk);
+            }
+        }
+        for (uint32_t j = 0; j < chunk->numLabels && status == 0; j++) {
+            ChunkLabel* label = chunk->labels + j;
+            status = label->status;
+            if (status == 0) {
+                uint32_t value = chunk->baseOffset + label->offset;
+                status = addSymbolToListN(assembly.symbols, label->name.start, label->name.length, value);
+            }
+            if (status == 0) {
+                countLabel();
+            }
+            if (status != 0) {
+                setDiagnostic(diagnostic, status, chunk->firstLine + label->line - 1, status == ERROR_OUT_OF_MEMORY ? 0 : label->column);
+            }
+        }
+        totalInstructions += chunk->numInstructions;
+        totalLines += chunk->numLines;
+    }
+
+    stopPhase(&timer, stats == NULL ? NULL : &stats->extraction);
+    if (stats != NULL) {
+        stats->lines += totalLines;
+    }
+
+    // phase 2, encode every chunk into its own slice of the output, or into scratch space if the output is too small
+    // so errors are still found and the caller learns how much room is needed
+    if (status == 0) {
+        if (reserveCode(code, code->length + totalInstructions)) {
+            assembly.output = code->data + code->length;
+        } else if (code->fixed) {
+            assembly.scratch = (uint8_t*)malloc(totalInstructions > 0 ? totalInstructions : 1);
+            assembly.output = assembly.scratch;
+            if (assembly.scratch != NULL) {
+                countAllocation(totalInstructions > 0 ? totalInstructions : 1);
+            }
+        }
+        if (assembly.output == NULL) {
+            status = ERROR_OUT_OF_MEMORY;
+            setDiagnostic(diagnostic, status, 0, 0);
+        }
+    }
+    startPhase(&timer);
+    if (status == 0) {
+        runWorkerPool(&encodeChunk, &assembly, numChunks, numThreads);
+        // chunks are in source order, so the first failed chunk has the earliest error
+        for (uint32_t i = 0; i < numChunks && status == 0; i++) {
+            status = (assembly.chunks + i)->status;
+            if (status != 0 && diagnostic != NULL) {
+                *diagnostic = (assembly.chunks + i)->diagnostic;
+            }
+        }
+        for (uint32_t i = 0; farJumps != NULL && i < numChunks && status == 0; i++) {
+            status = appendFarJumps(farJumps, &(assembly.chunks + i)->farJumps);
+            if (status != 0) {
+                setDiagnostic(diagnostic, status, 0, 0);
+            }
+        }
+    }
+
+    stopPhase(&timer, stats == NULL ? NULL : &stats->parsing);
+    if (status == 0) {
+        code->length += totalInstructions;
+    }
+    for (uint32_t i = 0; assembly.chunks != NULL && i < numChunks; i++) {
+        free((assembly.chunks + i)->labels);
+        freeFarJumpsList(&(assembly.chunks + i)->farJumps);
+    }
+    free(assembly.chunks);
+    free(assembly.scratch);
+    if (assembly.symbols != NULL) {
+        freeSymbolsList(&assembly.symbols);
+    }
+    return status;
+}
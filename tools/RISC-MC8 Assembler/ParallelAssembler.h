@@ -0,0 +1,33 @@
+#ifndef PARALLELASSEMBLER_H
+#define PARALLELASSEMBLER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "AssemblerStats.h"
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+#include "Relaxation.h"
+
+/**
+ * @brief Assemble a source held in memory on several threads, producing the same output as the two-pass path
+ *
+ * The source is split into chunks at line boundaries. Each chunk is lexed in parallel to count its instructions and
+ * collect its labels, chunk base offsets are found with a prefix sum and the labels merged into one symbols list, then
+ * each chunk is encoded in parallel straight into its slice of the output.
+ *
+ * @param data The whole source, such as a memory-mapped file
+ * @param length Number of bytes in data
+ * @param code Buffer to append assembled code to, only written if assembly succeeds
+ * @param numThreads Number of threads to use, 0 for one per processor
+ * @param farJumps List to record JUMPs to labels out of range in, NULL to report them as errors
+ * @param stats Receives the time spent scanning (as symbol extraction) and encoding (as parsing) and the line count,
+ *              may be NULL
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
+ * @return 0 if successful, STATUS_NEEDS_TWO_PASS (with nothing written) if the source has both li and JUMPs by a
+ *         number, otherwise returns the error that occurred
+ */
+uint8_t parseInstructionsParallel(const char* const data, size_t length, CodeBuffer* code, uint32_t numThreads, FarJumpsList* farJumps, AssemblerStats* stats, AssemblerDiagnostic* diagnostic);
+
+#endif
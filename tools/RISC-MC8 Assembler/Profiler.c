@@ -0,0 +1,330 @@
+#include "Profiler.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Source.h"
+#include "StatusCodes.h"
+
+/**
+ * Lines of a memory-mapped source, for quoting them in the report.
+ */
+typedef struct _SourceText {
+    SourceReader reader;
+    const char** starts;
+    uint32_t* lengths;
+    uint32_t numLines;
+} SourceText;
+
+/**
+ * A row of a report table before sorting.
+ */
+typedef struct _ProfileEntry {
+    uint64_t count;
+    uint32_t index;  // program offset, or label index + 1 with 0 for code before the first label
+} ProfileEntry;
+
+static const char* const opNames[EMULATOR_NUM_OPS] = {
+    "andi", "nand", "addi", "subi", "iori", "xori", "dupi", "dupr", "load", "stor", "shif", "skip", "stlo", "sthi",
+    "jump", "jump", "end", "load", "stor", "skip", "jump",
+};
+
+/**
+ * @brief Start counting branches of an emulator's next run
+ *
+ * @param profile The profile to start
+ * @param emulator The emulator about to run, from its current program counter
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t startProfile(EmulatorProfile* profile, Emulator* emulator)
+{
+    profile->length = emulator->length;
+    profile->startPc = emulator->state.pc;
+    profile->branches = (uint64_t*)calloc(2 * ((size_t)emulator->length + 2), sizeof(uint64_t));
+    profile->executions = (uint64_t*)calloc((size_t)emulator->length + 2, sizeof(uint64_t));
+    if (profile->branches == NULL || profile->executions == NULL) {
+        freeProfile(profile);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    attachBranchCounts(emulator, profile->branches);
+    return 0;
+}
+
+/**
+ * @brief Stop counting and work out how often each instruction ran
+ *
+ * @param profile The started profile
+ * @param emulator The emulator that ran
+ */
+void finishProfile(EmulatorProfile* profile, Emulator* emulator)
+{
+    attachBranchCounts(emulator, NULL);
+    const DecodedInstruction* const program = emulator->program;
+    uint64_t* executions = profile->executions;
+
+    // control reaches an instruction by being where the run started, by a taken SKIP or JUMP, or by falling through
+    // from the one before, and the instructions are visited in order so the one before is already complete
+    for (uint32_t pc = 0; pc < profile->length; pc++) {
+        uint8_t op = (program + pc)->op;
+        if (op == EMULATOR_OP_SKIP || op == EMULATOR_OP_JUMP) {
+            *(executions + (program + pc)->target) += *(profile->branches + 2 * (uint64_t)pc + 1);
+        }
+    }
+    if (profile->startPc < profile->length + 2) {
+        (*(executions + profile->startPc))++;
+    }
+    for (uint32_t pc = 1; pc < profile->length + 2; pc++) {
+        uint8_t op = (program + pc - 1)->op;
+        if (op == EMULATOR_OP_SKIP) {
+            *(executions + pc) += *(profile->branches + 2 * (uint64_t)(pc - 1));
+        } else if (op != EMULATOR_OP_JUMP && op != EMULATOR_OP_HALT && op != EMULATOR_OP_END) {
+            *(executions + pc) += *(executions + pc - 1);
+        }
+    }
+}
+
+void freeProfile(EmulatorProfile* profile)
+{
+    free(profile->branches);
+    free(profile->executions);
+    profile->branches = NULL;
+    profile->executions = NULL;
+}
+
+/**
+ * @brief Index the lines of a source file
+ *
+ * @param text The text to fill in
+ * @param path Path of the source
+ * @return true if successful, false if it could not be read
+ */
+static bool openSourceText(SourceText* text, const char* const path)
+{
+    memset(text, 0, sizeof(SourceText));
+    if (path == NULL || openSourceFile(&text->reader, path) != 0) {
+        return false;
+    }
+    if (text->reader.data == NULL) {
+        closeSource(&text->reader);  // lines of a stream do not stay put
+        return false;
+    }
+    uint32_t capacity = 0;
+    const char* line;
+    uint32_t length;
+    while (readSourceLine(&text->reader, &line, &length)) {
+        if (text->numLines == capacity) {
+            capacity = capacity == 0 ? 256 : capacity * 2;
+            const char** grownStarts = (const char**)realloc(text->starts, capacity * sizeof(const char*));
+            text->starts = grownStarts == NULL ? text->starts : grownStarts;
+            uint32_t* grownLengths = (uint32_t*)realloc(text->lengths, capacity * sizeof(uint32_t));
+            text->lengths = grownLengths == NULL ? text->lengths : grownLengths;
+            if (grownStarts == NULL || grownLengths == NULL) {
+                free(text->starts);
+                free(text->lengths);
+                closeSource(&text->reader);
+                memset(text, 0, sizeof(SourceText));
+                return false;
+            }
+        }
+        *(text->starts + text->numLines) = line;
+        *(text->lengths + text->numLines) = length;
+        text->numLines++;
+    }
+    return true;
+}
+
+static void closeSourceText(SourceText* text)
+{
+    free(text->starts);
+    free(text->lengths);
+    if (text->reader.data != NULL) {
+        closeSource(&text->reader);
+    }
+}
+
+/**
+ * @brief Print a source line without its leading indentation, or the instruction's name if there is no source
+ *
+ * @param stream Where to print
+ * @param text The source, may have no lines
+ * @param line 1-based line number, 0 if unknown
+ * @param op The decoded instruction, for when the line is unknown
+ */
+static void printSourceLine(FILE* stream, const SourceText* const text, uint32_t line, uint8_t op)
+{
+    if (line == 0 || line > text->numLines) {
+        fprintf(stream, "%s\n", opNames[op]);
+        return;
+    }
+    const char* start = *(text->starts + line - 1);
+    uint32_t length = *(text->lengths + line - 1);
+    while (length > 0 && (*start == ' ' || *start == '\t')) {
+        start++;
+        length--;
+    }
+    fprintf(stream, "%.*s\n", (int)length, start);
+}
+
+/**
+ * @brief Order entries from most to least common, then by index
+ */
+static int compareEntries(const void* a, const void* b)
+{
+    const ProfileEntry* left = (const ProfileEntry*)a;
+    const ProfileEntry* right = (const ProfileEntry*)b;
+    if (left->count != right->count) {
+        return left->count > right->count ? -1 : 1;
+    }
+    return left->index < right->index ? -1 : left->index > right->index;
+}
+
+/**
+ * @brief Print the hottest labels, lines and branches
+ *
+ * @param stream Where to print
+ * @param profile The finished profile
+ * @param emulator The emulator that ran
+ * @param table Line table of the program, or NULL to report program offsets only
+ */
+void printProfile(FILE* stream, const EmulatorProfile* const profile, const Emulator* const emulator, const LineTable* const table)
+{
+    const DecodedInstruction* const program = emulator->program;
+    bool hasLines = table != NULL && table->length == profile->length;
+    SourceText text;
+    if (!hasLines || !openSourceText(&text, table->sourcePath)) {
+        memset(&text, 0, sizeof(SourceText));
+    }
+    double total = emulator->executed > 0 ? (double)emulator->executed : 1;
+    ProfileEntry* entries = (ProfileEntry*)malloc(((size_t)profile->length + 1) * sizeof(ProfileEntry));
+    if (entries == NULL) {
+        fprintf(stream, "Error: Out of memory.\n");
+        closeSourceText(&text);
+        return;
+    }
+
+    // every instruction counts towards the last label before it
+    if (hasLines) {
+        uint32_t numEntries = table->numLabels + 1;
+        for (uint32_t i = 0; i < numEntries; i++) {
+            (entries + i)->count = 0;
+            (entries + i)->index = i;
+        }
+        for (uint32_t pc = 0; pc < profile->length; pc++) {
+            if ((program + pc)->op != EMULATOR_OP_HALT) {  // reached, but a jump to itself is not executed
+                (entries + findEnclosingLabel(table, pc) + 1)->count += *(profile->executions + pc);
+            }
+        }
+        qsort(entries, numEntries, sizeof(ProfileEntry), compareEntries);
+        fprintf(stream, "# HOT LABELS\n#     executed   share  line  label\n");
+        for (uint32_t i = 0; i < numEntries && i < PROFILE_TOP_ENTRIES && (entries + i)->count > 0; i++) {
+            const ProfileEntry* entry = entries + i;
+            const LineTableLabel* label = entry->index == 0 ? NULL : table->labels + entry->index - 1;
+            fprintf(stream, "# %12" PRIu64 "  %5.1f%%  %4" PRIu32 "  %s\n", entry->count, 100 * entry->count / total, label == NULL ? 0 : label->line, label == NULL ? "(before the first label)" : label->name);
+        }
+    }
+
+    for (uint32_t pc = 0; pc < profile->length; pc++) {
+        (entries + pc)->count = *(profile->executions + pc);
+        (entries + pc)->index = pc;
+    }
+    qsort(entries, profile->length, sizeof(ProfileEntry), compareEntries);
+    fprintf(stream, "# HOT LINES\n#     executed   share  line      pc  source\n");
+    for (uint32_t i = 0; i < profile->length && i < PROFILE_TOP_ENTRIES && (entries + i)->count > 0; i++) {
+        const ProfileEntry* entry = entries + i;
+        uint32_t line = hasLines ? *(table->lines + entry->index) : 0;
+        fprintf(stream, "# %12" PRIu64 "  %5.1f%%  %4" PRIu32 "  %6" PRIu32 "  ", entry->count, 100 * entry->count / total, line, entry->index);
+        printSourceLine(stream, &text, line, (program + entry->index)->op);
+    }
+
+    // a JUMP is always taken, so its not taken count is only ever 0
+    uint32_t numBranches = 0;
+    for (uint32_t pc = 0; pc < profile->length; pc++) {
+        uint64_t notTaken = *(profile->branches + 2 * (uint64_t)pc);
+        uint64_t taken = *(profile->branches + 2 * (uint64_t)pc + 1);
+        if ((program + pc)->op == EMULATOR_OP_SKIP || (program + pc)->op == EMULATOR_OP_JUMP) {
+            (entries + numBranches)->count = taken + notTaken;
+            (entries + numBranches)->index = pc;
+            numBranches++;
+        }
+    }
+    qsort(entries, numBranches, sizeof(ProfileEntry), compareEntries);
+    fprintf(stream, "# HOT BRANCHES\n#        taken     not taken  taken  line      pc  source\n");
+    for (uint32_t i = 0; i < numBranches && i < PROFILE_TOP_ENTRIES && (entries + i)->count > 0; i++) {
+        const ProfileEntry* entry = entries + i;
+        uint64_t notTaken = *(profile->branches + 2 * (uint64_t)entry->index);
+        uint64_t taken = *(profile->branches + 2 * (uint64_t)entry->index + 1);
+        uint32_t line = hasLines ? *(table->lines + entry->index) : 0;
+        fprintf(stream, "# %12" PRIu64 "  %12" PRIu64 "  %4.0f%%  %4" PRIu32 "  %6" PRIu32 "  ", taken, notTaken, 100.0 * taken / entry->count, line, entry->index);
+        printSourceLine(stream, &text, line, (program + entry->index)->op);
+    }
+    free(entries);
+    closeSourceText(&text);
+}
+
+/**
+ * @brief Write how often control reached each label, one `label count` pair per line, for `assemble-risc-mc8 --layout`
+ *
+ * @param stream Where to write
+ * @param profile The finished profile
+ * @param table Line table of the program
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the table is not of the profiled program
+ */
+uint8_t writeLabelCounts(FILE* stream, const EmulatorProfile* const profile, const LineTable* const table)
+{
+    if (table->length != profile->length) {
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    fprintf(stream, "# times control reached each label\n");
+    for (uint32_t i = 0; i < table->numLabels; i++) {
+        const LineTableLabel* label = table->labels + i;
+        fprintf(stream, "%s %" PRIu64 "\n", label->name, *(profile->executions + label->offset));
+    }
+    return 0;
+}
+
+/**
+ * @brief Print the whole source with how often each instruction ran in the margin
+ *
+ * @param stream Where to print
+ * @param profile The finished profile
+ * @param table Line table of the program, its source path must be readable
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the source could not be read, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t printAnnotatedSource(FILE* stream, const EmulatorProfile* const profile, const LineTable* const table)
+{
+    SourceText text;
+    if (table->length != profile->length || !openSourceText(&text, table->sourcePath)) {
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    // a line can assemble to several instructions, some of them placed elsewhere (trampolines, moved blocks, JUMPs
+    // added after a block), but none runs more often than the line itself, so each line shows its most run one
+    uint64_t* counts = (uint64_t*)malloc(((size_t)text.numLines + 1) * sizeof(uint64_t));
+    if (counts == NULL) {
+        closeSourceText(&text);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    for (uint32_t line = 0; line <= text.numLines; line++) {
+        *(counts + line) = UINT64_MAX;  // no instruction
+    }
+    for (uint32_t pc = 0; pc < table->length; pc++) {
+        uint32_t line = *(table->lines + pc);
+        uint64_t executions = *(profile->executions + pc);
+        if (line <= text.numLines && (*(counts + line) == UINT64_MAX || executions > *(counts + line))) {
+            *(counts + line) = executions;
+        }
+    }
+    for (uint32_t line = 1; line <= text.numLines; line++) {
+        if (*(counts + line) != UINT64_MAX) {
+            fprintf(stream, "%12" PRIu64 " | ", *(counts + line));
+        } else {
+            fprintf(stream, "%12s | ", "");
+        }
+        fprintf(stream, "%.*s\n", (int)*(text.lengths + line - 1), *(text.starts + line - 1));
+    }
+    free(counts);
+    closeSourceText(&text);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "Emulator.h"
+#include "LineTable.h"
+
+#define PROFILE_TOP_ENTRIES 20  // rows in each table of the report
+
+/**
+ * Execution counts of one run. Only SKIPs and JUMPs are counted while running; how often every other instruction ran
+ * follows from them, since straight-line code runs exactly as often as control reaches its first instruction.
+ */
+typedef struct _EmulatorProfile {
+    uint64_t* branches;    // two per instruction, times a SKIP or JUMP was not taken and taken
+    uint64_t* executions;  // times control reached each instruction, including the END sentinels
+    uint32_t length;
+    uint32_t startPc;
+} EmulatorProfile;
+
+/**
+ * @brief Start counting branches of an emulator's next run
+ *
+ * @param profile The profile to start
+ * @param emulator The emulator about to run, from its current program counter
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t startProfile(EmulatorProfile* profile, Emulator* emulator);
+
+/**
+ * @brief Stop counting and work out how often each instruction ran
+ *
+ * @param profile The started profile
+ * @param emulator The emulator that ran
+ */
+void finishProfile(EmulatorProfile* profile, Emulator* emulator);
+
+void freeProfile(EmulatorProfile* profile);
+
+/**
+ * @brief Print the hottest labels, lines and branches
+ *
+ * @param stream Where to print
+ * @param profile The finished profile
+ * @param emulator The emulator that ran
+ * @param table Line table of the program, or NULL to report program offsets only
+ */
+void printProfile(FILE* stream, const EmulatorProfile* const profile, const Emulator* const emulator, const LineTable* const table);
+
+/**
+ * @brief Write how often control reached each label, one `label count` pair per line, for `assemble-risc-mc8 --layout`
+ *
+ * @param stream Where to write
+ * @param profile The finished profile
+ * @param table Line table of the program
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the table is not of the profiled program
+ */
+uint8_t writeLabelCounts(FILE* stream, const EmulatorProfile* const profile, const LineTable* const table);
+
+/**
+ * @brief Print the whole source with how often each instruction ran in the margin
+ *
+ * @param stream Where to print
+ * @param profile The finished profile
+ * @param table Line table of the program, its source path must be readable
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the source could not be read, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t printAnnotatedSource(FILE* stream, const EmulatorProfile* const profile, const LineTable* const table);
+
+#endif
@@ -3,20 +3,35 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "DecoderTables.h"
+
 /**
  * @brief Get a register with the given name
  *
- * @param name The register to get information about
+ * @param name The register to get information about, case insensitive
+ * @param length Number of characters in name, which need not be NUL terminated
  * @return The definition of the register, or NULL if the name was invalid
  */
-const RegisterDefinition* getRegisterDefinition(const char* const name)
+const RegisterDefinition* getRegisterDefinitionN(const char* const name, uint32_t length)
 {
-    for (uint8_t i = 0; i < NUM_REGISTERS; i++) {
-        if (strncmp(name, RegisterDefinitionLUT[i].name, 4) == 0) {
-            return &RegisterDefinitionLUT[i];
-        } else if (strncmp(name, RegisterDefinitionLUT[i].altName, 5) == 0) {
-            return &RegisterDefinitionLUT[i];
-        }
+    uint32_t key;
+    if (!packKey(&key, name, length)) {
+        return NULL;
+    }
+    uint32_t slot = PACKED_KEY_HASH(key, REGISTER_HASH_MULTIPLIER);
+    if (RegisterHashSlots[slot] == 0 || RegisterHashKeys[slot] != key) {
+        return NULL;
     }
-    return NULL;
+    return &RegisterDefinitionLUT[RegisterHashSlots[slot] - 1];
+}
+
+/**
+ * @brief Get a register with the given name
+ *
+ * @param name The register to get information about, case insensitive
+ * @return The definition of the register, or NULL if the name was invalid
+ */
+const RegisterDefinition* getRegisterDefinition(const char* const name)
+{
+    return getRegisterDefinitionN(name, strlen(name));
 }
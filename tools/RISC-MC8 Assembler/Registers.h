@@ -24,9 +24,18 @@ typedef struct _RegisterDefinition RegisterDefinition;
 /**
  * @brief Get a register with the given name
  *
- * @param name The register to get information about
+ * @param name The register to get information about, case insensitive
  * @return The definition of the register, or NULL if the name was invalid
  */
 const RegisterDefinition* getRegisterDefinition(const char* const name);
 
+/**
+ * @brief Get a register with the given name
+ *
+ * @param name The register to get information about, case insensitive
+ * @param length Number of characters in name, which need not be NUL terminated
+ * @return The definition of the register, or NULL if the name was invalid
+ */
+const RegisterDefinition* getRegisterDefinitionN(const char* const name, uint32_t length);
+
 #endif
@@ -0,0 +1,929 @@
+#include "Relaxation.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AssemblerStats.h"
+#include "StatusCodes.h"
+
+#define NOT_A_JUMP UINT32_MAX
+
+#define FLAG_SKIP 0b001           // a SKIP, so the instruction after it may not run
+#define FLAG_UNCONDITIONAL 0b010  // a JUMP not after a SKIP, so nothing ever falls through to what follows it
+#define FLAG_EXIT 0b100           // a JUMP out of the program, kept as it is while it still leaves
+
+/**
+ * A JUMP inserted by relaxation. It sits in a slot, the gap just before an old instruction, so the program keeps its
+ * order and only ever grows between old instructions.
+ */
+typedef struct _Trampoline {
+    uint32_t slot;    // old offset it is inserted before, the old length for the end of the program
+    uint32_t index;   // order within the slot
+    uint32_t target;  // item it jumps to
+    uint32_t final;   // item the JUMP it carries is headed for
+    uint32_t root;    // old offset of the JUMP it was inserted for
+    bool skip;        // jumps over the trampolines of its slot rather than carrying a JUMP
+} Trampoline;
+
+/**
+ * A JUMP that could carry others headed for the same place, as it was at the start of a round
+ */
+typedef struct _Carrier {
+    uint32_t final;
+    uint32_t position;
+    uint32_t item;
+} Carrier;
+
+/**
+ * A JUMP out of range, to be given a route in the current round
+ */
+typedef struct _Stranded {
+    uint32_t final;
+    uint32_t position;
+    uint32_t item;
+} Stranded;
+
+/**
+ * The program being relaxed. Items are the old instructions 0..length-1, the end of the program (length), and the
+ * inserted JUMPs (length + 1 + their index). A JUMP's target is always strictly between it and its final target, so
+ * every route heads one way and ends, and since code is only inserted between items that stays true.
+ */
+typedef struct _Relaxer {
+    uint32_t length;        // old length, also the item for the end of the program
+    const uint8_t* old;     // the old program
+    uint32_t* targets;      // item each old JUMP jumps to, NOT_A_JUMP for other instructions
+    uint32_t* finals;       // item each old JUMP is headed for
+    uint8_t* flags;         // FLAG_ bits of each old instruction
+    bool* deadSlots;        // slots execution never falls into, each old offset and the end
+    uint32_t* slotCounts;   // JUMPs inserted in each slot
+    uint32_t* slotTree;     // Fenwick tree over slotCounts, so positions stay exact as code is inserted
+    uint32_t* depths;       // loops running through each slot, counted from backward JUMPs
+    Trampoline* inserted;
+    uint32_t numInserted;
+    uint32_t insertedCapacity;
+    Carrier* carriers;
+    uint32_t numCarriers;
+    uint32_t carrierCapacity;
+    Stranded* stranded;
+    uint32_t numStranded;
+    uint32_t strandedCapacity;
+    uint32_t reused;
+} Relaxer;
+
+uint8_t addFarJump(FarJumpsList* list, uint32_t offset, uint32_t target, uint32_t line)
+{
+    if (list->length == list->capacity) {
+        uint32_t newCapacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        FarJump* grown = (FarJump*)realloc(list->jumps, newCapacity * sizeof(FarJump));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        countAllocation(newCapacity * sizeof(FarJump));
+        list->jumps = grown;
+        list->capacity = newCapacity;
+    }
+    FarJump* added = list->jumps + list->length;
+    added->offset = offset;
+    added->target = target;
+    added->line = line;
+    list->length++;
+    return 0;
+}
+
+uint8_t appendFarJumps(FarJumpsList* list, const FarJumpsList* const other)
+{
+    for (uint32_t i = 0; i < other->length; i++) {
+        const FarJump* jump = other->jumps + i;
+        uint8_t status = addFarJump(list, jump->offset, jump->target, jump->line);
+        if (status != 0) {
+            return status;
+        }
+    }
+    return 0;
+}
+
+void freeFarJumpsList(FarJumpsList* list)
+{
+    free(list->jumps);
+    list->jumps = NULL;
+    list->length = 0;
+    list->capacity = 0;
+}
+
+void freeRelaxationReport(RelaxationReport* report)
+{
+    free(report->jumps);
+    free(report->offsetMap);
+    free(report->origins);
+    memset(report, 0, sizeof(RelaxationReport));
+}
+
+/**
+ * @brief Write a 32-bit value of a summary in little-endian order
+ *
+ * @param dest Where to write the 4 bytes
+ * @param value The value to write
+ */
+static void putSummaryUint32(uint8_t* dest, uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; i++) {
+        *(dest + i) = (uint8_t)(value >> (i * 8));
+    }
+}
+
+/**
+ * @brief Read a 32-bit value of a summary in little-endian order
+ *
+ * @param src The 4 bytes to read
+ * @return The value
+ */
+static uint32_t getSummaryUint32(const uint8_t* const src)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        value |= (uint32_t)*(src + i) << (i * 8);
+    }
+    return value;
+}
+
+/**
+ * @brief Append the summary of a report, everything but its offset maps
+ *
+ * @param report The report
+ * @param summary Growable buffer to append to
+ * @return true if successful, false if out of memory
+ */
+bool writeRelaxationSummary(const RelaxationReport* const report, CodeBuffer* summary)
+{
+    size_t length = RELAXATION_SUMMARY_HEADER_LENGTH + (size_t)report->numJumps * RELAXATION_SUMMARY_JUMP_LENGTH;
+    if (!reserveCode(summary, summary->length + length)) {
+        return false;
+    }
+    uint8_t* next = summary->data + summary->length;
+    putSummaryUint32(next, report->numJumps);
+    putSummaryUint32(next + 4, report->trampolines);
+    putSummaryUint32(next + 8, report->skipJumps);
+    putSummaryUint32(next + 12, report->reused);
+    putSummaryUint32(next + 16, report->oldLength);
+    putSummaryUint32(next + 20, report->length);
+    next += RELAXATION_SUMMARY_HEADER_LENGTH;
+    for (uint32_t i = 0; i < report->numJumps; i++) {
+        const RelaxedJump* jump = report->jumps + i;
+        putSummaryUint32(next, jump->offset);
+        putSummaryUint32(next + 4, jump->line);
+        putSummaryUint32(next + 8, jump->hops);
+        putSummaryUint32(next + 12, jump->skipJumps);
+        next += RELAXATION_SUMMARY_JUMP_LENGTH;
+    }
+    summary->length += length;
+    return true;
+}
+
+/**
+ * @brief Read a summary written by writeRelaxationSummary into a report without offset maps
+ *
+ * @param data The summary
+ * @param length Number of bytes in data, exactly one summary
+ * @param report Empty report to fill in, free it with freeRelaxationReport
+ * @return true if successful, false if data is not one whole summary or out of memory
+ */
+bool readRelaxationSummary(const uint8_t* const data, size_t length, RelaxationReport* report)
+{
+    if (length < RELAXATION_SUMMARY_HEADER_LENGTH) {
+        return false;
+    }
+    uint32_t numJumps = getSummaryUint32(data);
+    if ((length - RELAXATION_SUMMARY_HEADER_LENGTH) / RELAXATION_SUMMARY_JUMP_LENGTH != numJumps || (length - RELAXATION_SUMMARY_HEADER_LENGTH) % RELAXATION_SUMMARY_JUMP_LENGTH != 0) {
+        return false;
+    }
+    RelaxedJump* jumps = NULL;
+    if (numJumps > 0) {
+        jumps = (RelaxedJump*)malloc(numJumps * sizeof(RelaxedJump));
+        if (jumps == NULL) {
+            return false;
+        }
+        countAllocation(numJumps * sizeof(RelaxedJump));
+    }
+    const uint8_t* next = data + RELAXATION_SUMMARY_HEADER_LENGTH;
+    for (uint32_t i = 0; i < numJumps; i++) {
+        RelaxedJump* jump = jumps + i;
+        jump->offset = getSummaryUint32(next);
+        jump->line = getSummaryUint32(next + 4);
+        jump->hops = getSummaryUint32(next + 8);
+        jump->skipJumps = getSummaryUint32(next + 12);
+        next += RELAXATION_SUMMARY_JUMP_LENGTH;
+    }
+    memset(report, 0, sizeof(RelaxationReport));
+    report->jumps = jumps;
+    report->numJumps = numJumps;
+    report->trampolines = getSummaryUint32(data + 4);
+    report->skipJumps = getSummaryUint32(data + 8);
+    report->reused = getSummaryUint32(data + 12);
+    report->oldLength = getSummaryUint32(data + 16);
+    report->length = getSummaryUint32(data + 20);
+    return true;
+}
+
+/**
+ * @brief Count JUMPs inserted in the slots before a slot
+ *
+ * @param relaxer The program
+ * @param slot The slot
+ * @return Number of JUMPs inserted before it
+ */
+static uint32_t insertedBefore(const Relaxer* const relaxer, uint32_t slot)
+{
+    uint32_t sum = 0;
+    for (uint32_t i = slot; i > 0; i -= i & (~i + 1)) {
+        sum += *(relaxer->slotTree + i);
+    }
+    return sum;
+}
+
+/**
+ * @param relaxer The program
+ * @param item An item
+ * @return Its offset in the program as it is now
+ */
+static uint32_t positionOf(const Relaxer* const relaxer, uint32_t item)
+{
+    if (item <= relaxer->length) {
+        return item + insertedBefore(relaxer, item + 1);
+    }
+    const Trampoline* trampoline = relaxer->inserted + (item - relaxer->length - 1);
+    return trampoline->slot + insertedBefore(relaxer, trampoline->slot) + trampoline->index;
+}
+
+static uint32_t targetOf(const Relaxer* const relaxer, uint32_t item)
+{
+    if (item < relaxer->length) {
+        return *(relaxer->targets + item);
+    }
+    return (relaxer->inserted + (item - relaxer->length - 1))->target;
+}
+
+static uint32_t finalOf(const Relaxer* const relaxer, uint32_t item)
+{
+    if (item < relaxer->length) {
+        return *(relaxer->finals + item);
+    }
+    return (relaxer->inserted + (item - relaxer->length - 1))->final;
+}
+
+static uint32_t rootOf(const Relaxer* const relaxer, uint32_t item)
+{
+    if (item < relaxer->length) {
+        return item;
+    }
+    return (relaxer->inserted + (item - relaxer->length - 1))->root;
+}
+
+static void setTarget(Relaxer* relaxer, uint32_t item, uint32_t target)
+{
+    if (item < relaxer->length) {
+        *(relaxer->targets + item) = target;
+    } else {
+        (relaxer->inserted + (item - relaxer->length - 1))->target = target;
+    }
+}
+
+/**
+ * @brief Insert a JUMP at the end of a slot
+ *
+ * @param relaxer The program
+ * @param slot Old offset to insert it before
+ * @param target Item it jumps to
+ * @param final Item the JUMP it carries is headed for
+ * @param root Old offset of the JUMP it is inserted for
+ * @param skip true if it jumps over the slot's trampolines
+ * @param item Set to the new item
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t insertJump(Relaxer* relaxer, uint32_t slot, uint32_t target, uint32_t final, uint32_t root, bool skip, uint32_t* item)
+{
+    if (relaxer->numInserted == relaxer->insertedCapacity) {
+        uint32_t newCapacity = relaxer->insertedCapacity == 0 ? 64 : relaxer->insertedCapacity * 2;
+        Trampoline* grown = (Trampoline*)realloc(relaxer->inserted, newCapacity * sizeof(Trampoline));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        countAllocation(newCapacity * sizeof(Trampoline));
+        relaxer->inserted = grown;
+        relaxer->insertedCapacity = newCapacity;
+    }
+    Trampoline* added = relaxer->inserted + relaxer->numInserted;
+    added->slot = slot;
+    added->index = *(relaxer->slotCounts + slot);
+    added->target = target;
+    added->final = final;
+    added->root = root;
+    added->skip = skip;
+    *item = relaxer->length + 1 + relaxer->numInserted;
+    relaxer->numInserted++;
+
+    (*(relaxer->slotCounts + slot))++;
+    for (uint32_t i = slot + 1; i <= relaxer->length + 1; i += i & (~i + 1)) {
+        (*(relaxer->slotTree + i))++;
+    }
+    return 0;
+}
+
+static int compareCarriers(const void* a, const void* b)
+{
+    const Carrier* left = (const Carrier*)a;
+    const Carrier* right = (const Carrier*)b;
+    if (left->final != right->final) {
+        return left->final < right->final ? -1 : 1;
+    }
+    return left->position < right->position ? -1 : left->position > right->position;
+}
+
+static int compareFarJumps(const void* a, const void* b)
+{
+    const FarJump* left = (const FarJump*)a;
+    const FarJump* right = (const FarJump*)b;
+    return left->offset < right->offset ? -1 : left->offset > right->offset;
+}
+
+static int compareRoots(const void* a, const void* b)
+{
+    uint32_t left = *(const uint32_t*)a;
+    uint32_t right = *(const uint32_t*)b;
+    return left < right ? -1 : left > right;
+}
+
+/**
+ * @param relaxer The program
+ * @param item A JUMP
+ * @return true if it jumps somewhere -64..63 away, or still leaves the program
+ */
+static bool jumpFits(const Relaxer* const relaxer, uint32_t item)
+{
+    int64_t position = positionOf(relaxer, item);
+    if (item < relaxer->length && (*(relaxer->flags + item) & FLAG_EXIT)) {
+        int64_t target = position + (int8_t)(*(relaxer->old + item) << 1) / 2;
+        return target < 0 || target >= positionOf(relaxer, relaxer->length);
+    }
+    int64_t distance = (int64_t)positionOf(relaxer, targetOf(relaxer, item)) - position;
+    return distance >= -64 && distance <= 63;
+}
+
+/**
+ * @brief Find the first slot at or after a position
+ *
+ * @param relaxer The program
+ * @param position Offset in the program as it is now
+ * @return The slot, the old length if position is past every old instruction
+ */
+static uint32_t firstSlotFrom(const Relaxer* const relaxer, uint32_t position)
+{
+    uint32_t low = 0;
+    uint32_t high = relaxer->length;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (positionOf(relaxer, middle) < position) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Find the JUMP already in the program that carries a JUMP furthest toward its final target
+ *
+ * @param relaxer The program
+ * @param item The JUMP
+ * @param freshFrom Index of the first carrier added this round
+ * @param low Lowest position in reach
+ * @param high Highest position in reach
+ * @return The carrier, NOT_A_JUMP if none is in reach
+ */
+static uint32_t findCarrier(const Relaxer* const relaxer, uint32_t item, uint32_t freshFrom, int64_t low, int64_t high)
+{
+    uint32_t final = finalOf(relaxer, item);
+    int64_t position = positionOf(relaxer, item);
+    int64_t finalPosition = positionOf(relaxer, final);
+    bool forward = finalPosition > position;
+
+    // carriers are sorted by where they were at the start of the round, code inserted since only moves them later
+    uint32_t first = 0;
+    uint32_t last = freshFrom;
+    Carrier key = {final, low > 128 ? (uint32_t)(low - 128) : 0, 0};
+    while (first < last) {
+        uint32_t middle = first + (last - first) / 2;
+        if (compareCarriers(relaxer->carriers + middle, &key) < 0) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+
+    uint32_t best = NOT_A_JUMP;
+    int64_t bestDistance = finalPosition > position ? finalPosition - position : position - finalPosition;
+    for (uint32_t i = first; i < relaxer->numCarriers; i++) {
+        const Carrier* carrier = relaxer->carriers + i;
+        if (i < freshFrom && (carrier->final != final || carrier->position > high)) {
+            i = freshFrom - 1;  // on to the ones added this round, which are unsorted
+            continue;
+        } else if (carrier->final != final || carrier->item == item) {
+            continue;
+        }
+        int64_t carrierPosition = positionOf(relaxer, carrier->item);
+        bool between = forward ? carrierPosition > position && carrierPosition < finalPosition : carrierPosition < position && carrierPosition > finalPosition;
+        int64_t distance = forward ? finalPosition - carrierPosition : carrierPosition - finalPosition;
+        if (between && carrierPosition >= low && carrierPosition <= high && distance < bestDistance) {
+            best = carrier->item;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Record a JUMP as one that may carry others, for the rest of the round
+ *
+ * @param relaxer The program
+ * @param item The JUMP
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t addCarrier(Relaxer* relaxer, uint32_t item)
+{
+    if (relaxer->numCarriers == relaxer->carrierCapacity) {
+        uint32_t newCapacity = relaxer->carrierCapacity == 0 ? 64 : relaxer->carrierCapacity * 2;
+        Carrier* grown = (Carrier*)realloc(relaxer->carriers, newCapacity * sizeof(Carrier));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        countAllocation(newCapacity * sizeof(Carrier));
+        relaxer->carriers = grown;
+        relaxer->carrierCapacity = newCapacity;
+    }
+    Carrier* added = relaxer->carriers + relaxer->numCarriers;
+    added->final = finalOf(relaxer, item);
+    added->position = positionOf(relaxer, item);
+    added->item = item;
+    relaxer->numCarriers++;
+    return 0;
+}
+
+/**
+ * @brief Give a JUMP out of range a route one hop nearer its target
+ *
+ * @param relaxer The program
+ * @param item The JUMP
+ * @param freshFrom Index of the first carrier added this round
+ * @param added Set to the trampoline inserted, which may itself be out of range, or NOT_A_JUMP if an existing JUMP
+ *              carries it
+ * @return 0 if successful, ERROR_RELAXATION_FAILED if there is nowhere to put a trampoline, otherwise
+ *         ERROR_OUT_OF_MEMORY
+ */
+static uint8_t relaxJump(Relaxer* relaxer, uint32_t item, uint32_t freshFrom, uint32_t* added)
+{
+    *added = NOT_A_JUMP;
+    uint32_t target = targetOf(relaxer, item);
+    int64_t position = positionOf(relaxer, item);
+    int64_t targetPosition = positionOf(relaxer, target);
+    bool forward = targetPosition > position;
+    int64_t low = forward ? position + 1 : position - 63;  // code inserted before the JUMP moves it one further away
+    int64_t high = forward ? position + 63 : position - 1;
+
+    uint32_t carrier = findCarrier(relaxer, item, freshFrom, low, high);
+    if (carrier != NOT_A_JUMP) {
+        setTarget(relaxer, item, carrier);
+        relaxer->reused++;
+        return 0;
+    }
+
+    // a trampoline goes at the end of a slot strictly between the JUMP and its target, where inserting it lands
+    // forward: on a position in (position, targetPosition], backward: in (targetPosition, position)
+    int64_t first = forward ? position + 1 : (targetPosition + 1 > low ? targetPosition + 1 : low);
+    int64_t last = forward ? (targetPosition < high ? targetPosition : high) : position - 1;
+
+    // a trampoline that reaches the target takes no further hops, so the cheapest slot that gives one is best: a dead
+    // slot costs nothing on the straight-line path, a live one a JUMP over the trampoline every time execution falls
+    // through (so the one in the fewest loops), a dead slot at capacity only crowds it; failing that, the slot that
+    // gets nearest the target, so the fewest hops follow
+    uint32_t bestSlot = NOT_A_JUMP;
+    uint32_t bestRank = 0;  // 0 dead, 1 live, 2 dead at capacity
+    uint32_t bestDepth = 0;
+    int64_t bestRemaining = 0;
+    bool bestReaches = false;
+    for (uint32_t slot = first < 0 ? 0 : firstSlotFrom(relaxer, (uint32_t)first); slot <= relaxer->length; slot++) {
+        int64_t slotPosition = positionOf(relaxer, slot);
+        if (slotPosition > last) {
+            break;
+        }
+        uint32_t rank;
+        if (*(relaxer->deadSlots + slot)) {
+            uint32_t count = *(relaxer->slotCounts + slot);
+            if (count >= RELAXATION_SLOT_LIMIT) {
+                continue;
+            }
+            rank = count < RELAXATION_SLOT_CAPACITY ? 0 : 2;
+        } else if ((slot == 0 || !(*(relaxer->flags + slot - 1) & FLAG_SKIP)) && (forward ? slotPosition + 1 <= high : true)) {
+            rank = 1;
+        } else {
+            continue;
+        }
+        // how far the trampoline is from the target once inserted, forward the target moves on by what goes in
+        int64_t remaining = forward ? targetPosition + 1 - slotPosition : slotPosition + (rank == 1) - targetPosition;
+        bool reaches = remaining <= (forward ? 63 : 64);
+        uint32_t depth = rank == 1 ? *(relaxer->depths + slot) : 0;
+        bool better;
+        if (bestSlot == NOT_A_JUMP || reaches != bestReaches) {
+            better = bestSlot == NOT_A_JUMP || reaches;
+        } else if (reaches) {
+            better = rank != bestRank ? rank < bestRank : depth != bestDepth ? depth < bestDepth : remaining < bestRemaining;
+        } else {
+            better = remaining != bestRemaining ? remaining < bestRemaining : rank < bestRank;
+        }
+        if (better) {
+            bestSlot = slot;
+            bestRank = rank;
+            bestDepth = depth;
+            bestRemaining = remaining;
+            bestReaches = reaches;
+        }
+    }
+    if (bestSlot == NOT_A_JUMP) {
+        return ERROR_RELAXATION_FAILED;
+    }
+
+    uint32_t root = rootOf(relaxer, item);
+    uint32_t final = finalOf(relaxer, item);
+    uint32_t trampoline;
+    uint8_t status = 0;
+    if (bestRank == 1) {
+        uint32_t skipJump;
+        status = insertJump(relaxer, bestSlot, bestSlot, bestSlot, root, true, &skipJump);
+        if (status == 0) {
+            status = insertJump(relaxer, bestSlot, target, final, root, false, &trampoline);
+        }
+        *(relaxer->deadSlots + bestSlot) = true;
+    } else {
+        status = insertJump(relaxer, bestSlot, target, final, root, false, &trampoline);
+    }
+    if (status != 0) {
+        return status;
+    }
+    setTarget(relaxer, item, trampoline);
+    *added = trampoline;
+    return addCarrier(relaxer, trampoline);
+}
+
+/**
+ * @brief Find every JUMP out of range, after retargeting JUMPs that no longer leave the program to its end
+ *
+ * @param relaxer The program
+ */
+static void findStranded(Relaxer* relaxer)
+{
+    relaxer->numStranded = 0;
+    relaxer->numCarriers = 0;
+    uint32_t numItems = relaxer->length + 1 + relaxer->numInserted;
+    for (uint32_t item = 0; item < numItems; item++) {
+        if (item == relaxer->length || (item < relaxer->length && *(relaxer->targets + item) == NOT_A_JUMP)) {
+            continue;
+        }
+        if (item < relaxer->length && (*(relaxer->flags + item) & FLAG_EXIT)) {
+            if (jumpFits(relaxer, item)) {
+                continue;
+            }
+            // the program grew past where it jumps, so send it to the end instead
+            *(relaxer->flags + item) &= ~FLAG_EXIT;
+            *(relaxer->targets + item) = relaxer->length;
+            *(relaxer->finals + item) = relaxer->length;
+        }
+        Carrier* carrier = relaxer->carriers + relaxer->numCarriers;
+        carrier->final = finalOf(relaxer, item);
+        carrier->position = positionOf(relaxer, item);
+        carrier->item = item;
+        relaxer->numCarriers++;
+        if (!jumpFits(relaxer, item)) {
+            Stranded* stranded = relaxer->stranded + relaxer->numStranded;
+            stranded->final = carrier->final;
+            stranded->position = carrier->position;
+            stranded->item = item;
+            relaxer->numStranded++;
+        }
+    }
+    qsort(relaxer->carriers, relaxer->numCarriers, sizeof(Carrier), compareCarriers);
+    // JUMPs to the same place are relaxed together, so later ones can ride the trampolines of earlier ones
+    qsort(relaxer->stranded, relaxer->numStranded, sizeof(Stranded), compareCarriers);
+}
+
+/**
+ * @brief Make room for every JUMP in the program in the lists findStranded fills
+ *
+ * @param relaxer The program
+ * @return true if successful, false if out of memory
+ */
+static bool reserveJumps(Relaxer* relaxer)
+{
+    uint32_t needed = relaxer->numInserted + 1;
+    for (uint32_t i = 0; i < relaxer->length; i++) {
+        needed += *(relaxer->targets + i) != NOT_A_JUMP;
+    }
+    if (needed > relaxer->carrierCapacity) {
+        Carrier* carriers = (Carrier*)realloc(relaxer->carriers, needed * sizeof(Carrier));
+        if (carriers == NULL) {
+            return false;
+        }
+        countAllocation(needed * sizeof(Carrier));
+        relaxer->carriers = carriers;
+        relaxer->carrierCapacity = needed;
+    }
+    if (needed > relaxer->strandedCapacity) {
+        Stranded* stranded = (Stranded*)realloc(relaxer->stranded, needed * sizeof(Stranded));
+        if (stranded == NULL) {
+            return false;
+        }
+        countAllocation(needed * sizeof(Stranded));
+        relaxer->stranded = stranded;
+        relaxer->strandedCapacity = needed;
+    }
+    return true;
+}
+
+/**
+ * @brief Read the old program's JUMPs, SKIPs, and the loops they form
+ *
+ * @param relaxer The program, with old and length set and every array allocated
+ * @param farJumps JUMPs whose targets were out of range when assembled
+ */
+static void readProgram(Relaxer* relaxer, const FarJumpsList* const farJumps)
+{
+    uint32_t length = relaxer->length;
+    for (uint32_t i = 0; i < length; i++) {
+        uint8_t instruction = *(relaxer->old + i);
+        uint8_t flags = 0;
+        uint32_t target = NOT_A_JUMP;
+        if (instruction & 0b10000000) {
+            int64_t jumpTarget = (int64_t)i + (int8_t)(instruction << 1) / 2;
+            flags = i == 0 || !(*(relaxer->flags + i - 1) & FLAG_SKIP) ? FLAG_UNCONDITIONAL : 0;
+            if (jumpTarget < 0 || jumpTarget > length) {
+                flags |= FLAG_EXIT;
+            }
+            target = (uint32_t)jumpTarget;  // ignored for exits
+        } else if ((instruction >> 3) == 0b01011) {
+            flags = FLAG_SKIP;
+        }
+        *(relaxer->flags + i) = flags;
+        *(relaxer->targets + i) = target;
+        *(relaxer->deadSlots + i + 1) = (flags & FLAG_UNCONDITIONAL) != 0;
+    }
+    *relaxer->deadSlots = false;
+    for (uint32_t i = 0; i < farJumps->length; i++) {
+        const FarJump* jump = farJumps->jumps + i;
+        *(relaxer->flags + jump->offset) &= ~FLAG_EXIT;
+        *(relaxer->targets + jump->offset) = jump->target;
+    }
+    memcpy(relaxer->finals, relaxer->targets, length * sizeof(uint32_t));
+
+    // a backward JUMP from i to t runs slots t+1..i each time round, so count the loops over each slot
+    memset(relaxer->depths, 0, (length + 2) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < length; i++) {
+        uint32_t target = *(relaxer->targets + i);
+        if (target != NOT_A_JUMP && !(*(relaxer->flags + i) & FLAG_EXIT) && target <= i) {
+            (*(relaxer->depths + target + 1))++;
+            (*(relaxer->depths + i + 1))--;
+        }
+    }
+    for (uint32_t i = 1; i <= length; i++) {
+        *(relaxer->depths + i) += *(relaxer->depths + i - 1);
+    }
+}
+
+/**
+ * @brief Write the relaxed program and fill in the report
+ *
+ * @param relaxer The relaxed program
+ * @param code Buffer to write it to
+ * @param start Offset of the program within code
+ * @param farJumps JUMPs whose targets were out of range when assembled
+ * @param report Receives what was inserted, with the offset maps, may be NULL
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t writeProgram(Relaxer* relaxer, CodeBuffer* code, size_t start, const FarJumpsList* const farJumps, RelaxationReport* report)
+{
+    uint32_t length = relaxer->length;
+    uint32_t newLength = positionOf(relaxer, length);
+    uint8_t* program = (uint8_t*)malloc(newLength + 1);
+    uint32_t* offsetMap = (uint32_t*)malloc((length + 1) * sizeof(uint32_t));
+    uint32_t* origins = (uint32_t*)malloc((newLength + 1) * sizeof(uint32_t));
+    if (program == NULL || offsetMap == NULL || origins == NULL) {
+        free(program);
+        free(offsetMap);
+        free(origins);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    countAllocation(newLength + 1 + (length + 1 + newLength + 1) * sizeof(uint32_t));
+
+    uint32_t numItems = length + 1 + relaxer->numInserted;
+    for (uint32_t item = 0; item < numItems; item++) {
+        if (item == length) {
+            *(offsetMap + length) = newLength;
+            continue;
+        }
+        uint32_t position = positionOf(relaxer, item);
+        uint8_t instruction;
+        if (item < length && (*(relaxer->targets + item) == NOT_A_JUMP || (*(relaxer->flags + item) & FLAG_EXIT))) {
+            instruction = *(relaxer->old + item);
+        } else {
+            int64_t distance = (int64_t)positionOf(relaxer, targetOf(relaxer, item)) - position;
+            instruction = 0b10000000 | (distance & 0b1111111);  // drop high bits
+        }
+        *(program + position) = instruction;
+        *(origins + position) = rootOf(relaxer, item);
+        if (item < length) {
+            *(offsetMap + item) = position;
+        }
+    }
+
+    code->length = start;
+    reserveCode(code, start + newLength);  // only a speed up, a fixed buffer that is too small counts the rest
+    uint8_t status = 0;
+    for (uint32_t i = 0; status == 0 && i < newLength; i++) {
+        if (!appendCode(code, *(program + i))) {
+            status = ERROR_OUT_OF_MEMORY;
+        }
+    }
+    free(program);
+    if (status != 0 || report == NULL) {
+        free(offsetMap);
+        free(origins);
+        return status;
+    }
+
+    // report every old JUMP whose route changed, with the lines of the ones the source wrote too far
+    FarJump* lines = (FarJump*)malloc((farJumps->length + 1) * sizeof(FarJump));
+    uint32_t* skipRoots = (uint32_t*)malloc((relaxer->numInserted + 1) * sizeof(uint32_t));
+    uint32_t numJumps = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        numJumps += *(relaxer->targets + i) != NOT_A_JUMP && *(relaxer->targets + i) != *(relaxer->finals + i);
+    }
+    RelaxedJump* jumps = (RelaxedJump*)malloc((numJumps + 1) * sizeof(RelaxedJump));
+    if (lines == NULL || skipRoots == NULL || jumps == NULL) {
+        free(lines);
+        free(skipRoots);
+        free(jumps);
+        free(offsetMap);
+        free(origins);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    countAllocation((farJumps->length + 1) * sizeof(FarJump) + (relaxer->numInserted + 1) * sizeof(uint32_t) + (numJumps + 1) * sizeof(RelaxedJump));
+    memcpy(lines, farJumps->jumps, farJumps->length * sizeof(FarJump));
+    qsort(lines, farJumps->length, sizeof(FarJump), compareFarJumps);
+    uint32_t numSkipRoots = 0;
+    for (uint32_t i = 0; i < relaxer->numInserted; i++) {
+        if ((relaxer->inserted + i)->skip) {
+            *(skipRoots + numSkipRoots++) = (relaxer->inserted + i)->root;
+        }
+    }
+    qsort(skipRoots, numSkipRoots, sizeof(uint32_t), compareRoots);
+
+    uint32_t numReported = 0;
+    uint32_t nextLine = 0;
+    uint32_t nextSkip = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        if (*(relaxer->targets + i) == NOT_A_JUMP || *(relaxer->targets + i) == *(relaxer->finals + i)) {
+            continue;
+        }
+        RelaxedJump* jump = jumps + numReported++;
+        jump->offset = *(offsetMap + i);
+        jump->hops = 0;
+        for (uint32_t hop = *(relaxer->targets + i); hop != *(relaxer->finals + i); hop = targetOf(relaxer, hop)) {
+            jump->hops++;
+        }
+        while (nextLine < farJumps->length && (lines + nextLine)->offset < i) {
+            nextLine++;
+        }
+        jump->line = nextLine < farJumps->length && (lines + nextLine)->offset == i ? (lines + nextLine)->line : 0;
+        while (nextSkip < numSkipRoots && *(skipRoots + nextSkip) < i) {
+            nextSkip++;
+        }
+        jump->skipJumps = 0;
+        while (nextSkip < numSkipRoots && *(skipRoots + nextSkip) == i) {
+            jump->skipJumps++;
+            nextSkip++;
+        }
+    }
+    free(lines);
+    free(skipRoots);
+
+    report->jumps = jumps;
+    report->numJumps = numReported;
+    report->trampolines = relaxer->numInserted - numSkipRoots;
+    report->skipJumps = numSkipRoots;
+    report->reused = relaxer->reused;
+    report->oldLength = length;
+    report->length = newLength;
+    report->offsetMap = offsetMap;
+    report->origins = origins;
+    return 0;
+}
+
+/**
+ * @brief Give every JUMP that cannot reach its target a route there through intermediate JUMPs
+ *
+ * Each JUMP out of range hops through, in order of preference, a JUMP already in the program to the same target, a
+ * new trampoline where execution never falls through (just after an unconditional JUMP), or a new trampoline with a
+ * JUMP over it on the straight-line path, placed where the fewest loops would run that JUMP. Inserting code pushes
+ * other JUMPs apart, so this repeats until every offset fits. JUMPs that leave the program still do, and instructions
+ * keep their order, so labels move with the instructions they mark.
+ *
+ * @param code The program, rewritten in place from start to its end
+ * @param start Offset of the program within code, jumps are relative to it
+ * @param farJumps JUMPs whose targets were out of range when assembled, each assembled as `jump 0`
+ * @param report Receives what was inserted, with the offset maps, may be NULL
+ * @param diagnostic Set to the error and the JUMP it occurred at if one occurs, may be NULL
+ * @return 0 if successful, ERROR_RELAXATION_FAILED if a JUMP had nowhere to put a trampoline, otherwise
+ *         ERROR_OUT_OF_MEMORY
+ */
+uint8_t relaxJumps(CodeBuffer* code, size_t start, const FarJumpsList* const farJumps, RelaxationReport* report, AssemblerDiagnostic* diagnostic)
+{
+    if (report != NULL) {
+        memset(report, 0, sizeof(RelaxationReport));
+    }
+    Relaxer relaxer;
+    memset(&relaxer, 0, sizeof(Relaxer));
+    uint32_t length = (uint32_t)(code->length - start);
+    relaxer.length = length;
+    uint8_t* old = (uint8_t*)malloc(length + 1);
+    relaxer.targets = (uint32_t*)malloc((length + 1) * sizeof(uint32_t));
+    relaxer.finals = (uint32_t*)malloc((length + 1) * sizeof(uint32_t));
+    relaxer.flags = (uint8_t*)malloc(length + 1);
+    relaxer.deadSlots = (bool*)malloc((length + 1) * sizeof(bool));
+    relaxer.slotCounts = (uint32_t*)calloc(length + 1, sizeof(uint32_t));
+    relaxer.slotTree = (uint32_t*)calloc(length + 2, sizeof(uint32_t));
+    relaxer.depths = (uint32_t*)malloc((length + 2) * sizeof(uint32_t));
+    uint8_t status = 0;
+    if (old == NULL || relaxer.targets == NULL || relaxer.finals == NULL || relaxer.flags == NULL || relaxer.deadSlots == NULL ||
+        relaxer.slotCounts == NULL || relaxer.slotTree == NULL || relaxer.depths == NULL) {
+        status = ERROR_OUT_OF_MEMORY;
+    } else {
+        countAllocation((length + 1) * (3 + 2 * sizeof(uint32_t) + sizeof(bool)) + 2 * (length + 2) * sizeof(uint32_t));
+        memcpy(old, code->data + start, length);
+        relaxer.old = old;
+        readProgram(&relaxer, farJumps);
+    }
+
+    uint32_t failed = NOT_A_JUMP;
+    for (uint32_t round = 0; status == 0; round++) {
+        if (!reserveJumps(&relaxer)) {
+            status = ERROR_OUT_OF_MEMORY;
+            break;
+        }
+        findStranded(&relaxer);
+        if (relaxer.numStranded == 0) {
+            break;
+        } else if (round == RELAXATION_MAX_ROUNDS) {
+            status = ERROR_RELAXATION_FAILED;
+            failed = relaxer.stranded->item;
+            break;
+        }
+        uint32_t freshFrom = relaxer.numCarriers;
+        for (uint32_t i = 0; status == 0 && i < relaxer.numStranded; i++) {
+            // lay the whole route now, rather than one hop a round
+            uint32_t item = (relaxer.stranded + i)->item;
+            while (status == 0 && item != NOT_A_JUMP && !jumpFits(&relaxer, item)) {
+                failed = item;
+                status = relaxJump(&relaxer, item, freshFrom, &item);
+            }
+        }
+    }
+
+    if (status == 0) {
+        status = writeProgram(&relaxer, code, start, farJumps, report);
+    } else if (status == ERROR_RELAXATION_FAILED) {
+        // point at the source JUMP the stranded one serves, if the source wrote it too far
+        uint32_t root = rootOf(&relaxer, failed);
+        uint32_t line = 0;
+        for (uint32_t i = 0; i < farJumps->length; i++) {
+            if ((farJumps->jumps + i)->offset == root) {
+                line = (farJumps->jumps + i)->line;
+            }
+        }
+        setDiagnostic(diagnostic, status, line, 0);
+    }
+    if (status == ERROR_OUT_OF_MEMORY) {
+        setDiagnostic(diagnostic, status, 0, 0);
+    }
+
+    free(old);
+    free(relaxer.targets);
+    free(relaxer.finals);
+    free(relaxer.flags);
+    free(relaxer.deadSlots);
+    free(relaxer.slotCounts);
+    free(relaxer.slotTree);
+    free(relaxer.depths);
+    free(relaxer.inserted);
+    free(relaxer.carriers);
+    free(relaxer.stranded);
+    return status;
+}
@@ -0,0 +1,136 @@
+#ifndef RELAXATION_H
+#define RELAXATION_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "CodeBuffer.h"
+#include "Diagnostics.h"
+
+#define RELAXATION_MAX_ROUNDS 32     // each round fixes every JUMP out of range, inserting code pushes a few more out
+#define RELAXATION_SLOT_CAPACITY 8   // trampolines in one place, so every stretch of code in reach has slots to use
+#define RELAXATION_SLOT_LIMIT 56     // trampolines in one place when every slot in reach is at capacity, so a JUMP over
+                                     // them still reaches the code after them
+#define RELAXATION_SUMMARY_HEADER_LENGTH 24
+#define RELAXATION_SUMMARY_JUMP_LENGTH 16
+
+/*
+ * Summary of a report, kept by the build cache and sent by the assembler server, all integers little-endian u32:
+ *   JUMPs relaxed, trampolines, JUMPs over trampolines, JUMPs reused, length before, length after
+ *   per JUMP relaxed: offset, line, hops, JUMPs over its trampolines
+ * The offset maps are left out, only a local assembly has them.
+ */
+
+/**
+ * A JUMP to a label more than -64..63 instructions away, assembled as `jump 0` until relaxJumps gives it a route
+ */
+typedef struct _FarJump {
+    uint32_t offset;  // of the JUMP
+    uint32_t target;  // offset of the label
+    uint32_t line;    // source line of the JUMP, for reporting
+} FarJump;
+
+typedef struct _FarJumpsList {
+    FarJump* jumps;
+    uint32_t length;
+    uint32_t capacity;
+} FarJumpsList;
+
+/**
+ * A JUMP of the source that now reaches its target through trampolines
+ */
+typedef struct _RelaxedJump {
+    uint32_t offset;      // where the JUMP is in the relaxed program
+    uint32_t line;        // its source line, 0 if it was in range until code was inserted around it
+    uint32_t hops;        // JUMPs it passes through on the way, each one cycle more whenever it is taken
+    uint32_t skipJumps;   // JUMPs inserted on the straight-line path to step over its trampolines, each one cycle more
+                          // whenever execution falls through there
+} RelaxedJump;
+
+typedef struct _RelaxationReport {
+    RelaxedJump* jumps;  // in program order
+    uint32_t numJumps;
+    uint32_t trampolines;  // JUMPs inserted to carry other JUMPs part of the way
+    uint32_t skipJumps;    // JUMPs inserted on the straight-line path to step over trampolines
+    uint32_t reused;       // times a JUMP already in the program to the same target carried another part of the way
+    uint32_t oldLength;    // length of the program before relaxing
+    uint32_t length;       // length after relaxing
+    uint32_t* offsetMap;   // new offset of each old offset, up to and including the old length
+    uint32_t* origins;     // for each new offset, the old offset of the instruction there, or of the JUMP an inserted
+                           // JUMP was added for
+} RelaxationReport;
+
+/**
+ * @brief Record a JUMP whose label is too far away for its 7-bit offset
+ *
+ * @param list List to add to
+ * @param offset Offset of the JUMP
+ * @param target Offset of the label
+ * @param line Source line of the JUMP
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t addFarJump(FarJumpsList* list, uint32_t offset, uint32_t target, uint32_t line);
+
+/**
+ * @brief Append every JUMP of one list to another
+ *
+ * @param list List to add to
+ * @param other List to add from, unchanged
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t appendFarJumps(FarJumpsList* list, const FarJumpsList* const other);
+
+/**
+ * @brief Free the JUMPs of a list, leaving it empty
+ *
+ * @param list The list
+ */
+void freeFarJumpsList(FarJumpsList* list);
+
+/**
+ * @brief Free the arrays of a report, leaving it empty
+ *
+ * @param report The report
+ */
+void freeRelaxationReport(RelaxationReport* report);
+
+/**
+ * @brief Append the summary of a report, everything but its offset maps
+ *
+ * @param report The report
+ * @param summary Growable buffer to append to
+ * @return true if successful, false if out of memory
+ */
+bool writeRelaxationSummary(const RelaxationReport* const report, CodeBuffer* summary);
+
+/**
+ * @brief Read a summary written by writeRelaxationSummary into a report without offset maps
+ *
+ * @param data The summary
+ * @param length Number of bytes in data, exactly one summary
+ * @param report Empty report to fill in, free it with freeRelaxationReport
+ * @return true if successful, false if data is not one whole summary or out of memory
+ */
+bool readRelaxationSummary(const uint8_t* const data, size_t length, RelaxationReport* report);
+
+/**
+ * @brief Give every JUMP that cannot reach its target a route there through intermediate JUMPs
+ *
+ * Each JUMP out of range hops through, in order of preference, a JUMP already in the program to the same target, a
+ * new trampoline where execution never falls through (just after an unconditional JUMP), or a new trampoline with a
+ * JUMP over it on the straight-line path, placed where the fewest loops would run that JUMP. Inserting code pushes
+ * other JUMPs apart, so this repeats until every offset fits. JUMPs that leave the program still do, and instructions
+ * keep their order, so labels move with the instructions they mark.
+ *
+ * @param code The program, rewritten in place from start to its end
+ * @param start Offset of the program within code, jumps are relative to it
+ * @param farJumps JUMPs whose targets were out of range when assembled, each assembled as `jump 0`
+ * @param report Receives what was inserted, with the offset maps, may be NULL
+ * @param diagnostic Set to the error and the JUMP it occurred at if one occurs, may be NULL
+ * @return 0 if successful, ERROR_RELAXATION_FAILED if a JUMP had nowhere to put a trampoline, otherwise
+ *         ERROR_OUT_OF_MEMORY
+ */
+uint8_t relaxJumps(CodeBuffer* code, size_t start, const FarJumpsList* const farJumps, RelaxationReport* report, AssemblerDiagnostic* diagnostic);
+
+#endif
@@ -0,0 +1,357 @@
+#include "Schematic.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "StatusCodes.h"
+
+#define SCHEMATIC_WIDTH ((7 & 0xE) * SCHEMATIC_ROW_STEP + SCHEMATIC_BIT_STEP + SCHEMATIC_ROW_STEP + 1)
+#define SCHEMATIC_HEIGHT (((SCHEMATIC_MAX_BYTES - 1) / SCHEMATIC_PLANE_WRAP) * SCHEMATIC_UP_STEP + 1)
+#define SCHEMATIC_LENGTH (((SCHEMATIC_PLANE_WRAP - 1) >> 1) * SCHEMATIC_LENGTH_STEP + 1)
+
+#define PALETTE_AIR 0
+#define PALETTE_ON 1
+#define PALETTE_OFF 2
+
+#define NBT_END 0
+#define NBT_SHORT 2
+#define NBT_INT 3
+#define NBT_BYTE_ARRAY 7
+#define NBT_LIST 9
+#define NBT_COMPOUND 10
+
+#define DEFLATE_MAX_MATCH 258
+#define GZIP_BUFFER_SIZE 4096
+
+/**
+ * A gzip stream of a single fixed-Huffman deflate block. Repeats of the previous byte become length/distance 1
+ * matches, which is all the compression a schematic needs: it is almost entirely runs of air.
+ */
+typedef struct _GzipWriter {
+    FILE* file;
+    uint8_t buffer[GZIP_BUFFER_SIZE];
+    uint32_t buffered;
+    uint64_t bits;
+    uint32_t numBits;
+    uint32_t crc;
+    uint32_t size;
+    int32_t last;  // previous byte, -1 before the first
+    uint32_t run;  // repeats of last not yet written
+    bool failed;
+} GzipWriter;
+
+static const uint32_t crcTable[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+static const uint16_t lengthBases[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+
+static const uint8_t lengthExtraBits[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+
+/**
+ * @brief Write the compressed bytes collected so far to the file
+ *
+ * @param writer The writer
+ */
+static void flushGzipBuffer(GzipWriter* writer)
+{
+    if (writer->buffered > 0 && fwrite(writer->buffer, 1, writer->buffered, writer->file) != writer->buffered) {
+        writer->failed = true;
+    }
+    writer->buffered = 0;
+}
+
+/**
+ * @brief Append a byte of compressed output
+ *
+ * @param writer The writer
+ * @param value The byte
+ */
+static void putGzipByte(GzipWriter* writer, uint8_t value)
+{
+    if (writer->buffered == GZIP_BUFFER_SIZE) {
+        flushGzipBuffer(writer);
+    }
+    writer->buffer[writer->buffered++] = value;
+}
+
+/**
+ * @brief Append bits to the deflate stream, least significant first
+ *
+ * @param writer The writer
+ * @param value The bits
+ * @param count Number of bits, at most 32
+ */
+static void putBits(GzipWriter* writer, uint32_t value, uint32_t count)
+{
+    writer->bits |= (uint64_t)value << writer->numBits;
+    writer->numBits += count;
+    while (writer->numBits >= 8) {
+        putGzipByte(writer, (uint8_t)writer->bits);
+        writer->bits >>= 8;
+        writer->numBits -= 8;
+    }
+}
+
+/**
+ * @brief Append a Huffman code, which deflate stores most significant bit first
+ *
+ * @param writer The writer
+ * @param code The code
+ * @param length Number of bits in the code
+ */
+static void putHuffmanCode(GzipWriter* writer, uint32_t code, uint32_t length)
+{
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        reversed |= ((code >> i) & 1) << (length - 1 - i);
+    }
+    putBits(writer, reversed, length);
+}
+
+/**
+ * @brief Append a literal/length symbol using the fixed Huffman codes of RFC 1951
+ *
+ * @param writer The writer
+ * @param symbol The symbol, 0-255 for a literal, 256 for the end of the block, 257-285 for a length
+ */
+static void putSymbol(GzipWriter* writer, uint32_t symbol)
+{
+    if (symbol < 144) {
+        putHuffmanCode(writer, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        putHuffmanCode(writer, 0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        putHuffmanCode(writer, symbol - 256, 7);
+    } else {
+        putHuffmanCode(writer, 0xC0 + symbol - 280, 8);
+    }
+}
+
+/**
+ * @brief Write out the repeats of the previous byte, as a match at distance 1 when that is shorter
+ *
+ * @param writer The writer
+ */
+static void flushRun(GzipWriter* writer)
+{
+    if (writer->run < 3) {
+        for (uint32_t i = 0; i < writer->run; i++) {
+            putSymbol(writer, (uint32_t)writer->last);
+        }
+    } else {
+        uint32_t code = 28;
+        while (lengthBases[code] > writer->run) {
+            code--;
+        }
+        putSymbol(writer, 257 + code);
+        putBits(writer, writer->run - lengthBases[code], lengthExtraBits[code]);
+        putHuffmanCode(writer, 0, 5);  // distance code 0, a distance of 1
+    }
+    writer->run = 0;
+}
+
+/**
+ * @brief Compress one byte of the uncompressed data
+ *
+ * @param writer The writer
+ * @param value The byte
+ */
+static void writeGzipByte(GzipWriter* writer, uint8_t value)
+{
+    writer->crc ^= value;
+    writer->crc = (writer->crc >> 4) ^ crcTable[writer->crc & 0xF];
+    writer->crc = (writer->crc >> 4) ^ crcTable[writer->crc & 0xF];
+    writer->size++;
+    if (writer->last == value) {
+        if (++writer->run == DEFLATE_MAX_MATCH) {
+            flushRun(writer);
+        }
+        return;
+    }
+    flushRun(writer);
+    putSymbol(writer, value);
+    writer->last = value;
+}
+
+/**
+ * @brief Start a gzip stream, writing its header
+ *
+ * @param writer The writer to initialize
+ * @param file Where to write the stream
+ */
+static void openGzipWriter(GzipWriter* writer, FILE* file)
+{
+    memset(writer, 0, sizeof(GzipWriter));
+    writer->file = file;
+    writer->crc = UINT32_MAX;
+    writer->last = -1;
+    // magic, deflate, no flags, no modification time, no extra flags, unknown OS
+    static const uint8_t header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+    for (uint32_t i = 0; i < sizeof(header); i++) {
+        putGzipByte(writer, header[i]);
+    }
+    putBits(writer, 1, 1);  // the final block
+    putBits(writer, 1, 2);  // compressed with the fixed codes
+}
+
+/**
+ * @brief End the deflate block and write the gzip trailer
+ *
+ * @param writer The writer
+ * @return true if everything was written, false if the file could not be written
+ */
+static bool closeGzipWriter(GzipWriter* writer)
+{
+    flushRun(writer);
+    putSymbol(writer, 256);
+    if (writer->numBits > 0) {
+        putGzipByte(writer, (uint8_t)writer->bits);  // pad to a byte boundary
+    }
+    uint32_t crc = ~writer->crc;
+    for (uint32_t i = 0; i < 4; i++) {
+        putGzipByte(writer, (uint8_t)(crc >> (8 * i)));
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        putGzipByte(writer, (uint8_t)(writer->size >> (8 * i)));
+    }
+    flushGzipBuffer(writer);
+    return !writer->failed;
+}
+
+/**
+ * @brief Write a big-endian integer, as NBT stores them
+ *
+ * @param writer The writer
+ * @param value The integer
+ * @param size Number of bytes
+ */
+static void writeNbtNumber(GzipWriter* writer, uint32_t value, uint32_t size)
+{
+    for (uint32_t i = size; i > 0; i--) {
+        writeGzipByte(writer, (uint8_t)(value >> (8 * (i - 1))));
+    }
+}
+
+/**
+ * @brief Write the type and name that start a named tag
+ *
+ * @param writer The writer
+ * @param type The tag type, such as NBT_INT
+ * @param name The tag name
+ */
+static void writeNbtTag(GzipWriter* writer, uint8_t type, const char* const name)
+{
+    uint32_t length = (uint32_t)strlen(name);
+    writeGzipByte(writer, type);
+    writeNbtNumber(writer, length, 2);
+    for (uint32_t i = 0; i < length; i++) {
+        writeGzipByte(writer, (uint8_t)*(name + i));
+    }
+}
+
+/**
+ * @brief Write a named int tag
+ *
+ * @param writer The writer
+ * @param name The tag name
+ * @param value The value
+ */
+static void writeNbtInt(GzipWriter* writer, const char* const name, int32_t value)
+{
+    writeNbtTag(writer, NBT_INT, name);
+    writeNbtNumber(writer, (uint32_t)value, 4);
+}
+
+/**
+ * @brief Write a named short tag
+ *
+ * @param writer The writer
+ * @param name The tag name
+ * @param value The value
+ */
+static void writeNbtShort(GzipWriter* writer, const char* const name, int16_t value)
+{
+    writeNbtTag(writer, NBT_SHORT, name);
+    writeNbtNumber(writer, (uint16_t)value, 2);
+}
+
+/**
+ * @brief Write a program as a gzip-compressed Sponge schematic (version 2) of the Minecraft CPU's instruction ROM,
+ * ready to paste with WorldEdit
+ *
+ * @param file Where to write the schematic
+ * @param code The assembled program
+ * @param length Number of bytes in code
+ * @return 0 if successful, otherwise ERROR_PROGRAM_TOO_LARGE, or ERROR_INVALID_ARGUMENTS if the file could not be
+ *         written
+ */
+uint8_t writeRomSchematic(FILE* file, const uint8_t* const code, uint32_t length)
+{
+    if (length > SCHEMATIC_MAX_BYTES) {
+        return ERROR_PROGRAM_TOO_LARGE;
+    }
+    // the bit and byte parity each x column holds, or -1 for columns of air
+    int8_t columns[SCHEMATIC_WIDTH];
+    memset(columns, -1, sizeof(columns));
+    for (uint32_t odd = 0; odd < 2; odd++) {
+        for (uint32_t bit = 0; bit < 8; bit++) {
+            uint32_t x = (bit & 0xE) * SCHEMATIC_ROW_STEP + (bit & 1) * SCHEMATIC_BIT_STEP + odd * SCHEMATIC_ROW_STEP;
+            columns[x] = (int8_t)(bit | (odd << 3));
+        }
+    }
+
+    GzipWriter writer;
+    openGzipWriter(&writer, file);
+    writeNbtTag(&writer, NBT_COMPOUND, "Schematic");
+    writeNbtInt(&writer, "Version", 2);
+    writeNbtInt(&writer, "DataVersion", SCHEMATIC_DATA_VERSION);
+    // byte 0 is at the paste position, at the top of the box
+    writeNbtTag(&writer, NBT_COMPOUND, "Metadata");
+    writeNbtInt(&writer, "WEOffsetX", 0);
+    writeNbtInt(&writer, "WEOffsetY", 1 - SCHEMATIC_HEIGHT);
+    writeNbtInt(&writer, "WEOffsetZ", 0);
+    writeGzipByte(&writer, NBT_END);
+    writeNbtShort(&writer, "Width", SCHEMATIC_WIDTH);
+    writeNbtShort(&writer, "Height", SCHEMATIC_HEIGHT);
+    writeNbtShort(&writer, "Length", SCHEMATIC_LENGTH);
+    writeNbtInt(&writer, "PaletteMax", 3);
+    writeNbtTag(&writer, NBT_COMPOUND, "Palette");
+    writeNbtInt(&writer, "minecraft:air", PALETTE_AIR);
+    writeNbtInt(&writer, SCHEMATIC_ON_BLOCK, PALETTE_ON);
+    writeNbtInt(&writer, SCHEMATIC_OFF_BLOCK, PALETTE_OFF);
+    writeGzipByte(&writer, NBT_END);
+
+    // one palette index per block, x fastest then z then y from the bottom; every index is below 128, so each varint
+    // is a single byte
+    writeNbtTag(&writer, NBT_BYTE_ARRAY, "BlockData");
+    writeNbtNumber(&writer, SCHEMATIC_WIDTH * SCHEMATIC_HEIGHT * SCHEMATIC_LENGTH, 4);
+    for (uint32_t y = 0; y < SCHEMATIC_HEIGHT; y++) {
+        uint32_t down = SCHEMATIC_HEIGHT - 1 - y;
+        for (uint32_t z = 0; z < SCHEMATIC_LENGTH; z++) {
+            bool filled = down % SCHEMATIC_UP_STEP == 0 && z % SCHEMATIC_LENGTH_STEP == 0;
+            uint32_t pair = (down / SCHEMATIC_UP_STEP) * SCHEMATIC_PLANE_WRAP + (z / SCHEMATIC_LENGTH_STEP) * 2;
+            for (uint32_t x = 0; x < SCHEMATIC_WIDTH; x++) {
+                if (!filled || columns[x] < 0) {
+                    writeGzipByte(&writer, PALETTE_AIR);
+                    continue;
+                }
+                uint32_t address = pair + (uint32_t)(columns[x] >> 3);
+                uint8_t value = address < length ? *(code + address) : 0;
+                writeGzipByte(&writer, ((value >> (columns[x] & 7)) & 1) ? PALETTE_ON : PALETTE_OFF);
+            }
+        }
+    }
+    writeNbtTag(&writer, NBT_LIST, "BlockEntities");
+    writeGzipByte(&writer, NBT_COMPOUND);
+    writeNbtNumber(&writer, 0, 4);
+    writeGzipByte(&writer, NBT_END);
+    return closeGzipWriter(&writer) ? 0 : ERROR_INVALID_ARGUMENTS;
+}
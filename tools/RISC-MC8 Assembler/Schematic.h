@@ -0,0 +1,38 @@
+#ifndef SCHEMATIC_H
+#define SCHEMATIC_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#define SCHEMATIC_MAX_BYTES 256         // size of the Minecraft CPU's instruction ROM, shorter programs are padded with 0
+#define SCHEMATIC_DATA_VERSION 3105     // Minecraft Java Edition 1.19
+#define SCHEMATIC_ON_BLOCK "minecraft:redstone_block"
+#define SCHEMATIC_OFF_BLOCK "minecraft:blue_ice"
+
+/*
+ * Placement of ROM bits, the same as tools/generate-mc-schematic.py. Byte i sits (i >> 5) * SCHEMATIC_UP_STEP blocks
+ * down from the paste position and ((i % SCHEMATIC_PLANE_WRAP) >> 1) * SCHEMATIC_LENGTH_STEP blocks along +z. Bit b
+ * sits (b & 0xE) * SCHEMATIC_ROW_STEP + (b & 1) * SCHEMATIC_BIT_STEP blocks along +x, plus SCHEMATIC_ROW_STEP for
+ * odd bytes. Every other block in the bounding box is air.
+ */
+#define SCHEMATIC_ROW_STEP 4
+#define SCHEMATIC_BIT_STEP 2
+#define SCHEMATIC_LENGTH_STEP 6
+#define SCHEMATIC_UP_STEP 2
+#define SCHEMATIC_PLANE_WRAP 32
+
+/**
+ * @brief Write a program as a gzip-compressed Sponge schematic (version 2) of the Minecraft CPU's instruction ROM,
+ * ready to paste with WorldEdit
+ *
+ * The NBT is generated block by block straight into the compressor, so nothing but the program is held in memory.
+ *
+ * @param file Where to write the schematic
+ * @param code The assembled program
+ * @param length Number of bytes in code
+ * @return 0 if successful, otherwise ERROR_PROGRAM_TOO_LARGE, or ERROR_INVALID_ARGUMENTS if the file could not be
+ *         written
+ */
+uint8_t writeRomSchematic(FILE* file, const uint8_t* const code, uint32_t length);
+
+#endif
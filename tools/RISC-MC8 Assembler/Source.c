@@ -0,0 +1,193 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "Source.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "AssemblerStats.h"
+#include "StatusCodes.h"
+
+/**
+ * @brief Open a file as a source, memory-mapping it when possible
+ *
+ * @param source The reader to initialize
+ * @param path Path of the file to open
+ * @return 0 if successful, otherwise ERROR_INVALID_ARGUMENTS if the file could not be opened
+ */
+uint8_t openSourceFile(SourceReader* source, const char* const path)
+{
+#if !defined(_WIN32)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        if (info.st_size == 0) {
+            close(fd);
+            openSourceBuffer(source, "", 0);
+            return 0;
+        }
+        void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            close(fd);
+            openSourceBuffer(source, (const char*)mapping, info.st_size);
+            source->mapped = true;
+            return 0;
+        }
+    }
+    close(fd);
+#endif
+    // not a regular file (or no mmap), fall back to reading it as a stream
+    FILE* stream = fopen(path, "rb");
+    if (stream == NULL) {
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    openSourceStream(source, stream);
+    source->ownsStream = true;
+    return 0;
+}
+
+/**
+ * @brief Use a stream, such as stdin, as a source (cannot be rewound)
+ *
+ * @param source The reader to initialize
+ * @param stream The stream to read lines from
+ */
+void openSourceStream(SourceReader* source, FILE* stream)
+{
+    memset(source, 0, sizeof(SourceReader));
+    source->stream = stream;
+}
+
+/**
+ * @brief Use a buffer in memory as a source, the buffer must outlive the reader
+ *
+ * @param source The reader to initialize
+ * @param data The source text
+ * @param length Number of bytes in data
+ */
+void openSourceBuffer(SourceReader* source, const char* const data, size_t length)
+{
+    memset(source, 0, sizeof(SourceReader));
+    source->data = data;
+    source->length = length;
+}
+
+/**
+ * @brief Read the next line from a stream into the reader's line buffer
+ *
+ * @param source The reader to read from
+ * @param line Set to the start of the line
+ * @param length Set to the number of characters in the line
+ * @return true if a line was read, false at end of stream or if source->status was set to an error
+ */
+static bool readStreamLine(SourceReader* source, const char** line, uint32_t* length)
+{
+    size_t used = 0;
+    while (true) {
+        if (source->lineCapacity - used < 2) {
+            size_t newCapacity = source->lineCapacity == 0 ? 256 : source->lineCapacity * 2;
+            char* grown = (char*)realloc(source->lineBuffer, newCapacity);
+            if (grown == NULL) {
+                source->status = ERROR_OUT_OF_MEMORY;
+                return false;
+            }
+            countAllocation(newCapacity);
+            source->lineBuffer = grown;
+            source->lineCapacity = newCapacity;
+        }
+        if (fgets(source->lineBuffer + used, source->lineCapacity - used, source->stream) == NULL) {
+            if (used == 0) {
+                return false;
+            }
+            break;  // last line has no newline
+        }
+        used += strlen(source->lineBuffer + used);
+        if (*(source->lineBuffer + used - 1) == '\n') {
+            used--;
+            break;
+        }
+    }
+    *line = source->lineBuffer;
+    *length = used;
+    return true;
+}
+
+/**
+ * @brief Read the next line, not including its newline
+ *
+ * @param source The reader to read from
+ * @param line Set to the start of the line, valid until the next read
+ * @param length Set to the number of characters in the line
+ * @return true if a line was read, false at end of source or if source->status was set to an error
+ */
+bool readSourceLine(SourceReader* source, const char** line, uint32_t* length)
+{
+    if (source->data == NULL) {
+        if (source->stream == NULL || !readStreamLine(source, line, length)) {
+            return false;
+        }
+        source->lineNumber++;
+        return true;
+    }
+    if (source->position >= source->length) {
+        return false;
+    }
+    const char* start = source->data + source->position;
+    const char* newline = (const char*)memchr(start, '\n', source->length - source->position);
+    size_t lineLength = newline == NULL ? source->length - source->position : (size_t)(newline - start);
+    source->position += lineLength + 1;
+    source->lineNumber++;
+    *line = start;
+    *length = lineLength;
+    return true;
+}
+
+/**
+ * @brief Go back to the first line
+ *
+ * @param source The reader to rewind
+ * @return true if successful, false if the source is a stream
+ */
+bool rewindSource(SourceReader* source)
+{
+    if (source->data == NULL) {
+        return false;
+    }
+    source->position = 0;
+    source->lineNumber = 0;
+    return true;
+}
+
+/**
+ * @brief Release anything held by the reader (does not close a stream given to openSourceStream)
+ *
+ * @param source The reader to close
+ */
+void closeSource(SourceReader* source)
+{
+#if !defined(_WIN32)
+    if (source->mapped) {
+        munmap((void*)source->data, source->length);
+    }
+#endif
+    if (source->ownsStream) {
+        fclose(source->stream);
+    }
+    free(source->lineBuffer);
+    memset(source, 0, sizeof(SourceReader));
+}
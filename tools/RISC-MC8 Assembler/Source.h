@@ -0,0 +1,78 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * A source of assembly lines. Files are memory-mapped and walked in place; streams such as pipes are read one line at
+ * a time into a single buffer that grows as needed and is reused for every line. Either way lines have no length
+ * limit and no per-line allocation is done.
+ */
+typedef struct _SourceReader {
+    const char* data;  // whole source when mapped or in memory, NULL when streaming
+    size_t length;
+    size_t position;
+    bool mapped;
+    FILE* stream;
+    bool ownsStream;
+    char* lineBuffer;
+    size_t lineCapacity;
+    uint32_t lineNumber;  // number of the line most recently read, 1-based
+    uint8_t status;       // ERROR_OUT_OF_MEMORY if reading stopped because a line did not fit in memory, otherwise 0
+} SourceReader;
+
+/**
+ * @brief Open a file as a source, memory-mapping it when possible
+ *
+ * @param source The reader to initialize
+ * @param path Path of the file to open
+ * @return 0 if successful, otherwise ERROR_INVALID_ARGUMENTS if the file could not be opened
+ */
+uint8_t openSourceFile(SourceReader* source, const char* const path);
+
+/**
+ * @brief Use a stream, such as stdin, as a source (cannot be rewound)
+ *
+ * @param source The reader to initialize
+ * @param stream The stream to read lines from
+ */
+void openSourceStream(SourceReader* source, FILE* stream);
+
+/**
+ * @brief Use a buffer in memory as a source, the buffer must outlive the reader
+ *
+ * @param source The reader to initialize
+ * @param data The source text
+ * @param length Number of bytes in data
+ */
+void openSourceBuffer(SourceReader* source, const char* const data, size_t length);
+
+/**
+ * @brief Read the next line, not including its newline
+ *
+ * @param source The reader to read from
+ * @param line Set to the start of the line, valid until the next read
+ * @param length Set to the number of characters in the line
+ * @return true if a line was read, false at end of source or if source->status was set to an error
+ */
+bool readSourceLine(SourceReader* source, const char** line, uint32_t* length);
+
+/**
+ * @brief Go back to the first line
+ *
+ * @param source The reader to rewind
+ * @return true if successful, false if the source is a stream
+ */
+bool rewindSource(SourceReader* source);
+
+/**
+ * @brief Release anything held by the reader (does not close a stream given to openSourceStream)
+ *
+ * @param source The reader to close
+ */
+void closeSource(SourceReader* source);
+
+#endif
@@ -14,7 +14,37 @@
 #define ERROR_INSTRUCTION_FOLLOWS_LABEL 11
 #define ERROR_NO_SPACE_AFTER_LABEL 12
 #define ERROR_TOO_MANY_TOKENS 13
+#define ERROR_UNKNOWN_LABEL 14
+#define ERROR_OUT_OF_MEMORY 15
+#define ERROR_MALFORMED_MANIFEST 16
+#define ERROR_OUTPUT_TOO_SMALL 17
+#define ERROR_MALFORMED_REQUEST 18
+#define ERROR_SERVER_UNAVAILABLE 19
+#define ERROR_UNKNOWN_DIRECTIVE 20
+#define ERROR_MALFORMED_OBJECT 21
+#define ERROR_IO_UNAVAILABLE 22
+#define ERROR_MALFORMED_LINE_TABLE 23
+#define ERROR_MALFORMED_TRACE 24
+#define ERROR_MALFORMED_CIRCUIT 25
+#define ERROR_UNSUPPORTED_COMPONENT 26
+#define ERROR_INCOMPATIBLE_WIDTHS 27
+#define ERROR_MULTIPLE_DRIVERS 28
+#define ERROR_COMBINATIONAL_LOOP 29
+#define ERROR_MODEL_MISMATCH 30
+#define ERROR_PROGRAM_TOO_LARGE 31
+#define ERROR_ROUND_TRIP_MISMATCH 32
+#define ERROR_EXPANSION_AFTER_SKIP 33
+#define ERROR_RELAXATION_FAILED 34
+#define ERROR_MALFORMED_COUNTS 35
+#define ERROR_MALFORMED_TIMING 36
+#define ERROR_MALFORMED_LOOP_BOUND 37
+#define ERROR_UNBOUNDED_LOOP 38
+#define ERROR_IRREDUCIBLE_LOOP 39
+#define ERROR_OVER_BUDGET 40
+#define ERROR_JUMP_INTO_LOAD_IMMEDIATE 41
 
+#define STATUS_NEEDS_TWO_PASS 252
+#define STATUS_UNRESOLVED_SYMBOL 253
 #define STATUS_LINE_CONTAINED_INSTRUCTION 254
 #define STATUS_LINE_NOT_INSTRUCTION 255
 
@@ -1,168 +1,274 @@
 #include "Symbols.h"
 
-#include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "AssemblerStats.h"
+#include "Lexer.h"
+#include "LoadImmediate.h"
 #include "StatusCodes.h"
 
 void freeSymbolsList(SymbolsList** list)
 {
-    for (uint32_t i = 0; i < (*list)->length; i++) {
-        freeSymbol((*list)->symbols + i);
-    }
     free((*list)->symbols);
+    free((*list)->buckets);
+    free((*list)->pool);
     free(*list);
-    list = NULL;
+    *list = NULL;
 }
 
-void freeSymbol(Symbol* sym)
+/**
+ * @brief FNV-1a hash of a string, ignoring case
+ *
+ * @param str The string to hash
+ * @param length Number of characters to hash
+ * @return The 32-bit hash
+ */
+static uint32_t hashSymbol(const char* const str, uint32_t length)
 {
-    free(sym->symbol);
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)toLowerAscii(*(str + i));
+        hash *= 16777619u;
+    }
+    return hash;
 }
 
 /**
- * @brief Allocate and add a symbol to the given list
+ * @brief Find the bucket that holds symbol, or the empty bucket it would be placed in
  *
- * @param list List to add to
- * @param symbol The symbol to add
- * @param value The value of the symbol to add
- * @return 0 if successful, otherwise an error (such as duplicates) - if error, list is unchanged
+ * @param list List to search, must have buckets allocated
+ * @param symbol The symbol to look for
+ * @param length Length of symbol
+ * @param hash Hash of symbol
+ * @return Index into list->buckets
  */
-uint8_t addSymbolToList(SymbolsList* list, char* symbol, uint32_t value)
+static uint32_t findBucket(const SymbolsList* const list, const char* const symbol, uint32_t length, uint32_t hash)
 {
-    for (uint16_t i = 0; i < list->length; i++) {
-        if (strcmp(symbol, (list->symbols + i)->symbol) == 0) {
-            return ERROR_DUPLICATE_LABEL;
+    uint32_t mask = list->bucketCount - 1;
+    uint32_t bucket = hash & mask;
+    while (*(list->buckets + bucket) != 0) {
+        const Symbol* candidate = list->symbols + *(list->buckets + bucket) - 1;
+        const char* name = list->pool + candidate->nameOffset;
+        if (candidate->hash == hash) {
+            // stored names are lowercase, so only symbol needs case folding
+            uint32_t i = 0;
+            while (i < length && *(name + i) == toLowerAscii(*(symbol + i))) {
+                i++;
+            }
+            if (i == length && *(name + length) == '\0') {
+                break;
+            }
         }
+        bucket = (bucket + 1) & mask;  // linear probing
     }
-    list->length++;
-    list->symbols = (Symbol*)realloc(list->symbols, list->length * sizeof(Symbol));
-    (list->symbols + list->length - 1)->symbol = symbol;
-    (list->symbols + list->length - 1)->value = value;
+    return bucket;
+}
+
+/**
+ * @brief Double the bucket array (or create it) and reinsert every symbol
+ *
+ * @param list List to grow
+ * @return 0 if successful, ERROR_OUT_OF_MEMORY otherwise (list is unchanged)
+ */
+static uint8_t growBuckets(SymbolsList* list)
+{
+    uint32_t newCount = list->bucketCount == 0 ? 64 : list->bucketCount * 2;
+    uint32_t* newBuckets = (uint32_t*)calloc(newCount, sizeof(uint32_t));
+    if (newBuckets == NULL) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    countAllocation(newCount * sizeof(uint32_t));
+    for (uint32_t i = 0; i < list->length; i++) {
+        uint32_t bucket = (list->symbols + i)->hash & (newCount - 1);
+        while (*(newBuckets + bucket) != 0) {
+            bucket = (bucket + 1) & (newCount - 1);
+        }
+        *(newBuckets + bucket) = i + 1;
+    }
+    free(list->buckets);
+    list->buckets = newBuckets;
+    list->bucketCount = newCount;
     return 0;
 }
 
 /**
- * @brief Return true if a line is empty or contains only a comment, false otherwise
+ * @brief Look up a symbol by name
+ *
+ * @param list List to search
+ * @param symbol The symbol to find, case insensitive
+ * @param length Number of characters in symbol, which need not be NUL terminated
+ * @return The symbol, or NULL if it is not in the list
+ */
+const Symbol* findSymbolN(const SymbolsList* const list, const char* const symbol, uint32_t length)
+{
+    countSymbolLookup();
+    if (list->length == 0) {
+        return NULL;
+    }
+    uint32_t bucket = findBucket(list, symbol, length, hashSymbol(symbol, length));
+    if (*(list->buckets + bucket) == 0) {
+        return NULL;
+    }
+    return list->symbols + *(list->buckets + bucket) - 1;
+}
+
+/**
+ * @brief Look up a symbol by name
+ *
+ * @param list List to search
+ * @param symbol The symbol to find, case insensitive
+ * @return The symbol, or NULL if it is not in the list
+ */
+const Symbol* findSymbol(const SymbolsList* const list, const char* const symbol)
+{
+    return findSymbolN(list, symbol, strlen(symbol));
+}
+
+/**
+ * @brief Get the name of a symbol in the list
  *
- * @param line Line to check
- * @return True if condition satisfied, false otherwise
+ * @param list List that holds the symbol
+ * @param symbol A symbol from list
+ * @return The symbol's name, valid until the list is next modified
  */
-bool isLineEmptyOrComment(char* line)
+const char* getSymbolName(const SymbolsList* const list, const Symbol* const symbol)
 {
-    char* lineCopy = (char*)calloc(64, sizeof(char));
-    strncpy(lineCopy, line, 64);
-    char* firstToken = strtok(lineCopy, " \t\r\n");
-    bool result = firstToken == NULL || strlen(firstToken) <= 1 || *firstToken == '#';
-    free(lineCopy);
-    return result;
+    return list->pool + symbol->nameOffset;
 }
 
 /**
- * @brief Copy src[startPos:endPos] to dest (starting from position 0 in dest)
+ * @brief Add a copy of a symbol to the given list
  *
- * @param dest Place to copy to
- * @param src Place to copy from
- * @param startPos Position, in src, to start copying from
- * @param endPos Position, in src, to stop copying (exclusive)
+ * @param list List to add to
+ * @param symbol The symbol to add, copied (lowercased) into the list's string pool
+ * @param length Number of characters in symbol, which need not be NUL terminated
+ * @param value The value of the symbol to add
+ * @return 0 if successful, otherwise an error (such as duplicates) - if error, list is unchanged
  */
-void copyStringAsLower(char* dest, char* src, uint16_t startPos, uint16_t endPos)
+uint8_t addSymbolToListN(SymbolsList* list, const char* const symbol, uint32_t length, uint32_t value)
 {
-    for (uint16_t i = 0; i < endPos - startPos; i++) {
-        *(dest + i) = tolower(*(src + i + startPos));
+    // keep the load factor at or below 1/2
+    if ((list->length + 1) * 2 > list->bucketCount && growBuckets(list) != 0) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    uint32_t hash = hashSymbol(symbol, length);
+    uint32_t bucket = findBucket(list, symbol, length, hash);
+    if (*(list->buckets + bucket) != 0) {
+        return ERROR_DUPLICATE_LABEL;
+    }
+
+    if (list->length == list->capacity) {
+        uint32_t newCapacity = list->capacity == 0 ? 32 : list->capacity * 2;
+        Symbol* grown = (Symbol*)realloc(list->symbols, newCapacity * sizeof(Symbol));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        countAllocation(newCapacity * sizeof(Symbol));
+        list->symbols = grown;
+        list->capacity = newCapacity;
+    }
+    if (list->poolLength + length + 1 > list->poolCapacity) {
+        uint32_t newCapacity = list->poolCapacity == 0 ? 512 : list->poolCapacity;
+        while (list->poolLength + length + 1 > newCapacity) {
+            newCapacity *= 2;
+        }
+        char* grown = (char*)realloc(list->pool, newCapacity);
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        countAllocation(newCapacity);
+        list->pool = grown;
+        list->poolCapacity = newCapacity;
     }
+
+    Symbol* added = list->symbols + list->length;
+    added->nameOffset = list->poolLength;
+    added->hash = hash;
+    added->value = value;
+    for (uint32_t i = 0; i < length; i++) {
+        *(list->pool + list->poolLength + i) = toLowerAscii(*(symbol + i));
+    }
+    *(list->pool + list->poolLength + length) = '\0';
+    list->poolLength += length + 1;
+    list->length++;
+    *(list->buckets + bucket) = list->length;
+    return 0;
+}
+
+/**
+ * @brief Add a copy of a symbol to the given list
+ *
+ * @param list List to add to
+ * @param symbol The symbol to add, copied (lowercased) into the list's string pool
+ * @param value The value of the symbol to add
+ * @return 0 if successful, otherwise an error (such as duplicates) - if error, list is unchanged
+ */
+uint8_t addSymbolToList(SymbolsList* list, const char* const symbol, uint32_t value)
+{
+    return addSymbolToListN(list, symbol, strlen(symbol), value);
 }
 
 /**
  * @brief Attempt to extract a label from a line
  *
  * @param list The symbols list to add the label to
- * @param line The line to extract from
+ * @param line The lexed line to extract from
  * @param value The value that would be stored in this label, if there is one
- * @return 0 if a symbol was extracted, STATUS_LINE_CONTAINED_INSTRUCTION if it was an instruction, otherwise an error code
+ * @return 0 if a symbol was extracted, STATUS_LINE_CONTAINED_INSTRUCTION if it was an instruction,
+ *         STATUS_LINE_NOT_INSTRUCTION if it was empty, otherwise an error code
  */
-uint8_t attemptSymbolExtraction(SymbolsList* list, char* line, uint16_t value)
+uint8_t attemptSymbolExtraction(SymbolsList* list, const SourceLine* const line, uint32_t value)
 {
-    uint16_t lineLength = strlen(line);
-    uint16_t startPos = 0;
-    while (startPos < lineLength && isspace(*(line + startPos))) {  // get to potential start of label
-        startPos++;
+    if (line->kind == LINE_KIND_INSTRUCTION) {
+        return STATUS_LINE_CONTAINED_INSTRUCTION;
+    } else if (line->kind == LINE_KIND_EMPTY || line->kind == LINE_KIND_DIRECTIVE) {
+        return STATUS_LINE_NOT_INSTRUCTION;
+    } else if (line->status != 0) {
+        return line->status;
     }
-    for (uint16_t i = startPos; i < lineLength; i++) {
-        char c = *(line + i);
-        if (c == ':') {  // found label ending point
-            // make sure it's not followed by an instruction - whitespace until # or \0
-            if (!isspace(*(line + i + 1)) && i + 1 < lineLength) {
-                return ERROR_NO_SPACE_AFTER_LABEL;
-            }
-            uint16_t verifyPos = i + 2;  // + 2 since we require a space after :
-            if (verifyPos < lineLength) {
-                while (isspace(*(line + verifyPos))) {
-                    verifyPos++;
-                }
-                if (*(line + verifyPos) != '#' && *(line + verifyPos) != '\0') {
-                    return ERROR_INSTRUCTION_FOLLOWS_LABEL;
-                }
-            }
-            // get the label
-            char* label = (char*)calloc(i - startPos + 1, sizeof(char));
-            copyStringAsLower(label, line, startPos, i);
-            // add it to list
-            uint8_t addStatus = addSymbolToList(list, label, value);
-            if (addStatus != 0) {
-                free(label);
-                return addStatus;
-            }
-            return 0;
-        } else if (isspace(c) || c == '#') {  // delimited past potential label
-            return STATUS_LINE_CONTAINED_INSTRUCTION;
-        }
+    uint8_t status = addSymbolToListN(list, line->tokens[0].start, line->tokens[0].length, value);
+    if (status == 0) {
+        countLabel();
     }
-    return STATUS_LINE_CONTAINED_INSTRUCTION;  // no label, ran off end of line
+    return status;
 }
 
 /**
- * @brief Parse through the provided input file and make a list of symbols seen along with their line value
+ * @brief Parse through the provided source and make a list of symbols seen along with their line value
  *
- * @param inputFile File to parse
- * @param printErrors Print errors if any occur
+ * @param source Source to parse, read from its current position
+ * @param landings Where JUMPs by a number land, rewound, added to as they are found and unsettled if li were sized
+ *                 wrongly, see settleJumpLandings
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
  * @return List of symbols (may be empty), or NULL if an error occurred
  */
-SymbolsList* extractSymbols(FILE* inputFile, bool printErrors)
+SymbolsList* extractSymbols(SourceReader* source, JumpLandings* landings, AssemblerDiagnostic* diagnostic)
 {
     SymbolsList* list = (SymbolsList*)calloc(1, sizeof(SymbolsList));
-    uint16_t currentOffset = 0;
-    uint16_t currentLine = 0;
-    char* lineBuffer = (char*)calloc(64, sizeof(char));
-    while (!feof(inputFile)) {
-        currentLine++;
-        fgets(lineBuffer, 64, inputFile);
-        if (isLineEmptyOrComment(lineBuffer)) {
-            continue;  // ignore blank lines and comments
-        }
-        uint8_t status = attemptSymbolExtraction(list, lineBuffer, currentOffset);
-        if (status != 0 && status != STATUS_LINE_CONTAINED_INSTRUCTION) {
-            if (printErrors) {
-                if (status == ERROR_DUPLICATE_LABEL) {
-                    fprintf(stderr, "Error: Duplicate symbol on line %d.\n", currentLine);
-                } else if (status == ERROR_INSTRUCTION_FOLLOWS_LABEL) {
-                    fprintf(stderr, "Error: Instruction follows label on line %d (labels must be on their own line).\n", currentLine);
-                } else if (status == ERROR_NO_SPACE_AFTER_LABEL) {
-                    fprintf(stderr, "Error: Lacking space after label on line %d.\n", currentLine);
-                } else {
-                    fprintf(stderr, "Error: Unknown error on line %d.\n", currentLine);
-                }
-            }
-            free(lineBuffer);
+    if (list == NULL) {
+        setDiagnostic(diagnostic, ERROR_OUT_OF_MEMORY, 0, 0);
+        return NULL;
+    }
+    countAllocation(sizeof(SymbolsList));
+    LineSizer sizer;
+    initLineSizer(&sizer, NULL, source->data == NULL, landings);
+    uint32_t currentOffset = 0;
+    const char* text;
+    uint32_t length;
+    SourceLine line;
+    while (readSourceLine(source, &text, &length)) {
+        lexLine(&line, text, length);
+        uint8_t status = attemptSymbolExtraction(list, &line, currentOffset);
+        if (status == 0 || status == STATUS_LINE_CONTAINED_INSTRUCTION) {
+            currentOffset += sizeSourceLine(&sizer, &line);  // an li may be several instructions
+        } else if (status != 0 && status != STATUS_LINE_NOT_INSTRUCTION) {
+            setDiagnostic(diagnostic, status, source->lineNumber, getStatusColumn(&line, status));
             freeSymbolsList(&list);
             return NULL;
-        } else if (status == STATUS_LINE_CONTAINED_INSTRUCTION) {
-            currentOffset++;
         }
     }
-    free(lineBuffer);
     return list;
 }
@@ -5,56 +5,104 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include "Diagnostics.h"
+#include "Lexer.h"
+#include "LoadImmediate.h"
+#include "Source.h"
+
 typedef struct _Symbol {
-    char* symbol;
-    uint16_t value;
+    uint32_t nameOffset;  // into the owning list's string pool
+    uint32_t hash;
+    uint32_t value;
 } Symbol;
 
+/**
+ * Open-addressing hash table of symbols. Names are interned in one contiguous string pool, symbols are kept in
+ * insertion order, and buckets hold (index + 1) into symbols, with 0 marking an empty bucket.
+ * A zeroed (calloc'd) SymbolsList is a valid empty list.
+ */
 typedef struct _SymbolsList {
     Symbol* symbols;
-    uint16_t length;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t* buckets;
+    uint32_t bucketCount;
+    char* pool;
+    uint32_t poolLength;
+    uint32_t poolCapacity;
 } SymbolsList;
 
-void freeSymbol(Symbol* symbol);
 void freeSymbolsList(SymbolsList** symbolsList);
 
 /**
- * @brief Allocate and add a symbol to the given list
+ * @brief Add a copy of a symbol to the given list
+ *
+ * @param list List to add to
+ * @param symbol The symbol to add, copied (lowercased) into the list's string pool
+ * @param value The value of the symbol to add
+ * @return 0 if successful, otherwise an error (such as duplicates) - if error, list is unchanged
+ */
+uint8_t addSymbolToList(SymbolsList* list, const char* const symbol, uint32_t value);
+
+/**
+ * @brief Add a copy of a symbol to the given list
  *
  * @param list List to add to
- * @param symbol The symbol to add
+ * @param symbol The symbol to add, copied (lowercased) into the list's string pool
+ * @param length Number of characters in symbol, which need not be NUL terminated
  * @param value The value of the symbol to add
  * @return 0 if successful, otherwise an error (such as duplicates) - if error, list is unchanged
  */
-uint8_t addSymbolToList(SymbolsList* list, char* symbol, uint32_t value);
+uint8_t addSymbolToListN(SymbolsList* list, const char* const symbol, uint32_t length, uint32_t value);
+
+/**
+ * @brief Look up a symbol by name
+ *
+ * @param list List to search
+ * @param symbol The symbol to find, case insensitive
+ * @return The symbol, or NULL if it is not in the list
+ */
+const Symbol* findSymbol(const SymbolsList* const list, const char* const symbol);
+
+/**
+ * @brief Look up a symbol by name
+ *
+ * @param list List to search
+ * @param symbol The symbol to find, case insensitive
+ * @param length Number of characters in symbol, which need not be NUL terminated
+ * @return The symbol, or NULL if it is not in the list
+ */
+const Symbol* findSymbolN(const SymbolsList* const list, const char* const symbol, uint32_t length);
 
 /**
- * @brief Copy src[startPos:endPos] to dest (starting from position 0 in dest)
+ * @brief Get the name of a symbol in the list
  *
- * @param dest Place to copy to
- * @param src Place to copy from
- * @param startPos Position, in src, to start copying from
- * @param endPos Position, in src, to stop copying (exclusive)
+ * @param list List that holds the symbol
+ * @param symbol A symbol from list
+ * @return The symbol's name, valid until the list is next modified
  */
-void copyStringAsLower(char* dest, char* src, uint16_t startPos, uint16_t endPos);
+const char* getSymbolName(const SymbolsList* const list, const Symbol* const symbol);
 
 /**
  * @brief Attempt to extract a label from a line
  *
  * @param list The symbols list to add the label to
- * @param line The line to extract from
+ * @param line The lexed line to extract from
  * @param value The value that would be stored in this label, if there is one
- * @return 0 if a symbol was extracted or there was no symbol, otherwise an error code
+ * @return 0 if a symbol was extracted, STATUS_LINE_CONTAINED_INSTRUCTION if it was an instruction,
+ *         STATUS_LINE_NOT_INSTRUCTION if it was empty, otherwise an error code
  */
-uint8_t attemptSymbolExtraction(SymbolsList* list, char* line, uint16_t value);
+uint8_t attemptSymbolExtraction(SymbolsList* list, const SourceLine* const line, uint32_t value);
 
 /**
- * @brief Parse through the provided input file and make a list of symbols seen along with their line value
+ * @brief Parse through the provided source and make a list of symbols seen along with their line value
  *
- * @param inputFile File to parse
- * @param printErrors Print errors if any occur
+ * @param source Source to parse, read from its current position
+ * @param landings Where JUMPs by a number land, rewound, added to as they are found and unsettled if li were sized
+ *                 wrongly, see settleJumpLandings
+ * @param diagnostic Set to the error and where it occurred if one occurs, may be NULL
  * @return List of symbols (may be empty), or NULL if an error occurred
  */
-SymbolsList* extractSymbols(FILE* inputFile, bool printErrors);
+SymbolsList* extractSymbols(SourceReader* source, JumpLandings* landings, AssemblerDiagnostic* diagnostic);
 
 #endif
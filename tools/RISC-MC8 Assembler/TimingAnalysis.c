@@ -0,0 +1,828 @@
+#include "TimingAnalysis.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AssemblerStats.h"
+#include "StatusCodes.h"
+
+#define NO_NODE UINT32_MAX
+#define HALT 0b10000000  // `jump 0`
+#define INSTRUCTION_STLO 12
+#define INSTRUCTION_STHI 13
+#define INSTRUCTION_JUMP 14
+#define LOOP_BOUND_KEYWORD "@loop"
+
+/**
+ * Everything a loop's iterations can leave it for, with the shortest and longest time from entering its header to
+ * getting there
+ */
+typedef struct _LoopExit {
+    uint32_t target;  // first instruction after the loop, the program length for the end
+    uint64_t best;
+    uint64_t worst;
+} LoopExit;
+
+/**
+ * @param instruction An instruction
+ * @return Its index in InstructionLoaderLUT
+ */
+static uint32_t instructionIndex(uint8_t instruction)
+{
+    if (instruction & 0b10000000) {
+        return INSTRUCTION_JUMP;
+    }
+    if ((instruction >> 4) == 0b0111) {
+        return INSTRUCTION_STHI;
+    }
+    if ((instruction >> 4) == 0b0110) {
+        return INSTRUCTION_STLO;
+    }
+    return instruction >> 3;
+}
+
+/**
+ * @return a + b, or TIMING_UNBOUNDED if that does not fit
+ */
+static uint64_t addTime(uint64_t a, uint64_t b)
+{
+    return a > TIMING_UNBOUNDED - b ? TIMING_UNBOUNDED : a + b;
+}
+
+/**
+ * @return a * times, or TIMING_UNBOUNDED if that does not fit
+ */
+static uint64_t multiplyTime(uint64_t a, uint64_t times)
+{
+    return times != 0 && a > TIMING_UNBOUNDED / times ? TIMING_UNBOUNDED : a * times;
+}
+
+/**
+ * @brief Skip spaces and tabs
+ *
+ * @param line The line
+ * @param length Number of characters in line
+ * @param pos Position to start at
+ * @return Position of the first other character, or length
+ */
+static uint32_t skipBlanks(const char* const line, uint32_t length, uint32_t pos)
+{
+    while (pos < length && (*(line + pos) == ' ' || *(line + pos) == '\t' || *(line + pos) == '\r')) {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Parse a decimal number
+ *
+ * @param line The line
+ * @param length Number of characters in line
+ * @param pos Position of the number, moved past it
+ * @param max Largest value allowed
+ * @param value Receives the number
+ * @return true if there were digits and their value is at most max
+ */
+static bool parseNumber(const char* const line, uint32_t length, uint32_t* pos, uint64_t max, uint64_t* value)
+{
+    uint32_t start = *pos;
+    *value = 0;
+    while (*pos < length && *(line + *pos) >= '0' && *(line + *pos) <= '9') {
+        uint64_t digit = (uint64_t)(*(line + (*pos)++) - '0');
+        if (*value > (max - digit) / 10) {
+            return false;
+        }
+        *value = *value * 10 + digit;
+    }
+    return *pos > start;
+}
+
+/**
+ * @brief Set up a model counting the instructions executed, which are also the clock cycles of the Logisim CPU
+ *
+ * @param model The model to initialize
+ */
+void initInstructionCountModel(TimingModel* model)
+{
+    for (uint32_t i = 0; i < NUM_INSTRUCTIONS; i++) {
+        *(model->costs + i) = 1;
+    }
+    strcpy(model->unit, "instructions");
+}
+
+/**
+ * @brief Read a timing model, one `mnemonic cost` pair per line, `unit name` naming the unit, `default cost` the cost of
+ *        every instruction not listed (1 if not given), # starting a comment
+ *
+ * @param file The timing model file
+ * @param model Receives the model
+ * @param diagnostic Set to the error and the line of the file it occurred on if one occurs, may be NULL
+ * @return 0 if successful, otherwise ERROR_MALFORMED_TIMING
+ */
+uint8_t readTimingModel(SourceReader* file, TimingModel* model, AssemblerDiagnostic* diagnostic)
+{
+    bool listed[NUM_INSTRUCTIONS] = {false};
+    uint64_t fallback = 1;
+    initInstructionCountModel(model);
+    strcpy(model->unit, "cycles");
+    const char* line;
+    uint32_t length;
+    while (readSourceLine(file, &line, &length)) {
+        uint32_t pos = skipBlanks(line, length, 0);
+        uint32_t keyStart = pos;
+        while (pos < length && *(line + pos) != ' ' && *(line + pos) != '\t' && *(line + pos) != '\r' && *(line + pos) != '#') {
+            pos++;
+        }
+        uint32_t keyLength = pos - keyStart;
+        pos = skipBlanks(line, length, pos);
+        uint32_t valueStart = pos;
+        while (pos < length && *(line + pos) != ' ' && *(line + pos) != '\t' && *(line + pos) != '\r' && *(line + pos) != '#') {
+            pos++;
+        }
+        uint32_t valueLength = pos - valueStart;
+        pos = skipBlanks(line, length, pos);
+        if (keyLength == 0 && valueLength == 0) {
+            continue;  // blank or comment
+        }
+        bool valid = keyLength > 0 && valueLength > 0 && (pos == length || *(line + pos) == '#');
+        const char* key = line + keyStart;
+        const char* value = line + valueStart;
+        uint32_t valuePos = valueStart;
+        uint64_t cost = 0;
+        if (valid && keyLength == 4 && strncmp(key, "unit", 4) == 0) {
+            valid = valueLength < TIMING_UNIT_LENGTH;
+            valuePos += valueLength;
+            if (valid) {
+                memcpy(model->unit, value, valueLength);
+                *(model->unit + valueLength) = '\0';
+            }
+        } else if (valid && keyLength == 7 && strncmp(key, "default", 7) == 0) {
+            valid = parseNumber(line, valueStart + valueLength, &valuePos, UINT32_MAX, &fallback);
+        } else if (valid) {
+            const InstructionLoaderDefinition* definition = getInstructionLoaderDefinitionN(key, keyLength);
+            valid = definition != NULL && parseNumber(line, valueStart + valueLength, &valuePos, UINT32_MAX, &cost);
+            if (valid) {
+                uint32_t index = instructionIndex(definition->instructionBase);
+                *(model->costs + index) = cost;
+                listed[index] = true;
+            }
+        }
+        if (!valid || valuePos != valueStart + valueLength) {
+            setDiagnostic(diagnostic, ERROR_MALFORMED_TIMING, file->lineNumber, 0);
+            return ERROR_MALFORMED_TIMING;
+        }
+    }
+    for (uint32_t i = 0; i < NUM_INSTRUCTIONS; i++) {
+        if (!listed[i]) {
+            *(model->costs + i) = fallback;
+        }
+    }
+    setDiagnostic(diagnostic, 0, 0, 0);
+    return 0;
+}
+
+/**
+ * @brief Record a loop bound
+ *
+ * @param list List to add to
+ * @param line Source line of the bound
+ * @param minIterations Least times the loop's header runs each time control enters the loop
+ * @param maxIterations Most times
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t addLoopBound(LoopBoundsList* list, uint32_t line, uint32_t minIterations, uint32_t maxIterations)
+{
+    if (list->length == list->capacity) {
+        uint32_t newCapacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        LoopBound* grown = (LoopBound*)realloc(list->bounds, newCapacity * sizeof(LoopBound));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        countAllocation(newCapacity * sizeof(LoopBound));
+        list->bounds = grown;
+        list->capacity = newCapacity;
+    }
+    LoopBound* added = list->bounds + list->length;
+    added->line = line;
+    added->minIterations = minIterations;
+    added->maxIterations = maxIterations;
+    list->length++;
+    return 0;
+}
+
+/**
+ * @brief Find every `@loop N` and `@loop M..N` in the comments of a source
+ *
+ * @param source The source, read from its current position
+ * @param list Empty list to fill in
+ * @param diagnostic Set to the error and the line it occurred on if one occurs, may be NULL
+ * @return 0 if successful, ERROR_MALFORMED_LOOP_BOUND if a bound is not 1 <= M <= N, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t readLoopBounds(SourceReader* source, LoopBoundsList* list, AssemblerDiagnostic* diagnostic)
+{
+    const uint32_t keywordLength = sizeof(LOOP_BOUND_KEYWORD) - 1;
+    const char* line;
+    uint32_t length;
+    while (readSourceLine(source, &line, &length)) {
+        const char* comment = (const char*)memchr(line, '#', length);
+        if (comment == NULL) {
+            continue;
+        }
+        uint32_t pos = (uint32_t)(comment - line) + 1;
+        while (pos + keywordLength <= length && strncmp(line + pos, LOOP_BOUND_KEYWORD, keywordLength) != 0) {
+            pos++;
+        }
+        if (pos + keywordLength > length) {
+            continue;
+        }
+        pos = skipBlanks(line, length, pos + keywordLength);
+        uint64_t minIterations = 0;
+        uint64_t maxIterations = 0;
+        bool valid = parseNumber(line, length, &pos, UINT32_MAX, &maxIterations);
+        if (valid && pos + 1 < length && *(line + pos) == '.' && *(line + pos + 1) == '.') {
+            minIterations = maxIterations;
+            pos += 2;
+            valid = parseNumber(line, length, &pos, UINT32_MAX, &maxIterations);
+        } else {
+            minIterations = 1;
+        }
+        valid = valid && minIterations >= 1 && minIterations <= maxIterations;
+        if (!valid || (pos < length && *(line + pos) != ' ' && *(line + pos) != '\t' && *(line + pos) != '\r')) {
+            setDiagnostic(diagnostic, ERROR_MALFORMED_LOOP_BOUND, source->lineNumber, pos + 1);
+            return ERROR_MALFORMED_LOOP_BOUND;
+        }
+        uint8_t status = addLoopBound(list, source->lineNumber, (uint32_t)minIterations, (uint32_t)maxIterations);
+        if (status != 0) {
+            setDiagnostic(diagnostic, status, 0, 0);
+            return status;
+        }
+    }
+    setDiagnostic(diagnostic, 0, 0, 0);
+    return 0;
+}
+
+/**
+ * @brief Free the bounds of a list, leaving it empty
+ *
+ * @param list The list
+ */
+void freeLoopBoundsList(LoopBoundsList* list)
+{
+    free(list->bounds);
+    list->bounds = NULL;
+    list->length = 0;
+    list->capacity = 0;
+}
+
+/**
+ * @brief Check whether an instruction is in a loop
+ *
+ * @param analysis The analysis
+ * @param node Offset of the instruction, or the program length for the end
+ * @param loop Index of the loop, numLoops for the whole program
+ * @return true if it is, at any depth
+ */
+static bool inLoop(const TimingAnalysis* const analysis, uint32_t node, uint32_t loop)
+{
+    if (node >= analysis->length) {
+        return false;
+    }
+    if (loop == analysis->numLoops) {
+        return true;
+    }
+    uint32_t inner = *(analysis->innermost + node);
+    while (inner != TIMING_NO_LOOP && inner < loop) {
+        inner = (analysis->loops + inner)->parent;  // loops come before the loops around them
+    }
+    return inner == loop;
+}
+
+/**
+ * @brief Check whether every way from the start to an instruction passes through another
+ *
+ * @param idom Immediate dominator of each reachable instruction
+ * @param position Position of each reachable instruction in reverse postorder
+ * @param dominator The instruction that may dominate
+ * @param node The instruction that may be dominated
+ * @return true if dominator dominates node
+ */
+static bool dominates(const uint32_t* const idom, const uint32_t* const position, uint32_t dominator, uint32_t node)
+{
+    while (*(position + node) > *(position + dominator)) {
+        node = *(idom + node);
+    }
+    return node == dominator;
+}
+
+/**
+ * @brief Mark the body of the natural loop of a header, everything that reaches a JUMP back to it without passing it
+ *
+ * @param analysis The analysis, with successors and order
+ * @param predStart Predecessors of instruction i are preds[predStart[i]] to preds[predStart[i + 1]]
+ * @param preds Predecessors of every reachable instruction
+ * @param idom Immediate dominator of each reachable instruction
+ * @param position Position of each reachable instruction in reverse postorder
+ * @param header The header
+ * @param stamps Set to stamp for every instruction in the body
+ * @param stamp Value no instruction's stamp has yet
+ * @param stack Room for one entry per instruction
+ * @param innermost Set to loop for every instruction in the body, may be NULL
+ * @param loop Index of the loop
+ * @return Instructions in the body
+ */
+static uint32_t markLoopBody(const uint32_t* const predStart, const uint32_t* const preds, const uint32_t* const idom, const uint32_t* const position, uint32_t header, uint32_t* stamps, uint32_t stamp, uint32_t* stack, uint32_t* innermost, uint32_t loop)
+{
+    uint32_t size = 0;
+    uint32_t depth = 0;
+    *(stack + depth++) = header;
+    *(stamps + header) = stamp;
+    for (uint32_t i = *(predStart + header); i < *(predStart + header + 1); i++) {
+        uint32_t source = *(preds + i);
+        if (*(stamps + source) != stamp && dominates(idom, position, header, source)) {
+            *(stamps + source) = stamp;
+            *(stack + depth++) = source;
+        }
+    }
+    while (depth > 0) {
+        uint32_t node = *(stack + --depth);
+        size++;
+        if (innermost != NULL) {
+            *(innermost + node) = loop;
+        }
+        if (node == header) {
+            continue;  // the way in, not part of the way round
+        }
+        for (uint32_t i = *(predStart + node); i < *(predStart + node + 1); i++) {
+            uint32_t pred = *(preds + i);
+            if (*(stamps + pred) != stamp) {
+                *(stamps + pred) = stamp;
+                *(stack + depth++) = pred;
+            }
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Order loops by size, so every loop comes before the loops around it
+ */
+static int compareLoopSizes(const void* a, const void* b)
+{
+    uint32_t sizeA = ((const TimedLoop*)a)->size;
+    uint32_t sizeB = ((const TimedLoop*)b)->size;
+    return (sizeA > sizeB) - (sizeA < sizeB);
+}
+
+/**
+ * @brief Find the control flow and loops of a program
+ *
+ * A SKIP leads to both the next instruction and the one after, but skip ireg compares ireg with itself and only to
+ * the one after. A JUMP leads to its target, and anything past either end of the program, or a JUMP to itself, ends
+ * the run. Loops are found from the dominator tree, so each needs one header
+ * every way into it passes through. A loop entered anywhere else is not analyzed, and irreducibleAt is set to it.
+ *
+ * @param code The program, which must outlive the analysis
+ * @param length Number of instructions in code
+ * @param analysis Receives the control flow
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t analyzeControlFlow(const uint8_t* const code, uint32_t length, TimingAnalysis* analysis)
+{
+    memset(analysis, 0, sizeof(TimingAnalysis));
+    analysis->code = code;
+    analysis->length = length;
+    analysis->irreducibleAt = UINT32_MAX;
+    size_t nodes = (size_t)length + 1;
+    analysis->successors = (uint32_t*)malloc(2 * nodes * sizeof(uint32_t));
+    analysis->order = (uint32_t*)malloc(nodes * sizeof(uint32_t));
+    analysis->innermost = (uint32_t*)malloc(nodes * sizeof(uint32_t));
+    uint32_t* position = (uint32_t*)malloc(nodes * sizeof(uint32_t));
+    uint32_t* idom = (uint32_t*)malloc(nodes * sizeof(uint32_t));
+    uint32_t* predStart = (uint32_t*)calloc(nodes + 1, sizeof(uint32_t));
+    uint32_t* preds = (uint32_t*)malloc(2 * nodes * sizeof(uint32_t));
+    uint32_t* stack = (uint32_t*)malloc(nodes * sizeof(uint32_t));
+    uint32_t* stamps = (uint32_t*)calloc(nodes, sizeof(uint32_t));
+    uint32_t* headers = (uint32_t*)malloc(nodes * sizeof(uint32_t));
+    uint8_t* visited = (uint8_t*)calloc(nodes, sizeof(uint8_t));
+    uint8_t status = 0;
+    if (analysis->successors == NULL || analysis->order == NULL || analysis->innermost == NULL || position == NULL || idom == NULL || predStart == NULL || preds == NULL || stack == NULL || stamps == NULL || headers == NULL || visited == NULL) {
+        status = ERROR_OUT_OF_MEMORY;
+        goto done;
+    }
+    countAllocation(nodes * (12 * sizeof(uint32_t) + 1) + sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < length; i++) {
+        uint8_t instruction = *(code + i);
+        uint32_t* successors = analysis->successors + 2 * (size_t)i;
+        *(successors + 1) = TIMING_NO_SUCCESSOR;
+        if (instruction & 0b10000000) {
+            int64_t target = (int64_t)i + (int32_t)(instruction & 0b1111111) - ((instruction & 0b1000000) << 1);  // sign extend
+            *successors = instruction == HALT || target < 0 || target >= length ? length : (uint32_t)target;
+        } else {
+            *successors = i + 1 < length ? i + 1 : length;
+            uint32_t skipped = i + 2 < length ? i + 2 : length;
+            if (instruction == (0b01011 << 3)) {
+                *successors = skipped;  // skip ireg always skips
+            } else if ((instruction >> 3) == 0b01011 && skipped != *successors) {
+                *(successors + 1) = skipped;  // a SKIP of the last instruction leads to the end either way
+            }
+        }
+        *(analysis->innermost + i) = TIMING_NO_LOOP;
+        *(position + i) = NO_NODE;
+    }
+    if (length == 0) {
+        goto done;
+    }
+
+    // reverse postorder from offset 0, so every edge that is not part of a cycle goes to a later position
+    uint32_t depth = 0;
+    uint32_t postorder = length;
+    *(stack + depth++) = 0;
+    visited[0] = 1;
+    while (depth > 0) {
+        uint32_t node = *(stack + depth - 1);
+        uint32_t next = NO_NODE;
+        while (next == NO_NODE && visited[node] <= 2) {
+            uint32_t successor = *(analysis->successors + 2 * (size_t)node + visited[node]++ - 1);
+            if (successor != TIMING_NO_SUCCESSOR && successor != length && !visited[successor]) {
+                next = successor;
+            }
+        }
+        if (next != NO_NODE) {
+            visited[next] = 1;
+            *(stack + depth++) = next;
+        } else {
+            *(analysis->order + --postorder) = node;
+            depth--;
+        }
+    }
+    analysis->numReachable = length - postorder;
+    memmove(analysis->order, analysis->order + postorder, analysis->numReachable * sizeof(uint32_t));
+    for (uint32_t i = 0; i < analysis->numReachable; i++) {
+        *(position + *(analysis->order + i)) = i;
+    }
+
+    // predecessors of every reachable instruction, then the dominator tree by Cooper, Harvey and Kennedy's iteration
+    for (uint32_t i = 0; i < analysis->numReachable; i++) {
+        const uint32_t* successors = analysis->successors + 2 * (size_t)*(analysis->order + i);
+        for (uint32_t j = 0; j < 2; j++) {
+            if (*(successors + j) != TIMING_NO_SUCCESSOR && *(successors + j) != length) {
+                (*(predStart + *(successors + j) + 1))++;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        *(predStart + i + 1) += *(predStart + i);
+    }
+    memcpy(stack, predStart, nodes * sizeof(uint32_t));
+    for (uint32_t i = 0; i < analysis->numReachable; i++) {
+        uint32_t node = *(analysis->order + i);
+        const uint32_t* successors = analysis->successors + 2 * (size_t)node;
+        for (uint32_t j = 0; j < 2; j++) {
+            if (*(successors + j) != TIMING_NO_SUCCESSOR && *(successors + j) != length) {
+                *(preds + (*(stack + *(successors + j)))++) = node;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        *(idom + i) = NO_NODE;
+    }
+    *idom = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (uint32_t i = 1; i < analysis->numReachable; i++) {
+            uint32_t node = *(analysis->order + i);
+            uint32_t dominator = NO_NODE;
+            for (uint32_t j = *(predStart + node); j < *(predStart + node + 1); j++) {
+                uint32_t other = *(preds + j);
+                if (*(idom + other) == NO_NODE) {
+                    continue;
+                }
+                while (dominator != NO_NODE && other != dominator) {
+                    while (*(position + other) > *(position + dominator)) {
+                        other = *(idom + other);
+                    }
+                    while (*(position + dominator) > *(position + other)) {
+                        dominator = *(idom + dominator);
+                    }
+                }
+                dominator = other;
+            }
+            if (*(idom + node) != dominator) {
+                *(idom + node) = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    // an edge back to an earlier position closes a loop, which has to be back to an instruction dominating it
+    uint32_t numHeaders = 0;
+    for (uint32_t i = 0; i < analysis->numReachable; i++) {
+        uint32_t node = *(analysis->order + i);
+        for (uint32_t j = *(predStart + node); j < *(predStart + node + 1); j++) {
+            uint32_t source = *(preds + j);
+            if (*(position + source) < i) {
+                continue;
+            }
+            if (!dominates(idom, position, node, source)) {
+                analysis->irreducibleAt = node;
+                goto done;
+            }
+            if (numHeaders == 0 || *(headers + numHeaders - 1) != node) {
+                *(headers + numHeaders++) = node;
+            }
+        }
+    }
+
+    // bodies marked again from the largest loop in, so every instruction is left with its innermost loop
+    analysis->loops = (TimedLoop*)malloc(((size_t)numHeaders + 1) * sizeof(TimedLoop));
+    if (analysis->loops == NULL) {
+        status = ERROR_OUT_OF_MEMORY;
+        goto done;
+    }
+    countAllocation(((size_t)numHeaders + 1) * sizeof(TimedLoop));
+    analysis->numLoops = numHeaders;
+    for (uint32_t i = 0; i < numHeaders; i++) {
+        TimedLoop* loop = analysis->loops + i;
+        loop->header = *(headers + i);
+        loop->size = markLoopBody(predStart, preds, idom, position, loop->header, stamps, i + 1, stack, NULL, i);
+        loop->minIterations = 1;
+        loop->maxIterations = 0;
+        loop->exits = false;
+    }
+    qsort(analysis->loops, numHeaders, sizeof(TimedLoop), compareLoopSizes);
+    memset(stamps, 0, nodes * sizeof(uint32_t));
+    for (uint32_t k = numHeaders; k-- > 0;) {
+        TimedLoop* loop = analysis->loops + k;
+        loop->parent = *(analysis->innermost + loop->header);
+        markLoopBody(predStart, preds, idom, position, loop->header, stamps, numHeaders - k, stack, analysis->innermost, k);
+    }
+
+    // the members of each loop, and whether anything leaves it
+    analysis->memberStart = (uint32_t*)calloc((size_t)numHeaders + 2, sizeof(uint32_t));
+    analysis->members = (uint32_t*)malloc(((size_t)analysis->numReachable + numHeaders) * sizeof(uint32_t));
+    if (analysis->memberStart == NULL || analysis->members == NULL) {
+        status = ERROR_OUT_OF_MEMORY;
+        goto done;
+    }
+    countAllocation(((size_t)numHeaders + 2 + analysis->numReachable + numHeaders) * sizeof(uint32_t));
+    for (uint32_t pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            for (uint32_t k = 0; k <= numHeaders; k++) {
+                *(analysis->memberStart + k + 1) += *(analysis->memberStart + k);
+            }
+            memcpy(stack, analysis->memberStart, ((size_t)numHeaders + 1) * sizeof(uint32_t));
+        }
+        for (uint32_t i = 0; i < analysis->numReachable; i++) {
+            uint32_t node = *(analysis->order + i);
+            uint32_t inner = *(analysis->innermost + node);
+            uint32_t owners[2] = {inner == TIMING_NO_LOOP ? numHeaders : inner, NO_NODE};
+            if (inner != TIMING_NO_LOOP && (analysis->loops + inner)->header == node) {
+                uint32_t parent = (analysis->loops + inner)->parent;
+                owners[1] = parent == TIMING_NO_LOOP ? numHeaders : parent;
+            }
+            for (uint32_t j = 0; j < 2 && owners[j] != NO_NODE; j++) {
+                if (pass == 0) {
+                    (*(analysis->memberStart + owners[j] + 1))++;
+                } else {
+                    *(analysis->members + (*(stack + owners[j]))++) = node;
+                }
+            }
+        }
+    }
+    for (uint32_t i = 0; i < analysis->numReachable; i++) {
+        uint32_t node = *(analysis->order + i);
+        for (uint32_t j = 0; j < 2; j++) {
+            uint32_t successor = *(analysis->successors + 2 * (size_t)node + j);
+            uint32_t inner = *(analysis->innermost + node);
+            while (successor != TIMING_NO_SUCCESSOR && inner != TIMING_NO_LOOP && !inLoop(analysis, successor, inner)) {
+                (analysis->loops + inner)->exits = true;
+                inner = (analysis->loops + inner)->parent;
+            }
+        }
+    }
+
+done:
+    free(position);
+    free(idom);
+    free(predStart);
+    free(preds);
+    free(stack);
+    free(stamps);
+    free(headers);
+    free(visited);
+    if (status != 0) {
+        freeTimingAnalysis(analysis);
+    }
+    return status;
+}
+
+/**
+ * @brief Free everything an analysis allocated
+ *
+ * @param analysis The analysis
+ */
+void freeTimingAnalysis(TimingAnalysis* analysis)
+{
+    free(analysis->successors);
+    free(analysis->order);
+    free(analysis->innermost);
+    free(analysis->loops);
+    free(analysis->members);
+    free(analysis->memberStart);
+    analysis->successors = NULL;
+    analysis->order = NULL;
+    analysis->innermost = NULL;
+    analysis->loops = NULL;
+    analysis->members = NULL;
+    analysis->memberStart = NULL;
+    analysis->numReachable = 0;
+    analysis->numLoops = 0;
+}
+
+/**
+ * @brief Bound the loop an instruction belongs to, if it is a loop's header or a JUMP back to one
+ *
+ * A loop bounded more than once keeps the widest range, so conflicting bounds never underestimate it.
+ *
+ * @param analysis The analysis
+ * @param offset Offset of the instruction
+ * @param minIterations Least times the header runs each time control enters the loop
+ * @param maxIterations Most times it runs
+ * @return true if a loop was bounded
+ */
+bool boundLoopAt(TimingAnalysis* analysis, uint32_t offset, uint32_t minIterations, uint32_t maxIterations)
+{
+    if (offset >= analysis->length || analysis->numLoops == 0) {
+        return false;
+    }
+    uint32_t candidates[3] = {offset, *(analysis->successors + 2 * (size_t)offset), *(analysis->successors + 2 * (size_t)offset + 1)};
+    for (uint32_t i = 0; i < 3; i++) {
+        uint32_t node = *(candidates + i);
+        if (node >= analysis->length) {
+            continue;
+        }
+        uint32_t loop = *(analysis->innermost + node);
+        if (loop != TIMING_NO_LOOP && (analysis->loops + loop)->header == node && (i == 0 || inLoop(analysis, offset, loop))) {
+            TimedLoop* bounded = analysis->loops + loop;
+            if (bounded->maxIterations != 0) {
+                minIterations = minIterations < bounded->minIterations ? minIterations : bounded->minIterations;
+                maxIterations = maxIterations > bounded->maxIterations ? maxIterations : bounded->maxIterations;
+            }
+            bounded->minIterations = minIterations;
+            bounded->maxIterations = maxIterations;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Find the shortest and longest time a program can take from offset 0 until it ends
+ *
+ * Each loop is timed from its innermost nested loops out. The longest time through a loop is its bound minus one
+ * times its longest iteration, plus the longest way from its header out of it along each exit, and likewise the
+ * shortest time with its least bound. A JUMP that halts the CPU costs nothing, like the emulator's count.
+ *
+ * @param analysis The control flow, with every loop bounded
+ * @param model Cost of each instruction
+ * @param best Receives the shortest time
+ * @param worst Receives the longest time
+ * @param loopWorst Receives the longest iteration of each loop, including nested loops, may be NULL
+ * @param unboundedLoop Receives the index of a loop without a bound or without a way out if there is one
+ * @return 0 if successful, ERROR_UNBOUNDED_LOOP if a loop has no bound or never exits, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t boundExecutionTime(const TimingAnalysis* const analysis, const TimingModel* const model, uint64_t* best, uint64_t* worst, uint64_t* loopWorst, uint32_t* unboundedLoop)
+{
+    *best = 0;
+    *worst = 0;
+    *unboundedLoop = TIMING_NO_LOOP;
+    if (analysis->numReachable == 0) {
+        return 0;
+    }
+    for (uint32_t k = 0; k < analysis->numLoops; k++) {
+        if ((analysis->loops + k)->maxIterations == 0 || !(analysis->loops + k)->exits) {
+            *unboundedLoop = k;
+            return ERROR_UNBOUNDED_LOOP;
+        }
+    }
+    size_t nodes = (size_t)analysis->length + 1;
+    uint64_t* bestTo = (uint64_t*)malloc(nodes * sizeof(uint64_t));
+    uint64_t* worstTo = (uint64_t*)malloc(nodes * sizeof(uint64_t));
+    uint32_t* reached = (uint32_t*)calloc(nodes, sizeof(uint32_t));
+    uint32_t* exitAt = (uint32_t*)calloc(nodes, sizeof(uint32_t));
+    uint32_t* exitStart = (uint32_t*)malloc(((size_t)analysis->numLoops + 2) * sizeof(uint32_t));
+    LoopExit* exits = NULL;
+    uint32_t numExits = 0;
+    uint32_t exitCapacity = 0;
+    uint8_t status = 0;
+    if (bestTo == NULL || worstTo == NULL || reached == NULL || exitAt == NULL || exitStart == NULL) {
+        status = ERROR_OUT_OF_MEMORY;
+        goto done;
+    }
+    countAllocation(nodes * (2 * sizeof(uint64_t) + 2 * sizeof(uint32_t)) + ((size_t)analysis->numLoops + 2) * sizeof(uint32_t));
+
+    // each loop, then the whole program, as a DAG of its own instructions and the loops directly inside it
+    for (uint32_t k = 0; k <= analysis->numLoops; k++) {
+        const TimedLoop* loop = k < analysis->numLoops ? analysis->loops + k : NULL;
+        uint32_t header = loop != NULL ? loop->header : 0;
+        uint64_t bestIteration = TIMING_UNBOUNDED;
+        uint64_t worstIteration = 0;
+        *(exitStart + k) = numExits;
+        *(reached + header) = k + 1;
+        *(bestTo + header) = 0;
+        *(worstTo + header) = 0;
+        for (uint32_t m = *(analysis->memberStart + k); m < *(analysis->memberStart + k + 1); m++) {
+            uint32_t node = *(analysis->members + m);
+            if (*(reached + node) != k + 1) {
+                continue;
+            }
+            // an instruction leads to its successors, a nested loop to wherever its iterations leave it for
+            uint32_t inner = *(analysis->innermost + node);
+            bool nested = inner != (loop != NULL ? k : TIMING_NO_LOOP);
+            uint32_t first = nested ? *(exitStart + inner) : 0;
+            uint32_t last = nested ? *(exitStart + inner + 1) : 2;
+            uint64_t cost = *(analysis->code + node) == HALT ? 0 : *(model->costs + instructionIndex(*(analysis->code + node)));
+            for (uint32_t e = first; e < last; e++) {
+                uint32_t target;
+                uint64_t bestThere;
+                uint64_t worstThere;
+                if (nested) {
+                    target = (exits + e)->target;
+                    bestThere = addTime(*(bestTo + node), (exits + e)->best);
+                    worstThere = addTime(*(worstTo + node), (exits + e)->worst);
+                } else {
+                    target = *(analysis->successors + 2 * (size_t)node + e);
+                    bestThere = addTime(*(bestTo + node), cost);
+                    worstThere = addTime(*(worstTo + node), cost);
+                }
+                if (target == TIMING_NO_SUCCESSOR) {
+                    continue;
+                }
+                if (loop != NULL && target == header) {
+                    bestIteration = bestThere < bestIteration ? bestThere : bestIteration;
+                    worstIteration = worstThere > worstIteration ? worstThere : worstIteration;
+                } else if (inLoop(analysis, target, k)) {
+                    if (*(reached + target) != k + 1) {
+                        *(reached + target) = k + 1;
+                        *(bestTo + target) = bestThere;
+                        *(worstTo + target) = worstThere;
+                    } else {
+                        *(bestTo + target) = bestThere < *(bestTo + target) ? bestThere : *(bestTo + target);
+                        *(worstTo + target) = worstThere > *(worstTo + target) ? worstThere : *(worstTo + target);
+                    }
+                } else if (numExits > *(exitStart + k) && *(exitAt + target) >= *(exitStart + k) && *(exitAt + target) < numExits && (exits + *(exitAt + target))->target == target) {
+                    LoopExit* exit = exits + *(exitAt + target);
+                    exit->best = bestThere < exit->best ? bestThere : exit->best;
+                    exit->worst = worstThere > exit->worst ? worstThere : exit->worst;
+                } else {
+                    if (numExits == exitCapacity) {
+                        uint32_t newCapacity = exitCapacity == 0 ? 64 : exitCapacity * 2;
+                        LoopExit* grown = (LoopExit*)realloc(exits, newCapacity * sizeof(LoopExit));
+                        if (grown == NULL) {
+                            status = ERROR_OUT_OF_MEMORY;
+                            goto done;
+                        }
+                        countAllocation(newCapacity * sizeof(LoopExit));
+                        exits = grown;
+                        exitCapacity = newCapacity;
+                    }
+                    *(exitAt + target) = numExits;
+                    (exits + numExits)->target = target;
+                    (exits + numExits)->best = bestThere;
+                    (exits + numExits)->worst = worstThere;
+                    numExits++;
+                }
+            }
+        }
+        *(exitStart + k + 1) = numExits;
+        if (loop != NULL) {
+            // every iteration but the last goes around, the last leaves
+            for (uint32_t e = *(exitStart + k); e < numExits; e++) {
+                LoopExit* exit = exits + e;
+                exit->best = addTime(multiplyTime(bestIteration, loop->minIterations - 1), exit->best);
+                exit->worst = addTime(multiplyTime(worstIteration, loop->maxIterations - 1), exit->worst);
+            }
+            if (loopWorst != NULL) {
+                *(loopWorst + k) = worstIteration;
+            }
+        }
+    }
+    // the whole program only leaves for the end
+    if (numExits > *(exitStart + analysis->numLoops)) {
+        *best = (exits + numExits - 1)->best;
+        *worst = (exits + numExits - 1)->worst;
+    }
+
+done:
+    free(bestTo);
+    free(worstTo);
+    free(reached);
+    free(exitAt);
+    free(exitStart);
+    free(exits);
+    return status;
+}
@@ -0,0 +1,158 @@
+#ifndef TIMINGANALYSIS_H
+#define TIMINGANALYSIS_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "Diagnostics.h"
+#include "Instructions.h"
+#include "Source.h"
+
+#define TIMING_NO_LOOP UINT32_MAX
+#define TIMING_NO_SUCCESSOR UINT32_MAX
+#define TIMING_UNIT_LENGTH 24
+#define TIMING_UNBOUNDED UINT64_MAX  // a time too long to count, costs saturate here instead of wrapping
+
+/**
+ * What each instruction costs on one hardware target, in whatever unit it is timed in.
+ */
+typedef struct _TimingModel {
+    uint64_t costs[NUM_INSTRUCTIONS];  // in InstructionLoaderLUT order
+    char unit[TIMING_UNIT_LENGTH];     // such as "instructions" or "ticks"
+} TimingModel;
+
+/**
+ * A `# @loop N` or `# @loop M..N` comment in the source
+ */
+typedef struct _LoopBound {
+    uint32_t line;
+    uint32_t minIterations;
+    uint32_t maxIterations;
+} LoopBound;
+
+typedef struct _LoopBoundsList {
+    LoopBound* bounds;  // in line order
+    uint32_t length;
+    uint32_t capacity;
+} LoopBoundsList;
+
+/**
+ * A natural loop: a header instruction and everything that can reach a JUMP back to it without passing through it.
+ */
+typedef struct _TimedLoop {
+    uint32_t header;         // offset of the one instruction control enters the loop through
+    uint32_t parent;         // index of the innermost loop around this one, TIMING_NO_LOOP if none
+    uint32_t size;           // instructions in the loop, nested loops included
+    uint32_t minIterations;  // least times the header runs each time control enters the loop
+    uint32_t maxIterations;  // most times, 0 until the loop is bounded
+    bool exits;              // whether any instruction of the loop leads out of it
+} TimedLoop;
+
+/**
+ * The control flow of a program as far as timing is concerned. Every instruction reachable from offset 0 is a node,
+ * with the JUMP to itself that halts the CPU and every way out of the program leading to one end node.
+ */
+typedef struct _TimingAnalysis {
+    const uint8_t* code;
+    uint32_t length;
+    uint32_t* successors;  // two per instruction, the second TIMING_NO_SUCCESSOR if there is only one, length for
+                           // the end
+    uint32_t* order;       // reachable instructions in reverse postorder, so every edge but a loop's goes forward
+    uint32_t numReachable;
+    uint32_t* innermost;   // per instruction, index of the innermost loop holding it, TIMING_NO_LOOP if none
+    TimedLoop* loops;      // every loop after the loops nested in it
+    uint32_t numLoops;
+    uint32_t* members;     // per loop and then the whole program, its instructions outside nested loops and the
+                           // headers of the loops directly inside it, in reverse postorder
+    uint32_t* memberStart; // where each loop's members start, numLoops + 2 entries
+    uint32_t irreducibleAt;  // offset of a loop entered other than through one header, UINT32_MAX if there is none
+} TimingAnalysis;
+
+/**
+ * @brief Set up a model counting the instructions executed, which are also the clock cycles of the Logisim CPU
+ *
+ * @param model The model to initialize
+ */
+void initInstructionCountModel(TimingModel* model);
+
+/**
+ * @brief Read a timing model, one `mnemonic cost` pair per line, `unit name` naming the unit, `default cost` the cost of
+ *        every instruction not listed (1 if not given), # starting a comment
+ *
+ * @param file The timing model file
+ * @param model Receives the model
+ * @param diagnostic Set to the error and the line of the file it occurred on if one occurs, may be NULL
+ * @return 0 if successful, otherwise ERROR_MALFORMED_TIMING
+ */
+uint8_t readTimingModel(SourceReader* file, TimingModel* model, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Find every `@loop N` and `@loop M..N` in the comments of a source
+ *
+ * @param source The source, read from its current position
+ * @param list Empty list to fill in
+ * @param diagnostic Set to the error and the line it occurred on if one occurs, may be NULL
+ * @return 0 if successful, ERROR_MALFORMED_LOOP_BOUND if a bound is not 1 <= M <= N, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t readLoopBounds(SourceReader* source, LoopBoundsList* list, AssemblerDiagnostic* diagnostic);
+
+/**
+ * @brief Free the bounds of a list, leaving it empty
+ *
+ * @param list The list
+ */
+void freeLoopBoundsList(LoopBoundsList* list);
+
+/**
+ * @brief Find the control flow and loops of a program
+ *
+ * A SKIP leads to both the next instruction and the one after, but skip ireg compares ireg with itself and only to
+ * the one after. A JUMP leads to its target, and anything past either end of the program, or a JUMP to itself, ends
+ * the run. Loops are found from the dominator tree, so each needs one header
+ * every way into it passes through. A loop entered anywhere else is not analyzed, and irreducibleAt is set to it.
+ *
+ * @param code The program, which must outlive the analysis
+ * @param length Number of instructions in code
+ * @param analysis Receives the control flow
+ * @return 0 if successful, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t analyzeControlFlow(const uint8_t* const code, uint32_t length, TimingAnalysis* analysis);
+
+/**
+ * @brief Free everything an analysis allocated
+ *
+ * @param analysis The analysis
+ */
+void freeTimingAnalysis(TimingAnalysis* analysis);
+
+/**
+ * @brief Bound the loop an instruction belongs to, if it is a loop's header or a JUMP back to one
+ *
+ * A loop bounded more than once keeps the widest range, so conflicting bounds never underestimate it.
+ *
+ * @param analysis The analysis
+ * @param offset Offset of the instruction
+ * @param minIterations Least times the header runs each time control enters the loop
+ * @param maxIterations Most times it runs
+ * @return true if a loop was bounded
+ */
+bool boundLoopAt(TimingAnalysis* analysis, uint32_t offset, uint32_t minIterations, uint32_t maxIterations);
+
+/**
+ * @brief Find the shortest and longest time a program can take from offset 0 until it ends
+ *
+ * Each loop is timed from its innermost nested loops out. The longest time through a loop is its bound minus one
+ * times its longest iteration, plus the longest way from its header out of it along each exit, and likewise the
+ * shortest time with its least bound. A JUMP that halts the CPU costs nothing, like the emulator's count.
+ *
+ * @param analysis The control flow, with every loop bounded
+ * @param model Cost of each instruction
+ * @param best Receives the shortest time
+ * @param worst Receives the longest time
+ * @param loopWorst Receives the longest iteration of each loop, including nested loops, may be NULL
+ * @param unboundedLoop Receives the index of a loop without a bound or without a way out if there is one
+ * @return 0 if successful, ERROR_UNBOUNDED_LOOP if a loop has no bound or never exits, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t boundExecutionTime(const TimingAnalysis* const analysis, const TimingModel* const model, uint64_t* best, uint64_t* worst, uint64_t* loopWorst, uint32_t* unboundedLoop);
+
+#endif
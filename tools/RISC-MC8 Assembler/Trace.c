@@ -0,0 +1,459 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "Trace.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "StatusCodes.h"
+
+#define TRACE_HEADER_LENGTH 16
+#define TRACE_STATE_LENGTH (8 + 8 + EMULATOR_NUM_REGISTERS + 4 + EMULATOR_RAM_SIZE)
+#define TRACE_INITIAL_CAPACITY (1u << 20)
+
+/**
+ * @brief Write a value in little-endian order
+ *
+ * @param dest Where to write the bytes
+ * @param value The value to write
+ * @param size Number of bytes to write
+ */
+static void putTraceUint(uint8_t* dest, uint64_t value, uint8_t size)
+{
+    for (uint8_t i = 0; i < size; i++) {
+        *(dest + i) = (uint8_t)(value >> (i * 8));
+    }
+}
+
+/**
+ * @brief Read a value in little-endian order
+ *
+ * @param src The bytes to read
+ * @param size Number of bytes to read
+ * @return The value
+ */
+static uint64_t getTraceUint(const uint8_t* const src, uint8_t size)
+{
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < size; i++) {
+        value |= (uint64_t)*(src + i) << (i * 8);
+    }
+    return value;
+}
+
+/**
+ * @brief Lay out a checkpoint as it is stored in a trace
+ *
+ * @param dest Where to write TRACE_STATE_LENGTH bytes
+ * @param emulator The emulator to store the state of
+ * @param inputPosition Port bytes recorded before this point
+ */
+static void putTraceState(uint8_t* dest, const Emulator* const emulator, uint64_t inputPosition)
+{
+    putTraceUint(dest, emulator->executed, 8);
+    putTraceUint(dest + 8, inputPosition, 8);
+    memcpy(dest + 16, emulator->state.registers, EMULATOR_NUM_REGISTERS);
+    putTraceUint(dest + 16 + EMULATOR_NUM_REGISTERS, emulator->state.pc, 4);
+    memcpy(dest + 20 + EMULATOR_NUM_REGISTERS, emulator->state.ram, EMULATOR_RAM_SIZE);
+}
+
+#if !defined(_WIN32)
+
+/**
+ * @brief Make room at the end of the mapping, growing the file and mapping it again if needed
+ *
+ * @param writer The writer
+ * @param extra Number of bytes about to be appended
+ * @return true if there is room, false if the file could not be grown
+ */
+static bool reserveTrace(TraceWriter* writer, size_t extra)
+{
+    if (writer->failed) {
+        return false;
+    } else if (writer->length + extra <= writer->capacity) {
+        return true;
+    }
+    size_t newCapacity = writer->capacity == 0 ? TRACE_INITIAL_CAPACITY : writer->capacity * 2;
+    while (newCapacity < writer->length + extra) {
+        newCapacity *= 2;
+    }
+    if (writer->map != NULL) {
+        munmap(writer->map, writer->capacity);
+        writer->map = NULL;
+    }
+    void* mapping = MAP_FAILED;
+    if (ftruncate(writer->fd, (off_t)newCapacity) == 0) {
+        mapping = mmap(NULL, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0);
+    }
+    if (mapping == MAP_FAILED) {
+        writer->failed = true;
+        return false;
+    }
+    writer->map = (uint8_t*)mapping;
+    writer->capacity = newCapacity;
+    return true;
+}
+
+/**
+ * @brief Append bytes to the trace
+ *
+ * @param writer The writer
+ * @param data The bytes to append
+ * @param length Number of bytes
+ */
+static void appendTrace(TraceWriter* writer, const uint8_t* const data, size_t length)
+{
+    if (reserveTrace(writer, length)) {
+        memcpy(writer->map + writer->length, data, length);
+        writer->length += length;
+    }
+}
+
+/**
+ * @brief Append the port bytes recorded since the last checkpoint and the emulator's state as one record
+ *
+ * @param writer The writer
+ * @param emulator The emulator being recorded
+ * @param kind TRACE_RECORD_CHECKPOINT or TRACE_RECORD_END
+ * @param reason Why the run halted, only stored for TRACE_RECORD_END
+ */
+static void appendTraceState(TraceWriter* writer, const Emulator* const emulator, uint8_t kind, uint8_t reason)
+{
+    if (writer->input.length > 0) {
+        uint8_t header[5];
+        header[0] = TRACE_RECORD_INPUT;
+        putTraceUint(header + 1, writer->input.length, 4);
+        appendTrace(writer, header, sizeof(header));
+        appendTrace(writer, writer->input.data, writer->input.length);
+        writer->inputTotal += writer->input.length;
+        writer->input.length = 0;
+    }
+    uint8_t record[2 + TRACE_STATE_LENGTH];
+    uint8_t headerLength = kind == TRACE_RECORD_END ? 2 : 1;
+    record[0] = kind;
+    record[1] = reason;
+    putTraceState(record + headerLength, emulator, writer->inputTotal);
+    appendTrace(writer, record, headerLength + TRACE_STATE_LENGTH);
+}
+
+/**
+ * @brief Create a trace file and record the program and its starting state
+ *
+ * @param writer The writer to initialize
+ * @param path Path of the trace file, replaced if it exists
+ * @param code The program
+ * @param length Number of bytes in code
+ * @param interval Instructions between checkpoints, stored for reference
+ * @param emulator The emulator about to run, its current state is the first checkpoint
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the file could not be created, ERROR_IO_UNAVAILABLE on platforms
+ *         without memory mapping
+ */
+uint8_t openTraceWriter(TraceWriter* writer, const char* const path, const uint8_t* const code, uint32_t length, uint32_t interval, const Emulator* const emulator)
+{
+    memset(writer, 0, sizeof(TraceWriter));
+    initGrowableCodeBuffer(&writer->input);
+    writer->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (writer->fd < 0) {
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    uint8_t header[TRACE_HEADER_LENGTH];
+    memcpy(header, TRACE_MAGIC, 7);
+    header[7] = TRACE_FORMAT_VERSION;
+    putTraceUint(header + 8, interval, 4);
+    putTraceUint(header + 12, length, 4);
+    appendTrace(writer, header, TRACE_HEADER_LENGTH);
+    appendTrace(writer, code, length);
+    appendTraceState(writer, emulator, TRACE_RECORD_CHECKPOINT, 0);
+    if (writer->failed) {
+        closeTraceWriter(writer, emulator, EMULATOR_HALT_STEP_LIMIT);
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    return 0;
+}
+
+/**
+ * @brief Append the port bytes recorded since the last checkpoint, then the emulator's state
+ *
+ * @param writer The writer
+ * @param emulator The emulator being recorded
+ * @return 0 if successful, otherwise ERROR_INVALID_ARGUMENTS if the file could not be written
+ */
+uint8_t writeTraceCheckpoint(TraceWriter* writer, const Emulator* const emulator)
+{
+    appendTraceState(writer, emulator, TRACE_RECORD_CHECKPOINT, 0);
+    return writer->failed ? ERROR_INVALID_ARGUMENTS : 0;
+}
+
+/**
+ * @brief Append the end of the run and close the file
+ *
+ * @param writer The writer
+ * @param emulator The emulator that was recorded
+ * @param reason The EMULATOR_HALT_* reason it stopped
+ * @return 0 if successful, otherwise ERROR_INVALID_ARGUMENTS if the file could not be written
+ */
+uint8_t closeTraceWriter(TraceWriter* writer, const Emulator* const emulator, uint8_t reason)
+{
+    appendTraceState(writer, emulator, TRACE_RECORD_END, reason);
+    if (writer->map != NULL) {
+        munmap(writer->map, writer->capacity);
+    }
+    // drop the unused end of the last growth
+    if (ftruncate(writer->fd, (off_t)writer->length) != 0 || close(writer->fd) != 0) {
+        writer->failed = true;
+    }
+    freeCodeBuffer(&writer->input);
+    return writer->failed ? ERROR_INVALID_ARGUMENTS : 0;
+}
+
+#else
+
+uint8_t openTraceWriter(TraceWriter* writer, const char* const path, const uint8_t* const code, uint32_t length, uint32_t interval, const Emulator* const emulator)
+{
+    fprintf(stderr, "Error: Recording is not supported on this platform.\n");
+    return ERROR_IO_UNAVAILABLE;
+}
+
+uint8_t writeTraceCheckpoint(TraceWriter* writer, const Emulator* const emulator)
+{
+    return ERROR_IO_UNAVAILABLE;
+}
+
+uint8_t closeTraceWriter(TraceWriter* writer, const Emulator* const emulator, uint8_t reason)
+{
+    return ERROR_IO_UNAVAILABLE;
+}
+
+#endif
+
+/**
+ * @brief Add a checkpoint read from a trace
+ *
+ * @param replay The replay
+ * @param record The stored checkpoint, TRACE_STATE_LENGTH bytes
+ * @return 0 if successful, ERROR_MALFORMED_TRACE if it does not follow the last one, otherwise ERROR_OUT_OF_MEMORY
+ */
+static uint8_t addTraceCheckpoint(TraceReplay* replay, const uint8_t* const record)
+{
+    if (replay->numCheckpoints == replay->checkpointCapacity) {
+        uint32_t newCapacity = replay->checkpointCapacity == 0 ? 64 : replay->checkpointCapacity * 2;
+        TraceCheckpoint* grown = (TraceCheckpoint*)realloc(replay->checkpoints, newCapacity * sizeof(TraceCheckpoint));
+        if (grown == NULL) {
+            return ERROR_OUT_OF_MEMORY;
+        }
+        replay->checkpoints = grown;
+        replay->checkpointCapacity = newCapacity;
+    }
+    TraceCheckpoint* added = replay->checkpoints + replay->numCheckpoints;
+    added->executed = getTraceUint(record, 8);
+    added->inputPosition = getTraceUint(record + 8, 8);
+    memcpy(added->state.registers, record + 16, EMULATOR_NUM_REGISTERS);
+    added->state.pc = (uint32_t)getTraceUint(record + 16 + EMULATOR_NUM_REGISTERS, 4);
+    memcpy(added->state.ram, record + 20 + EMULATOR_NUM_REGISTERS, EMULATOR_RAM_SIZE);
+    const TraceCheckpoint* previous = replay->numCheckpoints == 0 ? NULL : added - 1;
+    if ((previous != NULL && (added->executed < previous->executed || added->inputPosition < previous->inputPosition)) || added->inputPosition != replay->input.length || added->state.pc > replay->programLength + 1) {
+        return ERROR_MALFORMED_TRACE;
+    }
+    replay->numCheckpoints++;
+    return 0;
+}
+
+/**
+ * @brief Put the emulator at a checkpoint
+ *
+ * @param replay The replay
+ * @param index Index of the checkpoint
+ */
+static void restoreCheckpoint(TraceReplay* replay, uint32_t index)
+{
+    const TraceCheckpoint* checkpoint = replay->checkpoints + index;
+    replay->emulator.state = checkpoint->state;
+    replay->emulator.executed = checkpoint->executed;
+    replay->io.replayPosition = checkpoint->inputPosition;
+}
+
+/**
+ * @brief Find the last checkpoint at or before a point
+ *
+ * @param replay The replay
+ * @param executed Number of instructions executed at the point
+ * @return Index of the checkpoint, the first one always qualifies
+ */
+static uint32_t findCheckpoint(const TraceReplay* const replay, uint64_t executed)
+{
+    uint32_t low = 1;
+    uint32_t high = replay->numCheckpoints;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if ((replay->checkpoints + middle)->executed <= executed) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low - 1;
+}
+
+/**
+ * @brief Open a trace and go to its start
+ *
+ * @param replay The replay to initialize
+ * @param path Path of the trace file
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if it could not be opened, ERROR_MALFORMED_TRACE if it is not a
+ *         trace, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t openTraceReplay(TraceReplay* replay, const char* const path)
+{
+    memset(replay, 0, sizeof(TraceReplay));
+    initGrowableCodeBuffer(&replay->input);
+    if (openSourceFile(&replay->file, path) != 0) {
+        return ERROR_INVALID_ARGUMENTS;
+    }
+    const uint8_t* data = (const uint8_t*)replay->file.data;
+    size_t length = replay->file.length;
+    if (data == NULL || length < TRACE_HEADER_LENGTH || memcmp(data, TRACE_MAGIC, 7) != 0 || data[7] != TRACE_FORMAT_VERSION) {
+        closeTraceReplay(replay);
+        return ERROR_MALFORMED_TRACE;
+    }
+    replay->interval = (uint32_t)getTraceUint(data + 8, 4);
+    replay->programLength = (uint32_t)getTraceUint(data + 12, 4);
+    replay->program = data + TRACE_HEADER_LENGTH;
+    size_t position = TRACE_HEADER_LENGTH;
+    uint8_t status = length - position < replay->programLength ? ERROR_MALFORMED_TRACE : 0;
+    position += replay->programLength;
+
+    // a recording that was cut short ends at its last checkpoint
+    replay->endReason = EMULATOR_HALT_STEP_LIMIT;
+    bool ended = false;
+    while (status == 0 && !ended && position < length && *(data + position) != TRACE_RECORD_NONE) {
+        uint8_t kind = *(data + position++);
+        if (kind == TRACE_RECORD_INPUT && length - position >= 4) {
+            size_t inputLength = (size_t)getTraceUint(data + position, 4);
+            position += 4;
+            if (length - position < inputLength) {
+                status = ERROR_MALFORMED_TRACE;
+            } else if (!reserveCode(&replay->input, replay->input.length + inputLength)) {
+                status = ERROR_OUT_OF_MEMORY;
+            } else {
+                memcpy(replay->input.data + replay->input.length, data + position, inputLength);
+                replay->input.length += inputLength;
+                position += inputLength;
+            }
+        } else if (kind == TRACE_RECORD_CHECKPOINT && length - position >= TRACE_STATE_LENGTH) {
+            status = addTraceCheckpoint(replay, data + position);
+            position += TRACE_STATE_LENGTH;
+        } else if (kind == TRACE_RECORD_END && length - position >= 1 + TRACE_STATE_LENGTH) {
+            replay->endReason = *(data + position);
+            status = addTraceCheckpoint(replay, data + position + 1);
+            ended = true;
+        } else {
+            status = ERROR_MALFORMED_TRACE;
+        }
+    }
+    if (status == 0 && replay->numCheckpoints == 0) {
+        status = ERROR_MALFORMED_TRACE;
+    }
+    if (status == 0) {
+        status = initEmulator(&replay->emulator, replay->program, replay->programLength);
+    }
+    if (status != 0) {
+        closeTraceReplay(replay);
+        return status;
+    }
+    replay->endExecuted = (replay->checkpoints + replay->numCheckpoints - 1)->executed;
+    startReplayIo(&replay->io, replay->input.data, replay->input.length);
+    attachEmulatorIo(&replay->emulator, &replay->io);
+    restoreCheckpoint(replay, 0);
+    return 0;
+}
+
+void closeTraceReplay(TraceReplay* replay)
+{
+    freeEmulator(&replay->emulator);
+    freeCodeBuffer(&replay->input);
+    free(replay->checkpoints);
+    replay->checkpoints = NULL;
+    closeSource(&replay->file);
+}
+
+/**
+ * @brief Go to the point after a number of instructions, or to the end of the recording if it is shorter
+ *
+ * @param replay The replay
+ * @param target Number of instructions executed at the point to go to
+ */
+void seekTrace(TraceReplay* replay, uint64_t target)
+{
+    if (target > replay->endExecuted) {
+        target = replay->endExecuted;
+    }
+    // carry on from where the emulator is when no checkpoint is closer
+    uint32_t index = findCheckpoint(replay, target);
+    if (replay->emulator.executed > target || (replay->checkpoints + index)->executed > replay->emulator.executed) {
+        restoreCheckpoint(replay, index);
+    }
+    stepEmulator(&replay->emulator, target - replay->emulator.executed, UINT32_MAX);
+}
+
+/**
+ * @brief Run forward until the program counter reaches a breakpoint or the recording ends
+ *
+ * @param replay The replay
+ * @param breakPc The breakpoint, UINT32_MAX for none
+ * @return true if it stopped at the breakpoint, false at the end of the recording
+ */
+bool continueTrace(TraceReplay* replay, uint32_t breakPc)
+{
+    uint64_t remaining = replay->endExecuted - replay->emulator.executed;
+    return stepEmulator(&replay->emulator, remaining, breakPc) == EMULATOR_HALT_BREAKPOINT;
+}
+
+/**
+ * @brief Run backward to the last earlier point where the program counter was at a breakpoint, or to the start
+ *
+ * Each checkpoint interval before the current point is stepped through from its checkpoint, latest first, until one
+ * passes the breakpoint.
+ *
+ * @param replay The replay
+ * @param breakPc The breakpoint, UINT32_MAX for none
+ * @return true if it stopped at the breakpoint, false at the start of the recording
+ */
+bool reverseContinueTrace(TraceReplay* replay, uint32_t breakPc)
+{
+    uint64_t limit = replay->emulator.executed;
+    if (limit == 0) {
+        return false;
+    }
+    uint32_t index = findCheckpoint(replay, limit - 1);
+    while (true) {
+        restoreCheckpoint(replay, index);
+        Emulator* emulator = &replay->emulator;
+        bool found = emulator->state.pc == breakPc;
+        uint64_t last = emulator->executed;
+        while (emulator->executed < limit && stepEmulator(emulator, limit - emulator->executed, breakPc) == EMULATOR_HALT_BREAKPOINT) {
+            if (emulator->executed < limit) {
+                found = true;
+                last = emulator->executed;
+            }
+        }
+        if (found) {
+            seekTrace(replay, last);
+            return true;
+        } else if (index == 0) {
+            restoreCheckpoint(replay, 0);
+            return false;
+        }
+        limit = (replay->checkpoints + index)->executed;
+        index--;
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "CodeBuffer.h"
+#include "Emulator.h"
+#include "EmulatorIo.h"
+#include "Source.h"
+
+#define TRACE_MAGIC "RMC8TRC"
+#define TRACE_FORMAT_VERSION 1
+#define TRACE_DEFAULT_INTERVAL (1u << 16)  // instructions between checkpoints
+
+// record kinds
+#define TRACE_RECORD_NONE 0        // the rest of the file was never written, the recorder stopped early
+#define TRACE_RECORD_INPUT 1       // bytes LOADs of the I/O ports returned
+#define TRACE_RECORD_CHECKPOINT 2  // the full machine state
+#define TRACE_RECORD_END 3         // why the run halted, then the final state like a checkpoint
+
+/*
+ * Trace layout, all integers little-endian:
+ *   "RMC8TRC", u8 format version
+ *   u32 checkpoint interval, u32 program length, program bytes
+ *   records, each starting with a u8 TRACE_RECORD_* kind:
+ *     input: u32 length, bytes
+ *     checkpoint: u64 instructions executed, u64 input bytes before it, 8 registers, u32 pc, 256 bytes of RAM
+ *     end: u8 EMULATOR_HALT_* reason, then the body of a checkpoint
+ * The program is deterministic apart from what it reads from the I/O ports, so those bytes and the starting state
+ * reproduce the whole run; the checkpoints only bound how far a replay has to step to reach any point. The first
+ * checkpoint is the starting state.
+ */
+
+/**
+ * Records a run into a trace file through a memory mapping that grows as needed. Bytes are only ever appended, so a
+ * trace cut short by a crash is still readable up to its last complete record.
+ */
+typedef struct _TraceWriter {
+    int fd;
+    uint8_t* map;
+    size_t length;
+    size_t capacity;
+    CodeBuffer input;     // port bytes since the last checkpoint, give it to EmulatorIo as its recording
+    uint64_t inputTotal;  // port bytes recorded before input
+    bool failed;
+} TraceWriter;
+
+typedef struct _TraceCheckpoint {
+    uint64_t executed;
+    uint64_t inputPosition;
+    EmulatorState state;
+} TraceCheckpoint;
+
+/**
+ * A trace opened for replay. The emulator is always at some point of the recorded run, and every movement goes
+ * through the checkpoints, so reaching any instruction count takes at most one checkpoint interval of stepping.
+ */
+typedef struct _TraceReplay {
+    SourceReader file;
+    const uint8_t* program;
+    uint32_t programLength;
+    uint32_t interval;
+    CodeBuffer input;  // every byte the ports returned, in order
+    TraceCheckpoint* checkpoints;
+    uint32_t numCheckpoints;
+    uint32_t checkpointCapacity;
+    uint64_t endExecuted;  // how far the recording goes
+    uint8_t endReason;     // EMULATOR_HALT_*, EMULATOR_HALT_STEP_LIMIT if the recording was cut short
+    Emulator emulator;
+    EmulatorIo io;
+} TraceReplay;
+
+/**
+ * @brief Create a trace file and record the program and its starting state
+ *
+ * @param writer The writer to initialize
+ * @param path Path of the trace file, replaced if it exists
+ * @param code The program
+ * @param length Number of bytes in code
+ * @param interval Instructions between checkpoints, stored for reference
+ * @param emulator The emulator about to run, its current state is the first checkpoint
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if the file could not be created, ERROR_IO_UNAVAILABLE on platforms
+ *         without memory mapping
+ */
+uint8_t openTraceWriter(TraceWriter* writer, const char* const path, const uint8_t* const code, uint32_t length, uint32_t interval, const Emulator* const emulator);
+
+/**
+ * @brief Append the port bytes recorded since the last checkpoint, then the emulator's state
+ *
+ * @param writer The writer
+ * @param emulator The emulator being recorded
+ * @return 0 if successful, otherwise ERROR_INVALID_ARGUMENTS if the file could not be written
+ */
+uint8_t writeTraceCheckpoint(TraceWriter* writer, const Emulator* const emulator);
+
+/**
+ * @brief Append the end of the run and close the file
+ *
+ * @param writer The writer
+ * @param emulator The emulator that was recorded
+ * @param reason The EMULATOR_HALT_* reason it stopped
+ * @return 0 if successful, otherwise ERROR_INVALID_ARGUMENTS if the file could not be written
+ */
+uint8_t closeTraceWriter(TraceWriter* writer, const Emulator* const emulator, uint8_t reason);
+
+/**
+ * @brief Open a trace and go to its start
+ *
+ * @param replay The replay to initialize
+ * @param path Path of the trace file
+ * @return 0 if successful, ERROR_INVALID_ARGUMENTS if it could not be opened, ERROR_MALFORMED_TRACE if it is not a
+ *         trace, otherwise ERROR_OUT_OF_MEMORY
+ */
+uint8_t openTraceReplay(TraceReplay* replay, const char* const path);
+
+void closeTraceReplay(TraceReplay* replay);
+
+/**
+ * @brief Go to the point after a number of instructions, or to the end of the recording if it is shorter
+ *
+ * @param replay The replay
+ * @param target Number of instructions executed at the point to go to
+ */
+void seekTrace(TraceReplay* replay, uint64_t target);
+
+/**
+ * @brief Run forward until the program counter reaches a breakpoint or the recording ends
+ *
+ * @param replay The replay
+ * @param breakPc The breakpoint, UINT32_MAX for none
+ * @return true if it stopped at the breakpoint, false at the end of the recording
+ */
+bool continueTrace(TraceReplay* replay, uint32_t breakPc);
+
+/**
+ * @brief Run backward to the last earlier point where the program counter was at a breakpoint, or to the start
+ *
+ * Each checkpoint interval before the current point is stepped through from its checkpoint, latest first, until one
+ * passes the breakpoint.
+ *
+ * @param replay The replay
+ * @param breakPc The breakpoint, UINT32_MAX for none
+ * @return true if it stopped at the breakpoint, false at the start of the recording
+ */
+bool reverseContinueTrace(TraceReplay* replay, uint32_t breakPc);
+
+#endif
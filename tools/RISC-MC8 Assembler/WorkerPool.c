@@ -0,0 +1,95 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "WorkerPool.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "AssemblerStats.h"
+
+typedef struct _WorkerPool {
+    WorkerTask task;
+    void* context;
+    uint32_t numTasks;
+    atomic_uint_fast32_t nextTask;
+} WorkerPool;
+
+/**
+ * @brief Get the number of processors available to run threads on
+ *
+ * @return Number of online processors, at least 1
+ */
+uint32_t getProcessorCount(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0) {
+        return (uint32_t)count;
+    }
+#endif
+    return 1;
+}
+
+/**
+ * @brief Claim and run tasks until there are none left
+ *
+ * @param arg The WorkerPool to take tasks from
+ * @return NULL
+ */
+static void* runWorker(void* arg)
+{
+    WorkerPool* pool = (WorkerPool*)arg;
+    while (true) {
+        uint32_t index = atomic_fetch_add(&pool->nextTask, 1);
+        if (index >= pool->numTasks) {
+            return NULL;
+        }
+        pool->task(pool->context, index);
+    }
+}
+
+/**
+ * @brief Run task for every index on a fixed set of threads, returning once all of them are done
+ *
+ * @param task Function to run for each index
+ * @param context Passed to every call of task
+ * @param numTasks Number of indices to run
+ * @param numThreads Number of threads to use, 0 for one per processor
+ */
+void runWorkerPool(WorkerTask task, void* context, uint32_t numTasks, uint32_t numThreads)
+{
+    if (numThreads == 0) {
+        numThreads = getProcessorCount();
+    }
+    if (numThreads > numTasks) {
+        numThreads = numTasks;
+    }
+    WorkerPool pool;
+    pool.task = task;
+    pool.context = context;
+    pool.numTasks = numTasks;
+    atomic_init(&pool.nextTask, 0);
+
+    pthread_t* threads = numThreads > 1 ? (pthread_t*)calloc(numThreads - 1, sizeof(pthread_t)) : NULL;
+    if (threads != NULL) {
+        countAllocation((numThreads - 1) * sizeof(pthread_t));
+    }
+    uint32_t started = 0;
+    while (threads != NULL && started < numThreads - 1 && pthread_create(threads + started, NULL, &runWorker, &pool) == 0) {
+        started++;
+    }
+    runWorker(&pool);  // the caller works too
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(*(threads + i), NULL);
+    }
+    free(threads);
+}
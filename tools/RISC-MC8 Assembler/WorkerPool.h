@@ -0,0 +1,32 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <inttypes.h>
+
+/**
+ * A task run by the pool, called once for every index in [0, numTasks)
+ */
+typedef void (*WorkerTask)(void* context, uint32_t index);
+
+/**
+ * @brief Get the number of processors available to run threads on
+ *
+ * @return Number of online processors, at least 1
+ */
+uint32_t getProcessorCount(void);
+
+/**
+ * @brief Run task for every index on a fixed set of threads, returning once all of them are done
+ *
+ * Indices are handed out in increasing order from a shared counter, so faster threads pick up more work. The calling
+ * thread takes part, so numThreads = 1 runs everything inline. If a thread cannot be started, the rest of the
+ * threads (at least the caller) do its share.
+ *
+ * @param task Function to run for each index
+ * @param context Passed to every call of task
+ * @param numTasks Number of indices to run
+ * @param numThreads Number of threads to use, 0 for one per processor
+ */
+void runWorkerPool(WorkerTask task, void* context, uint32_t numTasks, uint32_t numThreads);
+
+#endif